@@ -0,0 +1,248 @@
+/**
+* Copyright (C) 2019-2021 Xilinx, Inc
+*
+* Licensed under the Apache License, Version 2.0 (the "License"). You may
+* not use this file except in compliance with the License. A copy of the
+* License is located at
+*
+*     http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+* WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the
+* License for the specific language governing permissions and limitations
+* under the License.
+*/
+#include "bandwidth_cus.h"
+#include <algorithm>
+#include <sstream>
+#include <string.h>
+
+bool parse_mixes(const std::string& list, std::vector<Mix>& mixes) {
+    std::stringstream stream(list);
+    std::string item;
+    while (std::getline(stream, item, ',')) {
+        Mix mix = {item, 1, 1};
+        if (item == "read") {
+            mix.writes = 0;
+        } else if (item == "write") {
+            mix.reads = 0;
+        } else if (item != "read_write") {
+            auto colon = item.find(':');
+            if (colon == std::string::npos) {
+                std::cout << "ERROR : unknown mix " << item << ", expected read_write, read, write or reads:writes\n";
+                return false;
+            }
+            mix.reads = strtoul(item.substr(0, colon).c_str(), nullptr, 10);
+            mix.writes = strtoul(item.substr(colon + 1).c_str(), nullptr, 10);
+            if ((mix.reads == 0 && mix.writes == 0) || mix.reads > MAX_WEIGHT || mix.writes > MAX_WEIGHT) {
+                std::cout << "ERROR : mix " << item << " needs weights of 0 to " << MAX_WEIGHT
+                          << ", not both 0\n";
+                return false;
+            }
+            if (mix.reads == mix.writes) {
+                mix.name = "read_write";
+            } else if (mix.writes == 0) {
+                mix.name = "read";
+            } else if (mix.reads == 0) {
+                mix.name = "write";
+            } else {
+                mix.name = "read_write_" + item;
+            }
+        }
+        mixes.push_back(mix);
+    }
+    return !mixes.empty();
+}
+
+void mix_blocks(const Mix& mix, unsigned int data_size, unsigned int& num_reads, unsigned int& num_writes) {
+    unsigned int num_blocks = (data_size - 1) / BLOCK_SIZE + 1;
+    unsigned int most = std::max(mix.reads, mix.writes);
+    num_reads = num_blocks * mix.reads / most;
+    num_writes = num_blocks * mix.writes / most;
+}
+
+static double event_seconds(cl::Event& event) {
+    cl_int err;
+    unsigned long end = OCL_CHECK(err, event.getProfilingInfo<CL_PROFILING_COMMAND_END>(&err));
+    unsigned long start = OCL_CHECK(err, event.getProfilingInfo<CL_PROFILING_COMMAND_START>(&err));
+    return (end - start) / ((double)1000000000);
+}
+
+void setup_cus(cl::Context& context,
+               cl::CommandQueue& q,
+               std::vector<Cu>& cus,
+               std::vector<cl::Buffer>& input_buffer,
+               std::vector<cl::Buffer>& output_buffer,
+               std::vector<unsigned char, aligned_allocator<unsigned char> >& input_host,
+               unsigned int reps,
+               const Mix& mix) {
+    cl_int err;
+    unsigned int data_size = input_host.size();
+    input_buffer.resize(cus.size());
+    output_buffer.resize(cus.size());
+
+    // These commands will allocate memory on the FPGA. The cl::Buffer objects
+    // can
+    // be used to reference the memory locations on the device.
+    // Creating Buffers
+    for (unsigned int i = 0; i < cus.size(); i++) {
+        cl_mem_ext_ptr_t input_buffer_ext, output_buffer_ext;
+        input_buffer_ext.flags = XCL_MEM_EXT_HOST_ONLY;
+        input_buffer_ext.obj = nullptr;
+        input_buffer_ext.param = 0;
+        output_buffer_ext = input_buffer_ext;
+        cl_mem_flags flags = CL_MEM_READ_WRITE | (cus[i].host_only ? CL_MEM_EXT_PTR_XILINX : 0);
+        OCL_CHECK(err, input_buffer[i] = cl::Buffer(context, flags, data_size,
+                                                    cus[i].host_only ? &input_buffer_ext : nullptr, &err));
+        OCL_CHECK(err, output_buffer[i] = cl::Buffer(context, flags, data_size + BLOCK_SIZE,
+                                                     cus[i].host_only ? &output_buffer_ext : nullptr, &err));
+    }
+
+    for (unsigned int i = 0; i < cus.size(); i++) {
+        OCL_CHECK(err, err = cus[i].krnl.setArg(0, input_buffer[i]));  // setting input data buffer
+        OCL_CHECK(err, err = cus[i].krnl.setArg(1, output_buffer[i])); // setting output data buffer
+        OCL_CHECK(err, err = cus[i].krnl.setArg(2, data_size));        // size of the data
+        OCL_CHECK(err, err = cus[i].krnl.setArg(3, reps));             // repeat counter
+        OCL_CHECK(err, err = cus[i].krnl.setArg(4, mix.reads));        // read weight
+        OCL_CHECK(err, err = cus[i].krnl.setArg(5, mix.writes));       // write weight
+    }
+
+    for (unsigned int i = 0; i < cus.size(); i++) {
+        OCL_CHECK(err, err = q.enqueueWriteBuffer(input_buffer[i], CL_TRUE, 0, data_size, input_host.data(), nullptr,
+                                                  nullptr));
+        OCL_CHECK(err, err = q.finish());
+    }
+}
+
+bool check_cus(cl::CommandQueue& q,
+               std::vector<Cu>& cus,
+               std::vector<cl::Buffer>& output_buffer,
+               std::vector<unsigned char, aligned_allocator<unsigned char> >& input_host,
+               unsigned int reps,
+               const Mix& mix) {
+    cl_int err;
+    unsigned int data_size = input_host.size();
+    unsigned int num_reads, num_writes;
+    mix_blocks(mix, data_size, num_reads, num_writes);
+    unsigned int num_blocks = (data_size - 1) / BLOCK_SIZE + 1;
+
+    std::vector<unsigned char, aligned_allocator<unsigned char> > expected(data_size + BLOCK_SIZE, 0);
+    unsigned int check_size = data_size;
+    if (mix.reads == mix.writes) {
+        std::copy(input_host.begin(), input_host.end(), expected.begin());
+    } else {
+        for (uint32_t b = 0; b < num_writes; b++) {
+            memcpy(&expected[b * BLOCK_SIZE], &b, sizeof(b));
+        }
+        uint32_t pass[BLOCK_SIZE / 4] = {0}, sum[BLOCK_SIZE / 4] = {0};
+        for (uint32_t j = 0; j < num_reads * BLOCK_SIZE; j++) {
+            ((unsigned char*)pass)[j % BLOCK_SIZE] ^= input_host[j];
+        }
+        for (uint32_t r = 0; r < reps; r++) {
+            uint64_t carry = 0;
+            for (uint32_t w = 0; w < BLOCK_SIZE / 4; w++) {
+                carry += (uint64_t)sum[w] + (w == 0 ? pass[w] ^ r : pass[w]);
+                sum[w] = (uint32_t)carry;
+                carry >>= 32;
+            }
+        }
+        memcpy(&expected[num_blocks * BLOCK_SIZE], sum, BLOCK_SIZE);
+        // The blocks after the written ones are left as they were
+        std::copy(expected.begin() + num_blocks * BLOCK_SIZE, expected.end(),
+                  expected.begin() + num_writes * BLOCK_SIZE);
+        check_size = (num_writes + 1) * BLOCK_SIZE;
+    }
+
+    std::vector<unsigned char, aligned_allocator<unsigned char> > output_host(data_size + BLOCK_SIZE);
+    for (unsigned int i = 0; i < cus.size(); i++) {
+        OCL_CHECK(err, err = q.enqueueReadBuffer(output_buffer[i], CL_TRUE, 0, data_size + BLOCK_SIZE,
+                                                 output_host.data(), nullptr, nullptr));
+        // The sum of the reads is after the buffer
+        if (mix.reads != mix.writes) {
+            std::copy(output_host.begin() + num_blocks * BLOCK_SIZE, output_host.end(),
+                      output_host.begin() + num_writes * BLOCK_SIZE);
+        }
+        for (uint32_t j = 0; j < check_size; j++) {
+            if (output_host[j] != expected[j]) {
+                std::cout << "ERROR : kernel " << cus[i].bank << " (" << mix.name << ") failed at entry " << j
+                          << " expected " << (int)expected[j] << " output " << (int)output_host[j] << std::endl;
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+bool saturate(sda::utils::BandwidthBench& bench,
+              cl::Context& context,
+              cl::CommandQueue& q,
+              std::vector<Cu>& cus,
+              unsigned int reps,
+              const Mix& mix) {
+    unsigned int num_cus = cus.size();
+    uint64_t size = bench.sizes().back();
+    unsigned int data_size = size;
+    std::vector<unsigned char, aligned_allocator<unsigned char> > input_host(data_size);
+    for (uint32_t j = 0; j < data_size; j++) {
+        input_host[j] = j % 256;
+    }
+
+    std::vector<cl::Buffer> input_buffer, output_buffer;
+    setup_cus(context, q, cus, input_buffer, output_buffer, input_host, reps, mix);
+
+    unsigned int num_reads, num_writes;
+    mix_blocks(mix, data_size, num_reads, num_writes);
+    double bytes = (double)(num_reads + num_writes) * BLOCK_SIZE * reps;
+    std::string banks;
+    for (auto& cu : cus) {
+        banks += (banks.empty() ? "" : ",") + cu.bank;
+    }
+
+    std::vector<double> isolated(num_cus);
+    for (unsigned int i = 0; i < num_cus; i++) {
+        auto& result = bench.run({"isolated", mix.name, cus[i].bank, 1, size, bytes}, [&] {
+            cl_int err;
+            OCL_CHECK(err, err = q.enqueueTask(cus[i].krnl));
+            q.finish();
+        });
+        isolated[i] = result.median;
+    }
+
+    // Each CU is also timed by its own task, for the throughput of its bank
+    // while all the banks are loaded
+    std::vector<std::vector<double> > loaded_seconds(num_cus);
+    auto& result = bench.run({"aggregate", mix.name, banks, num_cus, size, bytes * num_cus}, [&] {
+        cl_int err;
+        std::vector<cl::Event> events(num_cus);
+        for (unsigned int i = 0; i < num_cus; i++) {
+            OCL_CHECK(err, err = q.enqueueTask(cus[i].krnl, nullptr, &events[i]));
+        }
+        q.finish();
+        for (unsigned int i = 0; i < num_cus; i++) {
+            loaded_seconds[i].push_back(event_seconds(events[i]));
+        }
+    });
+    double aggregate = result.median;
+    std::vector<double> loaded(num_cus);
+    for (unsigned int i = 0; i < num_cus; i++) {
+        loaded[i] = bench.record({"loaded", mix.name, cus[i].bank, 1, size, bytes}, loaded_seconds[i]).median;
+    }
+
+    if (!check_cus(q, cus, output_buffer, input_host, reps, mix)) return false;
+
+    printf("\nSaturation (%s, %s per CU, MB/s)\n", mix.name.c_str(),
+           sda::utils::BandwidthBench::sizeString(size).c_str());
+    printf("%-12s %12s %12s %10s\n", "bank", "isolated", "loaded", "kept");
+    double total = 0;
+    unsigned int worst = 0;
+    for (unsigned int i = 0; i < num_cus; i++) {
+        printf("%-12s %12.0f %12.0f %9.1f%%\n", cus[i].bank.c_str(), isolated[i], loaded[i],
+               100 * loaded[i] / isolated[i]);
+        total += isolated[i];
+        if (loaded[i] / isolated[i] < loaded[worst] / isolated[worst]) worst = i;
+    }
+    printf("%-12s %12.0f %12.0f %9.1f%%\n", "aggregate", total, aggregate, 100 * aggregate / total);
+    printf("Most contended bank: %s\n", cus[worst].bank.c_str());
+    return true;
+}
@@ -0,0 +1,93 @@
+/**
+* Copyright (C) 2019-2021 Xilinx, Inc
+*
+* Licensed under the Apache License, Version 2.0 (the "License"). You may
+* not use this file except in compliance with the License. A copy of the
+* License is located at
+*
+*     http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+* WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the
+* License for the specific language governing permissions and limitations
+* under the License.
+*/
+#ifndef BANDWIDTH_CUS_H_
+#define BANDWIDTH_CUS_H_
+
+#include <string>
+#include <vector>
+
+#include "bench.h"
+#include "xcl2.hpp"
+
+/*!
+ * Host side of the bandwidth kernel of the validate tests (bandwidth_test
+ * and combine_bw_hm): the read/write mixes, the buffers and arguments of
+ * its CUs, the check of their output and the saturation test. The kernel
+ * takes its input and output buffers, the size, the repeat count and the
+ * read and write weights, in that order.
+ */
+
+#define BLOCK_SIZE 64 // bytes of a 512-bit block of the kernel
+#define MAX_WEIGHT 16
+
+// Ratio of the reads to the writes of the kernel. Equal weights copy the
+// input buffer to the output buffer.
+struct Mix {
+    std::string name;
+    unsigned int reads;
+    unsigned int writes;
+};
+
+// One CU of a test and the bank its buffers are in, host memory for the
+// hostmemory CUs
+struct Cu {
+    cl::Kernel krnl;
+    std::string bank;
+    bool host_only;
+};
+
+// Parses a list of mixes such as "read_write,read,write,2:1"
+bool parse_mixes(const std::string& list, std::vector<Mix>& mixes);
+
+// Blocks read and written by a task, as computed by the kernel
+void mix_blocks(const Mix& mix, unsigned int data_size, unsigned int& num_reads, unsigned int& num_writes);
+
+// Creates the buffers of each CU, the output one block larger for the mixed
+// modes, and writes the input pattern to the input buffers. The buffers of
+// the hostmemory CUs are host-only buffers, as in the host memory test.
+void setup_cus(cl::Context& context,
+               cl::CommandQueue& q,
+               std::vector<Cu>& cus,
+               std::vector<cl::Buffer>& input_buffer,
+               std::vector<cl::Buffer>& output_buffer,
+               std::vector<unsigned char, aligned_allocator<unsigned char> >& input_host,
+               unsigned int reps,
+               const Mix& mix);
+
+// Checks the output of each CU: a copy of the input, or with a mixed mode
+// the index of each written block and the sum of the reps passes of reads,
+// each the XOR of the read blocks and of the index of the pass, added as
+// 512-bit integers
+bool check_cus(cl::CommandQueue& q,
+               std::vector<Cu>& cus,
+               std::vector<cl::Buffer>& output_buffer,
+               std::vector<unsigned char, aligned_allocator<unsigned char> >& input_host,
+               unsigned int reps,
+               const Mix& mix);
+
+// Runs every CU alone, then all of them at once, at the largest size of the
+// sweep, and reports how much of its isolated throughput each bank keeps
+// when every bank is loaded, and the aggregate throughput against the sum of
+// the isolated ones. A bank or an aggregate well below 100% points to a
+// bottleneck shared by the banks, e.g. the interconnect.
+bool saturate(sda::utils::BandwidthBench& bench,
+              cl::Context& context,
+              cl::CommandQueue& q,
+              std::vector<Cu>& cus,
+              unsigned int reps,
+              const Mix& mix);
+
+#endif
@@ -0,0 +1,411 @@
+/**
+* Copyright (C) 2019-2021 Xilinx, Inc
+*
+* Licensed under the Apache License, Version 2.0 (the "License"). You may
+* not use this file except in compliance with the License. A copy of the
+* License is located at
+*
+*     http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+* WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the
+* License for the specific language governing permissions and limitations
+* under the License.
+*/
+#include "bench.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <ctime>
+#include <fstream>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+namespace sda {
+namespace utils {
+
+// Size with an optional K, M or G suffix, e.g. 4K
+uint64_t BandwidthBench::parseSize(const std::string& s) {
+    char* end = nullptr;
+    uint64_t size = strtoull(s.c_str(), &end, 10);
+    if (end == s.c_str()) return 0;
+    switch (*end) {
+        case 'k':
+        case 'K':
+            return size << 10;
+        case 'm':
+        case 'M':
+            return size << 20;
+        case 'g':
+        case 'G':
+            return size << 30;
+        default:
+            return size;
+    }
+}
+
+std::string BandwidthBench::sizeString(uint64_t size) {
+    const char* units[] = {"", "K", "M", "G"};
+    unsigned unit = 0;
+    while (unit < 3 && size >= 1024 && size % 1024 == 0) {
+        size /= 1024;
+        unit++;
+    }
+    return std::to_string(size) + units[unit];
+}
+
+// 97.5% quantile of the Student t distribution with df degrees of freedom,
+// for two-sided 95% confidence intervals
+static double t_quantile(size_t df) {
+    static const double t[] = {12.706, 4.303, 3.182, 2.776, 2.571, 2.447, 2.365, 2.306, 2.262, 2.228,
+                               2.201,  2.179, 2.160, 2.145, 2.131, 2.120, 2.110, 2.101, 2.093, 2.086,
+                               2.080,  2.074, 2.069, 2.064, 2.060, 2.056, 2.052, 2.048, 2.045, 2.042};
+    if (df == 0) return 0;
+    return df <= 30 ? t[df - 1] : 1.960 + 2.4 / df;
+}
+
+// Quantile q of sorted values, interpolated between the closest two
+static double quantile(const std::vector<double>& sorted, double q) {
+    double pos = q * (sorted.size() - 1);
+    size_t lo = (size_t)std::floor(pos);
+    size_t hi = std::min(lo + 1, sorted.size() - 1);
+    return sorted[lo] + (pos - lo) * (sorted[hi] - sorted[lo]);
+}
+
+BandwidthBench::BandwidthBench(const std::string& name) : m_name(name), m_unit("MB/s"), m_scale(1024.0 * 1024.0) {
+    m_options.min_size = 4 * 1024;
+    m_options.max_size = 16 * 1024 * 1024;
+    m_options.reps = 10;
+    m_options.max_reps = 100;
+    m_options.ci_pct = 2.0;
+    m_options.outliers = true;
+    m_options.warmup = 1;
+    m_options.cus = 0;
+    m_options.threshold = 5.0;
+    m_options.update_baseline = false;
+
+    char host[256] = "";
+    gethostname(host, sizeof(host) - 1);
+    char date[32];
+    time_t now = time(nullptr);
+    strftime(date, sizeof(date), "%Y-%m-%dT%H:%M:%S", localtime(&now));
+    m_info["host"] = host;
+    m_info["date"] = date;
+    m_info["unit"] = m_unit;
+}
+
+void BandwidthBench::setUnit(const std::string& unit, double scale) {
+    m_unit = unit;
+    m_scale = scale;
+    m_info["unit"] = unit;
+}
+
+void BandwidthBench::addSwitches(CmdLineParser& parser) const {
+    char ci[16], threshold[16];
+    snprintf(ci, sizeof(ci), "%g", m_options.ci_pct);
+    snprintf(threshold, sizeof(threshold), "%g", m_options.threshold);
+    parser.addSwitch("--sizes", "-z", "transfer sizes min:max, powers of 2 (e.g. 4K:16M)",
+                     sizeString(m_options.min_size) + ":" + sizeString(m_options.max_size));
+    parser.addSwitch("--reps", "-r", "minimum timed repetitions of each transfer", std::to_string(m_options.reps));
+    parser.addSwitch("--max_reps", "-mr", "maximum timed repetitions to reach the confidence interval",
+                     std::to_string(m_options.max_reps));
+    parser.addSwitch("--ci", "-ci", "95% confidence interval to reach, in % of the mean", ci);
+    parser.addSwitch("--keep_outliers", "-ko", "keep the outliers instead of rejecting them", "", true);
+    parser.addSwitch("--warmup", "-w", "warm-up repetitions discarded before timing", std::to_string(m_options.warmup));
+    parser.addSwitch("--cus", "-u", "compute units to use (0 = all)", std::to_string(m_options.cus));
+    parser.addSwitch("--output", "-o", "write the results to this .json or .csv file", m_options.output);
+    parser.addSwitch("--baseline", "-b", "fail when the results regressed from this .json file", m_options.baseline);
+    parser.addSwitch("--threshold", "-t", "regression allowed from the baseline, in %", threshold);
+    parser.addSwitch("--update_baseline", "-ub", "write the results to the baseline file instead", "", true);
+}
+
+void BandwidthBench::parse(CmdLineParser& parser) {
+    std::string sizes = parser.value("sizes");
+    size_t colon = sizes.find(':');
+    m_options.min_size = parseSize(sizes.substr(0, colon));
+    m_options.max_size = colon == std::string::npos ? m_options.min_size : parseSize(sizes.substr(colon + 1));
+    if (m_options.min_size == 0 || m_options.max_size < m_options.min_size) {
+        printf("Error: invalid transfer sizes %s, expected min:max\n", sizes.c_str());
+        exit(EXIT_FAILURE);
+    }
+    m_options.reps = std::max(parser.value_to_int("reps"), 1);
+    int max_reps = parser.value_to_int("max_reps");
+    if (max_reps < 1) {
+        printf("Error: invalid maximum repetitions %d, expected at least 1\n", max_reps);
+        exit(EXIT_FAILURE);
+    }
+    m_options.max_reps = std::max(max_reps, (int)m_options.reps);
+    m_options.ci_pct = std::max(atof(parser.value("ci").c_str()), 0.0);
+    m_options.outliers = !parser.value_to_bool("keep_outliers");
+    m_options.warmup = std::max(parser.value_to_int("warmup"), 0);
+    m_options.cus = std::max(parser.value_to_int("cus"), 0);
+    m_options.output = parser.value("output");
+    m_options.baseline = parser.value("baseline");
+    m_options.threshold = std::max(atof(parser.value("threshold").c_str()), 0.0);
+    m_options.update_baseline = parser.value_to_bool("update_baseline");
+    if (m_options.update_baseline && m_options.baseline.empty()) {
+        printf("Error: --update_baseline needs the baseline file, -b\n");
+        exit(EXIT_FAILURE);
+    }
+}
+
+std::vector<uint64_t> BandwidthBench::sizes() const {
+    std::vector<uint64_t> sizes;
+    for (uint64_t size = m_options.min_size; size <= m_options.max_size; size *= 2) sizes.push_back(size);
+    return sizes;
+}
+
+unsigned int BandwidthBench::cus(unsigned int available) const {
+    return m_options.cus == 0 ? available : std::min(m_options.cus, available);
+}
+
+const BandwidthBench::Result& BandwidthBench::run(const Point& point, const std::function<void()>& repetition) {
+    return runTimed(point, [&] {
+        auto start = std::chrono::steady_clock::now();
+        repetition();
+        std::chrono::duration<double> duration = std::chrono::steady_clock::now() - start;
+        return duration.count();
+    });
+}
+
+const BandwidthBench::Result& BandwidthBench::runTimed(const Point& point, const std::function<double()>& repetition) {
+    std::vector<double> seconds;
+    for (unsigned int i = 0; i < m_options.warmup; i++) seconds.push_back(repetition());
+
+    std::vector<double> timed;
+    while (timed.size() < m_options.max_reps) {
+        timed.push_back(repetition());
+        if (timed.size() < std::max(m_options.reps, 2u)) continue;
+        Result result = summarize(point, timed);
+        if (result.ci <= m_options.ci_pct / 100 * result.mean) break;
+    }
+    seconds.insert(seconds.end(), timed.begin(), timed.end());
+    return record(point, seconds);
+}
+
+BandwidthBench::Result BandwidthBench::summarize(const Point& point, const std::vector<double>& seconds) const {
+    Result result;
+    static_cast<Point&>(result) = point;
+    result.warmup = 0;
+
+    // Throughputs with their durations, slowest first. A repetition faster
+    // than the clock counts as one tick instead of an infinite throughput.
+    double tick = std::chrono::duration<double>(std::chrono::steady_clock::duration(1)).count();
+    std::vector<std::pair<double, double> > samples;
+    for (double s : seconds) {
+        s = std::max(s, tick);
+        samples.push_back(std::make_pair(point.bytes / s / m_scale, s));
+    }
+    std::sort(samples.begin(), samples.end());
+
+    // Tukey fences: the outliers are more than 1.5 interquartile ranges
+    // below the first quartile or above the third one
+    std::vector<double> rates;
+    for (auto& sample : samples) rates.push_back(sample.first);
+    if (m_options.outliers && rates.size() >= 4) {
+        double q1 = quantile(rates, 0.25);
+        double q3 = quantile(rates, 0.75);
+        double low = q1 - 1.5 * (q3 - q1);
+        double high = q3 + 1.5 * (q3 - q1);
+        samples.erase(std::remove_if(samples.begin(), samples.end(),
+                                     [&](const std::pair<double, double>& sample) {
+                                         return sample.first < low || sample.first > high;
+                                     }),
+                      samples.end());
+        rates.clear();
+        for (auto& sample : samples) rates.push_back(sample.first);
+    }
+    result.outliers = seconds.size() - samples.size();
+    result.reps = samples.size();
+
+    // The mean, stddev and ci all describe the throughputs of the
+    // repetitions, so that runTimed() stops on the ci of the mean it reports
+    size_t n = rates.size();
+    double sum = 0, sum_sq = 0;
+    for (double rate : rates) {
+        sum += rate;
+        sum_sq += rate * rate;
+    }
+    result.median = n % 2 ? rates[n / 2] : (rates[n / 2 - 1] + rates[n / 2]) / 2;
+    result.p99 = rates[(size_t)std::floor(0.01 * (n - 1))];
+    result.mean = sum / n;
+    result.min = rates.front();
+    result.max = rates.back();
+    result.stddev = n > 1 ? std::sqrt(std::max(0.0, (sum_sq - sum * sum / n) / (n - 1))) : 0.0;
+    result.ci = t_quantile(n - 1) * result.stddev / std::sqrt((double)n);
+    return result;
+}
+
+const BandwidthBench::Result& BandwidthBench::record(const Point& point, const std::vector<double>& seconds) {
+    if (seconds.empty()) {
+        printf("Error: no repetition of %s %s to record\n", point.test.c_str(), point.direction.c_str());
+        exit(EXIT_FAILURE);
+    }
+    unsigned int warmup = std::min((size_t)m_options.warmup, seconds.size() - 1);
+    Result result = summarize(point, std::vector<double>(seconds.begin() + warmup, seconds.end()));
+    result.warmup = warmup;
+
+    if (m_results.empty()) {
+        printf("%-8s %-10s %-12s %4s %8s %5s %4s %14s %14s %12s %6s\n", "Test", "Direction", "Banks", "CUs", "Size",
+               "Reps", "Out", ("Median " + m_unit).c_str(), ("p99 " + m_unit).c_str(), "Stddev", "CI %");
+    }
+    printf("%-8s %-10s %-12s %4u %8s %5u %4u %14.1f %14.1f %12.1f %6.2f\n", point.test.c_str(),
+           point.direction.c_str(), point.banks.c_str(), point.cus, sizeString(point.size).c_str(), result.reps,
+           result.outliers, result.median, result.p99, result.stddev, 100 * result.ci / result.mean);
+
+    m_results.push_back(result);
+    return m_results.back();
+}
+
+double BandwidthBench::best(const std::string& test, const std::string& direction) const {
+    double best = 0;
+    for (auto& result : m_results) {
+        if (result.test == test && result.direction == direction) best = std::max(best, result.median);
+    }
+    return best;
+}
+
+// Escapes a string for JSON or a quoted CSV field
+static std::string quoted(const std::string& s, char quote_escape) {
+    std::string out = "\"";
+    for (char c : s) {
+        if (c == '"') {
+            out += quote_escape;
+            out += c;
+        } else if (c == '\\' && quote_escape == '\\') {
+            out += "\\\\";
+        } else if ((unsigned char)c >= 0x20) {
+            out += c;
+        }
+    }
+    return out + "\"";
+}
+
+// Value of a key in a line of a JSON file written by write(), a string or a
+// number, empty if the line does not have the key
+static std::string json_value(const std::string& line, const std::string& key) {
+    size_t pos = line.find(quoted(key, '\\') + ": ");
+    if (pos == std::string::npos) return "";
+    pos += key.size() + 4;
+    if (pos >= line.size() || line[pos] != '"') return line.substr(pos, line.find_first_of(",}", pos) - pos);
+    std::string value;
+    for (pos++; pos < line.size() && line[pos] != '"'; pos++) {
+        if (line[pos] == '\\' && pos + 1 < line.size()) pos++;
+        value += line[pos];
+    }
+    return value;
+}
+
+bool BandwidthBench::write(const std::string& filename) const {
+    std::ofstream file(filename.c_str());
+    if (!file.good()) {
+        printf("Error: cannot open %s for the results\n", filename.c_str());
+        return false;
+    }
+    bool csv = filename.size() >= 4 && filename.compare(filename.size() - 4, 4, ".csv") == 0;
+    char line[512];
+
+    if (csv) {
+        // One self-contained row per result, so files of several runs can
+        // simply be concatenated
+        file << "benchmark";
+        for (auto& info : m_info) file << "," << info.first;
+        file << ",test,direction,banks,cus,size,bytes,reps,warmup,outliers,median,p99,mean,min,max,stddev,ci\n";
+        for (auto& r : m_results) {
+            file << quoted(m_name, '"');
+            for (auto& info : m_info) file << "," << quoted(info.second, '"');
+            snprintf(line, sizeof(line), ",%s,%s,%s,%u,%llu,%.0f,%u,%u,%u,%.3f,%.3f,%.3f,%.3f,%.3f,%.3f,%.3f\n",
+                     quoted(r.test, '"').c_str(), quoted(r.direction, '"').c_str(), quoted(r.banks, '"').c_str(), r.cus,
+                     (unsigned long long)r.size, r.bytes, r.reps, r.warmup, r.outliers, r.median, r.p99, r.mean, r.min,
+                     r.max, r.stddev, r.ci);
+            file << line;
+        }
+    } else {
+        file << "{\n  \"benchmark\": " << quoted(m_name, '\\') << ",\n  \"info\": {";
+        const char* sep = "\n";
+        for (auto& info : m_info) {
+            file << sep << "    " << quoted(info.first, '\\') << ": " << quoted(info.second, '\\');
+            sep = ",\n";
+        }
+        file << "\n  },\n  \"results\": [";
+        sep = "\n";
+        for (auto& r : m_results) {
+            file << sep << "    {\"test\": " << quoted(r.test, '\\') << ", \"direction\": " << quoted(r.direction, '\\')
+                 << ", \"banks\": " << quoted(r.banks, '\\');
+            snprintf(line, sizeof(line),
+                     ", \"cus\": %u, \"size\": %llu, \"bytes\": %.0f, \"reps\": %u, \"warmup\": %u, "
+                     "\"outliers\": %u, \"median\": %.3f, \"p99\": %.3f, \"mean\": %.3f, \"min\": %.3f, "
+                     "\"max\": %.3f, \"stddev\": %.3f, \"ci\": %.3f}",
+                     r.cus, (unsigned long long)r.size, r.bytes, r.reps, r.warmup, r.outliers, r.median, r.p99, r.mean,
+                     r.min, r.max, r.stddev, r.ci);
+            file << line;
+            sep = ",\n";
+        }
+        file << "\n  ]\n}\n";
+    }
+
+    if (file.good()) printf("Results written to %s\n", filename.c_str());
+    return file.good();
+}
+
+bool BandwidthBench::write() const {
+    return m_options.output.empty() || write(m_options.output);
+}
+
+bool BandwidthBench::check() const {
+    if (m_options.baseline.empty()) return true;
+    if (m_options.update_baseline) return write(m_options.baseline);
+
+    std::ifstream file(m_options.baseline.c_str());
+    if (!file.good()) {
+        printf("Error: cannot open the baseline %s, write it with --update_baseline\n", m_options.baseline.c_str());
+        return false;
+    }
+    // write() puts the info and every result on lines of their own
+    std::vector<Result> baseline;
+    std::string line, unit = "MB/s";
+    while (std::getline(file, line)) {
+        if (!json_value(line, "unit").empty()) unit = json_value(line, "unit");
+        if (json_value(line, "median").empty()) continue;
+        Result r;
+        r.test = json_value(line, "test");
+        r.direction = json_value(line, "direction");
+        r.banks = json_value(line, "banks");
+        r.cus = strtoul(json_value(line, "cus").c_str(), nullptr, 10);
+        r.size = strtoull(json_value(line, "size").c_str(), nullptr, 10);
+        r.median = atof(json_value(line, "median").c_str());
+        baseline.push_back(r);
+    }
+    if (unit != m_unit) {
+        printf("Error: the baseline %s is in %s, not %s\n", m_options.baseline.c_str(), unit.c_str(), m_unit.c_str());
+        return false;
+    }
+
+    printf("Regression check against %s, threshold %.1f%%\n", m_options.baseline.c_str(), m_options.threshold);
+    printf("%-8s %-10s %-12s %4s %8s %14s %14s %8s %s\n", "Test", "Direction", "Banks", "CUs", "Size", "Baseline",
+           ("Median " + m_unit).c_str(), "Change", "");
+    bool passed = true;
+    for (auto& r : m_results) {
+        auto base = std::find_if(baseline.begin(), baseline.end(), [&](const Result& b) {
+            return b.test == r.test && b.direction == r.direction && b.banks == r.banks && b.cus == r.cus &&
+                   b.size == r.size;
+        });
+        if (base == baseline.end()) {
+            printf("%-8s %-10s %-12s %4u %8s %14s %14.1f %8s %s\n", r.test.c_str(), r.direction.c_str(),
+                   r.banks.c_str(), r.cus, sizeString(r.size).c_str(), "-", r.median, "-", "not in baseline");
+            continue;
+        }
+        double change = base->median > 0 ? 100 * (r.median - base->median) / base->median : 0.0;
+        bool regressed = change < -m_options.threshold;
+        printf("%-8s %-10s %-12s %4u %8s %14.1f %14.1f %7.1f%% %s\n", r.test.c_str(), r.direction.c_str(),
+               r.banks.c_str(), r.cus, sizeString(r.size).c_str(), base->median, r.median, change,
+               regressed ? "REGRESSED" : "");
+        if (regressed) passed = false;
+    }
+    printf("Regression check %s\n", passed ? "PASSED" : "FAILED");
+    return passed;
+}
+}
+}
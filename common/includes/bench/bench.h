@@ -0,0 +1,185 @@
+/**
+* Copyright (C) 2019-2021 Xilinx, Inc
+*
+* Licensed under the Apache License, Version 2.0 (the "License"). You may
+* not use this file except in compliance with the License. A copy of the
+* License is located at
+*
+*     http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+* WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the
+* License for the specific language governing permissions and limitations
+* under the License.
+*/
+#ifndef BENCH_H_
+#define BENCH_H_
+
+#include <functional>
+#include <map>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+#include "cmdlineparser.h"
+
+namespace sda {
+namespace utils {
+
+/*!
+ * Synopsis:
+ * 1.Sweeps the transfer sizes of a bandwidth test, powers of 2 between a
+ *      minimum and a maximum size
+ * 2.Times every repetition of a transfer on its own, after discarding the
+ *      warm-up repetitions, and keeps repeating until the 95% confidence
+ *      interval of the mean throughput is narrow enough
+ * 3.Rejects the outliers, outside the Tukey fences of the throughputs, and
+ *      keeps the median, p99, mean, min, max, standard deviation and
+ *      confidence interval of the others
+ * 4.Writes the results with the card and shell they ran on as JSON or CSV,
+ *      so runs on different cards, shells or dates can be compared
+ * 5.Checks the results against a baseline written by an earlier run, and
+ *      fails when the throughput regressed by more than a threshold
+ */
+class BandwidthBench {
+   public:
+    /*!
+     * What one repetition moves. bytes counts every buffer, direction and
+     * CU, so that a repetition of bytes in t seconds is bytes / t. Benches
+     * in operations per second count operations in bytes instead.
+     */
+    class Point {
+       public:
+        std::string test;      // e.g. "ddr", "hbm", "host"
+        std::string direction; // "read", "write", "read_write", "h2d", "d2h"
+        std::string banks;     // e.g. "DDR[0:3]", "HBM[0:11]", "HOST[0]"
+        unsigned int cus;
+        uint64_t size; // size of each buffer
+        double bytes;
+    };
+
+    /*!
+     * Throughputs in the unit of the bench, MB/s (1 MB = 1024 * 1024 bytes)
+     * by default. 99% of the repetitions were at least as fast as p99, and
+     * the mean is within +/- ci of the true mean with 95% confidence.
+     */
+    class Result : public Point {
+       public:
+        unsigned int reps; // repetitions kept, outliers excluded
+        unsigned int warmup;
+        unsigned int outliers;
+        double median;
+        double p99;
+        double mean;
+        double min;
+        double max;
+        double stddev;
+        double ci;
+    };
+
+    class Options {
+       public:
+        uint64_t min_size;
+        uint64_t max_size;
+        unsigned int reps;     // minimum timed repetitions
+        unsigned int max_reps; // repetitions allowed to reach ci_pct
+        double ci_pct;         // confidence interval to reach, % of the mean
+        bool outliers;         // reject outliers
+        unsigned int warmup;
+        unsigned int cus; // 0 = every CU
+        std::string output;
+        std::string baseline;
+        double threshold; // regression allowed by check(), % of the baseline
+        bool update_baseline;
+    };
+
+    explicit BandwidthBench(const std::string& name);
+
+    /*!
+     * Unit of the throughputs, "MB/s" for scale 1024 * 1024 by default, e.g.
+     * "ops/s" and 1 for a bench counting operations in Point::bytes
+     */
+    void setUnit(const std::string& unit, double scale);
+
+    /*!
+     * Options of the sweep. Set the defaults of the test before
+     * addSwitches(), the command line overrides them in parse().
+     */
+    Options& options() { return m_options; }
+    void addSwitches(CmdLineParser& parser) const;
+    void parse(CmdLineParser& parser);
+
+    /*!
+     * Transfer sizes of the sweep, and CUs to use out of the available ones
+     */
+    std::vector<uint64_t> sizes() const;
+    unsigned int cus(unsigned int available) const;
+
+    /*!
+     * Describes the run in the results, e.g. "device" (the shell name),
+     * "xclbin". "host", "date" and "unit" are set by the constructor.
+     */
+    void setInfo(const std::string& key, const std::string& value) { m_info[key] = value; }
+
+    /*!
+     * Calls repetition warmup + reps times, timing each call, then again
+     * until the confidence interval is within ci_pct of the mean or
+     * max_reps repetitions were timed, and prints the result
+     */
+    const Result& run(const Point& point, const std::function<void()>& repetition);
+
+    /*!
+     * Same as run() for repetitions timed by themselves, e.g. from the
+     * profiling info of their events or a cycle counter of the kernel.
+     * repetition returns its duration in seconds.
+     */
+    const Result& runTimed(const Point& point, const std::function<double()>& repetition);
+
+    /*!
+     * Same as run() for repetitions already timed by the caller. The
+     * warm-up samples are included.
+     */
+    const Result& record(const Point& point, const std::vector<double>& seconds);
+
+    const std::vector<Result>& results() const { return m_results; }
+
+    /*!
+     * Sizes with an optional K, M or G suffix, as in the --sizes switch
+     */
+    static uint64_t parseSize(const std::string& size);
+    static std::string sizeString(uint64_t size);
+
+    /*!
+     * Highest median throughput of a test and direction over the sweep
+     */
+    double best(const std::string& test, const std::string& direction) const;
+
+    /*!
+     * Writes the results as CSV when filename ends with .csv, else as JSON.
+     * write() without filename uses the --output switch, if any.
+     */
+    bool write(const std::string& filename) const;
+    bool write() const;
+
+    /*!
+     * Compares the median throughputs with the ones of the same points in
+     * the --baseline JSON file and returns false if one of them dropped by
+     * more than --threshold percent. With --update_baseline, writes the
+     * results to the baseline file instead. Returns true without a baseline.
+     */
+    bool check() const;
+
+   private:
+    Result summarize(const Point& point, const std::vector<double>& seconds) const;
+
+    std::string m_name;
+    std::string m_unit;
+    double m_scale;
+    Options m_options;
+    std::map<std::string, std::string> m_info;
+    std::vector<Result> m_results;
+};
+}
+}
+#endif /* BENCH_H_ */
@@ -0,0 +1,3 @@
+bench_SRCS:=${COMMON_REPO}/common/includes/bench/bench.cpp
+bench_HDRS:=${COMMON_REPO}/common/includes/bench/bench.h
+bench_CXXFLAGS:=-I${COMMON_REPO}/common/includes/bench
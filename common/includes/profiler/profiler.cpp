@@ -0,0 +1,321 @@
+/**
+* Copyright (C) 2019-2021 Xilinx, Inc
+*
+* Licensed under the Apache License, Version 2.0 (the "License"). You may
+* not use this file except in compliance with the License. A copy of the
+* License is located at
+*
+*     http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+* WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the
+* License for the specific language governing permissions and limitations
+* under the License.
+*/
+#include "profiler.h"
+#include <algorithm>
+#include <fstream>
+#include <stdlib.h>
+
+namespace sda {
+namespace utils {
+
+// Histogram bucket of a duration: durations below 4 ns have their own
+// bucket, the others are split in 4 buckets per power of two
+#define PROFILER_BUCKETS 256
+
+static unsigned bucket_of(uint64_t ns) {
+    if (ns < 4) return (unsigned)ns;
+    unsigned msb = 63 - __builtin_clzll(ns);
+    return (msb - 1) * 4 + ((ns >> (msb - 2)) & 3);
+}
+
+static double bucket_middle_ns(unsigned bucket) {
+    if (bucket < 4) return bucket;
+    unsigned msb = bucket / 4 + 1;
+    uint64_t width = 1ULL << (msb - 2);
+    return (double)((1ULL << msb) + (bucket % 4) * width) + width / 2.0;
+}
+
+// Only the owning thread updates these counters, the relaxed atomics just
+// let the report read them meanwhile
+static void relaxed_add(std::atomic<uint64_t>& counter, uint64_t value) {
+    counter.store(counter.load(std::memory_order_relaxed) + value, std::memory_order_relaxed);
+}
+
+class Profiler::RegionData {
+   public:
+    RegionData() : count(0), total_ns(0), min_ns(UINT64_MAX), max_ns(0) {
+        for (auto& bucket : buckets) bucket.store(0, std::memory_order_relaxed);
+    }
+
+    std::atomic<uint64_t> count;
+    std::atomic<uint64_t> total_ns;
+    std::atomic<uint64_t> min_ns;
+    std::atomic<uint64_t> max_ns;
+    std::atomic<uint64_t> buckets[PROFILER_BUCKETS];
+
+    // Adds the samples of other, which no thread records in anymore
+    void merge(const RegionData& other) {
+        relaxed_add(count, other.count.load(std::memory_order_relaxed));
+        relaxed_add(total_ns, other.total_ns.load(std::memory_order_relaxed));
+        min_ns.store(std::min(min_ns.load(std::memory_order_relaxed), other.min_ns.load(std::memory_order_relaxed)),
+                     std::memory_order_relaxed);
+        max_ns.store(std::max(max_ns.load(std::memory_order_relaxed), other.max_ns.load(std::memory_order_relaxed)),
+                     std::memory_order_relaxed);
+        for (unsigned b = 0; b < PROFILER_BUCKETS; b++) {
+            relaxed_add(buckets[b], other.buckets[b].load(std::memory_order_relaxed));
+        }
+    }
+};
+
+class Profiler::ThreadData {
+   public:
+    class Event {
+       public:
+        RegionId id;
+        uint64_t start_ns;
+        uint64_t end_ns;
+    };
+
+    ThreadData() : tid(0), ring(PROFILER_RING_EVENTS), head(0) {
+        for (auto& region : regions) region.store(nullptr, std::memory_order_relaxed);
+    }
+    ~ThreadData() {
+        for (auto& region : regions) delete region.load(std::memory_order_relaxed);
+    }
+
+    // Id of the recording thread in the trace, assigned again when the data
+    // goes to a new thread
+    unsigned tid;
+    // Region statistics, allocated by the owning thread on its first sample
+    std::atomic<RegionData*> regions[PROFILER_MAX_REGIONS];
+    // Last PROFILER_RING_EVENTS samples, head counts all the samples
+    std::vector<Event> ring;
+    std::atomic<uint64_t> head;
+};
+
+Profiler& Profiler::instance() {
+    static Profiler profiler;
+    return profiler;
+}
+
+Profiler::Profiler() : m_origin_ns(now()), m_retired(PROFILER_MAX_REGIONS), m_next_tid(0) {}
+
+Profiler::~Profiler() {}
+
+Profiler::RegionId Profiler::region(const std::string& name) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    for (RegionId id = 0; id < m_region_names.size(); id++) {
+        if (m_region_names[id] == name) return id;
+    }
+    if (m_region_names.size() == PROFILER_MAX_REGIONS) {
+        fprintf(stderr, "Error: more than %d profiler regions, cannot add %s\n", PROFILER_MAX_REGIONS, name.c_str());
+        exit(EXIT_FAILURE);
+    }
+    m_region_names.push_back(name);
+    return m_region_names.size() - 1;
+}
+
+// Returns nullptr once the thread_local slot of the thread is destroyed,
+// for the timers of the thread_local objects destroyed after it
+Profiler::ThreadData* Profiler::threadData() {
+    // A trivial thread_local, still readable in the thread_local destructors
+    static thread_local bool destroyed = false;
+    // Hands the data of the thread back to the profiler when the thread
+    // exits, so that the threads started later reuse its ring instead of
+    // allocating one each
+    struct Slot {
+        Profiler* profiler = nullptr;
+        ThreadData* data = nullptr;
+        ~Slot() {
+            destroyed = true;
+            if (data == nullptr) return;
+            std::lock_guard<std::mutex> lock(profiler->m_mutex);
+            profiler->retire(data);
+        }
+    };
+    if (destroyed) return nullptr;
+    static thread_local Slot slot;
+    if (slot.data == nullptr) {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (m_free_threads.empty()) {
+            m_threads.emplace_back(new ThreadData());
+            slot.data = m_threads.back().get();
+        } else {
+            slot.data = m_free_threads.back();
+            m_free_threads.pop_back();
+        }
+        slot.data->tid = m_next_tid++;
+        slot.profiler = this;
+    }
+    return slot.data;
+}
+
+// Moves the statistics of a thread that exited to m_retired and empties its
+// ring, so the next thread starts from clean data. Called with m_mutex held.
+void Profiler::retire(ThreadData* data) {
+    for (RegionId id = 0; id < PROFILER_MAX_REGIONS; id++) {
+        RegionData* region = data->regions[id].exchange(nullptr);
+        if (region == nullptr) continue;
+        if (m_retired[id]) {
+            m_retired[id]->merge(*region);
+            delete region;
+        } else {
+            m_retired[id].reset(region);
+        }
+    }
+    data->head.store(0, std::memory_order_release);
+    m_free_threads.push_back(data);
+}
+
+void Profiler::record(RegionId id, uint64_t start_ns, uint64_t end_ns) {
+    ThreadData* data = threadData();
+    if (data == nullptr) return;
+    uint64_t ns = end_ns - start_ns;
+
+    RegionData* region = data->regions[id].load(std::memory_order_relaxed);
+    if (region == nullptr) {
+        region = new RegionData();
+        data->regions[id].store(region, std::memory_order_release);
+    }
+    relaxed_add(region->count, 1);
+    relaxed_add(region->total_ns, ns);
+    if (ns < region->min_ns.load(std::memory_order_relaxed)) region->min_ns.store(ns, std::memory_order_relaxed);
+    if (ns > region->max_ns.load(std::memory_order_relaxed)) region->max_ns.store(ns, std::memory_order_relaxed);
+    relaxed_add(region->buckets[bucket_of(ns)], 1);
+
+    uint64_t head = data->head.load(std::memory_order_relaxed);
+    data->ring[head % PROFILER_RING_EVENTS] = {id, start_ns, end_ns};
+    data->head.store(head + 1, std::memory_order_release);
+}
+
+Profiler::Stats Profiler::stats(RegionId id) const {
+    Stats stats = {"", 0, 0.0, 0.0, 0.0, 0.0, 0.0, 0.0, 0.0};
+    std::vector<uint64_t> buckets(PROFILER_BUCKETS, 0);
+    uint64_t total_ns = 0;
+    uint64_t min_ns = UINT64_MAX;
+    uint64_t max_ns = 0;
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (id < m_region_names.size()) stats.name = m_region_names[id];
+    std::vector<const RegionData*> regions;
+    if (id < PROFILER_MAX_REGIONS && m_retired[id]) regions.push_back(m_retired[id].get());
+    for (auto& data : m_threads) {
+        const RegionData* region = data->regions[id].load(std::memory_order_acquire);
+        if (region != nullptr) regions.push_back(region);
+    }
+    for (const RegionData* region : regions) {
+        stats.count += region->count.load(std::memory_order_relaxed);
+        total_ns += region->total_ns.load(std::memory_order_relaxed);
+        min_ns = std::min(min_ns, region->min_ns.load(std::memory_order_relaxed));
+        max_ns = std::max(max_ns, region->max_ns.load(std::memory_order_relaxed));
+        for (unsigned b = 0; b < PROFILER_BUCKETS; b++) buckets[b] += region->buckets[b].load(std::memory_order_relaxed);
+    }
+    if (stats.count == 0) return stats;
+
+    stats.total_ms = total_ns / 1e6;
+    stats.min_ms = min_ns / 1e6;
+    stats.max_ms = max_ns / 1e6;
+    stats.mean_ms = stats.total_ms / stats.count;
+
+    // The percentiles are the middle of their bucket, clamped to the samples
+    const double percentiles[3] = {0.50, 0.90, 0.99};
+    double* results[3] = {&stats.p50_ms, &stats.p90_ms, &stats.p99_ms};
+    uint64_t seen = 0;
+    unsigned p = 0;
+    for (unsigned b = 0; b < PROFILER_BUCKETS && p < 3; b++) {
+        seen += buckets[b];
+        while (p < 3 && seen >= percentiles[p] * stats.count && seen > 0) {
+            double ns = std::min(std::max(bucket_middle_ns(b), (double)min_ns), (double)max_ns);
+            *results[p++] = ns / 1e6;
+        }
+    }
+
+    return stats;
+}
+
+void Profiler::printReport(FILE* out) const {
+    size_t num_regions;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        num_regions = m_region_names.size();
+    }
+
+    fprintf(out, "%-28s %10s %12s %10s %10s %10s %10s\n", "  Region", "Count", "Total (ms)", "Mean", "p50", "p90",
+            "p99");
+    for (RegionId id = 0; id < num_regions; id++) {
+        Stats s = stats(id);
+        if (s.count == 0) continue;
+        fprintf(out, "  %-26s %10lu %12.4f %10.4f %10.4f %10.4f %10.4f\n", s.name.c_str(), (unsigned long)s.count,
+                s.total_ms, s.mean_ms, s.p50_ms, s.p90_ms, s.p99_ms);
+    }
+}
+
+// Escapes a region name for a JSON string
+static std::string json_string(const std::string& s) {
+    std::string out = "\"";
+    for (char c : s) {
+        if (c == '"' || c == '\\') {
+            out += '\\';
+            out += c;
+        } else if ((unsigned char)c < 0x20) {
+            char code[8];
+            snprintf(code, sizeof(code), "\\u%04x", c);
+            out += code;
+        } else {
+            out += c;
+        }
+    }
+    return out + "\"";
+}
+
+bool Profiler::writeChromeTrace(const std::string& filename) const {
+    std::ofstream file(filename.c_str());
+    if (!file.good()) {
+        fprintf(stderr, "Error: cannot open %s for the trace\n", filename.c_str());
+        return false;
+    }
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    const char* sep = "\n";
+    char line[256];
+
+    // Complete ("X") events with their timestamps and durations in us, and
+    // one thread name per recording thread
+    file << "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [";
+    for (auto& data : m_threads) {
+        uint64_t head = data->head.load(std::memory_order_acquire);
+        // Data of an exited thread not reused yet
+        if (head == 0) continue;
+        snprintf(line, sizeof(line), "%s{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 0, \"tid\": %u, ", sep,
+                 data->tid);
+        file << line << "\"args\": {\"name\": \"host thread " << data->tid << "\"}}";
+        sep = ",\n";
+
+        uint64_t first = head > PROFILER_RING_EVENTS ? head - PROFILER_RING_EVENTS : 0;
+        for (uint64_t i = first; i < head; i++) {
+            const ThreadData::Event& event = data->ring[i % PROFILER_RING_EVENTS];
+            snprintf(line, sizeof(line), "%s{\"name\": ", sep);
+            file << line << json_string(m_region_names[event.id]);
+            snprintf(line, sizeof(line), ", \"ph\": \"X\", \"pid\": 0, \"tid\": %u, \"ts\": %.3f, \"dur\": %.3f}",
+                     data->tid, (event.start_ns - m_origin_ns) / 1e3, (event.end_ns - event.start_ns) / 1e3);
+            file << line;
+        }
+    }
+    file << "\n]}\n";
+
+    return file.good();
+}
+
+void Profiler::reset() {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    for (auto& data : m_threads) {
+        for (auto& region : data->regions) delete region.exchange(nullptr);
+        data->head.store(0, std::memory_order_release);
+    }
+    for (auto& region : m_retired) region.reset();
+}
+}
+}
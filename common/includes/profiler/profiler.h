@@ -0,0 +1,169 @@
+/**
+* Copyright (C) 2019-2021 Xilinx, Inc
+*
+* Licensed under the Apache License, Version 2.0 (the "License"). You may
+* not use this file except in compliance with the License. A copy of the
+* License is located at
+*
+*     http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+* WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the
+* License for the specific language governing permissions and limitations
+* under the License.
+*/
+#ifndef PROFILER_H_
+#define PROFILER_H_
+
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <mutex>
+#include <stdint.h>
+#include <stdio.h>
+#include <string>
+#include <vector>
+
+// Regions a program can register, and samples kept per thread for the trace
+#define PROFILER_MAX_REGIONS 256
+#define PROFILER_RING_EVENTS 65536
+
+// Times the rest of the enclosing scope in the region of that name. The
+// region is looked up once per call site.
+#define PROFILE_SCOPE(name) PROFILE_SCOPE_ID(__LINE__, name)
+#define PROFILE_SCOPE_ID(line, name) PROFILE_SCOPE_ID_(line, name)
+#define PROFILE_SCOPE_ID_(line, name)                                                              \
+    static const sda::utils::Profiler::RegionId _profile_region_##line =                           \
+        sda::utils::Profiler::instance().region(name);                                             \
+    sda::utils::ScopedTimer _profile_timer_##line(_profile_region_##line)
+
+namespace sda {
+namespace utils {
+
+/*!
+ * Synopsis:
+ * 1.Named timing regions, registered once and then referred to by id
+ * 2.Every thread records its samples in its own ring buffer and histograms,
+ *      without taking any lock, so the regions can be timed from any thread.
+ *      The buffers of a thread that exited go to the next new thread, once
+ *      its statistics are moved to those of the exited threads.
+ * 3.Aggregates count, total, min, max and percentiles of each region over
+ *      all the threads
+ * 4.Exports the samples still in the ring buffers as a Chrome trace (JSON),
+ *      which chrome://tracing or Perfetto can open. The samples of the
+ *      threads that exited are not in it.
+ */
+class Profiler {
+   public:
+    typedef unsigned int RegionId;
+
+    class Stats {
+       public:
+        std::string name;
+        uint64_t count;
+        double total_ms;
+        double min_ms;
+        double max_ms;
+        double mean_ms;
+        double p50_ms;
+        double p90_ms;
+        double p99_ms;
+    };
+
+    /*!
+     * The profiler shared by the whole program
+     */
+    static Profiler& instance();
+
+    /*!
+     * Returns the id of the region of that name, registering it on first use
+     */
+    RegionId region(const std::string& name);
+
+    /*!
+     * Records one sample of a region in the buffers of the calling thread
+     */
+    void record(RegionId id, uint64_t start_ns, uint64_t end_ns);
+
+    /*!
+     * Steady clock timestamp, in ns, of the samples
+     */
+    static uint64_t now() {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(
+                   std::chrono::steady_clock::now().time_since_epoch())
+            .count();
+    }
+
+    /*!
+     * Aggregated statistics of a region over all the threads. The
+     * percentiles come from log2 histograms with 4 sub-buckets, so they are
+     * within 25% of the exact value.
+     */
+    Stats stats(RegionId id) const;
+    double totalMs(RegionId id) const { return stats(id).total_ms; }
+
+    /*!
+     * Prints the statistics of every region with samples
+     */
+    void printReport(FILE* out = stdout) const;
+
+    /*!
+     * Writes the samples of the ring buffers as a Chrome trace. The recording
+     * threads should be idle, otherwise the samples they overwrite meanwhile
+     * are lost.
+     */
+    bool writeChromeTrace(const std::string& filename) const;
+
+    /*!
+     * Clears the samples of every region. Same restriction as
+     * writeChromeTrace().
+     */
+    void reset();
+
+   private:
+    class RegionData;
+    class ThreadData;
+
+    Profiler();
+    ~Profiler();
+    Profiler(const Profiler&) = delete;
+    Profiler& operator=(const Profiler&) = delete;
+
+    ThreadData* threadData();
+    void retire(ThreadData* data);
+
+    uint64_t m_origin_ns;
+    mutable std::mutex m_mutex;
+    std::vector<std::string> m_region_names;
+    std::vector<std::unique_ptr<ThreadData> > m_threads;
+    // Data of the threads that exited, for the next threads to record in
+    std::vector<ThreadData*> m_free_threads;
+    // Statistics of the threads that exited, per region
+    std::vector<std::unique_ptr<RegionData> > m_retired;
+    unsigned m_next_tid;
+};
+
+/*!
+ * Times its own lifetime, or until stop(), in a region. Disabled timers
+ * record nothing, which keeps conditional timing in a single scope.
+ */
+class ScopedTimer {
+   public:
+    explicit ScopedTimer(Profiler::RegionId id, bool enabled = true)
+        : m_id(id), m_enabled(enabled), m_start(enabled ? Profiler::now() : 0) {}
+    ~ScopedTimer() { stop(); }
+
+    void stop() {
+        if (m_enabled) Profiler::instance().record(m_id, m_start, Profiler::now());
+        m_enabled = false;
+    }
+
+   private:
+    Profiler::RegionId m_id;
+    bool m_enabled;
+    uint64_t m_start;
+};
+}
+}
+#endif /* PROFILER_H_ */
@@ -0,0 +1,3 @@
+profiler_SRCS:=${COMMON_REPO}/common/includes/profiler/profiler.cpp
+profiler_HDRS:=${COMMON_REPO}/common/includes/profiler/profiler.h
+profiler_CXXFLAGS:=-I${COMMON_REPO}/common/includes/profiler
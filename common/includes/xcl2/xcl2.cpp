@@ -15,17 +15,30 @@
 */
 
 #include "xcl2.hpp"
+#include <algorithm>
+#include <chrono>
 #include <climits>
+#include <map>
+#include <mutex>
 #include <sys/stat.h>
 #include <string>
 #include <iomanip>
 #include <sstream>
+#include <tuple>
 #if defined(_WINDOWS)
 #include <io.h>
 #else
+#include <fcntl.h>
+#include <sched.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
 #include <unistd.h>
 #endif
 
+#ifndef MAP_HUGE_SHIFT
+#define MAP_HUGE_SHIFT 26
+#endif
+
 namespace xcl {
 std::vector<cl::Device> get_devices(const std::string& vendor_name) {
     size_t i;
@@ -177,4 +190,277 @@ bool is_xpr_device(const char* device_name) {
         return true;
     }
 }
+
+Xclbin::Xclbin(const std::string& xclbin_file_name) : m_data(nullptr), m_size(0) {
+    std::cout << "INFO: Mapping " << xclbin_file_name << std::endl;
+#if defined(_WINDOWS)
+    m_copy = read_binary_file(xclbin_file_name);
+    m_data = m_copy.data();
+    m_size = m_copy.size();
+#else
+    int fd = open(xclbin_file_name.c_str(), O_RDONLY);
+    struct stat st;
+    if (fd < 0 || fstat(fd, &st) != 0 || st.st_size == 0) {
+        printf("ERROR: %s xclbin not available please build\n", xclbin_file_name.c_str());
+        exit(EXIT_FAILURE);
+    }
+    void* mapped = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (mapped == MAP_FAILED) {
+        printf("ERROR: Failed to map %s\n", xclbin_file_name.c_str());
+        exit(EXIT_FAILURE);
+    }
+    m_data = (const unsigned char*)mapped;
+    m_size = st.st_size;
+#endif
+}
+
+Xclbin::~Xclbin() {
+#if !defined(_WINDOWS)
+    if (m_data != nullptr) munmap((void*)m_data, m_size);
+#endif
+}
+
+static double elapsed_ms(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+Session::Session(const std::string& xclbin_file_name, int device_index)
+    : m_devices_ms(0.0), m_xclbin_ms(0.0), m_program_ms(0.0) {
+    cl_int err;
+
+    auto start = std::chrono::steady_clock::now();
+    std::vector<cl::Device> devices = get_xil_devices();
+    m_devices_ms = elapsed_ms(start);
+
+    start = std::chrono::steady_clock::now();
+    Xclbin xclbin(xclbin_file_name);
+    m_xclbin_ms = elapsed_ms(start);
+
+    start = std::chrono::steady_clock::now();
+    bool valid_device = false;
+    for (unsigned int i = 0; i < devices.size() && !valid_device; i++) {
+        if (device_index >= 0 && (int)i != device_index) continue;
+        auto device = devices[i];
+
+        OCL_CHECK(err, m_context = cl::Context(device, nullptr, nullptr, nullptr, &err));
+        std::cout << "Trying to program device[" << i << "]: " << device.getInfo<CL_DEVICE_NAME>() << std::endl;
+        m_program = cl::Program(m_context, {device}, xclbin.binaries(), nullptr, &err);
+        if (err != CL_SUCCESS) {
+            std::cout << "Failed to program device[" << i << "] with xclbin file!\n";
+            continue;
+        }
+        std::cout << "Device[" << i << "]: program successful!\n";
+        m_device = device;
+        valid_device = true;
+    }
+    m_program_ms = elapsed_ms(start);
+
+    if (!valid_device) {
+        std::cout << "Failed to program any device found, exit!\n";
+        exit(EXIT_FAILURE);
+    }
+}
+
+cl::CommandQueue Session::createQueue(cl_command_queue_properties properties) const {
+    cl_int err;
+    OCL_CHECK(err, cl::CommandQueue q(m_context, m_device, properties, &err));
+    return q;
+}
+
+void Session::printStartup() const {
+    printf("Device startup: %.3f ms (devices %.3f ms, xclbin %.3f ms, program %.3f ms)\n", startupMs(), m_devices_ms,
+           m_xclbin_ms, m_program_ms);
+}
+
+struct BufferPool::Slab {
+    void* ptr;
+    size_t size;
+    bool in_use;
+    // USE_HOST_PTR buffers created over the slab, by context, flags and size
+    std::map<std::tuple<cl_context, cl_mem_flags, size_t>, cl::Buffer> buffers;
+};
+
+BufferPool::BufferPool(PageSize page_size, int numa_node)
+    : m_page_size(page_size), m_numa_node(numa_node), m_fallback(false) {}
+
+BufferPool::~BufferPool() {
+    for (auto& slab : m_slabs) unmap(slab.second.get());
+}
+
+BufferPool& BufferPool::instance() {
+    static BufferPool pool;
+    return pool;
+}
+
+void* BufferPool::map(size_t size) {
+#if defined(_WINDOWS)
+    void* ptr = _aligned_malloc(size, 4096);
+#else
+    void* ptr = MAP_FAILED;
+    if (m_page_size != PAGE_4K && !m_fallback) {
+        int shift = m_page_size == PAGE_1G ? 30 : 21;
+        ptr = mmap(nullptr, size, PROT_READ | PROT_WRITE,
+                   MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB | (shift << MAP_HUGE_SHIFT), -1, 0);
+        if (ptr == MAP_FAILED) {
+            // No huge pages reserved (vm.nr_hugepages) for this size, use the
+            // transparent huge pages of the kernel instead
+            std::cout << "WARNING: cannot map " << (m_page_size == PAGE_1G ? "1 GB" : "2 MB")
+                      << " huge pages, falling back to 4 KB pages" << std::endl;
+            m_fallback = true;
+        }
+    }
+    if (ptr == MAP_FAILED) {
+        ptr = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (ptr == MAP_FAILED) ptr = nullptr;
+        if (ptr != nullptr && m_page_size != PAGE_4K) madvise(ptr, size, MADV_HUGEPAGE);
+    }
+    if (ptr != nullptr && m_numa_node >= 0) {
+        // mbind(MPOL_BIND) before the first touch places the pages on the
+        // node, without linking libnuma
+        const int mpol_bind = 2;
+        std::vector<unsigned long> nodemask(m_numa_node / (8 * sizeof(unsigned long)) + 1, 0);
+        nodemask[m_numa_node / (8 * sizeof(unsigned long))] = 1UL << (m_numa_node % (8 * sizeof(unsigned long)));
+        if (syscall(SYS_mbind, ptr, size, mpol_bind, nodemask.data(), nodemask.size() * 8 * sizeof(unsigned long) + 1,
+                    0) != 0) {
+            std::cout << "WARNING: cannot bind the buffer pool to NUMA node " << m_numa_node << std::endl;
+            m_numa_node = -1;
+        }
+    }
+#endif
+    if (ptr == nullptr) throw std::bad_alloc();
+    return ptr;
+}
+
+void BufferPool::unmap(Slab* slab) {
+    slab->buffers.clear();
+#if defined(_WINDOWS)
+    _aligned_free(slab->ptr);
+#else
+    munmap(slab->ptr, slab->size);
+#endif
+}
+
+void* BufferPool::allocate(size_t size) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    // Once the huge pages fell back to 4 KB pages, rounding to a huge page
+    // would only waste memory
+    size_t page = 4096;
+    if (!m_fallback) page = m_page_size == PAGE_1G ? (1UL << 30) : m_page_size == PAGE_2M ? (1UL << 21) : 4096;
+    size = (std::max(size, (size_t)1) + page - 1) / page * page;
+
+    auto it = m_free.lower_bound(size);
+    if (it != m_free.end() && it->first <= 2 * size) {
+        Slab* slab = it->second;
+        m_free.erase(it);
+        slab->in_use = true;
+        return slab->ptr;
+    }
+
+    std::unique_ptr<Slab> slab(new Slab());
+    slab->ptr = map(size);
+    slab->size = size;
+    slab->in_use = true;
+    void* ptr = slab->ptr;
+    m_slabs[ptr] = std::move(slab);
+    return ptr;
+}
+
+void BufferPool::release(void* ptr) {
+    if (ptr == nullptr) return;
+    std::lock_guard<std::mutex> lock(m_mutex);
+    auto it = m_slabs.find(ptr);
+    if (it == m_slabs.end() || !it->second->in_use) {
+        std::cout << "Error: " << ptr << " is not a buffer of this pool" << std::endl;
+        exit(EXIT_FAILURE);
+    }
+    it->second->in_use = false;
+    m_free.insert(std::make_pair(it->second->size, it->second.get()));
+}
+
+cl::Buffer BufferPool::buffer(const cl::Context& context, void* ptr, size_t size, cl_mem_flags flags) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    auto it = m_slabs.find(ptr);
+    if (it == m_slabs.end() || size > it->second->size) {
+        std::cout << "Error: " << ptr << " is not a buffer of this pool of at least " << size << " bytes" << std::endl;
+        exit(EXIT_FAILURE);
+    }
+    cl::Buffer& buffer = it->second->buffers[std::make_tuple(context(), flags, size)];
+    if (buffer() == nullptr) {
+        cl_int err;
+        OCL_CHECK(err, buffer = cl::Buffer(context, flags | CL_MEM_USE_HOST_PTR, size, ptr, &err));
+    }
+    return buffer;
+}
+
+void BufferPool::trim() {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    for (auto& free : m_free) {
+        unmap(free.second);
+        m_slabs.erase(free.second->ptr);
+    }
+    m_free.clear();
+}
+
+size_t BufferPool::mappedBytes() const {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    size_t bytes = 0;
+    for (auto& slab : m_slabs) bytes += slab.second->size;
+    return bytes;
+}
+
+size_t BufferPool::slabs() const {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_slabs.size();
+}
+
+// Parses a list of /sys, such as "0-15,32-47"
+static std::vector<int> parse_list(const std::string& path) {
+    std::vector<int> values;
+    std::ifstream file(path);
+    std::string item;
+    while (std::getline(file, item, ',')) {
+        auto dash = item.find('-');
+        int first = atoi(item.c_str());
+        int last = dash == std::string::npos ? first : atoi(item.c_str() + dash + 1);
+        for (int value = first; value <= last; value++) values.push_back(value);
+    }
+    return values;
+}
+
+std::vector<int> numa_nodes() {
+    return parse_list("/sys/devices/system/node/online");
+}
+
+std::vector<int> numa_node_cpus(int node) {
+    if (node < 0) return parse_list("/sys/devices/system/cpu/online");
+    return parse_list("/sys/devices/system/node/node" + std::to_string(node) + "/cpulist");
+}
+
+int numa_node(const cl::Device& device) {
+    char bdf[20] = {0};
+    if (device.getInfo(CL_DEVICE_PCIE_BDF, &bdf) != CL_SUCCESS) return -1;
+    std::string name(bdf);
+    // The domain is left out of the BDF of some runtimes
+    if (std::count(name.begin(), name.end(), ':') == 1) name = "0000:" + name;
+    std::ifstream file("/sys/bus/pci/devices/" + name + "/numa_node");
+    int node = -1;
+    if (!(file >> node)) return -1;
+    return node;
+}
+
+bool bind_thread_to_numa_node(int node) {
+#if defined(_WINDOWS)
+    return false;
+#else
+    std::vector<int> cpus = numa_node_cpus(node);
+    if (cpus.empty()) return false;
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    for (int cpu : cpus) {
+        if (cpu < CPU_SETSIZE) CPU_SET(cpu, &set);
+    }
+    return sched_setaffinity(0, sizeof(set), &set) == 0;
+#endif
+}
 }; // namespace xcl
@@ -34,6 +34,11 @@
 #include <CL/cl_ext_xilinx.h>
 #include <fstream>
 #include <iostream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
 // When creating a buffer with user pointer (CL_MEM_USE_HOST_PTR), under the
 // hood
 // User ptr is used if and only if it is properly aligned (page aligned). When
@@ -115,4 +120,139 @@ class Ext {
         getComputeUnitInfo = (decltype(&xclGetComputeUnitInfo))bar;
     }
 };
+
+// Read-only memory mapping of an xclbin file. Unlike read_binary_file() it
+// does not copy the file.
+class Xclbin {
+   public:
+    explicit Xclbin(const std::string& xclbin_file_name);
+    ~Xclbin();
+    Xclbin(const Xclbin&) = delete;
+    Xclbin& operator=(const Xclbin&) = delete;
+
+    const unsigned char* data() const { return m_data; }
+    size_t size() const { return m_size; }
+    cl::Program::Binaries binaries() const { return {{m_data, m_size}}; }
+
+   private:
+    const unsigned char* m_data;
+    size_t m_size;
+    std::vector<unsigned char> m_copy;
+};
+
+// Pool of page aligned host buffers for CL_MEM_USE_HOST_PTR. The slabs are
+// mapped with mmap, optionally on 2 MB or 1 GB huge pages and bound to one
+// NUMA node, and released slabs are kept for the next allocation of a
+// similar size instead of being unmapped. buffer() keeps the cl::Buffer
+// created over a slab with it, so the runtime only pins the pages once. The
+// slabs can also back an xrt::bo created from a user pointer.
+class BufferPool {
+   public:
+    enum PageSize { PAGE_4K, PAGE_2M, PAGE_1G };
+
+    explicit BufferPool(PageSize page_size = PAGE_4K, int numa_node = -1);
+    ~BufferPool();
+    BufferPool(const BufferPool&) = delete;
+    BufferPool& operator=(const BufferPool&) = delete;
+
+    // Returns at least size bytes, from a released slab of size to 2 * size
+    // bytes when there is one
+    void* allocate(size_t size);
+    // Keeps the slab of ptr for the next allocations
+    void release(void* ptr);
+    // CL_MEM_USE_HOST_PTR buffer of size bytes over the slab of ptr, created
+    // on first use for each context, flags and size
+    cl::Buffer buffer(const cl::Context& context, void* ptr, size_t size, cl_mem_flags flags);
+    // Unmaps the released slabs and their buffers
+    void trim();
+
+    size_t mappedBytes() const;
+    size_t slabs() const;
+    // Huge pages were requested but none could be mapped, the slabs fell
+    // back to (transparent huge page advised) 4 KB pages
+    bool hugePageFallback() const { return m_fallback; }
+
+    // Pool of the pooled_allocator, on 4 KB pages and any NUMA node
+    static BufferPool& instance();
+
+   private:
+    struct Slab;
+
+    void* map(size_t size);
+    void unmap(Slab* slab);
+
+    PageSize m_page_size;
+    int m_numa_node;
+    bool m_fallback;
+    mutable std::mutex m_mutex;
+    std::map<const void*, std::unique_ptr<Slab> > m_slabs;
+    std::multimap<size_t, Slab*> m_free;
+};
+
+// Drop-in replacement of aligned_allocator whose vectors take their storage
+// from BufferPool::instance(), so allocating the same buffers again on every
+// run does not map, fault and pin new pages
+template <typename T>
+struct pooled_allocator {
+    using value_type = T;
+
+    pooled_allocator() {}
+
+    template <typename U>
+    pooled_allocator(const pooled_allocator<U>&) {}
+
+    T* allocate(std::size_t num) { return reinterpret_cast<T*>(BufferPool::instance().allocate(num * sizeof(T))); }
+    void deallocate(T* p, std::size_t num) { BufferPool::instance().release(p); }
+};
+
+template <typename T, typename U>
+bool operator==(const pooled_allocator<T>&, const pooled_allocator<U>&) {
+    return true;
+}
+
+template <typename T, typename U>
+bool operator!=(const pooled_allocator<T>&, const pooled_allocator<U>&) {
+    return false;
+}
+
+// NUMA topology of the host, read from /sys without linking libnuma. The
+// nodes are empty and the node of a device is -1 when the host does not
+// report them.
+std::vector<int> numa_nodes();
+std::vector<int> numa_node_cpus(int node);
+// NUMA node of the PCIe slot of device
+int numa_node(const cl::Device& device);
+// Binds the calling thread to the CPUs of node, or to every CPU for node -1
+bool bind_thread_to_numa_node(int node);
+
+// Device setup shared by the host programs: finds the Xilinx devices, maps
+// the xclbin and programs the first device that accepts it (or only device
+// device_index). The session owns its context and program, so they are
+// released with it, before XRT shuts down. XRT itself skips the download
+// when the device already holds an xclbin of the same UUID.
+class Session {
+   public:
+    explicit Session(const std::string& xclbin_file_name, int device_index = -1);
+
+    const cl::Device& device() const { return m_device; }
+    const cl::Context& context() const { return m_context; }
+    const cl::Program& program() const { return m_program; }
+    cl::CommandQueue createQueue(cl_command_queue_properties properties = CL_QUEUE_PROFILING_ENABLE) const;
+
+    // Startup time spent finding the devices, mapping the xclbin and
+    // programming the device, in ms
+    double devicesMs() const { return m_devices_ms; }
+    double xclbinMs() const { return m_xclbin_ms; }
+    double programMs() const { return m_program_ms; }
+    double startupMs() const { return m_devices_ms + m_xclbin_ms + m_program_ms; }
+    void printStartup() const;
+
+   private:
+    cl::Device m_device;
+    cl::Context m_context;
+    cl::Program m_program;
+    double m_devices_ms;
+    double m_xclbin_ms;
+    double m_program_ms;
+};
 }
@@ -1,8 +1,14 @@
-#Number of compute units 
-NK:= 2
 #Number of parallel points
 PP:= 96
+#Feature format: 16, 24 or 32 bit fixed point, 0 for float
+FEATURE_BITS:= 24
 
-CXXFLAGS += -D __USE_OPENCL__ -DNUM_CU=$(NK)
-VPP_FLAGS += -DPARALLEL_POINTS=$(PP)
+CXXFLAGS += -D __USE_OPENCL__ -DFEATURE_BITS=$(FEATURE_BITS)
+VPP_FLAGS += -DPARALLEL_POINTS=$(PP) -DFEATURE_BITS=$(FEATURE_BITS)
 
+#Triangle inequality pruning in the kernel (0/1)
+PRUNING:= 0
+ifeq ($(PRUNING),1)
+CXXFLAGS += -DKMEANS_PRUNING
+VPP_FLAGS += -DKMEANS_PRUNING
+endif
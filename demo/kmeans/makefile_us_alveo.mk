@@ -66,9 +66,10 @@ PLATFORM_BLOCKLIST += zc vck u200_gen3x16 u30 nodma u2_ u25_ u55n samsung u280
 CXXFLAGS += -I$(XF_PROJ_ROOT)/common/includes/xcl2
 CXXFLAGS += -I$(XF_PROJ_ROOT)/common/includes/cmdparser
 CXXFLAGS += -I$(XF_PROJ_ROOT)/common/includes/logger
-HOST_SRCS += $(XF_PROJ_ROOT)/common/includes/xcl2/xcl2.cpp $(XF_PROJ_ROOT)/common/includes/cmdparser/cmdlineparser.cpp $(XF_PROJ_ROOT)/common/includes/logger/logger.cpp src/host.cpp src/fpga_kmeans.cpp src/kmeans_clustering_cmodel.c 
+CXXFLAGS += -I$(XF_PROJ_ROOT)/common/includes/profiler
+HOST_SRCS += $(XF_PROJ_ROOT)/common/includes/xcl2/xcl2.cpp $(XF_PROJ_ROOT)/common/includes/cmdparser/cmdlineparser.cpp $(XF_PROJ_ROOT)/common/includes/logger/logger.cpp $(XF_PROJ_ROOT)/common/includes/profiler/profiler.cpp src/host.cpp src/fpga_kmeans.cpp src/kmeans_clustering_cmodel.c src/cpu_kmeans.cpp src/kmeans_seeding.cpp src/kmeans_bounds.cpp 
 # Host compiler global settings
-CXXFLAGS += -fmessage-length=0
+CXXFLAGS += -fmessage-length=0 -O3
 LDFLAGS += -lrt -lstdc++ 
 
 ############################## Setting up Kernel Variables ##############################
@@ -0,0 +1,463 @@
+/**
+* Copyright (C) 2019-2021 Xilinx, Inc
+*
+* Licensed under the Apache License, Version 2.0 (the "License"). You may
+* not use this file except in compliance with the License. A copy of the
+* License is located at
+*
+*     http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+* WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the
+* License for the specific language governing permissions and limitations
+* under the License.
+*/
+
+#include "cpu_kmeans.h"
+#include "profiler.h"
+#include <algorithm>
+#include <float.h>
+#include <stdio.h>
+#include <string.h>
+
+// The 32-bit fixed point distances do not fit in 64-bit lanes, that format
+// only has the scalar kernel
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__)) && FEATURE_BITS != 32
+#define KMEANS_CPU_X86 1
+#include <immintrin.h>
+#endif
+
+// Distances are accumulated like point_dist_t in the kernel: exactly for the
+// fixed point formats, in single precision for float
+#if FEATURE_BITS == 0
+typedef float feature_dist_t;
+#define MAX_VALUE FLT_MAX
+#elif FEATURE_BITS == 32
+typedef unsigned __int128 feature_dist_t;
+#define MAX_VALUE ((feature_dist_t)-1)
+#else
+typedef unsigned long feature_dist_t;
+#define MAX_VALUE ((feature_dist_t)-1)
+#endif
+
+/****************************************************************
+
+             NEAREST CLUSTER FOR A BLOCK OF 16 POINTS
+
+  Each block is laid out as [nfeatures][16]: the 16 values of a
+  feature are contiguous, which maps 1:1 onto the SIMD registers.
+  Ties are resolved towards the lowest cluster id, as in the kernel.
+
+ ***************************************************************/
+static void nearest_block_scalar(
+    const feature_t* block, const feature_t* clusters, int nclusters, int nfeatures, int index[16]) {
+    feature_dist_t min_dist[16];
+    feature_dist_t dist[16];
+
+    for (int i = 0; i < 16; i++) {
+        min_dist[i] = MAX_VALUE;
+        index[i] = 0;
+    }
+
+    for (int c = 0; c < nclusters; c++) {
+        const feature_t* cluster = clusters + c * nfeatures;
+        for (int i = 0; i < 16; i++) dist[i] = 0;
+
+        for (int f = 0; f < nfeatures; f++) {
+            const feature_t* row = block + f * 16;
+            feature_t cluster_value = cluster[f];
+            for (int i = 0; i < 16; i++) {
+                feature_dist_t diff = (row[i] > cluster_value) ? row[i] - cluster_value : cluster_value - row[i];
+                dist[i] += diff * diff;
+            }
+        }
+
+        for (int i = 0; i < 16; i++) {
+            if (dist[i] < min_dist[i]) {
+                min_dist[i] = dist[i];
+                index[i] = c;
+            }
+        }
+    }
+}
+
+#if defined(KMEANS_CPU_X86) && FEATURE_BITS != 0
+// |a - b| is computed with unsigned 32-bit min/max so it is exact for the full
+// unsigned int range, then squared into 64-bit lanes with mul_epu32: the even
+// 32-bit lanes directly, the odd ones after a 32-bit shift. The 64-bit sums
+// are exact for up to 64 features of 24 bits.
+__attribute__((target("avx2"))) static void nearest_block_avx2(
+    const unsigned int* block, const unsigned int* clusters, int nclusters, int nfeatures, int index[16]) {
+    const __m256i sign = _mm256_set1_epi64x((long long)0x8000000000000000ULL);
+    __m256i min_dist[4];
+    __m256i min_index[4];
+
+    for (int k = 0; k < 4; k++) {
+        min_dist[k] = _mm256_set1_epi64x(-1);
+        min_index[k] = _mm256_setzero_si256();
+    }
+
+    for (int c = 0; c < nclusters; c++) {
+        const unsigned int* cluster = clusters + c * nfeatures;
+        // acc[0]: points 0,2,4,6  acc[1]: 1,3,5,7  acc[2]: 8,10,12,14  acc[3]: 9,11,13,15
+        __m256i acc[4];
+        for (int k = 0; k < 4; k++) acc[k] = _mm256_setzero_si256();
+
+        for (int f = 0; f < nfeatures; f++) {
+            const __m256i cv = _mm256_set1_epi32(cluster[f]);
+            const __m256i lo = _mm256_loadu_si256((const __m256i*)(block + f * 16));
+            const __m256i hi = _mm256_loadu_si256((const __m256i*)(block + f * 16 + 8));
+            const __m256i dlo = _mm256_sub_epi32(_mm256_max_epu32(lo, cv), _mm256_min_epu32(lo, cv));
+            const __m256i dhi = _mm256_sub_epi32(_mm256_max_epu32(hi, cv), _mm256_min_epu32(hi, cv));
+            const __m256i dlo_odd = _mm256_srli_epi64(dlo, 32);
+            const __m256i dhi_odd = _mm256_srli_epi64(dhi, 32);
+
+            acc[0] = _mm256_add_epi64(acc[0], _mm256_mul_epu32(dlo, dlo));
+            acc[1] = _mm256_add_epi64(acc[1], _mm256_mul_epu32(dlo_odd, dlo_odd));
+            acc[2] = _mm256_add_epi64(acc[2], _mm256_mul_epu32(dhi, dhi));
+            acc[3] = _mm256_add_epi64(acc[3], _mm256_mul_epu32(dhi_odd, dhi_odd));
+        }
+
+        // AVX2 only has a signed 64-bit compare: flip the sign bits to get an
+        // unsigned one
+        const __m256i cid = _mm256_set1_epi64x(c);
+        for (int k = 0; k < 4; k++) {
+            __m256i lt = _mm256_cmpgt_epi64(_mm256_xor_si256(min_dist[k], sign), _mm256_xor_si256(acc[k], sign));
+            min_dist[k] = _mm256_blendv_epi8(min_dist[k], acc[k], lt);
+            min_index[k] = _mm256_blendv_epi8(min_index[k], cid, lt);
+        }
+    }
+
+    long long tmp[4][4];
+    for (int k = 0; k < 4; k++) _mm256_storeu_si256((__m256i*)tmp[k], min_index[k]);
+    for (int j = 0; j < 4; j++) {
+        index[2 * j] = (int)tmp[0][j];
+        index[2 * j + 1] = (int)tmp[1][j];
+        index[8 + 2 * j] = (int)tmp[2][j];
+        index[8 + 2 * j + 1] = (int)tmp[3][j];
+    }
+}
+
+// GCC 12 reports its own _mm512_undefined_epi32() placeholders as uninitialized
+// when the intrinsics are inlined into a target("avx512f") function
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wmaybe-uninitialized"
+__attribute__((target("avx512f"))) static void nearest_block_avx512(
+    const unsigned int* block, const unsigned int* clusters, int nclusters, int nfeatures, int index[16]) {
+    // min_dist[0]/min_index[0]: points 0,2,..,14  min_dist[1]/min_index[1]: 1,3,..,15
+    __m512i min_dist[2] = {_mm512_set1_epi64(-1), _mm512_set1_epi64(-1)};
+    __m512i min_index[2] = {_mm512_setzero_si512(), _mm512_setzero_si512()};
+
+    for (int c = 0; c < nclusters; c++) {
+        const unsigned int* cluster = clusters + c * nfeatures;
+        __m512i acc_even = _mm512_setzero_si512();
+        __m512i acc_odd = _mm512_setzero_si512();
+
+        for (int f = 0; f < nfeatures; f++) {
+            const __m512i cv = _mm512_set1_epi32(cluster[f]);
+            const __m512i pv = _mm512_loadu_si512((const void*)(block + f * 16));
+            const __m512i d = _mm512_sub_epi32(_mm512_max_epu32(pv, cv), _mm512_min_epu32(pv, cv));
+            const __m512i d_odd = _mm512_srli_epi64(d, 32);
+
+            acc_even = _mm512_add_epi64(acc_even, _mm512_mul_epu32(d, d));
+            acc_odd = _mm512_add_epi64(acc_odd, _mm512_mul_epu32(d_odd, d_odd));
+        }
+
+        const __m512i cid = _mm512_set1_epi64(c);
+        __mmask8 lt_even = _mm512_cmplt_epu64_mask(acc_even, min_dist[0]);
+        __mmask8 lt_odd = _mm512_cmplt_epu64_mask(acc_odd, min_dist[1]);
+        min_dist[0] = _mm512_mask_mov_epi64(min_dist[0], lt_even, acc_even);
+        min_dist[1] = _mm512_mask_mov_epi64(min_dist[1], lt_odd, acc_odd);
+        min_index[0] = _mm512_mask_mov_epi64(min_index[0], lt_even, cid);
+        min_index[1] = _mm512_mask_mov_epi64(min_index[1], lt_odd, cid);
+    }
+
+    long long tmp[2][8];
+    _mm512_storeu_si512((void*)tmp[0], min_index[0]);
+    _mm512_storeu_si512((void*)tmp[1], min_index[1]);
+    for (int j = 0; j < 8; j++) {
+        index[2 * j] = (int)tmp[0][j];
+        index[2 * j + 1] = (int)tmp[1][j];
+    }
+}
+#pragma GCC diagnostic pop
+#elif defined(KMEANS_CPU_X86)
+// Same operations in the same order as the scalar kernel, so all the versions
+// give the same memberships
+__attribute__((target("avx2"))) static void nearest_block_avx2(
+    const float* block, const float* clusters, int nclusters, int nfeatures, int index[16]) {
+    // [0]: points 0..7  [1]: points 8..15
+    __m256 min_dist[2] = {_mm256_set1_ps(FLT_MAX), _mm256_set1_ps(FLT_MAX)};
+    __m256i min_index[2] = {_mm256_setzero_si256(), _mm256_setzero_si256()};
+
+    for (int c = 0; c < nclusters; c++) {
+        const float* cluster = clusters + c * nfeatures;
+        __m256 acc[2] = {_mm256_setzero_ps(), _mm256_setzero_ps()};
+
+        for (int f = 0; f < nfeatures; f++) {
+            const __m256 cv = _mm256_set1_ps(cluster[f]);
+            for (int k = 0; k < 2; k++) {
+                const __m256 d = _mm256_sub_ps(_mm256_loadu_ps(block + f * 16 + k * 8), cv);
+                acc[k] = _mm256_add_ps(acc[k], _mm256_mul_ps(d, d));
+            }
+        }
+
+        const __m256i cid = _mm256_set1_epi32(c);
+        for (int k = 0; k < 2; k++) {
+            __m256 lt = _mm256_cmp_ps(acc[k], min_dist[k], _CMP_LT_OQ);
+            min_dist[k] = _mm256_blendv_ps(min_dist[k], acc[k], lt);
+            min_index[k] = _mm256_blendv_epi8(min_index[k], cid, _mm256_castps_si256(lt));
+        }
+    }
+
+    for (int k = 0; k < 2; k++) _mm256_storeu_si256((__m256i*)(index + k * 8), min_index[k]);
+}
+
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wmaybe-uninitialized"
+__attribute__((target("avx512f"))) static void nearest_block_avx512(
+    const float* block, const float* clusters, int nclusters, int nfeatures, int index[16]) {
+    __m512 min_dist = _mm512_set1_ps(FLT_MAX);
+    __m512i min_index = _mm512_setzero_si512();
+
+    for (int c = 0; c < nclusters; c++) {
+        const float* cluster = clusters + c * nfeatures;
+        __m512 acc = _mm512_setzero_ps();
+
+        for (int f = 0; f < nfeatures; f++) {
+            const __m512 d = _mm512_sub_ps(_mm512_loadu_ps(block + f * 16), _mm512_set1_ps(cluster[f]));
+            acc = _mm512_add_ps(acc, _mm512_mul_ps(d, d));
+        }
+
+        __mmask16 lt = _mm512_cmp_ps_mask(acc, min_dist, _CMP_LT_OQ);
+        min_dist = _mm512_mask_mov_ps(min_dist, lt, acc);
+        min_index = _mm512_mask_mov_epi32(min_index, lt, _mm512_set1_epi32(c));
+    }
+
+    _mm512_storeu_si512((void*)index, min_index);
+}
+#pragma GCC diagnostic pop
+#endif
+
+/****************************************************************
+
+                    CPU KMEANS THREAD POOL
+
+ ***************************************************************/
+CPU_KMEANS::CPU_KMEANS()
+    : m_nearest(nearest_block_scalar), m_isa("scalar"), m_generation(0), m_pending(0), m_stop(false) {}
+
+CPU_KMEANS::~CPU_KMEANS() {
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_stop = true;
+    }
+    m_start_cv.notify_all();
+    for (auto& t : m_workers) t.join();
+}
+
+int CPU_KMEANS::cpu_kmeans_init(int nthreads) {
+    if (nthreads <= 0) nthreads = std::max(1u, std::thread::hardware_concurrency());
+
+#ifdef KMEANS_CPU_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx512f")) {
+        m_nearest = nearest_block_avx512;
+        m_isa = "AVX-512";
+    } else if (__builtin_cpu_supports("avx2")) {
+        m_nearest = nearest_block_avx2;
+        m_isa = "AVX2";
+    }
+#endif
+
+    m_partial_centers.resize(nthreads);
+    for (int i = 0; i < nthreads; i++) {
+        m_workers.emplace_back(&CPU_KMEANS::worker, this, i);
+    }
+
+    printf("CPU engine initialized with %d threads using %s distance kernel\n", nthreads, m_isa);
+
+    return 0;
+}
+
+void CPU_KMEANS::worker(unsigned id) {
+    unsigned seen = 0;
+    for (;;) {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_start_cv.wait(lock, [&] { return m_stop || m_generation != seen; });
+        if (m_stop) return;
+        seen = m_generation;
+        lock.unlock();
+
+        {
+            PROFILE_SCOPE("CPU Engine Job");
+            m_job(id);
+        }
+
+        lock.lock();
+        if (--m_pending == 0) m_done_cv.notify_one();
+    }
+}
+
+void CPU_KMEANS::run(const std::function<void(unsigned)>& job) {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_job = job;
+    m_pending = m_workers.size();
+    m_generation++;
+    m_start_cv.notify_all();
+    m_done_cv.wait(lock, [&] { return m_pending == 0; });
+}
+
+/****************************************************************
+
+                      CPU KMEANS COMPUTE()
+
+ ***************************************************************/
+void CPU_KMEANS::cpu_kmeans_compute(const feature_t* feature,
+                                    const feature_t* clusters,
+                                    int* membership,
+                                    center_sum_t* new_centers,
+                                    int npoints,
+                                    int nclusters,
+                                    int nfeatures) {
+    unsigned nthreads = m_workers.size();
+    unsigned nblocks = (npoints + 15) / 16;
+    unsigned centers_sz = nclusters * nfeatures;
+
+    run([&](unsigned t) {
+        std::vector<center_sum_t>& partial = m_partial_centers[t];
+        partial.assign(centers_sz, 0);
+
+        unsigned first = (unsigned long)nblocks * t / nthreads;
+        unsigned last = (unsigned long)nblocks * (t + 1) / nthreads;
+
+        for (unsigned b = first; b < last; b++) {
+            const feature_t* block = feature + (unsigned long)b * nfeatures * 16;
+            int index[16];
+
+            m_nearest(block, clusters, nclusters, nfeatures, index);
+
+            for (int i = 0; i < 16; i++) {
+                int p = b * 16 + i;
+                membership[p] = index[i];
+                // The buffers are padded to 16 points: keep the padding out of
+                // the new centers, as compute_new_centers() does
+                if (p >= npoints) continue;
+                center_sum_t* center = partial.data() + index[i] * nfeatures;
+                for (int f = 0; f < nfeatures; f++) center[f] += block[f * 16 + i];
+            }
+        }
+    });
+
+    memset(new_centers, 0, centers_sz * sizeof(center_sum_t));
+    for (unsigned t = 0; t < nthreads; t++) {
+        const center_sum_t* partial = m_partial_centers[t].data();
+        for (unsigned i = 0; i < centers_sz; i++) new_centers[i] += partial[i];
+    }
+}
+/****************************************************************
+
+                  CPU KMEANS COMPUTE BOUNDS()
+
+  Stable points keep their cluster without any distance evaluation.
+  When pruning single points, the distance to the current cluster
+  first tightens the upper bound and all the clusters are only
+  evaluated if that is not enough. A group that is not stable as a
+  whole evaluates all the clusters for all its points, like the
+  kernel. A full evaluation also gives the exact bounds of a point.
+
+ ***************************************************************/
+static feature_dist_t point_dist(const feature_t* block, int i, const feature_t* cluster, int nfeatures) {
+    feature_dist_t dist = 0;
+    for (int f = 0; f < nfeatures; f++) {
+        feature_t value = block[f * 16 + i];
+        feature_dist_t diff = (value > cluster[f]) ? value - cluster[f] : cluster[f] - value;
+        dist += diff * diff;
+    }
+    return dist;
+}
+
+unsigned long CPU_KMEANS::cpu_kmeans_compute_bounds(const feature_t* feature,
+                                                    const feature_t* clusters,
+                                                    int* membership,
+                                                    center_sum_t* new_centers,
+                                                    int npoints,
+                                                    int nclusters,
+                                                    int nfeatures,
+                                                    KMEANS_BOUNDS& bounds,
+                                                    unsigned start_point,
+                                                    int group_points) {
+    unsigned nthreads = m_workers.size();
+    unsigned ngroups = (npoints + group_points - 1) / group_points;
+    unsigned centers_sz = nclusters * nfeatures;
+    bool valid = bounds.kmeans_bounds_valid();
+
+    m_partial_evals.assign(nthreads, 0);
+
+    run([&](unsigned t) {
+        std::vector<center_sum_t>& partial = m_partial_centers[t];
+        partial.assign(centers_sz, 0);
+        unsigned long evals = 0;
+
+        unsigned first = (unsigned long)ngroups * t / nthreads;
+        unsigned last = (unsigned long)ngroups * (t + 1) / nthreads;
+
+        for (unsigned g = first; g < last; g++) {
+            int group_start = g * group_points;
+            int group_end = std::min(group_start + group_points, npoints);
+            int group_npoints = group_end - group_start;
+            bool group_stable = (group_points > 1) && bounds.kmeans_bounds_group_stable(start_point + group_start,
+                                                                                        group_npoints,
+                                                                                        membership + group_start);
+
+            for (int p = group_start; p < group_end; p++) {
+                const feature_t* block = feature + (unsigned long)(p / 16) * nfeatures * 16;
+                int i = p % 16;
+                unsigned point = start_point + p;
+                int index = membership[p];
+                bool stable = valid && (group_points > 1 ? group_stable : bounds.kmeans_bounds_stable(point, index));
+
+                if (valid && !stable && group_points == 1) {
+                    feature_dist_t dist = point_dist(block, i, clusters + index * nfeatures, nfeatures);
+                    bounds.kmeans_bounds_set_upper(point, dist);
+                    evals++;
+                    stable = bounds.kmeans_bounds_stable(point, index);
+                }
+
+                if (!stable) {
+                    feature_dist_t min_dist = MAX_VALUE;
+                    feature_dist_t second_dist = MAX_VALUE;
+                    for (int c = 0; c < nclusters; c++) {
+                        feature_dist_t dist = point_dist(block, i, clusters + c * nfeatures, nfeatures);
+                        if (dist < min_dist) {
+                            second_dist = min_dist;
+                            min_dist = dist;
+                            index = c;
+                        } else if (dist < second_dist) {
+                            second_dist = dist;
+                        }
+                    }
+                    evals += nclusters;
+                    bounds.kmeans_bounds_set(point, min_dist, second_dist);
+                    membership[p] = index;
+                }
+
+                center_sum_t* center = partial.data() + index * nfeatures;
+                for (int f = 0; f < nfeatures; f++) center[f] += block[f * 16 + i];
+            }
+        }
+
+        m_partial_evals[t] = evals;
+    });
+
+    unsigned long evals = 0;
+    memset(new_centers, 0, centers_sz * sizeof(center_sum_t));
+    for (unsigned t = 0; t < nthreads; t++) {
+        const center_sum_t* partial = m_partial_centers[t].data();
+        for (unsigned i = 0; i < centers_sz; i++) new_centers[i] += partial[i];
+        evals += m_partial_evals[t];
+    }
+
+    return evals;
+}
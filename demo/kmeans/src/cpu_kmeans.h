@@ -0,0 +1,99 @@
+/**
+* Copyright (C) 2019-2021 Xilinx, Inc
+*
+* Licensed under the Apache License, Version 2.0 (the "License"). You may
+* not use this file except in compliance with the License. A copy of the
+* License is located at
+*
+*     http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+* WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the
+* License for the specific language governing permissions and limitations
+* under the License.
+*/
+
+#ifndef _H_CPU_KMEANS_
+#define _H_CPU_KMEANS_
+
+#include "kmeans_bounds.h"
+#include "kmeans_feature.h"
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/*
+   CPU fallback engine for the kmeans kernel.
+    operation: Same contract as one call of the kmeans kernel over the whole
+   point range. Works directly on the 16-point interleaved layout produced by
+   scale_and_remap_features(), so the FPGA and CPU paths share every host
+   buffer. Points are split in blocks of 16 across a persistent thread pool and
+   the distance loop is vectorized with AVX-512 or AVX2 when the host supports
+   it (selected at runtime), with a scalar fallback otherwise. The features are
+   in the FEATURE_BITS format of the kernel.
+*/
+class CPU_KMEANS {
+   public:
+    CPU_KMEANS();
+    ~CPU_KMEANS();
+
+    // nthreads <= 0 uses all the hardware threads of the host
+    int cpu_kmeans_init(int nthreads);
+
+    void cpu_kmeans_compute(const feature_t* feature,  /* in: remapped [npoints/16][nfeatures][16] */
+                            const feature_t* clusters, /* in: [nclusters][nfeatures] */
+                            int* membership,           /* out: [npoints] */
+                            center_sum_t* new_centers, /* out: [nclusters][nfeatures] sums */
+                            int npoints,
+                            int nclusters,
+                            int nfeatures);
+
+    // Bounds-pruned variant. membership holds the previous memberships on
+    // input and the points start at start_point in bounds. With group_points
+    // = 1 every point is pruned on its own (Hamerly), larger values model the
+    // pruned kmeans kernel, which only skips groups of group_points points
+    // that are all stable. Returns the number of point to cluster distances
+    // evaluated.
+    unsigned long cpu_kmeans_compute_bounds(const feature_t* feature,
+                                            const feature_t* clusters,
+                                            int* membership,
+                                            center_sum_t* new_centers,
+                                            int npoints,
+                                            int nclusters,
+                                            int nfeatures,
+                                            KMEANS_BOUNDS& bounds,
+                                            unsigned start_point,
+                                            int group_points);
+
+    const char* cpu_kmeans_isa() const { return m_isa; }
+    int cpu_kmeans_threads() const { return (int)m_workers.size(); }
+
+    typedef void (*nearest_block_fn)(const feature_t* block,
+                                     const feature_t* clusters,
+                                     int nclusters,
+                                     int nfeatures,
+                                     int index[16]);
+
+   private:
+    void worker(unsigned id);
+    void run(const std::function<void(unsigned)>& job);
+
+    nearest_block_fn m_nearest;
+    const char* m_isa;
+
+    std::vector<std::thread> m_workers;
+    std::vector<std::vector<center_sum_t> > m_partial_centers;
+    std::vector<unsigned long> m_partial_evals;
+    std::function<void(unsigned)> m_job;
+    std::mutex m_mutex;
+    std::condition_variable m_start_cv;
+    std::condition_variable m_done_cv;
+    unsigned m_generation;
+    unsigned m_pending;
+    bool m_stop;
+};
+
+#endif // _H_CPU_KMEANS_
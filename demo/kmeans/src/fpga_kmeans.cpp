@@ -15,53 +15,484 @@
 */
 
 #include "fpga_kmeans.h"
+#include <algorithm>
+#include <thread>
+
+using sda::utils::Profiler;
+using sda::utils::ScopedTimer;
+
+// Host regions of the performance summary
+static const Profiler::RegionId region_compute = Profiler::instance().region("Total K-Means Compute");
+static const Profiler::RegionId region_memberships = Profiler::instance().region("Compute Memberships");
+static const Profiler::RegionId region_delta = Profiler::instance().region("Update Delta");
+static const Profiler::RegionId region_centers = Profiler::instance().region("Update Centers");
+static const Profiler::RegionId region_clusters = Profiler::instance().region("Update Clusters");
+static const Profiler::RegionId region_init = Profiler::instance().region("Device Initialization");
+static const Profiler::RegionId region_alloc = Profiler::instance().region("Buffer Allocation");
+static const Profiler::RegionId region_overlap = Profiler::instance().region("Reduction Overlapped");
+static const Profiler::RegionId region_remap = Profiler::instance().region("Remap Features");
+static const Profiler::RegionId region_seed = Profiler::instance().region("Seed Centers");
 
-TIMER_INIT(7);
+/****************************************************************
 
-static float calculate_scale_factor(float* mem, int size) {
-    float min = mem[0];
-    float max = mem[0];
-    for (int i = 0; i < size; i++) {
-        float value = mem[i];
-        if (value < min) min = value;
-        if (value > max) max = value;
-    }
-    float diff = max - min;
-    float scale_factor = diff / 0x00FFFFFF;
+                      FEATURE QUANTIZATION
 
-    printf("Float to integer scale factor = %f MaxFloat=%f and MinFloat=%f \n", scale_factor, max, min);
+  Maps the float features onto the FEATURE_BITS format of the
+  kernel. Fixed point first subtracts the minimum of the dataset,
+  which leaves the distances unchanged and keeps negative features
+  representable, then rounds to the nearest code. Float features
+  are only remapped, without any pass to find their range.
 
-    return scale_factor;
+ ***************************************************************/
+template <typename F>
+static void run_threads(int nthreads, F job) {
+    std::vector<std::thread> threads;
+    for (int t = 1; t < nthreads; t++) threads.emplace_back(job, t);
+    job(0);
+    for (auto& thread : threads) thread.join();
 }
 
-void scale_clusters(unsigned int* scaled, float** clusters, int n, float scale_factor) {
-    for (int i = 0; i < n; i++) {
-        scaled[i] = (unsigned int)((float)clusters[0][i] / (float)scale_factor);
-    }
+static feature_scale calculate_feature_scale(float** features, int npoints, int nfeatures, int nthreads) {
+    feature_scale scale = {0.0, 1.0, 1.0, 0.0};
+#if FEATURE_BITS != 0
+    nthreads = std::max(1, std::min(nthreads, npoints / 1024));
+    std::vector<float> partial_min(nthreads, features[0][0]);
+    std::vector<float> partial_max(nthreads, features[0][0]);
+
+    run_threads(nthreads, [&](int t) {
+        size_t first = (size_t)npoints * t / nthreads * nfeatures;
+        size_t last = (size_t)npoints * (t + 1) / nthreads * nfeatures;
+        float min = partial_min[t];
+        float max = partial_max[t];
+        for (size_t i = first; i < last; i++) {
+            float value = features[0][i];
+            min = std::min(min, value);
+            max = std::max(max, value);
+        }
+        partial_min[t] = min;
+        partial_max[t] = max;
+    });
+
+    float min = *std::min_element(partial_min.begin(), partial_min.end());
+    float max = *std::max_element(partial_max.begin(), partial_max.end());
+
+    scale.offset = min;
+    scale.max_code = FEATURE_MAX_CODE;
+    if (max > min) scale.step = ((double)max - min) / FEATURE_MAX_CODE;
+    scale.inv_step = 1.0 / scale.step;
+
+    printf("Float to %d-bit fixed point step = %g MaxFloat=%f and MinFloat=%f \n", FEATURE_BITS, scale.step, max,
+           min);
+#endif
+    return scale;
 }
 
-void scale_features(unsigned int* scaled, float** features, int n, float scale_factor) {
-    for (int i = 0; i < n; i++) {
-        scaled[i] = (unsigned int)((float)features[0][i] / (float)scale_factor);
-    }
+template <typename T>
+static inline T quantize(float value, const feature_scale& scale);
+
+// The conversion goes through a signed int, which vectorizes, offset by 2^31
+// to cover the whole unsigned range
+template <>
+inline unsigned int quantize<unsigned int>(float value, const feature_scale& scale) {
+    double code = ((double)value - scale.offset) * scale.inv_step + 0.5;
+    code = std::min(std::max(code, 0.0), scale.max_code);
+    return (unsigned int)(int)(code - 2147483648.0) + 2147483648u;
+}
+
+template <>
+inline float quantize<float>(float value, const feature_scale&) {
+    return value;
 }
 
-void scale_and_remap_features(
-    unsigned int* remapped, float** features, int npoints, int nfeatures, float scale_factor) {
-    unsigned ptr = 0;
-    for (int p = 0; p < npoints; p += 16) {
-        for (int f = 0; f < nfeatures; f++) {
+template <typename T>
+static void scale_clusters(T* scaled, float** clusters, int n, const feature_scale& scale) {
+    for (int i = 0; i < n; i++) scaled[i] = quantize<T>(clusters[0][i], scale);
+}
+
+// Each thread remaps whole blocks of 16 points. A point is converted in one
+// contiguous, vectorizable pass, then spread over the [nfeatures][16] block.
+template <typename T>
+static void scale_and_remap_features(
+    T* remapped, float** features, int npoints, int nfeatures, const feature_scale& scale, int nthreads) {
+    int nblocks = (npoints + 15) / 16;
+    nthreads = std::max(1, std::min(nthreads, nblocks / 64));
+
+    run_threads(nthreads, [&](int t) {
+        std::vector<T> row(nfeatures);
+        int first = (long)nblocks * t / nthreads;
+        int last = (long)nblocks * (t + 1) / nthreads;
+
+        for (int b = first; b < last; b++) {
+            T* block = remapped + (size_t)b * nfeatures * 16;
             for (int i = 0; i < 16; i++) {
-                if ((p + i) < npoints) {
-                    remapped[ptr++] = features[p + i][f] / scale_factor;
+                int p = b * 16 + i;
+                if (p < npoints) {
+                    const float* point = features[p];
+                    for (int f = 0; f < nfeatures; f++) row[f] = quantize<T>(point[f], scale);
+                    for (int f = 0; f < nfeatures; f++) block[f * 16 + i] = row[f];
                 } else {
-                    remapped[ptr++] = 0;
+                    for (int f = 0; f < nfeatures; f++) block[f * 16 + i] = 0;
                 }
             }
         }
+    });
+}
+
+/****************************************************************
+
+                      FPGA KMEANS REDUCE()
+
+  Folds the results of one work item into the host state:
+  membership delta, cluster sizes and center sums. Only touches
+  the point range of that item so it can run while the CUs are
+  still busy with the next ones.
+
+ ***************************************************************/
+int FPGA_KMEANS::fpga_kmeans_reduce(int* membership,
+                                    int* new_centers_len,
+                                    center_sum_t** new_centers,
+                                    const center_sum_t* partial_centers,
+                                    unsigned start_point,
+                                    unsigned npoints) {
+    int delta = 0;
+    unsigned end_point = start_point + npoints;
+
+    ScopedTimer delta_timer(region_delta);
+    for (unsigned p = start_point; p < end_point; p++) {
+        if (m_new_memberships[p] != membership[p]) {
+            delta++;
+            membership[p] = m_new_memberships[p];
+        }
+    }
+    delta_timer.stop();
+
+    ScopedTimer centers_timer(region_centers);
+    for (unsigned p = start_point; p < end_point; p++) {
+        int index = m_new_memberships[p];
+        new_centers_len[index]++;
+    }
+    // Sum the partial centers computed by this work item to form the actual
+    // new centers
+    for (unsigned c = 0, i = 0; c < m_nclusters; c++) {
+        for (unsigned f = 0; f < m_nfeatures; f++, i++) {
+            new_centers[c][f] += partial_centers[i];
+        }
+    }
+    centers_timer.stop();
+
+    return delta;
+}
+/****************************************************************
+
+                    FPGA KMEANS REMAP TILE()
+
+  Scales and remaps the points of one tile into a staging slot
+  of m_scaled_feature. When the dataset does not fit in one tile
+  this runs every iteration, overlapped with the device working
+  on the previous tile.
+
+ ***************************************************************/
+unsigned FPGA_KMEANS::fpga_kmeans_tile_npoints(unsigned tile) {
+    return std::min(m_tile_points, m_npoints - tile * m_tile_points);
+}
+
+unsigned FPGA_KMEANS::fpga_kmeans_tile_items(unsigned tile) {
+    return (fpga_kmeans_tile_npoints(tile) + m_item_points - 1) / m_item_points;
+}
+
+unsigned FPGA_KMEANS::fpga_kmeans_item_npoints(unsigned tile, unsigned item) {
+    return std::min(m_item_points, fpga_kmeans_tile_npoints(tile) - item * m_item_points);
+}
+
+void FPGA_KMEANS::fpga_kmeans_remap_tile(float** feature, unsigned tile, unsigned slot) {
+    ScopedTimer timer(region_remap);
+    feature_t* staging = m_scaled_feature + (size_t)slot * m_tile_points * m_nfeatures;
+    scale_and_remap_features(staging, feature + tile * m_tile_points, fpga_kmeans_tile_npoints(tile), m_nfeatures,
+                             m_scale, m_remap_threads);
+}
+
+#ifdef KMEANS_PRUNING
+/****************************************************************
+
+                   FPGA KMEANS SKIP GROUPS()
+
+  Sets the skip bit of every group of PARALLEL_POINTS points of a
+  tile whose points all provably keep their cluster. The work
+  items start on a group boundary, so the bits of an item start
+  at bit start_point / PARALLEL_POINTS. Returns the number of
+  skipped groups.
+
+ ***************************************************************/
+unsigned FPGA_KMEANS::fpga_kmeans_skip_groups(unsigned tile, unsigned slot) {
+    unsigned tile_start = tile * m_tile_points;
+    unsigned tile_npoints = fpga_kmeans_tile_npoints(tile);
+    std::vector<unsigned int>& flags = m_skip_flags[slot];
+    unsigned nskipped = 0;
+    unsigned long evals = 0;
+
+    std::fill(flags.begin(), flags.end(), 0);
+    for (unsigned g = 0; g * PARALLEL_POINTS < tile_npoints; g++) {
+        unsigned group_start = tile_start + g * PARALLEL_POINTS;
+        unsigned group_npoints = std::min((unsigned)PARALLEL_POINTS, tile_npoints - g * PARALLEL_POINTS);
+
+        if (m_bounds &&
+            m_bounds->kmeans_bounds_group_stable(group_start, group_npoints, m_new_memberships + group_start)) {
+            flags[g / 32] |= 1u << (g % 32);
+            nskipped++;
+        } else {
+            evals += (unsigned long)group_npoints * m_nclusters;
+        }
+    }
+
+    if (m_bounds) m_bounds_evals.back() += evals;
+
+    return nskipped;
+}
+
+// Exact bounds of the points of the groups a work item did not skip
+void FPGA_KMEANS::fpga_kmeans_update_bounds(unsigned tile,
+                                            unsigned slot,
+                                            unsigned start_point,
+                                            unsigned npoints) {
+    unsigned tile_start = tile * m_tile_points;
+    const std::vector<unsigned int>& flags = m_skip_flags[slot];
+
+    for (unsigned g = 0; g * PARALLEL_POINTS < npoints; g++) {
+        unsigned bit = start_point / PARALLEL_POINTS + g;
+        if (flags[bit / 32] & (1u << (bit % 32))) continue;
+
+        unsigned group_end = std::min((g + 1) * PARALLEL_POINTS, npoints);
+        for (unsigned p = tile_start + start_point + g * PARALLEL_POINTS; p < tile_start + start_point + group_end;
+             p++) {
+            m_bounds->kmeans_bounds_set(p, m_new_bounds[2 * p], m_new_bounds[2 * p + 1]);
+        }
+    }
+}
+#endif
+
+#ifdef __USE_OPENCL__
+/****************************************************************
+
+                    FPGA KMEANS UPLOAD TILE()
+
+  Prepares the device for the work items of one tile: upload of
+  the tile (streaming mode only) and of its skip bits. Tile t
+  uses the buffers of slot t % 2, which the scheduler only hands
+  out once every work item of tile t - 2 was collected.
+
+ ***************************************************************/
+void FPGA_KMEANS::fpga_kmeans_upload_tile(float** feature,
+                                          unsigned tile,
+                                          const std::vector<cl::Event>& cluster_event) {
+    cl_int err;
+    unsigned slot = tile % 2;
+    unsigned tile_npoints = fpga_kmeans_tile_npoints(tile);
+    std::vector<cl::Event>& wait_write = m_tile_events[slot];
+
+    wait_write = cluster_event;
+    if (m_num_tiles > 1) {
+        fpga_kmeans_remap_tile(feature, tile, slot);
+
+        size_t tile_feature_sz = sizeof(feature_t) * ((tile_npoints + 15) / 16) * 16 * m_nfeatures;
+        wait_write.emplace_back();
+        OCL_CHECK(err, err = m_q.enqueueWriteBuffer(m_buf_feature[slot], CL_FALSE, 0, tile_feature_sz,
+                                                    m_scaled_feature + (size_t)slot * m_tile_points * m_nfeatures,
+                                                    nullptr, &wait_write.back()));
+    }
+
+#ifdef KMEANS_PRUNING
+    unsigned tile_start = tile * m_tile_points;
+    unsigned nskipped = fpga_kmeans_skip_groups(tile, slot);
+    wait_write.emplace_back();
+    OCL_CHECK(err, err = m_q.enqueueWriteBuffer(m_buf_skip[slot], CL_FALSE, 0,
+                                                sizeof(unsigned int) * m_skip_flags[slot].size(),
+                                                m_skip_flags[slot].data(), nullptr, &wait_write.back()));
+    // Skipped groups read their previous memberships from the members buffer
+    // of the slot, which holds another tile when there are more than two
+    if (nskipped > 0 && m_num_tiles > 2) {
+        wait_write.emplace_back();
+        OCL_CHECK(err, err = m_q.enqueueWriteBuffer(m_buf_members[slot], CL_FALSE, 0,
+                                                    sizeof(int) * ((tile_npoints + 15) / 16) * 16,
+                                                    m_new_memberships + tile_start, nullptr, &wait_write.back()));
+    }
+#endif
+}
+/****************************************************************
+
+                    FPGA KMEANS ENQUEUE ITEM()
+
+  Runs the work item of a slot on the CU of that slot: one task
+  that only waits for the uploads of its tile, the readbacks of
+  its memberships, partial centers and bounds, and a marker whose
+  callback queues the slot for the host once they all completed.
+
+ ***************************************************************/
+void FPGA_KMEANS::fpga_kmeans_enqueue_item(unsigned slot, cl::Buffer& buf_cluster) {
+    cl_int err;
+    work_slot& work = m_work_slots[slot];
+    cl::Kernel& kernel = m_kernel_kmeans[work.cu];
+    unsigned tile_slot = work.tile % 2;
+    unsigned tile_start = work.tile * m_tile_points;
+    unsigned start_point = work.item * m_item_points;
+    unsigned npoints = fpga_kmeans_item_npoints(work.tile, work.item);
+    unsigned nclusters = m_nclusters;
+    unsigned nfeatures = m_nfeatures;
+    unsigned feature_offset = nfeatures * (start_point / 16);
+    unsigned members_offset = start_point / 16;
+    unsigned members_sz = sizeof(int) * ((npoints + 15) / 16) * 16;
+
+    int narg = 0;
+    OCL_CHECK(err, err = kernel.setArg(narg++, m_buf_feature[tile_slot]));
+    OCL_CHECK(err, err = kernel.setArg(narg++, buf_cluster));
+    OCL_CHECK(err, err = kernel.setArg(narg++, m_buf_members[tile_slot]));
+    OCL_CHECK(err, err = kernel.setArg(narg++, work.buf_centers));
+    OCL_CHECK(err, err = kernel.setArg(narg++, sizeof(cl_int), (void*)&npoints));
+    OCL_CHECK(err, err = kernel.setArg(narg++, sizeof(cl_int), (void*)&nclusters));
+    OCL_CHECK(err, err = kernel.setArg(narg++, sizeof(cl_int), (void*)&nfeatures));
+    OCL_CHECK(err, err = kernel.setArg(narg++, sizeof(cl_int), (void*)&feature_offset));
+    OCL_CHECK(err, err = kernel.setArg(narg++, sizeof(cl_int), (void*)&members_offset));
+#ifdef KMEANS_PRUNING
+    unsigned skip_offset = start_point / PARALLEL_POINTS;
+    OCL_CHECK(err, err = kernel.setArg(narg++, m_buf_members[tile_slot]));
+    OCL_CHECK(err, err = kernel.setArg(narg++, m_buf_skip[tile_slot]));
+    OCL_CHECK(err, err = kernel.setArg(narg++, m_buf_bounds[tile_slot]));
+    OCL_CHECK(err, err = kernel.setArg(narg++, sizeof(cl_int), (void*)&skip_offset));
+#endif
+
+    std::vector<cl::Event> wait_task(1);
+    OCL_CHECK(err, err = m_q.enqueueTask(kernel, &m_tile_events[tile_slot], &wait_task[0]));
+    work.task_event = wait_task[0];
+
+    std::vector<cl::Event> read_events(2);
+    OCL_CHECK(err, err = m_q.enqueueReadBuffer(m_buf_members[tile_slot], CL_FALSE, start_point * sizeof(int),
+                                               members_sz, m_new_memberships + tile_start + start_point, &wait_task,
+                                               &read_events[0]));
+    OCL_CHECK(err, err = m_q.enqueueReadBuffer(work.buf_centers, CL_FALSE, 0, m_buf_centers_sz, work.new_centers,
+                                               &wait_task, &read_events[1]));
+#ifdef KMEANS_PRUNING
+    if (m_bounds) {
+        read_events.emplace_back();
+        OCL_CHECK(err, err = m_q.enqueueReadBuffer(
+                           m_buf_bounds[tile_slot], CL_FALSE, 2 * sizeof(double) * start_point, 4 * members_sz,
+                           m_new_bounds + 2 * (tile_start + start_point), &wait_task, &read_events.back()));
     }
+#endif
+
+    cl::Event done;
+    OCL_CHECK(err, err = m_q.enqueueMarkerWithWaitList(&read_events, &done));
+    OCL_CHECK(err, err = done.setCallback(CL_COMPLETE, fpga_kmeans_item_done, &work));
+    m_q.flush();
+}
+
+// Called by the OpenCL runtime, from one of its threads, when all the
+// readbacks of a work item completed, or with a negative status when one of
+// its commands failed
+void CL_CALLBACK FPGA_KMEANS::fpga_kmeans_item_done(cl_event event, cl_int status, void* data) {
+    work_slot* work = (work_slot*)data;
+    FPGA_KMEANS* owner = work->owner;
+    {
+        std::lock_guard<std::mutex> lock(owner->m_done_mutex);
+        work->status = status;
+        owner->m_done_slots.push_back(work->index);
+    }
+    owner->m_done_cv.notify_one();
 }
 
+unsigned FPGA_KMEANS::fpga_kmeans_wait_item() {
+    std::unique_lock<std::mutex> lock(m_done_mutex);
+    m_done_cv.wait(lock, [this] { return !m_done_slots.empty(); });
+    unsigned slot = m_done_slots.front();
+    m_done_slots.pop_front();
+    return slot;
+}
+/****************************************************************
+
+                     FPGA KMEANS RUN QUEUE()
+
+  Runs one iteration as a work queue: the tiles are split in
+  work items of m_item_points points, handed out in order to
+  whichever CU has a free slot. Every CU keeps KMEANS_CU_DEPTH
+  items queued, and gets its next item as soon as the host has
+  collected one, so faster CUs simply run more items. The
+  results of each item are reduced while the CUs are still busy
+  with the following ones. When an item fails no further item is
+  handed out, the items in flight are collected and -1 returned.
+
+ ***************************************************************/
+int FPGA_KMEANS::fpga_kmeans_run_queue(float** feature,
+                                       cl::Buffer& buf_cluster,
+                                       const std::vector<cl::Event>& cluster_event,
+                                       int* membership,
+                                       int* new_centers_len,
+                                       center_sum_t** new_centers) {
+    int delta = 0;
+    unsigned next_tile = 0;
+    unsigned next_item = 0;
+    unsigned in_flight = 0;
+    bool failed = false;
+    std::vector<unsigned> pending(m_num_tiles);
+    std::deque<unsigned> free_slots;
+
+    for (unsigned t = 0; t < m_num_tiles; t++) pending[t] = fpga_kmeans_tile_items(t);
+    for (unsigned s = 0; s < m_work_slots.size(); s++) free_slots.push_back(s);
+
+    while (true) {
+        // Hand out the next items, as long as the staging slot of their tile
+        // is no longer used by the tile two before
+        while (!failed && !free_slots.empty() && next_tile < m_num_tiles &&
+               (next_tile < 2 || pending[next_tile - 2] == 0)) {
+            if (next_item == 0) fpga_kmeans_upload_tile(feature, next_tile, cluster_event);
+
+            unsigned slot = free_slots.front();
+            free_slots.pop_front();
+            m_work_slots[slot].tile = next_tile;
+            m_work_slots[slot].item = next_item;
+            fpga_kmeans_enqueue_item(slot, buf_cluster);
+            in_flight++;
+
+            if (++next_item == fpga_kmeans_tile_items(next_tile)) {
+                next_tile++;
+                next_item = 0;
+            }
+        }
+        if (in_flight == 0) break;
+
+        ScopedTimer wait_timer(region_memberships);
+        unsigned slot = fpga_kmeans_wait_item();
+        wait_timer.stop();
+        in_flight--;
+
+        work_slot& work = m_work_slots[slot];
+        pending[work.tile]--;
+        free_slots.push_back(slot);
+        if (work.status != CL_COMPLETE) {
+            fprintf(stderr, "Error: Work item %u of tile %u failed on CU %u with status %d\n", work.item, work.tile,
+                    work.cu, work.status);
+            failed = true;
+        }
+        // The results of the items that complete after a failure are dropped
+        if (failed) continue;
+
+        unsigned start_point = work.item * m_item_points;
+        unsigned npoints = fpga_kmeans_item_npoints(work.tile, work.item);
+        cl_ulong start = work.task_event.getProfilingInfo<CL_PROFILING_COMMAND_START>();
+        cl_ulong end = work.task_event.getProfilingInfo<CL_PROFILING_COMMAND_END>();
+        m_cu_busy_ms[work.cu] += (end - start) / 1000000.0;
+        m_cu_items[work.cu]++;
+
+#ifdef KMEANS_PRUNING
+        if (m_bounds) fpga_kmeans_update_bounds(work.tile, work.tile % 2, start_point, npoints);
+#endif
+
+        ScopedTimer overlap_timer(region_overlap, in_flight > 0);
+        delta += fpga_kmeans_reduce(membership, new_centers_len, new_centers, work.new_centers,
+                                    work.tile * m_tile_points + start_point, npoints);
+        overlap_timer.stop();
+    }
+
+    return failed ? -1 : delta;
+}
+#endif
 /****************************************************************
 
                       FPGA KMEANS COMPUTE()
@@ -72,7 +503,7 @@ void FPGA_KMEANS::fpga_kmeans_compute(float** feature, // in: [npoints][nfeature
                                       int* membership,
                                       float** clusters,
                                       int* new_centers_len,
-                                      unsigned int** new_centers) {
+                                      center_sum_t** new_centers) {
     int loop = 0;
     int delta = 0;
 
@@ -80,40 +511,32 @@ void FPGA_KMEANS::fpga_kmeans_compute(float** feature, // in: [npoints][nfeature
     int n_points = m_npoints;
     int n_clusters = m_nclusters;
 
-    float scale_factor = calculate_scale_factor(feature[0], n_points * n_features);
-    scale_and_remap_features(m_scaled_feature, feature, n_points, n_features, scale_factor);
+    // When the whole dataset fits in one tile it is remapped (and uploaded)
+    // once for all the calls on this dataset, otherwise the tiles are streamed
+    // through two staging slots on every iteration
+    bool new_dataset =
+        (feature != m_scaled_source || n_points != m_scaled_npoints || n_features != m_scaled_nfeatures);
+    if (new_dataset) {
+        m_scale = calculate_feature_scale(feature, n_points, n_features, m_remap_threads);
+        if (m_num_tiles == 1) fpga_kmeans_remap_tile(feature, 0, 0);
+        m_scaled_source = feature;
+        m_scaled_npoints = n_points;
+        m_scaled_nfeatures = n_features;
+    }
+
+    if (m_bounds) {
+        m_bounds->kmeans_bounds_reset(n_points, n_clusters, n_features);
+        m_bounds_evals.clear();
+    }
 
 #ifdef __USE_OPENCL__
     cl_int err;
 
-    // Set kernel arguments up front - they do need to change during the rest of
-    // the computation
-    for (unsigned i = 0; i < m_num_cu_calls; i++) {
-        unsigned start_point = i * m_num_points_per_cu;
-        unsigned npoints = std::min(m_num_points_per_cu, n_points - start_point);
-        unsigned nclusters = n_clusters;
-        unsigned nfeatures = n_features;
-        unsigned feature_offset = nfeatures * (start_point / 16);
-        unsigned members_offset = start_point / 16;
-
-        int narg = 0;
-        OCL_CHECK(err, err = m_kernel_kmeans[i].setArg(narg++, m_buf_feature));
-        OCL_CHECK(err, err = m_kernel_kmeans[i].setArg(narg++, m_buf_cluster));
-        OCL_CHECK(err, err = m_kernel_kmeans[i].setArg(narg++, m_buf_members));
-        OCL_CHECK(err, err = m_kernel_kmeans[i].setArg(narg++, m_buf_centers[i]));
-        OCL_CHECK(err, err = m_kernel_kmeans[i].setArg(narg++, sizeof(cl_int), (void*)&npoints));
-        OCL_CHECK(err, err = m_kernel_kmeans[i].setArg(narg++, sizeof(cl_int), (void*)&nclusters));
-        OCL_CHECK(err, err = m_kernel_kmeans[i].setArg(narg++, sizeof(cl_int), (void*)&nfeatures));
-        OCL_CHECK(err, err = m_kernel_kmeans[i].setArg(narg++, sizeof(cl_int), (void*)&feature_offset));
-        OCL_CHECK(err, err = m_kernel_kmeans[i].setArg(narg++, sizeof(cl_int), (void*)&members_offset));
-    }
-
-    // Write features to the device
-    OCL_CHECK(err, err = m_q.enqueueWriteBuffer(m_buf_feature, CL_TRUE, 0, m_buf_feature_sz, m_scaled_feature, nullptr,
-                                                nullptr));
-
-    OCL_CHECK(err, err = m_q.enqueueMigrateMemObjects({m_buf_feature}, 0, nullptr, nullptr));
-    m_q.enqueueBarrier();
+    if (!m_cpu_engine && m_num_tiles == 1 && new_dataset) {
+        // Write features to the device
+        OCL_CHECK(err, err = m_q.enqueueWriteBuffer(m_buf_feature[0], CL_TRUE, 0, m_buf_feature_sz, m_scaled_feature,
+                                                    nullptr, nullptr));
+    }
 #endif
 
     /* iterate until convergence */
@@ -123,90 +546,113 @@ void FPGA_KMEANS::fpga_kmeans_compute(float** feature, // in: [npoints][nfeature
         printf(" %3d ", loop);
         fflush(stdout);
 
-        scale_clusters(m_scaled_clusters, clusters, n_clusters * n_features, scale_factor);
-
-        TIMER_START(1);
-
-#ifdef __USE_OPENCL__
-
-        // Schedule the writing of updated clusters values to the device
-        OCL_CHECK(err, err = m_q.enqueueWriteBuffer(m_buf_cluster, CL_TRUE, 0, m_buf_cluster_sz, m_scaled_clusters,
-                                                    nullptr, nullptr));
+        scale_clusters(m_scaled_clusters, clusters, n_clusters * n_features, m_scale);
 
-        // Schedule kernel execution
-        for (unsigned i = 0; i < m_num_cu_calls; i++) {
-            OCL_CHECK(err, err = m_q.enqueueTask(m_kernel_kmeans[i], nullptr, nullptr));
+        if (m_bounds) {
+            m_bounds->kmeans_bounds_move_centers(m_scaled_clusters, m_new_memberships);
+            m_bounds_evals.push_back(0);
         }
 
-        // Ensure enqueueReadBuffer happens after all the enqueueTask have completed
-        m_q.enqueueBarrier();
+        delta = 0;
 
-        // Schedule the reading of new memberships values back to the host
-        OCL_CHECK(err, err = m_q.enqueueReadBuffer(m_buf_members, CL_TRUE, 0, m_buf_members_sz, m_new_memberships,
-                                                   nullptr, nullptr));
+        if (m_cpu_engine) {
+            center_sum_t* partial_centers = m_work_slots[0].new_centers;
+            for (unsigned t = 0; t < m_num_tiles; t++) {
+                unsigned start_point = t * m_tile_points;
+                unsigned npoints = fpga_kmeans_tile_npoints(t);
 
-        for (unsigned i = 0; i < m_num_cu_calls; i++) {
-            OCL_CHECK(err, err = m_q.enqueueReadBuffer(m_buf_centers[i], CL_TRUE, 0, m_buf_centers_sz, m_new_centers[i],
-                                                       nullptr, nullptr));
-        }
+                if (m_num_tiles > 1) fpga_kmeans_remap_tile(feature, t, 0);
 
-// enqueueReadBuffer is blocking (CL_TRUE), so no need for m_q.finish();
+                ScopedTimer compute_timer(region_memberships);
+                if (m_bounds) {
+                    m_bounds_evals.back() += m_cpu_engine->cpu_kmeans_compute_bounds(
+                        m_scaled_feature, m_scaled_clusters, m_new_memberships + start_point, partial_centers, npoints,
+                        n_clusters, n_features, *m_bounds, start_point, m_bounds_group);
+                } else {
+                    m_cpu_engine->cpu_kmeans_compute(m_scaled_feature, m_scaled_clusters,
+                                                     m_new_memberships + start_point, partial_centers, npoints,
+                                                     n_clusters, n_features);
+                }
+                compute_timer.stop();
 
+                delta += fpga_kmeans_reduce(membership, new_centers_len, new_centers, partial_centers, start_point,
+                                            npoints);
+            }
+        } else {
+#ifdef __USE_OPENCL__
+            // The cluster buffer is double buffered so the upload of this
+            // iteration never depends on commands of the previous one in the
+            // out-of-order queue
+            cl::Buffer& buf_cluster = m_buf_cluster[loop % 2];
+            std::vector<cl::Event> write_event(1);
+
+            // Schedule the writing of updated clusters values to the device
+            OCL_CHECK(err, err = m_q.enqueueWriteBuffer(buf_cluster, CL_FALSE, 0, m_buf_cluster_sz, m_scaled_clusters,
+                                                        nullptr, &write_event[0]));
+
+            delta =
+                fpga_kmeans_run_queue(feature, buf_cluster, write_event, membership, new_centers_len, new_centers);
+            if (delta < 0) {
+                fprintf(stderr, "Error: Iteration %d of the FPGA kmeans failed\n", loop);
+                exit(EXIT_FAILURE);
+            }
 #else
-        for (unsigned i = 0; i < m_num_cu_calls; i++) {
-            unsigned start_point = i * m_num_points_per_cu;
-            unsigned npoints = std::min(m_num_points_per_cu, n_points - start_point);
-            unsigned nclusters = n_clusters;
-            unsigned nfeatures = n_features;
-            unsigned feature_offset = nfeatures * (start_point / 16);
-            unsigned members_offset = start_point / 16;
-
-            kmeans_kernel_wrapper(m_scaled_feature, m_scaled_clusters, m_new_memberships, m_new_centers[i], npoints,
-                                  nclusters, nfeatures, feature_offset, members_offset);
-        }
+            // Without the device the kernel model runs the work items in order
+            work_slot& work = m_work_slots[0];
+            for (unsigned t = 0; t < m_num_tiles; t++) {
+                unsigned tile_start = t * m_tile_points;
+
+                if (m_num_tiles > 1) fpga_kmeans_remap_tile(feature, t, 0);
+#ifdef KMEANS_PRUNING
+                fpga_kmeans_skip_groups(t, 0);
 #endif
-        TIMER_STOP;
 
-        TIMER_START(2);
-        delta = 0;
-        for (int p = 0; p < n_points; p++) {
-            if (m_new_memberships[p] != membership[p]) {
-                delta++;
-                membership[p] = m_new_memberships[p];
-            }
-        }
-        TIMER_STOP;
+                for (unsigned i = 0; i < fpga_kmeans_tile_items(t); i++) {
+                    unsigned start_point = i * m_item_points;
+                    unsigned npoints = fpga_kmeans_item_npoints(t, i);
+                    unsigned nclusters = n_clusters;
+                    unsigned nfeatures = n_features;
+                    unsigned feature_offset = nfeatures * (start_point / 16);
+                    unsigned members_offset = start_point / 16;
+
+                    ScopedTimer kernel_timer(region_memberships);
+#ifdef KMEANS_PRUNING
+                    kmeans_kernel_wrapper(m_scaled_feature, m_scaled_clusters, m_new_memberships + tile_start,
+                                          work.new_centers, npoints, nclusters, nfeatures, feature_offset,
+                                          members_offset, m_new_memberships + tile_start, m_skip_flags[0].data(),
+                                          m_new_bounds + 2 * tile_start, start_point / PARALLEL_POINTS);
+                    if (m_bounds) fpga_kmeans_update_bounds(t, 0, start_point, npoints);
+#else
+                    kmeans_kernel_wrapper(m_scaled_feature, m_scaled_clusters, m_new_memberships + tile_start,
+                                          work.new_centers, npoints, nclusters, nfeatures, feature_offset,
+                                          members_offset);
+#endif
+                    kernel_timer.stop();
+                    m_cu_items[work.cu]++;
 
-        TIMER_START(3);
-        for (int p = 0; p < n_points; p++) {
-            int index = m_new_memberships[p];
-            new_centers_len[index]++;
-        }
-        // Sum the partial centers computed by each CU to form the actual new
-        // centers
-        for (int c = 0, i = 0; c < n_clusters; c++) {
-            for (int f = 0; f < n_features; f++, i++) {
-                for (unsigned cu = 0; cu < m_num_cu_calls; cu++) {
-                    new_centers[c][f] += m_new_centers[cu][i];
+                    delta += fpga_kmeans_reduce(membership, new_centers_len, new_centers, work.new_centers,
+                                                tile_start + start_point, npoints);
                 }
             }
+#endif
         }
-        TIMER_STOP;
 
-        TIMER_START(4);
+        ScopedTimer clusters_timer(region_clusters);
         for (int c = 0; c < n_clusters; c++) {
             for (int f = 0; f < n_features; f++) {
-                if (new_centers_len[c] > 0)
-                    clusters[c][f] =
-                        (new_centers[c][f] * scale_factor) / new_centers_len[c]; /* take average i.e. sum/n */
-                new_centers[c][f] = 0.0;                                         /* set back to 0 */
+                if (new_centers_len[c] > 0) /* take average i.e. sum/n, back to float */
+                    clusters[c][f] = m_scale.offset + ((double)new_centers[c][f] / new_centers_len[c]) * m_scale.step;
+                new_centers[c][f] = 0; /* set back to 0 */
             }
             new_centers_len[c] = 0; /* set back to 0 */
         }
-        TIMER_STOP;
+        clusters_timer.stop();
 
     } while ((delta > threshold) && (loop < 1000)); /* makes sure loop terminates */
 
+    m_iterations += loop;
+    m_last_iterations = loop;
+
     printf("\nNumber of iterations : %d \n", loop);
 }
 /****************************************************************
@@ -222,18 +668,10 @@ float** FPGA_KMEANS::fpga_kmeans_clustering(float** feature, // in: [npoints][nf
     int npoints = m_npoints;
     int nclusters = m_nclusters;
 
-    int temp, i, j, n = 0;
+    int i;
     int* new_centers_len;       /* [nclusters]: no. of points in each cluster */
     float** clusters;           /* out: [nclusters][nfeatures] */
-    unsigned int** new_centers; /* [nclusters][nfeatures] */
-
-    int* initial; /* used to hold the index of points not yet selected
-                                   prevents the "birthday problem" of dual
-                     selection (?)
-                                   considered holding initial cluster indices, but
-                     changed due to
-                                   possible, though unlikely, infinite loops */
-    int initial_points;
+    center_sum_t** new_centers; /* [nclusters][nfeatures] */
 
     /* nclusters should never be > npoints
        that would guarantee a cluster without points */
@@ -252,29 +690,14 @@ float** FPGA_KMEANS::fpga_kmeans_clustering(float** feature, // in: [npoints][nf
     }
     for (i = 1; i < nclusters; i++) clusters[i] = clusters[i - 1] + nfeatures;
 
-    /* initialize the random clusters */
-    initial = (int*)malloc(npoints * sizeof(int));
-    if (initial == nullptr) {
-        fprintf(stderr, "Error: Failed to allocate memory for initial\n");
-        exit(EXIT_FAILURE);
-    }
-    for (i = 0; i < npoints; i++) {
-        initial[i] = i;
-    }
-    initial_points = npoints;
-
-    /* randomly pick cluster centers */
-    for (i = 0; i < nclusters && initial_points >= 0; i++) {
-        for (j = 0; j < nfeatures; j++) clusters[i][j] = feature[initial[n]][j]; // remapped
-
-        /* swap the selected index to the end (not really necessary,
-           could just move the end up) */
-        temp = initial[n];
-        initial[n] = initial[initial_points - 1];
-        initial[initial_points - 1] = temp;
-        initial_points--;
-        n++;
-    }
+    /* pick the initial cluster centers */
+    auto seed_start = std::chrono::high_resolution_clock::now();
+    ScopedTimer seed_timer(region_seed);
+    kmeans_seed_centers(m_seed, feature, npoints, nfeatures, nclusters, clusters, m_seed_threads, m_seed_rng);
+    seed_timer.stop();
+    auto seed_end = std::chrono::high_resolution_clock::now();
+    m_last_seed_ms = std::chrono::duration<double, std::milli>(seed_end - seed_start).count();
+    printf("Seeded %d centers with %s in %.4f ms\n", nclusters, kmeans_seed_name(m_seed), m_last_seed_ms);
 
     /* initialize the membership to -1 for all */
     for (i = 0; i < npoints; i++) membership[i] = -1;
@@ -286,12 +709,12 @@ float** FPGA_KMEANS::fpga_kmeans_clustering(float** feature, // in: [npoints][nf
         exit(EXIT_FAILURE);
     }
 
-    new_centers = (unsigned int**)malloc(nclusters * sizeof(unsigned int*));
+    new_centers = (center_sum_t**)malloc(nclusters * sizeof(center_sum_t*));
     if (new_centers == nullptr) {
         fprintf(stderr, "Error: Failed to allocate memory for new_centers\n");
         exit(EXIT_FAILURE);
     }
-    new_centers[0] = (unsigned int*)calloc(nclusters * nfeatures, sizeof(unsigned int));
+    new_centers[0] = (center_sum_t*)calloc(nclusters * nfeatures, sizeof(center_sum_t));
     if (new_centers[0] == nullptr) {
         fprintf(stderr, "Error: Failed to allocate memory for new_centers[0]\n");
         exit(EXIT_FAILURE);
@@ -299,14 +722,14 @@ float** FPGA_KMEANS::fpga_kmeans_clustering(float** feature, // in: [npoints][nf
     for (i = 1; i < nclusters; i++) new_centers[i] = new_centers[i - 1] + nfeatures;
 
     /* iterate until convergence */
-    TIMER_START(0);
+    ScopedTimer compute_timer(region_compute);
     fpga_kmeans_compute(feature,               /* in: [npoints][nfeatures] */
                         threshold, membership, /* which cluster the point belongs to */
                         clusters,              /* out: [nclusters][nfeatures] */
                         new_centers_len,       /* out: number of points in each cluster */
                         new_centers            /* sum of points in each cluster */
                         );
-    TIMER_STOP_ID(0);
+    compute_timer.stop();
 
     free(new_centers[0]);
     free(new_centers);
@@ -320,52 +743,66 @@ float** FPGA_KMEANS::fpga_kmeans_clustering(float** feature, // in: [npoints][nf
 
  ***************************************************************/
 int FPGA_KMEANS::fpga_kmeans_init(std::string& binaryFile) {
-    TIMER_START(5);
+    ScopedTimer timer(region_init);
+
+    // The CPU engine and the kernel model run one work item at a time
+    m_num_cus = 1;
+
+    if (m_cpu_engine) {
+        m_cpu_engine->cpu_kmeans_init(m_cpu_threads);
+        return 0;
+    }
 
 #ifdef __USE_OPENCL__
     cl_int err;
 
-    // get_xil_devices() is a utility API which will find the xilinx
-    // platforms and will return list of devices connected to Xilinx platform
-    auto devices = xcl::get_xil_devices();
-    // read_binary_file() is a utility API which will load the binaryFile
-    // and will return the pointer to file buffer.
-    auto fileBuf = xcl::read_binary_file(binaryFile);
-    cl::Program::Binaries bins{{fileBuf.data(), fileBuf.size()}};
-    bool valid_device = false;
-    for (unsigned int i = 0; i < devices.size(); i++) {
-        auto device = devices[i];
-        // Creating Context and Command Queue for selected Device
-        OCL_CHECK(err, m_context = cl::Context(device, nullptr, nullptr, nullptr, &err));
-        OCL_CHECK(err,
-                  m_q = cl::CommandQueue(m_context, device,
-                                         CL_QUEUE_PROFILING_ENABLE | CL_QUEUE_OUT_OF_ORDER_EXEC_MODE_ENABLE, &err));
-
-        std::cout << "Trying to program device[" << i << "]: " << device.getInfo<CL_DEVICE_NAME>() << std::endl;
-        m_prog = cl::Program(m_context, {device}, bins, nullptr, &err);
-        if (err != CL_SUCCESS) {
-            std::cout << "Failed to program device[" << i << "] with xclbin file!\n";
-        } else {
-            std::cout << "Device[" << i << "]: program successful!\n";
-            valid_device = true;
-            break; // we break because we found a valid device
-        }
-    }
-    if (!valid_device) {
-        std::cout << "Failed to program any device found, exit!\n";
+    // The session finds the Xilinx devices, maps the xclbin and programs the
+    // first device that accepts it, or reuses the program of an earlier
+    // session on the same xclbin
+    xcl::Session session(binaryFile);
+    session.printStartup();
+    m_context = session.context();
+    m_prog = session.program();
+    m_q = session.createQueue(CL_QUEUE_PROFILING_ENABLE | CL_QUEUE_OUT_OF_ORDER_EXEC_MODE_ENABLE);
+
+    // Discover the kmeans CUs of the xclbin and bind one kernel object to
+    // each of them, so the scheduler can pick the CU of every work item
+    cl::Kernel kernel;
+    cl_uint num_cus = 0;
+    OCL_CHECK(err, kernel = cl::Kernel(m_prog, "kmeans", &err));
+    OCL_CHECK(err, err = clGetKernelInfo(kernel(), CL_KERNEL_COMPUTE_UNIT_COUNT, sizeof(num_cus), &num_cus, nullptr));
+    if (num_cus == 0) {
+        std::cout << "No kmeans compute unit found in the xclbin, exit!\n";
         exit(EXIT_FAILURE);
     }
 
-    for (int i = 0; i < NUM_CU; i++) {
-        std::string cuname = "kmeans:{kmeans_" + std::to_string(i + 1) + "}";
-        OCL_CHECK(err, m_kernel_kmeans[i] = cl::Kernel(m_prog, cuname.c_str(), &err));
+    m_num_cus = num_cus;
+    m_kernel_kmeans.clear();
+    for (unsigned i = 0; i < m_num_cus; i++) {
+        char name[128] = {0};
+        OCL_CHECK(err,
+                  err = xclGetComputeUnitInfo(kernel(), i, XCL_COMPUTE_UNIT_NAME, sizeof(name) - 1, name, nullptr));
+        // The instance name may come with or without the kernel name prefix
+        std::string instance(name);
+        std::string cuname = "kmeans:{" + instance.substr(instance.find(':') + 1) + "}";
+        m_kernel_kmeans.emplace_back();
+        OCL_CHECK(err, m_kernel_kmeans.back() = cl::Kernel(m_prog, cuname.c_str(), &err));
+        printf("Found compute unit %s\n", cuname.c_str());
     }
 #endif
 
-    printf("Application compiled with NUM_CU = %d\n", NUM_CU);
+    printf("Application running with %u CU(s)\n", m_num_cus);
+
+    return 0;
+}
+/****************************************************************
 
-    TIMER_STOP(5);
+                   FPGA KMEANS USE CPU ENGINE()
 
+ ***************************************************************/
+int FPGA_KMEANS::fpga_kmeans_use_cpu_engine(int nthreads) {
+    m_cpu_threads = nthreads;
+    if (m_cpu_engine == nullptr) m_cpu_engine = new CPU_KMEANS();
     return 0;
 }
 /****************************************************************
@@ -373,27 +810,88 @@ int FPGA_KMEANS::fpga_kmeans_init(std::string& binaryFile) {
                      FPGA KMEANS ALLOCATE()
 
  ***************************************************************/
+int FPGA_KMEANS::fpga_kmeans_use_work_items(int item_points) {
+    m_item_request = item_points;
+    return 0;
+}
+
+int FPGA_KMEANS::fpga_kmeans_use_tiles(int tile_points) {
+    m_tile_request = tile_points;
+    return 0;
+}
+
+int FPGA_KMEANS::fpga_kmeans_use_bounds(int group_points) {
+    if (!m_cpu_engine) {
+#ifndef KMEANS_PRUNING
+        printf("Error: bounds pruning on the FPGA needs the kernels built with PRUNING=1\n");
+        return -1;
+#endif
+        if (group_points != PARALLEL_POINTS) {
+            printf("Error: the FPGA engine prunes groups of %d points\n", PARALLEL_POINTS);
+            return -1;
+        }
+    }
+    if (m_bounds == nullptr) m_bounds = new KMEANS_BOUNDS();
+    m_bounds_group = group_points;
+    return 0;
+}
+
+int FPGA_KMEANS::fpga_kmeans_use_remap_threads(int nthreads) {
+    if (nthreads <= 0) nthreads = std::max(1u, std::thread::hardware_concurrency());
+    m_remap_threads = nthreads;
+    return 0;
+}
+
+int FPGA_KMEANS::fpga_kmeans_use_seeding(kmeans_seed_t seed, unsigned int rng_seed, int nthreads) {
+    m_seed = seed;
+    m_seed_rng = rng_seed;
+    m_seed_threads = nthreads;
+    return 0;
+}
+
 int FPGA_KMEANS::fpga_kmeans_allocate(int n_points, int n_features, int n_clusters) {
-    TIMER_START(6);
+    ScopedTimer timer(region_alloc);
 
     m_npoints = n_points;
     m_nfeatures = n_features;
     m_nclusters = n_clusters;
 
-    // There are NUM_CUS and CUs write 16 results in parallel
-    // So to divide points evenly, the number of points must be a multiple of both
-    // 16 and NUM_CU
-    unsigned factor = 16 * NUM_CU;
-    unsigned tmp = ((n_points + factor - 1) / factor) * factor;
+    // CUs write 16 results in parallel and prune groups of PARALLEL_POINTS
+    // points, so work items, and tiles, start on a multiple of both
+    unsigned factor = PARALLEL_POINTS;
+    while (factor % 16) factor += PARALLEL_POINTS;
+    unsigned tile_points = n_points;
+    if (m_tile_request > 0 && m_tile_request < n_points) tile_points = m_tile_request;
 
-    m_num_points_per_cu = tmp / NUM_CU;
-    m_num_cu_calls = (n_points + m_num_points_per_cu - 1) / m_num_points_per_cu;
+    m_tile_points = ((tile_points + factor - 1) / factor) * factor;
+    m_num_tiles = (n_points + m_tile_points - 1) / m_tile_points;
+
+    unsigned item_points = (m_tile_points + m_num_cus * KMEANS_ITEMS_PER_CU - 1) / (m_num_cus * KMEANS_ITEMS_PER_CU);
+    if (m_item_request > 0) item_points = m_item_request;
+    m_item_points = std::min(((item_points + factor - 1) / factor) * factor, m_tile_points);
+
+    // The CPU engine covers a whole tile in one call and reduces the partial
+    // centers of its threads itself
+    if (m_cpu_engine) m_item_points = m_tile_points;
+
+    // Streaming needs two staging slots so the next tile can be remapped and
+    // uploaded while the device works on the current one
+    unsigned num_slots = (m_num_tiles > 1) ? 2 : 1;
 
     m_buf_members_sz = sizeof(int) * ((n_points + 15) / 16) * 16; // Rounded up to nearest multiple of 16
     m_buf_cluster_sz =
-        sizeof(unsigned int) * ((n_clusters * n_features + 15) / 16) * 16; // Rounded up to nearest multiple of 16
-    m_buf_centers_sz = m_buf_cluster_sz;
-    m_buf_feature_sz = sizeof(unsigned int) * m_buf_members_sz * n_features;
+        sizeof(feature_t) * ((n_clusters * n_features + 15) / 16) * 16; // Rounded up to nearest multiple of 16
+    m_buf_centers_sz = sizeof(center_sum_t) * ((n_clusters * n_features + 15) / 16) * 16;
+    m_buf_feature_sz = sizeof(feature_t) * (size_t)m_tile_points * n_features; // One tile
+    m_scaled_source = nullptr;
+
+    if (m_num_tiles > 1) {
+        printf("Streaming %u tiles of %u points (%s of features per tile)\n", m_num_tiles, m_tile_points,
+               xcl::convert_size(m_buf_feature_sz).c_str());
+    }
+    if (!m_cpu_engine) {
+        printf("Scheduling work items of %u points on %u CU(s)\n", m_item_points, m_num_cus);
+    }
 
     m_new_memberships = (int*)malloc(m_buf_members_sz);
     if (m_new_memberships == nullptr) {
@@ -401,38 +899,78 @@ int FPGA_KMEANS::fpga_kmeans_allocate(int n_points, int n_features, int n_cluste
         exit(EXIT_FAILURE);
     }
 
-    for (int i = 0; i < NUM_CU; i++) {
-        m_new_centers[i] = (unsigned int*)malloc(m_buf_centers_sz);
-        if (m_new_centers[i] == nullptr) {
-            fprintf(stderr, "Error: Failed to allocate memory for m_new_centers\n");
+    m_work_slots.resize(m_num_cus * KMEANS_CU_DEPTH);
+    for (unsigned i = 0; i < m_work_slots.size(); i++) {
+        work_slot& work = m_work_slots[i];
+        work.owner = this;
+        work.index = i;
+        work.cu = i % m_num_cus;
+        work.new_centers = (center_sum_t*)malloc(m_buf_centers_sz);
+        if (work.new_centers == nullptr) {
+            fprintf(stderr, "Error: Failed to allocate memory for the partial centers\n");
             exit(EXIT_FAILURE);
         }
     }
+    m_cu_items.assign(m_num_cus, 0);
+    m_cu_busy_ms.assign(m_num_cus, 0.0);
 
-    m_scaled_clusters = (unsigned int*)malloc(m_buf_cluster_sz);
+    m_scaled_clusters = (feature_t*)malloc(m_buf_cluster_sz);
     if (m_scaled_clusters == nullptr) {
         fprintf(stderr, "Error: Failed to allocate memory for m_scaled_clusters\n");
         exit(EXIT_FAILURE);
     }
 
-    m_scaled_feature = (unsigned int*)malloc(m_buf_feature_sz);
+    m_scaled_feature = (feature_t*)malloc(num_slots * m_buf_feature_sz);
     if (m_scaled_feature == nullptr) {
         fprintf(stderr, "Error: Failed to allocate memory for m_scaled_feature\n");
         exit(EXIT_FAILURE);
     }
 
+#ifdef KMEANS_PRUNING
+    // The skip bits are read by the kernels in 512-bit words
+    size_t skip_words = (((m_tile_points + PARALLEL_POINTS - 1) / PARALLEL_POINTS + 511) / 512) * 16;
+    for (unsigned s = 0; s < num_slots; s++) m_skip_flags[s].assign(skip_words, 0);
+
+    m_new_bounds = nullptr;
+    if (!m_cpu_engine) {
+        m_new_bounds = (double*)malloc(2 * sizeof(double) * ((n_points + 15) / 16) * 16);
+        if (m_new_bounds == nullptr) {
+            fprintf(stderr, "Error: Failed to allocate memory for m_new_bounds\n");
+            exit(EXIT_FAILURE);
+        }
+    }
+#endif
+
 #ifdef __USE_OPENCL__
-    cl_int err;
-    OCL_CHECK(err, m_buf_feature = cl::Buffer(m_context, CL_MEM_READ_ONLY, m_buf_feature_sz, nullptr, &err));
-    OCL_CHECK(err, m_buf_cluster = cl::Buffer(m_context, CL_MEM_READ_ONLY, m_buf_cluster_sz, nullptr, &err));
-    OCL_CHECK(err, m_buf_members = cl::Buffer(m_context, CL_MEM_WRITE_ONLY, m_buf_members_sz, nullptr, &err));
+    if (m_cpu_engine) {
+        return 0;
+    }
 
-    for (int i = 0; i < NUM_CU; i++) {
-        OCL_CHECK(err, m_buf_centers[i] = cl::Buffer(m_context, CL_MEM_WRITE_ONLY, m_buf_centers_sz, nullptr, &err));
+    cl_int err;
+    for (int i = 0; i < 2; i++) {
+        OCL_CHECK(err, m_buf_cluster[i] = cl::Buffer(m_context, CL_MEM_READ_ONLY, m_buf_cluster_sz, nullptr, &err));
     }
+
+    for (unsigned s = 0; s < num_slots; s++) {
+        OCL_CHECK(err, m_buf_feature[s] = cl::Buffer(m_context, CL_MEM_READ_ONLY, m_buf_feature_sz, nullptr, &err));
+#ifdef KMEANS_PRUNING
+        // Also read back by the kernels for the memberships of skipped groups
+        OCL_CHECK(err, m_buf_members[s] = cl::Buffer(m_context, CL_MEM_READ_WRITE, sizeof(int) * m_tile_points,
+                                                     nullptr, &err));
+        OCL_CHECK(err, m_buf_skip[s] = cl::Buffer(m_context, CL_MEM_READ_ONLY,
+                                                  sizeof(unsigned int) * m_skip_flags[s].size(), nullptr, &err));
+        OCL_CHECK(err, m_buf_bounds[s] = cl::Buffer(m_context, CL_MEM_WRITE_ONLY,
+                                                    2 * sizeof(double) * m_tile_points, nullptr, &err));
+#else
+        OCL_CHECK(err, m_buf_members[s] = cl::Buffer(m_context, CL_MEM_WRITE_ONLY, sizeof(int) * m_tile_points,
+                                                     nullptr, &err));
 #endif
+    }
 
-    TIMER_STOP(6);
+    for (auto& work : m_work_slots) {
+        OCL_CHECK(err, work.buf_centers = cl::Buffer(m_context, CL_MEM_WRITE_ONLY, m_buf_centers_sz, nullptr, &err));
+    }
+#endif
 
     return 0;
 }
@@ -445,9 +983,12 @@ int FPGA_KMEANS::fpga_kmeans_deallocateMemory() {
     free(m_scaled_feature);
     free(m_scaled_clusters);
     free(m_new_memberships);
+#ifdef KMEANS_PRUNING
+    free(m_new_bounds);
+#endif
 
-    for (int i = 0; i < NUM_CU; i++) {
-        free(m_new_centers[i]);
+    for (auto& work : m_work_slots) {
+        free(work.new_centers);
     }
 
     return 0;
@@ -459,17 +1000,64 @@ int FPGA_KMEANS::fpga_kmeans_deallocateMemory() {
  ***************************************************************/
 int FPGA_KMEANS::fpga_kmeans_print_report() {
 #ifdef __USE_OPENCL__
+    Profiler& profiler = Profiler::instance();
+    double compute_ms = profiler.totalMs(region_compute);
+
+    printf("------------------------------------------------------\n");
+    if (m_cpu_engine) {
+        printf("  Performance Summary (CPU engine, %s, %d threads)\n", m_cpu_engine->cpu_kmeans_isa(),
+               m_cpu_engine->cpu_kmeans_threads());
+    } else {
+        printf("  Performance Summary (FPGA, %u CUs)\n", m_num_cus);
+    }
+    printf("------------------------------------------------------\n");
+    printf("  Device Initialization      : %12.4f ms\n", profiler.totalMs(region_init));
+    printf("  Buffer Allocation          : %12.4f ms\n", profiler.totalMs(region_alloc));
     printf("------------------------------------------------------\n");
-    printf("  Performance Summary                                 \n");
+    printf("  Seed Centers               : %12.4f ms\n", profiler.totalMs(region_seed));
+    printf("  Compute Memberships        : %12.4f ms\n", profiler.totalMs(region_memberships));
+    printf("  Update Delta               : %12.4f ms\n", profiler.totalMs(region_delta));
+    printf("  Update Centers             : %12.4f ms\n", profiler.totalMs(region_centers));
+    printf("  Update Clusters            : %12.4f ms\n", profiler.totalMs(region_clusters));
+    printf("  Remap Features             : %12.4f ms (%u tile(s))\n", profiler.totalMs(region_remap), m_num_tiles);
+    if (!m_cpu_engine) {
+        double reduce_ms = profiler.totalMs(region_delta) + profiler.totalMs(region_centers);
+        double overlap_ms = profiler.totalMs(region_overlap);
+        printf("  Reduction Overlapped       : %12.4f ms (%.1f%% of delta + centers)\n", overlap_ms,
+               reduce_ms > 0 ? 100.0 * overlap_ms / reduce_ms : 0.0);
+    }
+    printf("  Total K-Means Compute Time : %12.4f ms\n", compute_ms);
+    printf("  Iterations                 : %12u\n", m_iterations);
+    printf("  Iterations / sec           : %12.4f\n", compute_ms > 0 ? 1000.0 * m_iterations / compute_ms : 0.0);
+    printf("  Distances / sec            : %12.4g\n",
+           compute_ms > 0 ? 1000.0 * m_iterations * m_npoints * m_nclusters / compute_ms : 0.0);
     printf("------------------------------------------------------\n");
-    printf("  Device Initialization      : %12.4f ms\n", TIMER_REPORT_MS(5));
-    printf("  Buffer Allocation          : %12.4f ms\n", TIMER_REPORT_MS(6));
+    if (!m_cpu_engine) {
+        printf("  Work Item Size             : %12u points\n", m_item_points);
+        for (unsigned i = 0; i < m_num_cus; i++) {
+            printf("  CU %-2u                      : %12lu items, %10.4f ms busy (%.1f%%)\n", i, m_cu_items[i],
+                   m_cu_busy_ms[i], compute_ms > 0 ? 100.0 * m_cu_busy_ms[i] / compute_ms : 0.0);
+        }
+        printf("------------------------------------------------------\n");
+    }
+#if FEATURE_BITS == 0
+    printf("  Feature Format             :        float\n");
+#else
+    printf("  Feature Format             : %6d-bit fixed point\n", FEATURE_BITS);
+    printf("  Quantization Step          : %12.4g (max error %.4g)\n", m_scale.step, m_scale.step / 2);
+#endif
     printf("------------------------------------------------------\n");
-    printf("  Compute Memberships        : %12.4f ms\n", TIMER_REPORT_MS(1));
-    printf("  Update Delta               : %12.4f ms\n", TIMER_REPORT_MS(2));
-    printf("  Update Centers             : %12.4f ms\n", TIMER_REPORT_MS(3));
-    printf("  Update Clusters            : %12.4f ms\n", TIMER_REPORT_MS(4));
-    printf("  Total K-Means Compute Time : %12.4f ms\n", TIMER_REPORT_MS(0));
+    if (m_bounds) {
+        double full = (double)m_npoints * m_nclusters;
+        printf("  Distance Evaluations (last run, pruning %s)\n", m_bounds_group > 1 ? "groups" : "points");
+        for (unsigned i = 0; i < m_bounds_evals.size(); i++) {
+            printf("  Iteration %4u             : %12lu (%6.2f%%)\n", i + 1, m_bounds_evals[i],
+                   100.0 * m_bounds_evals[i] / full);
+        }
+        printf("------------------------------------------------------\n");
+    }
+    printf("  Host Regions (ms per call)\n");
+    profiler.printReport();
     printf("------------------------------------------------------\n");
 #endif
     return 0;
@@ -17,60 +17,228 @@
 #ifndef _H_FPGA_KMEANS_
 #define _H_FPGA_KMEANS_
 
+#include <condition_variable>
+#include <deque>
+#include <mutex>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <vector>
 
+#include "cpu_kmeans.h"
 #include "kmeans.h"
+#include "kmeans_bounds.h"
 #include "kmeans_config.h"
+#include "kmeans_feature.h"
+#include "kmeans_seeding.h"
 #include "krnl_kmeans.h"
-#include "timer.h"
+#include "profiler.h"
 #include "xcl2.hpp"
 
+// Work items each CU gets per tile when the item size is not set, so a slow
+// CU only holds back a small part of the tile
+#define KMEANS_ITEMS_PER_CU 8
+// Work items queued on each CU at a time, so a CU never idles while the host
+// hands out its next item
+#define KMEANS_CU_DEPTH 2
+
+// Feature x maps to round((x - offset) / step), up to max_code. Float features
+// use offset 0 and step 1.
+struct feature_scale {
+    double offset;
+    double step;
+    double inv_step;
+    double max_code;
+};
+
 class FPGA_KMEANS {
    public:
+    FPGA_KMEANS()
+        : m_num_cus(0),
+          m_item_request(0),
+          m_tile_request(0),
+          m_scaled_source(nullptr),
+          m_scaled_npoints(0),
+          m_scaled_nfeatures(0),
+          m_remap_threads(0),
+          m_iterations(0),
+          m_last_iterations(0),
+          m_seed(SEED_FIRST),
+          m_seed_rng(0),
+          m_seed_threads(0),
+          m_last_seed_ms(0.0),
+          m_cpu_threads(0),
+          m_cpu_engine(nullptr),
+          m_bounds(nullptr),
+          m_bounds_group(0) {}
+    ~FPGA_KMEANS() {
+        delete m_cpu_engine;
+        delete m_bounds;
+    }
+
+    // Run the membership computation on the host CPU engine instead of the
+    // kmeans kernels. Must be called before fpga_kmeans_init().
+    int fpga_kmeans_use_cpu_engine(int nthreads);
+    // Hand out the points of each tile to the CUs in work items of about
+    // item_points points (0 = KMEANS_ITEMS_PER_CU items per CU). Must be
+    // called before fpga_kmeans_allocate().
+    int fpga_kmeans_use_work_items(int item_points);
+    // Stream the dataset through the device in tiles of at most tile_points
+    // points instead of uploading it once. Must be called before
+    // fpga_kmeans_allocate().
+    int fpga_kmeans_use_tiles(int tile_points);
+    // Initial centers used by the next fpga_kmeans_clustering() calls. The
+    // seeding passes run on nthreads host threads (0 = all cores).
+    int fpga_kmeans_use_seeding(kmeans_seed_t seed, unsigned int rng_seed, int nthreads);
+    // Skip the points that provably keep their cluster (triangle inequality
+    // bounds), one at a time (group_points = 1) or by groups of
+    // PARALLEL_POINTS points like the kernels built with PRUNING=1, which the
+    // FPGA engine requires. Must be called after fpga_kmeans_use_cpu_engine().
+    int fpga_kmeans_use_bounds(int group_points);
+    // Host threads used to scale and remap the features (0 = all cores)
+    int fpga_kmeans_use_remap_threads(int nthreads);
+    // The features are scaled and remapped by the first call only, the next
+    // calls on the same feature array of the same size reuse them
     float** fpga_kmeans_clustering(float** feature, float threshold, int* membership);
+    // Makes the next fpga_kmeans_clustering() call scale and remap the
+    // features again, for a caller that changed them in place
+    void fpga_kmeans_invalidate_features() { m_scaled_source = nullptr; }
     int fpga_kmeans_init(std::string& binaryFile);
     int fpga_kmeans_allocate(int n_points, int n_features, int n_clusters);
     int fpga_kmeans_deallocateMemory();
     int fpga_kmeans_print_report();
 
+    // Statistics of the last fpga_kmeans_clustering() call
+    unsigned int fpga_kmeans_last_iterations() const { return m_last_iterations; }
+    double fpga_kmeans_last_seed_ms() const { return m_last_seed_ms; }
+
    private:
+    // One queued work item: the point range of a tile a CU works on and the
+    // partial centers it produces. Slot s belongs to CU s % m_num_cus.
+    struct work_slot {
+        FPGA_KMEANS* owner;
+        unsigned int index;
+        unsigned int cu;
+        unsigned int tile;
+        unsigned int item;
+        center_sum_t* new_centers;
+#ifdef __USE_OPENCL__
+        cl::Buffer buf_centers;
+        cl::Event task_event;
+        // Execution status of the item, negative when a command failed
+        cl_int status;
+#endif
+    };
+
     void fpga_kmeans_compute(float** feature, /* in: [npoints][nfeatures] */
                              float threshold,
                              int* membership,
                              float** clusters,
                              int* new_centers_len,
-                             unsigned int** new_centers);
+                             center_sum_t** new_centers);
+    unsigned fpga_kmeans_tile_npoints(unsigned tile);
+    unsigned fpga_kmeans_tile_items(unsigned tile);
+    unsigned fpga_kmeans_item_npoints(unsigned tile, unsigned item);
+#ifdef KMEANS_PRUNING
+    unsigned fpga_kmeans_skip_groups(unsigned tile, unsigned slot);
+    void fpga_kmeans_update_bounds(unsigned tile, unsigned slot, unsigned start_point, unsigned npoints);
+#endif
+    void fpga_kmeans_remap_tile(float** feature, unsigned tile, unsigned slot);
+#ifdef __USE_OPENCL__
+    void fpga_kmeans_upload_tile(float** feature, unsigned tile, const std::vector<cl::Event>& cluster_event);
+    void fpga_kmeans_enqueue_item(unsigned slot, cl::Buffer& buf_cluster);
+    unsigned fpga_kmeans_wait_item();
+    static void CL_CALLBACK fpga_kmeans_item_done(cl_event event, cl_int status, void* data);
+    int fpga_kmeans_run_queue(float** feature,
+                              cl::Buffer& buf_cluster,
+                              const std::vector<cl::Event>& cluster_event,
+                              int* membership,
+                              int* new_centers_len,
+                              center_sum_t** new_centers);
+#endif
+    int fpga_kmeans_reduce(int* membership,
+                           int* new_centers_len,
+                           center_sum_t** new_centers,
+                           const center_sum_t* partial_centers,
+                           unsigned start_point,
+                           unsigned npoints);
 
     int* m_new_memberships;
-    unsigned int* m_new_centers[NUM_CU];
 
     unsigned int m_nfeatures;
     unsigned int m_nclusters;
     unsigned int m_npoints;
 
     unsigned int m_buf_cluster_sz;
-    unsigned int m_buf_feature_sz;
+    size_t m_buf_feature_sz;
     unsigned int m_buf_members_sz;
     unsigned int m_buf_centers_sz;
 
-    unsigned int m_num_points_per_cu;
-    unsigned int m_num_cu_calls;
+    // Compute units found in the xclbin, and the work items they share
+    unsigned int m_num_cus;
+    std::vector<work_slot> m_work_slots;
+    int m_item_request;
+    unsigned int m_item_points;
+    std::vector<unsigned long> m_cu_items;
+    std::vector<double> m_cu_busy_ms;
 
-    unsigned int* m_scaled_feature;
-    unsigned int* m_scaled_clusters;
+    int m_tile_request;
+    unsigned int m_tile_points;
+    unsigned int m_num_tiles;
+
+    feature_t* m_scaled_feature;
+    feature_t* m_scaled_clusters;
+    // Dataset m_scaled_feature was computed from, its size and its scale
+    float** m_scaled_source;
+    int m_scaled_npoints;
+    int m_scaled_nfeatures;
+    feature_scale m_scale;
+    int m_remap_threads;
+
+    unsigned int m_iterations;
+    unsigned int m_last_iterations;
+
+    kmeans_seed_t m_seed;
+    unsigned int m_seed_rng;
+    int m_seed_threads;
+    double m_last_seed_ms;
+
+    int m_cpu_threads;
+    CPU_KMEANS* m_cpu_engine;
+
+    // Distance evaluations of each iteration of the last run
+    KMEANS_BOUNDS* m_bounds;
+    int m_bounds_group;
+    std::vector<unsigned long> m_bounds_evals;
+
+#ifdef KMEANS_PRUNING
+    // One skip bit per group of PARALLEL_POINTS points of each tile, and the
+    // nearest / second nearest squared distances read back per point
+    std::vector<unsigned int> m_skip_flags[2];
+    double* m_new_bounds;
+#endif
 
 #ifdef __USE_OPENCL__
     cl::Context m_context;
     cl::CommandQueue m_q;
     cl::Program m_prog;
-    cl::Kernel m_kernel_kmeans[NUM_CU];
+    std::vector<cl::Kernel> m_kernel_kmeans;
+
+    cl::Buffer m_buf_feature[2];
+    cl::Buffer m_buf_cluster[2];
+    cl::Buffer m_buf_members[2];
 
-    cl::Buffer m_buf_feature;
-    cl::Buffer m_buf_cluster;
-    cl::Buffer m_buf_members;
-    cl::Buffer m_buf_centers[NUM_CU];
+    // Uploads the work items of the tile in each slot wait for, and the
+    // slots of the work items the device finished, filled by the OpenCL
+    // callbacks
+    std::vector<cl::Event> m_tile_events[2];
+    std::mutex m_done_mutex;
+    std::condition_variable m_done_cv;
+    std::deque<unsigned> m_done_slots;
+#ifdef KMEANS_PRUNING
+    cl::Buffer m_buf_skip[2];
+    cl::Buffer m_buf_bounds[2];
+#endif
 #endif
 };
 
@@ -82,6 +250,8 @@ void cluster(FPGA_KMEANS* fpga,
              float,
              float***,
              int,
+             const std::vector<kmeans_seed_t>& seeds,
+             int,
              std::string& binaryFile,
              const char* goldenFile = nullptr);
 
@@ -58,10 +58,15 @@
 #include <fcntl.h>
 #include <stdio.h>
 #include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 #include <unistd.h>
 
 using namespace sda::utils;
 
+// Seed of the host random number generators, kept fixed so runs repeat
+#define KMEANS_RNG_SEED 7
+
 /**************************************************************************
 
                                  CLUSTER()
@@ -76,13 +81,25 @@ void cluster(FPGA_KMEANS* fpga,
              float threshold,          /* loop terminating factor */
              float*** cluster_centres, /* out: [best_nclusters][nfeatures] */
              int nloops,               /* number of iteration for each number of clusters */
-             std::string& binaryFile,  /* Binary file string */
+             const std::vector<kmeans_seed_t>& seeds, /* seeding strategies to run */
+             int nthreads,                            /* host threads used for seeding */
+             std::string& binaryFile,                 /* Binary file string */
              const char* goldenFile) {
     int* membership;             /* which cluster a data point belongs to */
     int* cmodel_membership;      /* which cluster a data point belongs to */
     float** tmp_cluster_centres; /* hold coordinates of cluster centers */
     int i;
 
+    // Per run summary of each seeding strategy
+    struct seed_run {
+        kmeans_seed_t seed;
+        double seed_ms;
+        double total_ms;
+        unsigned int iterations;
+        double sse;
+    };
+    std::vector<seed_run> runs;
+
     // Allocate memory for membership
     membership = (int*)malloc(npoints * sizeof(int));
     cmodel_membership = (int*)malloc(npoints * sizeof(int));
@@ -96,11 +113,29 @@ void cluster(FPGA_KMEANS* fpga,
     // Allocate device memory
     fpga->fpga_kmeans_allocate(npoints, nfeatures, nclusters);
 
-    // Iterate nloops times for each number of clusters
-    for (i = 0; i < nloops; i++) {
-        printf("Running device execution \n");
+    // Iterate nloops times for each seeding strategy
+    for (i = 0; i < nloops * (int)seeds.size(); i++) {
+        kmeans_seed_t seed = seeds[i / nloops];
+        fpga->fpga_kmeans_use_seeding(seed, KMEANS_RNG_SEED, nthreads);
+
+        printf("Running device execution (%s seeding)\n", kmeans_seed_name(seed));
         // Initialize initial cluster centers
+        auto d_start = std::chrono::high_resolution_clock::now();
         tmp_cluster_centres = fpga->fpga_kmeans_clustering(features, threshold, membership);
+        auto d_end = std::chrono::high_resolution_clock::now();
+
+        // Sum of squared distances to the assigned centers: lets the seeding
+        // strategies be compared on quality as well as on speed
+        double sse = 0.0;
+        for (int j = 0; j < npoints; j++) {
+            for (int f = 0; f < nfeatures; f++) {
+                float diff = features[j][f] - tmp_cluster_centres[membership[j]][f];
+                sse += diff * diff;
+            }
+        }
+        runs.push_back({seed, fpga->fpga_kmeans_last_seed_ms(),
+                        std::chrono::duration<double, std::milli>(d_end - d_start).count(),
+                        fpga->fpga_kmeans_last_iterations(), sse});
 
 #ifdef VERIFY_USING_CMODEL
         printf("Running host execution \n");
@@ -153,7 +188,11 @@ void cluster(FPGA_KMEANS* fpga,
         }
         fclose(outFile);
 
-        if (goldenFile && strcmp(goldenFile, "")) {
+        // The golden memberships come from the first points seeding, other
+        // strategies converge to differently numbered clusters
+        if (goldenFile && strcmp(goldenFile, "") && seed != SEED_FIRST) {
+            printf("Golden file comparison skipped for %s seeding\n", kmeans_seed_name(seed));
+        } else if (goldenFile && strcmp(goldenFile, "")) {
             int mismatch = 0;
             // Compare the result with expected golden file
             FILE* inFile;
@@ -190,6 +229,13 @@ void cluster(FPGA_KMEANS* fpga,
     fpga->fpga_kmeans_deallocateMemory();
     fpga->fpga_kmeans_print_report();
 
+    printf("  %-10s %14s %10s %14s %16s\n", "Seeding", "Seeding (ms)", "Iterations", "Total (ms)", "SSE");
+    for (auto& run : runs) {
+        printf("  %-10s %14.4f %10u %14.4f %16.6g\n", kmeans_seed_name(run.seed), run.seed_ms, run.iterations,
+               run.total_ms, run.sse);
+    }
+    printf("------------------------------------------------------\n");
+
     free(membership);
     free(cmodel_membership);
 }
@@ -211,6 +257,7 @@ int main(int argc, char** argv) {
     float** cluster_centres = nullptr;
     int i, j;
     int nloops = 1; // Default value
+    int nthreads = 0;
     int isOutput = 0;
 
     // Command Line Parser
@@ -224,16 +271,28 @@ int main(int argc, char** argv) {
     parser.addSwitch("--nclusters", "-n", "number of clusters", "5");
     parser.addSwitch("--threshold", "-t", "thresold value", "0.001");
     parser.addSwitch("--output", "-o", "output cluster center coordinates", "0");
+    parser.addSwitch("--engine", "-e", "compute engine: fpga or cpu", "fpga");
+    parser.addSwitch("--threads", "-p", "number of CPU engine, seeding and remap threads (0 = all cores)", "0");
+    parser.addSwitch("--binary", "-b", "input file is binary and memory-mapped", "", true);
+    parser.addSwitch("--tile_points", "-m", "stream the features to the device in tiles of this many points", "0");
+    parser.addSwitch("--item_points", "-w", "points per work item handed out to a CU (0 = 8 items per CU and tile)", "0");
+    parser.addSwitch("--seeding", "-s", "initial centers: first, kmeans++, kmeans|| or all", "first");
+    parser.addSwitch("--bounds", "-u", "triangle inequality pruning: off, point or group", "off");
+    parser.addSwitch("--trace", "-j", "write a Chrome trace (JSON) of the host timing regions to this file", "");
     parser.parse(argc, argv);
 
     // Read settings
     std::string binaryFile = parser.value("xclbin_file");
     std::string filename = parser.value("input_file");
     std::string goldenfile = parser.value("compare_file");
+    std::string engine = parser.value("engine");
+    std::vector<kmeans_seed_t> seeds;
 
     nclusters = parser.value_to_int("nclusters");
     threshold = atof((parser.value("threshold")).c_str());
     isOutput = parser.value_to_int("output");
+    isBinaryFile = parser.value_to_bool("binary");
+    nthreads = parser.value_to_int("threads");
 
     if (argc < 7) {
         parser.printHelp();
@@ -241,30 +300,67 @@ int main(int argc, char** argv) {
     }
 
     FPGA_KMEANS* fpga = new FPGA_KMEANS();
+    if (engine == "cpu") {
+        fpga->fpga_kmeans_use_cpu_engine(nthreads);
+    } else if (engine != "fpga") {
+        printf("Error: unknown compute engine '%s', expected fpga or cpu\n", engine.c_str());
+        parser.printHelp();
+        return EXIT_FAILURE;
+    }
+    fpga->fpga_kmeans_use_tiles(parser.value_to_int("tile_points"));
+    fpga->fpga_kmeans_use_work_items(parser.value_to_int("item_points"));
+    fpga->fpga_kmeans_use_remap_threads(nthreads);
+    std::string bounds = parser.value("bounds");
+    if (bounds == "point" || bounds == "group") {
+        if (fpga->fpga_kmeans_use_bounds(bounds == "point" ? 1 : PARALLEL_POINTS)) return EXIT_FAILURE;
+    } else if (bounds != "off") {
+        printf("Error: unknown bounds pruning '%s', expected off, point or group\n", bounds.c_str());
+        parser.printHelp();
+        return EXIT_FAILURE;
+    }
+    if (!kmeans_seed_parse(parser.value("seeding"), seeds)) {
+        printf("Error: unknown seeding '%s', expected first, kmeans++, kmeans|| or all\n",
+               parser.value("seeding").c_str());
+        parser.printHelp();
+        return EXIT_FAILURE;
+    }
     /******************************************************************
 
                                I/O BEGINS
 
   *****************************************************************/
     // Get nfeatures and npoints
+    void* mapped = MAP_FAILED;
+    size_t mapped_sz = 0;
     if (isBinaryFile) { // Binary file input
+        // Layout: int npoints, int nfeatures, float features[npoints][nfeatures]
+        // The file is memory-mapped rather than read so datasets larger than
+        // the host memory can be streamed through the page cache
         int infile;
-        if ((infile = open(filename.c_str(), O_RDONLY, "0600")) == -1) {
+        struct stat st;
+        if ((infile = open(filename.c_str(), O_RDONLY)) == -1 || fstat(infile, &st) == -1) {
             fprintf(stderr, "Error: no such file (%s)\n", filename.c_str());
             exit(EXIT_FAILURE);
         }
-        read(infile, &npoints, sizeof(int));
-        read(infile, &nfeatures, sizeof(int));
+        mapped_sz = st.st_size;
+        mapped = mmap(nullptr, mapped_sz, PROT_READ, MAP_PRIVATE, infile, 0);
+        close(infile);
+        if (mapped == MAP_FAILED || mapped_sz < 2 * sizeof(int)) {
+            fprintf(stderr, "Error: failed to map %s\n", filename.c_str());
+            exit(EXIT_FAILURE);
+        }
+        npoints = ((int*)mapped)[0];
+        nfeatures = ((int*)mapped)[1];
+        if (mapped_sz < 2 * sizeof(int) + (size_t)npoints * nfeatures * sizeof(float)) {
+            fprintf(stderr, "Error: %s is truncated\n", filename.c_str());
+            exit(EXIT_FAILURE);
+        }
+        madvise(mapped, mapped_sz, MADV_SEQUENTIAL);
 
-        // Allocate space for features[][] and read attributes of all objects
-        buf = (float*)malloc(npoints * nfeatures * sizeof(float));
+        buf = nullptr;
         features = (float**)malloc(npoints * sizeof(float*));
-        features[0] = (float*)malloc(npoints * nfeatures * sizeof(float));
+        features[0] = (float*)((int*)mapped + 2);
         for (i = 1; i < npoints; i++) features[i] = features[i - 1] + nfeatures;
-
-        read(infile, buf, npoints * nfeatures * sizeof(float));
-
-        close(infile);
     } else {
         FILE* infile;
         if ((infile = fopen(filename.c_str(), "r")) == nullptr) {
@@ -306,6 +402,9 @@ int main(int argc, char** argv) {
     printf("Number of features      : %d\n", nfeatures);
     printf("Number of clusters      : %d\n", nclusters);
     printf("Threshold               : %f\n", threshold);
+    printf("Compute engine          : %s\n", engine.c_str());
+    printf("Seeding                 : %s\n", parser.value("seeding").c_str());
+    printf("Bounds pruning          : %s\n", bounds.c_str());
 
     /******************************************************************
 
@@ -318,9 +417,11 @@ int main(int argc, char** argv) {
         exit(EXIT_FAILURE);
     }
 
-    srand(7);                                                      // Seed for future random number generator
-    memcpy(features[0], buf, npoints * nfeatures * sizeof(float)); // Now features holds 2-dimensional array of features
-    free(buf);
+    srand(KMEANS_RNG_SEED); // Seed for future random number generator
+    if (buf) {
+        memcpy(features[0], buf, npoints * nfeatures * sizeof(float)); // Now features holds 2-dimensional array of features
+        free(buf);
+    }
 
     /******************************************************************
 
@@ -336,11 +437,18 @@ int main(int argc, char** argv) {
             threshold,        /* loop termination factor */
             &cluster_centres, /* return: [best_nclusters][nfeatures] */
             nloops,           /* number of iteration for each number of clusters */
+            seeds,            /* seeding strategies */
+            nthreads,         /* seeding threads */
             binaryFile,       /* Binary File string */
             goldenfile.c_str());
 
     printf("Number of iteration(s)  : %d\n", nloops);
 
+    std::string tracefile = parser.value("trace");
+    if (!tracefile.empty() && sda::utils::Profiler::instance().writeChromeTrace(tracefile)) {
+        printf("Host timing trace written to %s\n", tracefile.c_str());
+    }
+
     /******************************************************************
 
                           COMMAND LINE OUTPUT
@@ -360,7 +468,11 @@ int main(int argc, char** argv) {
 
     // Free up memory
     delete fpga;
-    free(features[0]);
+    if (mapped != MAP_FAILED) {
+        munmap(mapped, mapped_sz);
+    } else {
+        free(features[0]);
+    }
     free(features);
 
     return (0);
@@ -0,0 +1,90 @@
+/**
+* Copyright (C) 2019-2021 Xilinx, Inc
+*
+* Licensed under the Apache License, Version 2.0 (the "License"). You may
+* not use this file except in compliance with the License. A copy of the
+* License is located at
+*
+*     http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+* WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the
+* License for the specific language governing permissions and limitations
+* under the License.
+*/
+
+#include "kmeans_bounds.h"
+#include <float.h>
+
+static double center_dist(const feature_t* a, const feature_t* b, int nfeatures) {
+    double dist = 0;
+    for (int f = 0; f < nfeatures; f++) {
+        double diff = (double)a[f] - (double)b[f];
+        dist += diff * diff;
+    }
+    return dist;
+}
+
+void KMEANS_BOUNDS::kmeans_bounds_reset(int npoints, int nclusters, int nfeatures) {
+    m_nclusters = nclusters;
+    m_nfeatures = nfeatures;
+    m_valid = false;
+
+    m_upper.assign(npoints, DBL_MAX);
+    m_lower.assign(npoints, 0.0);
+    m_half_separation.assign(nclusters, 0.0);
+    m_drift.assign(nclusters, 0.0);
+    m_clusters.clear();
+}
+
+void KMEANS_BOUNDS::kmeans_bounds_move_centers(const feature_t* clusters, const int* membership) {
+    unsigned centers_sz = m_nclusters * m_nfeatures;
+
+    // The first iteration has nothing to move from: its full evaluation sets
+    // the bounds of every point
+    if (m_clusters.empty()) {
+        m_clusters.assign(clusters, clusters + centers_sz);
+    } else {
+        // The other clusters of a point moved by at most the largest drift,
+        // or by the second largest for the points of the cluster that moved
+        // the most
+        int max_cluster = 0;
+        double max_drift = 0.0;
+        double second_drift = 0.0;
+        for (int c = 0; c < m_nclusters; c++) {
+            m_drift[c] = upper(center_dist(&m_clusters[c * m_nfeatures], clusters + c * m_nfeatures, m_nfeatures));
+            if (m_drift[c] > max_drift) {
+                second_drift = max_drift;
+                max_drift = m_drift[c];
+                max_cluster = c;
+            } else if (m_drift[c] > second_drift) {
+                second_drift = m_drift[c];
+            }
+        }
+        m_clusters.assign(clusters, clusters + centers_sz);
+
+        for (unsigned p = 0; p < m_upper.size(); p++) {
+            m_upper[p] += m_drift[membership[p]];
+            m_lower[p] -= (membership[p] == max_cluster) ? second_drift : max_drift;
+        }
+        m_valid = true;
+    }
+
+    for (int c = 0; c < m_nclusters; c++) {
+        const feature_t* center = clusters + c * m_nfeatures;
+        double nearest = DBL_MAX;
+        for (int o = 0; o < m_nclusters; o++) {
+            if (o != c) nearest = std::min(nearest, center_dist(center, clusters + o * m_nfeatures, m_nfeatures));
+        }
+        m_half_separation[c] = lower(nearest) / 2;
+    }
+}
+
+bool KMEANS_BOUNDS::kmeans_bounds_group_stable(unsigned start_point, unsigned npoints, const int* membership) const {
+    if (!m_valid) return false;
+    for (unsigned p = 0; p < npoints; p++) {
+        if (!kmeans_bounds_stable(start_point + p, membership[p])) return false;
+    }
+    return true;
+}
@@ -0,0 +1,80 @@
+/**
+* Copyright (C) 2019-2021 Xilinx, Inc
+*
+* Licensed under the Apache License, Version 2.0 (the "License"). You may
+* not use this file except in compliance with the License. A copy of the
+* License is located at
+*
+*     http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+* WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the
+* License for the specific language governing permissions and limitations
+* under the License.
+*/
+
+#ifndef _H_KMEANS_BOUNDS_
+#define _H_KMEANS_BOUNDS_
+
+#include "kmeans_feature.h"
+#include <algorithm>
+#include <math.h>
+#include <vector>
+
+/*
+   Triangle inequality bounds (Hamerly) for the membership computation.
+    For every point: an upper bound on the distance to its cluster and a
+   lower bound on the distance to every other cluster. For every cluster:
+   half the distance to its nearest other cluster. A point whose upper bound
+   is below either of the two cannot change cluster, so its distance loop can
+   be skipped. When the centers move, the bounds are loosened by the drift of
+   the centers instead of being recomputed.
+    Distances are Euclidean (not squared) on the features in the format the
+   kernel works on, and are widened by FEATURE_DIST_EPSILON so the pruned
+   memberships are the same as the full ones.
+*/
+class KMEANS_BOUNDS {
+   public:
+    KMEANS_BOUNDS() : m_nclusters(0), m_nfeatures(0), m_valid(false) {}
+
+    // Forgets every bound, the next iteration evaluates all the points
+    void kmeans_bounds_reset(int npoints, int nclusters, int nfeatures);
+
+    // Called once per iteration with the clusters it will use and the current
+    // memberships. Loosens the bounds by the drift of each center.
+    void kmeans_bounds_move_centers(const feature_t* clusters, /* in: [nclusters][nfeatures] */
+                                    const int* membership);    /* in: [npoints] */
+
+    // False until the bounds of every point were set by a full iteration
+    bool kmeans_bounds_valid() const { return m_valid; }
+
+    bool kmeans_bounds_stable(unsigned point, int index) const {
+        return m_upper[point] < std::max(m_lower[point], m_half_separation[index]);
+    }
+    // membership points to the memberships of the group
+    bool kmeans_bounds_group_stable(unsigned start_point, unsigned npoints, const int* membership) const;
+
+    // Exact squared distances from a full evaluation of a point
+    void kmeans_bounds_set(unsigned point, double min_dist, double second_dist) {
+        m_upper[point] = upper(min_dist);
+        m_lower[point] = lower(second_dist);
+    }
+    void kmeans_bounds_set_upper(unsigned point, double dist) { m_upper[point] = upper(dist); }
+
+   private:
+    static double upper(double dist) { return sqrt(dist) * (1 + FEATURE_DIST_EPSILON); }
+    static double lower(double dist) { return sqrt(dist) * (1 - FEATURE_DIST_EPSILON); }
+
+    int m_nclusters;
+    int m_nfeatures;
+    bool m_valid;
+
+    std::vector<double> m_upper;
+    std::vector<double> m_lower;
+    std::vector<double> m_half_separation;
+    std::vector<double> m_drift;
+    std::vector<feature_t> m_clusters;
+};
+
+#endif // _H_KMEANS_BOUNDS_
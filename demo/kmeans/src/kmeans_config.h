@@ -26,3 +26,7 @@
 #ifndef PARALLEL_POINTS
 #define PARALLEL_POINTS 96
 #endif
+
+#ifndef FEATURE_BITS
+#define FEATURE_BITS 24
+#endif
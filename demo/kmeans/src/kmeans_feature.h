@@ -0,0 +1,50 @@
+/**
+* Copyright (C) 2019-2021 Xilinx, Inc
+*
+* Licensed under the Apache License, Version 2.0 (the "License"). You may
+* not use this file except in compliance with the License. A copy of the
+* License is located at
+*
+*     http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+* WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the
+* License for the specific language governing permissions and limitations
+* under the License.
+*/
+
+
+#ifndef _H_KMEANS_FEATURE_
+#define _H_KMEANS_FEATURE_
+
+#include "kmeans_config.h"
+
+/*
+   Feature format of the kernel and of the host buffers, selected at build
+   time with FEATURE_BITS (config.mk):
+    16, 24, 32 : unsigned fixed point, a feature x is stored as the code
+                 round((x - min) / step) where step spreads the [min, max]
+                 range of the dataset over 2^FEATURE_BITS - 1 codes
+    0          : float, the features are only remapped, never scaled
+   Every feature takes one 32-bit slot in memory whatever the format, so the
+   buffer layout is the same for all of them; the format sets the width of the
+   distance datapath. The center sums are 64-bit in all the formats.
+*/
+#if FEATURE_BITS == 0
+typedef float feature_t;
+typedef double center_sum_t;
+#define FEATURE_NAME "float"
+// Relative error allowed on a distance (float rounding of the kernel)
+#define FEATURE_DIST_EPSILON 1e-5
+#elif FEATURE_BITS == 16 || FEATURE_BITS == 24 || FEATURE_BITS == 32
+typedef unsigned int feature_t;
+typedef unsigned long center_sum_t;
+#define FEATURE_NAME "fixed"
+#define FEATURE_MAX_CODE ((1ULL << FEATURE_BITS) - 1)
+#define FEATURE_DIST_EPSILON 1e-12
+#else
+#error FEATURE_BITS must be 16, 24, 32 or 0 (float)
+#endif
+
+#endif // _H_KMEANS_FEATURE_
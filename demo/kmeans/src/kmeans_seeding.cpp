@@ -0,0 +1,312 @@
+/**
+* Copyright (C) 2019-2021 Xilinx, Inc
+*
+* Licensed under the Apache License, Version 2.0 (the "License"). You may
+* not use this file except in compliance with the License. A copy of the
+* License is located at
+*
+*     http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+* WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the
+* License for the specific language governing permissions and limitations
+* under the License.
+*/
+
+#include "kmeans_seeding.h"
+#include <algorithm>
+#include <float.h>
+#include <random>
+#include <stdio.h>
+#include <string.h>
+#include <thread>
+
+// k-means|| oversampling factor (candidates drawn per round, relative to
+// nclusters) and number of rounds, as recommended by Bahmani et al.
+#define KMEANS_PARALLEL_OVERSAMPLING 2
+#define KMEANS_PARALLEL_ROUNDS 5
+// Weighted Lloyd iterations used to refine the k-means|| candidate reduction
+#define KMEANS_PARALLEL_LLOYD 10
+
+static const kmeans_seed_t all_seeds[] = {SEED_FIRST, SEED_KMEANS_PP, SEED_KMEANS_PARALLEL};
+
+const char* kmeans_seed_name(kmeans_seed_t seed) {
+    switch (seed) {
+        case SEED_KMEANS_PP:
+            return "kmeans++";
+        case SEED_KMEANS_PARALLEL:
+            return "kmeans||";
+        default:
+            return "first";
+    }
+}
+
+bool kmeans_seed_parse(const std::string& name, std::vector<kmeans_seed_t>& seeds) {
+    seeds.clear();
+    for (auto seed : all_seeds) {
+        if (name == "all" || name == kmeans_seed_name(seed)) seeds.push_back(seed);
+    }
+    return !seeds.empty();
+}
+
+static inline float dist2(const float* a, const float* b, int nfeatures) {
+    float d = 0;
+    for (int f = 0; f < nfeatures; f++) d += (a[f] - b[f]) * (a[f] - b[f]);
+    return d;
+}
+
+// Uniform [0, 1) value that only depends on (key, round, point), so the
+// k-means|| draws do not change with the number of threads
+static inline double hash_uniform(unsigned long key, unsigned long round, unsigned long point) {
+    unsigned long z = key * 0x9E3779B97F4A7C15UL + round * 0xBF58476D1CE4E5B9UL + point;
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9UL;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBUL;
+    z = z ^ (z >> 31);
+    return (z >> 11) * (1.0 / 9007199254740992.0);
+}
+
+/****************************************************************
+
+                  DISTANCE TO THE CHOSEN CENTERS
+
+  Every strategy keeps, for each point, the squared distance to the
+  nearest center chosen so far and the id of that center. Adding
+  centers is one pass over the points, split in contiguous ranges
+  across the threads; each thread also returns the sum over its range
+  so D^2 sampling can locate a point without another full pass.
+
+ ***************************************************************/
+class SeedContext {
+   public:
+    SeedContext(float** feature, int npoints, int nfeatures, int nthreads)
+        : m_feature(feature),
+          m_npoints(npoints),
+          m_nfeatures(nfeatures),
+          m_nthreads(std::max(1, std::min(nthreads, npoints))),
+          m_min_d2(npoints, FLT_MAX),
+          m_nearest(npoints, 0),
+          m_partial(m_nthreads, 0.0),
+          m_total(0.0) {}
+
+    int first(int t) const { return (long)m_npoints * t / m_nthreads; }
+
+    // centers are [ncenters][nfeatures], numbered from base_id
+    void add_centers(const float* centers, int ncenters, int base_id) {
+        run([&](int t) {
+            double sum = 0;
+            for (int i = first(t); i < first(t + 1); i++) {
+                float best = m_min_d2[i];
+                int nearest = m_nearest[i];
+                for (int c = 0; c < ncenters; c++) {
+                    float d = dist2(m_feature[i], centers + c * m_nfeatures, m_nfeatures);
+                    if (d < best) {
+                        best = d;
+                        nearest = base_id + c;
+                    }
+                }
+                m_min_d2[i] = best;
+                m_nearest[i] = nearest;
+                sum += best;
+            }
+            m_partial[t] = sum;
+        });
+
+        m_total = 0;
+        for (int t = 0; t < m_nthreads; t++) m_total += m_partial[t];
+    }
+
+    // Draws a point with probability min_d2 / total
+    int sample(std::mt19937& rng) const {
+        if (m_total <= 0) return std::uniform_int_distribution<int>(0, m_npoints - 1)(rng);
+
+        double r = std::uniform_real_distribution<double>(0.0, m_total)(rng);
+        int t = 0;
+        while (t < m_nthreads - 1 && r >= m_partial[t]) r -= m_partial[t++];
+
+        int last = first(t + 1) - 1;
+        for (int i = first(t); i < last; i++) {
+            if (r < m_min_d2[i]) return i;
+            r -= m_min_d2[i];
+        }
+        return last;
+    }
+
+    template <typename F>
+    void run(F job) {
+        std::vector<std::thread> threads;
+        for (int t = 1; t < m_nthreads; t++) threads.emplace_back(job, t);
+        job(0);
+        for (auto& thread : threads) thread.join();
+    }
+
+    float** m_feature;
+    int m_npoints;
+    int m_nfeatures;
+    int m_nthreads;
+
+    std::vector<float> m_min_d2;
+    std::vector<int> m_nearest;
+    std::vector<double> m_partial;
+    double m_total;
+};
+
+/****************************************************************
+
+                           K-MEANS++
+
+ ***************************************************************/
+static void seed_kmeans_pp(SeedContext& ctx, int nclusters, float** clusters, std::mt19937& rng) {
+    int nfeatures = ctx.m_nfeatures;
+    int p = std::uniform_int_distribution<int>(0, ctx.m_npoints - 1)(rng);
+
+    for (int c = 0; c < nclusters; c++) {
+        memcpy(clusters[c], ctx.m_feature[p], nfeatures * sizeof(float));
+        if (c == nclusters - 1) break;
+        ctx.add_centers(clusters[c], 1, c);
+        p = ctx.sample(rng);
+    }
+}
+
+/****************************************************************
+
+                           K-MEANS||
+
+  Each round keeps every point independently with probability
+  l * min_d2 / total, so a round is a single parallel pass no matter
+  how many centers it adds. The candidates are then weighted by the
+  number of points they are nearest to and reduced to nclusters
+  centers with weighted k-means++ followed by a few weighted Lloyd
+  iterations; the candidate set is small so this part is serial.
+
+ ***************************************************************/
+static void seed_kmeans_parallel(
+    SeedContext& ctx, int nclusters, float** clusters, std::mt19937& rng, unsigned int rng_seed) {
+    int nfeatures = ctx.m_nfeatures;
+    double oversampling = (double)KMEANS_PARALLEL_OVERSAMPLING * nclusters;
+    std::vector<float> candidates;
+    std::vector<std::vector<int> > picked(ctx.m_nthreads);
+
+    int p = std::uniform_int_distribution<int>(0, ctx.m_npoints - 1)(rng);
+    candidates.insert(candidates.end(), ctx.m_feature[p], ctx.m_feature[p] + nfeatures);
+    ctx.add_centers(candidates.data(), 1, 0);
+
+    for (int round = 0; round < KMEANS_PARALLEL_ROUNDS && ctx.m_total > 0; round++) {
+        double total = ctx.m_total;
+        ctx.run([&](int t) {
+            picked[t].clear();
+            for (int i = ctx.first(t); i < ctx.first(t + 1); i++) {
+                if (hash_uniform(rng_seed, round, i) * total < oversampling * ctx.m_min_d2[i]) picked[t].push_back(i);
+            }
+        });
+
+        int base_id = candidates.size() / nfeatures;
+        for (auto& points : picked) {
+            for (int i : points) candidates.insert(candidates.end(), ctx.m_feature[i], ctx.m_feature[i] + nfeatures);
+        }
+        int ncandidates = candidates.size() / nfeatures;
+        if (ncandidates > base_id) {
+            ctx.add_centers(candidates.data() + (size_t)base_id * nfeatures, ncandidates - base_id, base_id);
+        }
+    }
+
+    // Very small or degenerate datasets may not yield enough candidates
+    while ((int)candidates.size() / nfeatures < nclusters) {
+        int base_id = candidates.size() / nfeatures;
+        p = ctx.sample(rng);
+        candidates.insert(candidates.end(), ctx.m_feature[p], ctx.m_feature[p] + nfeatures);
+        ctx.add_centers(candidates.data() + (size_t)base_id * nfeatures, 1, base_id);
+    }
+
+    int ncandidates = candidates.size() / nfeatures;
+    std::vector<double> weight(ncandidates, 0.0);
+    for (int i = 0; i < ctx.m_npoints; i++) weight[ctx.m_nearest[i]] += 1.0;
+
+    // Weighted k-means++ over the candidates
+    std::vector<float> min_d2(ncandidates, FLT_MAX);
+    std::vector<int> nearest(ncandidates, 0);
+    std::discrete_distribution<int> pick_first(weight.begin(), weight.end());
+    int q = pick_first(rng);
+    for (int c = 0; c < nclusters; c++) {
+        memcpy(clusters[c], &candidates[(size_t)q * nfeatures], nfeatures * sizeof(float));
+        double total = 0;
+        for (int j = 0; j < ncandidates; j++) {
+            float d = dist2(&candidates[(size_t)j * nfeatures], clusters[c], nfeatures);
+            if (d < min_d2[j]) {
+                min_d2[j] = d;
+                nearest[j] = c;
+            }
+            total += weight[j] * min_d2[j];
+        }
+        if (c == nclusters - 1) break;
+
+        if (total <= 0) {
+            q = std::uniform_int_distribution<int>(0, ncandidates - 1)(rng);
+            continue;
+        }
+        double r = std::uniform_real_distribution<double>(0.0, total)(rng);
+        for (q = 0; q < ncandidates - 1; q++) {
+            r -= weight[q] * min_d2[q];
+            if (r < 0) break;
+        }
+    }
+
+    // Weighted Lloyd refinement, empty clusters keep their center
+    std::vector<double> sum((size_t)nclusters * nfeatures);
+    std::vector<double> count(nclusters);
+    for (int iter = 0; iter < KMEANS_PARALLEL_LLOYD; iter++) {
+        bool changed = false;
+        std::fill(sum.begin(), sum.end(), 0.0);
+        std::fill(count.begin(), count.end(), 0.0);
+        for (int j = 0; j < ncandidates; j++) {
+            const float* point = &candidates[(size_t)j * nfeatures];
+            int best = nearest[j];
+            float best_d = dist2(point, clusters[best], nfeatures);
+            for (int c = 0; c < nclusters; c++) {
+                float d = dist2(point, clusters[c], nfeatures);
+                if (d < best_d) {
+                    best_d = d;
+                    best = c;
+                }
+            }
+            if (best != nearest[j]) changed = true;
+            nearest[j] = best;
+            count[best] += weight[j];
+            for (int f = 0; f < nfeatures; f++) sum[(size_t)best * nfeatures + f] += weight[j] * point[f];
+        }
+        for (int c = 0; c < nclusters; c++) {
+            if (count[c] <= 0) continue;
+            for (int f = 0; f < nfeatures; f++) clusters[c][f] = sum[(size_t)c * nfeatures + f] / count[c];
+        }
+        if (!changed && iter > 0) break;
+    }
+}
+
+/****************************************************************
+
+                       KMEANS SEED CENTERS()
+
+ ***************************************************************/
+void kmeans_seed_centers(kmeans_seed_t seed,
+                         float** feature,
+                         int npoints,
+                         int nfeatures,
+                         int nclusters,
+                         float** clusters,
+                         int nthreads,
+                         unsigned int rng_seed) {
+    if (nthreads <= 0) nthreads = std::max(1u, std::thread::hardware_concurrency());
+
+    if (seed == SEED_FIRST) {
+        for (int c = 0; c < nclusters; c++) memcpy(clusters[c], feature[c], nfeatures * sizeof(float));
+        return;
+    }
+
+    std::mt19937 rng(rng_seed);
+    SeedContext ctx(feature, npoints, nfeatures, nthreads);
+    if (seed == SEED_KMEANS_PP) {
+        seed_kmeans_pp(ctx, nclusters, clusters, rng);
+    } else {
+        seed_kmeans_parallel(ctx, nclusters, clusters, rng, rng_seed);
+    }
+}
@@ -0,0 +1,49 @@
+/**
+* Copyright (C) 2019-2021 Xilinx, Inc
+*
+* Licensed under the Apache License, Version 2.0 (the "License"). You may
+* not use this file except in compliance with the License. A copy of the
+* License is located at
+*
+*     http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+* WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the
+* License for the specific language governing permissions and limitations
+* under the License.
+*/
+
+#ifndef _H_KMEANS_SEEDING_
+#define _H_KMEANS_SEEDING_
+
+#include <string>
+#include <vector>
+
+/*
+   Initial cluster center selection.
+    SEED_FIRST           : the first nclusters points (original behavior)
+    SEED_KMEANS_PP       : k-means++, D^2 weighted sampling, one center per
+                           pass over the data
+    SEED_KMEANS_PARALLEL : k-means||, oversamples ~2*nclusters candidates per
+                           pass for a few passes, then reduces the weighted
+                           candidates to nclusters centers with k-means++
+   All the passes over the points are split across nthreads host threads.
+*/
+enum kmeans_seed_t { SEED_FIRST, SEED_KMEANS_PP, SEED_KMEANS_PARALLEL };
+
+const char* kmeans_seed_name(kmeans_seed_t seed);
+
+// Parses "first", "kmeans++", "kmeans||" or "all" (every strategy in turn)
+bool kmeans_seed_parse(const std::string& name, std::vector<kmeans_seed_t>& seeds);
+
+void kmeans_seed_centers(kmeans_seed_t seed,
+                         float** feature, /* in: [npoints][nfeatures] */
+                         int npoints,
+                         int nfeatures,
+                         int nclusters,
+                         float** clusters, /* out: [nclusters][nfeatures] */
+                         int nthreads,
+                         unsigned int rng_seed);
+
+#endif // _H_KMEANS_SEEDING_
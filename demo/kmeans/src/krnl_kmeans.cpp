@@ -17,8 +17,7 @@
 #include "krnl_kmeans.h"
 #include "ap_int.h"
 #include "hls_stream.h"
-
-#define MAX_VALUE 0xFFFFFFFFFFFFFFFF
+#include <float.h>
 
 #define L_CLUSTERS_SZ ((CONST_NCLUSTERS * CONST_NFEATURES + 15) / 16) * 16
 
@@ -38,8 +37,9 @@ const unsigned int c_nclusters = CONST_NCLUSTERS;
 const unsigned int c_num_iter = CONST_NPOINTS / (PARALLEL_POINTS * NUM_CU);
 const unsigned int c_ld_features = CONST_NFEATURES * PARALLEL_POINTS / 16;
 const unsigned int c_ld_clusters = CONST_NFEATURES * CONST_NCLUSTERS / 16;
-const unsigned int c_st_centers = CONST_NFEATURES * CONST_NCLUSTERS / 16;
+const unsigned int c_st_centers = CONST_NFEATURES * CONST_NCLUSTERS / 8;
 const unsigned int c_st_members = PARALLEL_POINTS / 16;
+const unsigned int c_st_bounds = PARALLEL_POINTS / 4;
 
 /*
    This Application do K-means operations.
@@ -54,44 +54,162 @@ const unsigned int c_st_members = PARALLEL_POINTS / 16;
         npoints     (input)     --> Total number of points to execute
         nclusters   (input)     --> Total number clusters
         nfeatures   (input)     --> Total number of features
+    The features and clusters are in the FEATURE_BITS format (see
+   kmeans_feature.h), one per 32-bit word, and new_centers holds one 64-bit
+   sum per cluster feature.
+    With KMEANS_PRUNING (PRUNING=1 in config.mk) the kernel also supports
+   triangle inequality pruning driven by the host:
+        prev_membership (input) --> Memberships of the previous iteration, may
+   be the same buffer as membership
+        group_skip  (input)     --> One bit per group of PARALLEL_POINTS points,
+   set when the host proved that no point of the group can change cluster:
+   the group keeps its previous memberships and skips the distance loop
+        bounds      (output)    --> Squared distance to the nearest and to the
+   second nearest cluster of each point, from which the host derives the
+   bounds of the next iteration (zero for skipped groups)
+        skip_offset (input)     --> Bit of group_skip of the first group
 */
 
 typedef ap_uint<7> index_t;
+// Nearest (low 64 bits) and second nearest squared distances of a point, as
+// doubles
+typedef ap_uint<128> dist_pair_t;
+
+static ap_uint<64> double_bits(double value) {
+    union {
+        double d;
+        unsigned long u;
+    } bits;
+    bits.d = value;
+    return bits.u;
+}
+
+/*
+   Datapath of each feature format. Fixed point sums the squared differences
+   of up to 64 features exactly, float uses single precision distances and
+   double precision center sums.
+*/
+template <typename T>
+struct feature_traits;
+
+template <int W>
+struct feature_traits<ap_uint<W> > {
+    typedef ap_int<W + 1> diff_t;
+    typedef ap_uint<2 * W + 6> dist_t;
+    typedef ap_uint<64> sum_t;
+
+    static ap_uint<W> from_bits(ap_uint<32> bits) { return bits; }
+    static ap_uint<64> sum_bits(sum_t sum) { return sum; }
+    static dist_t max_dist() { return ~dist_t(0); }
+    static double to_double(dist_t dist) { return dist.to_double(); }
+};
+
+template <>
+struct feature_traits<float> {
+    typedef float diff_t;
+    typedef float dist_t;
+    typedef double sum_t;
+
+    static float from_bits(ap_uint<32> bits) {
+        union {
+            unsigned int u;
+            float f;
+        } value;
+        value.u = bits;
+        return value.f;
+    }
+    static ap_uint<64> sum_bits(sum_t sum) { return double_bits(sum); }
+    static dist_t max_dist() { return FLT_MAX; }
+    static double to_double(dist_t dist) { return dist; }
+};
 
+#if FEATURE_BITS == 0
+typedef float kfeature_t;
+#else
+typedef ap_uint<FEATURE_BITS> kfeature_t;
+#endif
+typedef feature_traits<kfeature_t>::sum_t ksum_t;
+
+template <typename T>
 struct point_dist_t {
+    typedef typename feature_traits<T>::diff_t diff_t;
+    typedef typename feature_traits<T>::dist_t dist_t;
+
     index_t index;
-    unsigned long min_dist;
-    unsigned long dist;
+    dist_t min_dist;
+    dist_t second_dist;
+    dist_t dist;
 
     void init() {
         index = 0;
-        min_dist = MAX_VALUE;
+        min_dist = feature_traits<T>::max_dist();
+        second_dist = feature_traits<T>::max_dist();
         dist = 0;
     }
 
-    void update_dist(unsigned long point_value, unsigned int cluster_value) {
-        long diff = (point_value - cluster_value);
+    void update_dist(T point_value, T cluster_value) {
+        diff_t diff = (diff_t)point_value - (diff_t)cluster_value;
         dist += diff * diff;
     }
 
     void update_index(index_t cluster_id) {
         if (dist < min_dist) {
+            second_dist = min_dist;
             min_dist = dist;
             index = cluster_id;
+        } else if (dist < second_dist) {
+            second_dist = dist;
         }
         dist = 0;
     }
+
+#ifdef KMEANS_PRUNING
+    dist_pair_t dist_pair() {
+        dist_pair_t pair;
+        pair.range(63, 0) = double_bits(feature_traits<T>::to_double(min_dist));
+        pair.range(127, 64) = double_bits(feature_traits<T>::to_double(second_dist));
+        return pair;
+    }
+#endif
 };
 
+template <typename T>
 void compute_memberships(hls::stream<unsigned int> index_str[PARALLEL_POINTS],
-                         hls::stream<unsigned int> feature_str[PARALLEL_POINTS],
-                         unsigned int features[PARALLEL_POINTS][CONST_NFEATURES],
-                         unsigned int clusters[L_CLUSTERS_SZ],
+                         hls::stream<T> feature_str[PARALLEL_POINTS],
+#ifdef KMEANS_PRUNING
+                         hls::stream<dist_pair_t> dist_str[PARALLEL_POINTS],
+                         bool skip,
+                         index_t prev_index[PARALLEL_POINTS],
+#endif
+                         T features[PARALLEL_POINTS][CONST_NFEATURES],
+                         T clusters[L_CLUSTERS_SZ],
                          int nclusters,
                          int nfeatures) {
-    point_dist_t pt[PARALLEL_POINTS];
+    point_dist_t<T> pt[PARALLEL_POINTS];
 #pragma HLS ARRAY_PARTITION variable = pt complete
 
+#ifdef KMEANS_PRUNING
+    // A skipped group only forwards its features and previous memberships to
+    // the new centers computation
+    if (skip) {
+    skip_features:
+        for (int f = 0; f < nfeatures; f++) {
+#pragma HLS LOOP_TRIPCOUNT min = c_nfeatures max = c_nfeatures
+#pragma HLS PIPELINE
+            for (int p = 0; p < PARALLEL_POINTS; p++) {
+#pragma HLS UNROLL
+                feature_str[p].write(features[p][f]);
+            }
+        }
+        for (int p = 0; p < PARALLEL_POINTS; p++) {
+#pragma HLS UNROLL
+            index_str[p].write(prev_index[p]);
+            dist_str[p].write(0);
+        }
+        return;
+    }
+#endif
+
     for (int p = 0; p < PARALLEL_POINTS; p++) {
 #pragma HLS UNROLL
         pt[p].init();
@@ -127,12 +245,20 @@ write_index_str:
         // The next process will take care of writing the index to global memory
         // instead.
         index_str[p].write(pt[p].index);
+#ifdef KMEANS_PRUNING
+        dist_str[p].write(pt[p].dist_pair());
+#endif
     }
 }
 
+template <typename T>
 void compute_new_centers(hls::stream<unsigned int> index_str[PARALLEL_POINTS],
-                         hls::stream<unsigned int> feature_str[PARALLEL_POINTS],
-                         unsigned int l_new_centers[L_CLUSTERS_SZ],
+                         hls::stream<T> feature_str[PARALLEL_POINTS],
+#ifdef KMEANS_PRUNING
+                         hls::stream<dist_pair_t> dist_str[PARALLEL_POINTS],
+                         dist_pair_t l_dist[PARALLEL_POINTS],
+#endif
+                         typename feature_traits<T>::sum_t l_new_centers[L_CLUSTERS_SZ],
                          index_t l_index[PARALLEL_POINTS],
                          int npoints,
                          int nclusters,
@@ -152,9 +278,12 @@ calc_centers_1:
             if (f == 0) {
                 index = index_str[p].read();
                 l_index[p] = index;
+#ifdef KMEANS_PRUNING
+                l_dist[p] = dist_str[p].read();
+#endif
             }
 
-            unsigned int feature = feature_str[p].read();
+            T feature = feature_str[p].read();
 
             // Since we've increased the buffer size to be multiple of 16
             // Make sure we don't include unwanted values in the calculation
@@ -163,7 +292,8 @@ calc_centers_1:
     }
 }
 
-void load_clusters(unsigned int l_clusters[L_CLUSTERS_SZ], ap_int<512>* clusters, int nclusters, int nfeatures) {
+template <typename T>
+void load_clusters(T l_clusters[L_CLUSTERS_SZ], ap_int<512>* clusters, int nclusters, int nfeatures) {
     unsigned nreads = (nclusters * nfeatures + 15) / 16;
 
 ld_clusters:
@@ -173,12 +303,13 @@ ld_clusters:
 
         ap_int<512> tmp = clusters[i];
         for (int j = 0; j < 16; j++) {
-            l_clusters[i * 16 + j] = tmp.range(j * 32 + 31, j * 32);
+            l_clusters[i * 16 + j] = feature_traits<T>::from_bits(tmp.range(j * 32 + 31, j * 32));
         }
     }
 }
 
-void load_features(unsigned int l_features[PARALLEL_POINTS][CONST_NFEATURES],
+template <typename T>
+void load_features(T l_features[PARALLEL_POINTS][CONST_NFEATURES],
                    ap_int<512>* feature,
                    int nfeatures,
                    unsigned nmem_reads,
@@ -198,7 +329,7 @@ ld_features:
 
         ap_int<512> tmp = feature[offset + i];
         for (int j = 0; j < 16; j++) {
-            l_features[p * 16 + j][f] = tmp.range(j * 32 + 31, j * 32);
+            l_features[p * 16 + j][f] = feature_traits<T>::from_bits(tmp.range(j * 32 + 31, j * 32));
         }
     }
 
@@ -225,8 +356,45 @@ st_members:
     offset += PARALLEL_POINTS / 16;
 }
 
-void store_centers(ap_int<512>* new_centers, unsigned int l_new_centers[L_CLUSTERS_SZ], int nclusters, int nfeatures) {
-    unsigned nwrites = (nclusters * nfeatures + 15) / 16;
+#ifdef KMEANS_PRUNING
+void load_memberships(index_t index[PARALLEL_POINTS], ap_int<512>* membership, unsigned nmem_reads, unsigned offset) {
+ld_members:
+    for (int i = 0; i < nmem_reads; i++) {
+#pragma HLS LOOP_TRIPCOUNT min = c_st_members max = c_st_members
+#pragma HLS PIPELINE
+
+        ap_int<512> tmp = membership[offset + i];
+        for (int j = 0; j < 16; j++) {
+            index[i * 16 + j] = tmp.range(j * 32 + 31, j * 32);
+        }
+    }
+}
+
+// Each 512-bit word holds the distance pairs of 4 points
+void store_bounds(ap_int<512>* bounds, dist_pair_t dist[PARALLEL_POINTS], unsigned nmem_writes, unsigned& offset) {
+st_bounds:
+    for (int i = 0; i < nmem_writes * 4; i++) {
+#pragma HLS LOOP_TRIPCOUNT min = c_st_bounds max = c_st_bounds
+#pragma HLS PIPELINE
+
+        ap_int<512> tmp;
+        for (int j = 0; j < 4; j++) {
+            tmp.range(j * 128 + 127, j * 128) = dist[i * 4 + j];
+        }
+        bounds[offset + i] = tmp;
+    }
+
+    offset += PARALLEL_POINTS / 4;
+}
+#endif
+
+// Each 512-bit word holds 8 center sums
+template <typename T>
+void store_centers(ap_int<512>* new_centers,
+                   typename feature_traits<T>::sum_t l_new_centers[L_CLUSTERS_SZ],
+                   int nclusters,
+                   int nfeatures) {
+    unsigned nwrites = (nclusters * nfeatures + 7) / 8;
 
 st_centers:
     for (int i = 0; i < nwrites; i++) {
@@ -234,15 +402,22 @@ st_centers:
 #pragma HLS PIPELINE
 
         ap_int<512> tmp;
-        for (int j = 0; j < 16; j++) {
-            tmp.range(j * 32 + 31, j * 32) = l_new_centers[i * 16 + j];
+        for (int j = 0; j < 8; j++) {
+            tmp.range(j * 64 + 63, j * 64) = feature_traits<T>::sum_bits(l_new_centers[i * 8 + j]);
         }
         new_centers[i] = tmp;
     }
 }
 
 void proc_memberships(hls::stream<unsigned int> index_str[PARALLEL_POINTS],
-                      hls::stream<unsigned int> feature_str[PARALLEL_POINTS],
+                      hls::stream<kfeature_t> feature_str[PARALLEL_POINTS],
+#ifdef KMEANS_PRUNING
+                      hls::stream<dist_pair_t> dist_str[PARALLEL_POINTS],
+                      ap_int<512>* prev_membership,
+                      ap_int<512>* group_skip,
+                      unsigned members_offset,
+                      unsigned skip_offset,
+#endif
                       ap_int<512>* features,
                       ap_int<512>* clusters,
                       int npoints,
@@ -252,14 +427,16 @@ void proc_memberships(hls::stream<unsigned int> index_str[PARALLEL_POINTS],
 #pragma HLS INLINE RECURSIVE
 
     unsigned max_nvalid_points = PARALLEL_POINTS;
-    unsigned min_nvalid_points = npoints - (npoints / PARALLEL_POINTS) * PARALLEL_POINTS;
+    // Points of the last iteration, a full PARALLEL_POINTS when npoints is a
+    // multiple of it
+    unsigned min_nvalid_points = npoints - ((npoints - 1) / PARALLEL_POINTS) * PARALLEL_POINTS;
     unsigned max_rd_feature_count = nfeatures * ((max_nvalid_points - 1) / 16 + 1);
     unsigned min_rd_feature_count = nfeatures * ((min_nvalid_points - 1) / 16 + 1);
     unsigned rd_feature_offset = feature_offset;
 
     unsigned num_iterations = (npoints + PARALLEL_POINTS - 1) / PARALLEL_POINTS;
 
-    unsigned int l_clusters[L_CLUSTERS_SZ];
+    kfeature_t l_clusters[L_CLUSTERS_SZ];
 #pragma HLS ARRAY_PARTITION variable = l_clusters cyclic factor = 16
 
     load_clusters(l_clusters, clusters, nclusters, nfeatures);
@@ -267,21 +444,41 @@ void proc_memberships(hls::stream<unsigned int> index_str[PARALLEL_POINTS],
     for (unsigned int i = 0; i < num_iterations; i++) {
 #pragma HLS LOOP_TRIPCOUNT min = c_num_iter max = c_num_iter
 
-        unsigned int l_features[PARALLEL_POINTS][CONST_NFEATURES];
+        kfeature_t l_features[PARALLEL_POINTS][CONST_NFEATURES];
 #pragma HLS ARRAY_PARTITION variable = l_features complete dim = 1
 
         unsigned rd_feature_count = (i == (num_iterations - 1)) ? min_rd_feature_count : max_rd_feature_count;
 
         load_features(l_features, features, nfeatures, rd_feature_count, rd_feature_offset);
 
+#ifdef KMEANS_PRUNING
+        index_t l_prev_index[PARALLEL_POINTS];
+#pragma HLS ARRAY_PARTITION variable = l_prev_index complete
+
+        unsigned group = skip_offset + i;
+        bool skip = group_skip[group / 512].range(group % 512, group % 512) == 1;
+        if (skip) {
+            unsigned rd_members_count = rd_feature_count / nfeatures;
+            load_memberships(l_prev_index, prev_membership, rd_members_count,
+                             members_offset + i * (PARALLEL_POINTS / 16));
+        }
+
+        compute_memberships(index_str, feature_str, dist_str, skip, l_prev_index, l_features, l_clusters, nclusters,
+                            nfeatures);
+#else
         compute_memberships(index_str, feature_str, l_features, l_clusters, nclusters, nfeatures);
+#endif
     }
 }
 
 void proc_new_centers(ap_int<512>* membership,
                       ap_int<512>* new_centers,
                       hls::stream<unsigned int> index_str[PARALLEL_POINTS],
-                      hls::stream<unsigned int> feature_str[PARALLEL_POINTS],
+                      hls::stream<kfeature_t> feature_str[PARALLEL_POINTS],
+#ifdef KMEANS_PRUNING
+                      hls::stream<dist_pair_t> dist_str[PARALLEL_POINTS],
+                      ap_int<512>* bounds,
+#endif
                       int npoints,
                       int nclusters,
                       int nfeatures,
@@ -289,15 +486,20 @@ void proc_new_centers(ap_int<512>* membership,
 #pragma HLS INLINE RECURSIVE
 
     unsigned max_nvalid_points = PARALLEL_POINTS;
-    unsigned min_nvalid_points = npoints - (npoints / PARALLEL_POINTS) * PARALLEL_POINTS;
+    // Points of the last iteration, a full PARALLEL_POINTS when npoints is a
+    // multiple of it
+    unsigned min_nvalid_points = npoints - ((npoints - 1) / PARALLEL_POINTS) * PARALLEL_POINTS;
     unsigned max_wr_members_count = (max_nvalid_points - 1) / 16 + 1;
     unsigned min_wr_members_count = (min_nvalid_points - 1) / 16 + 1;
     unsigned wr_members_offset = members_offset;
     unsigned wr_centers_count = 0;
+#ifdef KMEANS_PRUNING
+    unsigned wr_bounds_offset = members_offset * 4;
+#endif
 
     unsigned num_iterations = (npoints + PARALLEL_POINTS - 1) / PARALLEL_POINTS;
 
-    unsigned int l_new_centers[L_CLUSTERS_SZ];
+    ksum_t l_new_centers[L_CLUSTERS_SZ];
 #pragma HLS ARRAY_PARTITION variable = l_new_centers cyclic factor = 16
 
 // Zero the new centers
@@ -315,13 +517,23 @@ init_centers:
 
         unsigned wr_members_count = (i == (num_iterations - 1)) ? min_wr_members_count : max_wr_members_count;
 
+#ifdef KMEANS_PRUNING
+        dist_pair_t l_dist[PARALLEL_POINTS];
+#pragma HLS ARRAY_PARTITION variable = l_dist complete
+
+        compute_new_centers(index_str, feature_str, dist_str, l_dist, l_new_centers, l_index, npoints, nclusters,
+                            nfeatures, wr_centers_count);
+
+        store_bounds(bounds, l_dist, wr_members_count, wr_bounds_offset);
+#else
         compute_new_centers(index_str, feature_str, l_new_centers, l_index, npoints, nclusters, nfeatures,
                             wr_centers_count);
+#endif
 
         store_memberships(membership, l_index, wr_members_count, wr_members_offset);
     }
 
-    store_centers(new_centers, l_new_centers, nclusters, nfeatures);
+    store_centers<kfeature_t>(new_centers, l_new_centers, nclusters, nfeatures);
 }
 
 extern "C" {
@@ -334,7 +546,15 @@ void kmeans(ap_int<512>* features,
             int nclusters,
             int nfeatures,
             unsigned feature_offset,
+#ifdef KMEANS_PRUNING
+            unsigned members_offset,
+            ap_int<512>* prev_membership,
+            ap_int<512>* group_skip,
+            ap_int<512>* bounds,
+            unsigned skip_offset) {
+#else
             unsigned members_offset) {
+#endif
 #pragma HLS INTERFACE m_axi port = features bundle = gmem0 offset = slave
 #pragma HLS INTERFACE m_axi port = clusters bundle = gmem0 offset = slave
 #pragma HLS INTERFACE m_axi port = membership bundle = gmem0 offset = slave
@@ -348,14 +568,28 @@ void kmeans(ap_int<512>* features,
 #pragma HLS INTERFACE s_axilite port = nfeatures bundle = control
 #pragma HLS INTERFACE s_axilite port = feature_offset bundle = control
 #pragma HLS INTERFACE s_axilite port = members_offset bundle = control
+#ifdef KMEANS_PRUNING
+#pragma HLS INTERFACE m_axi port = prev_membership bundle = gmem0 offset = slave
+#pragma HLS INTERFACE m_axi port = group_skip bundle = gmem0 offset = slave
+#pragma HLS INTERFACE m_axi port = bounds bundle = gmem0 offset = slave
+#pragma HLS INTERFACE s_axilite port = prev_membership bundle = control
+#pragma HLS INTERFACE s_axilite port = group_skip bundle = control
+#pragma HLS INTERFACE s_axilite port = bounds bundle = control
+#pragma HLS INTERFACE s_axilite port = skip_offset bundle = control
+#endif
 #pragma HLS INTERFACE s_axilite port = return bundle = control
 
     static hls::stream<unsigned int> index_str[PARALLEL_POINTS];
-    static hls::stream<unsigned int> feature_str[PARALLEL_POINTS];
+    static hls::stream<kfeature_t> feature_str[PARALLEL_POINTS];
 
 #pragma HLS stream variable = index_str depth = 2
 #pragma HLS stream variable = feature_str depth = c_nfeatures
 
+#ifdef KMEANS_PRUNING
+    static hls::stream<dist_pair_t> dist_str[PARALLEL_POINTS];
+#pragma HLS stream variable = dist_str depth = 2
+#endif
+
 // The DATAFLOW optimization creates a kernel where the two functions
 // below run in a concurrent fashion (if allowed by the flow of data)
 // While these two functions execute sequentially in software, they
@@ -363,23 +597,48 @@ void kmeans(ap_int<512>* features,
 
 #pragma HLS DATAFLOW
 
+#ifdef KMEANS_PRUNING
+    // prev_membership is a separate argument from membership even when both
+    // point to the same buffer: a dataflow process cannot share an argument
+    // with another one. A group is only read here before proc_new_centers
+    // writes it.
+    proc_memberships(index_str, feature_str, dist_str, prev_membership, group_skip, members_offset, skip_offset,
+                     features, clusters, npoints, nclusters, nfeatures, feature_offset);
+
+    proc_new_centers(membership, new_centers, index_str, feature_str, dist_str, bounds, npoints, nclusters, nfeatures,
+                     members_offset);
+#else
     proc_memberships(index_str, feature_str, features, clusters, npoints, nclusters, nfeatures, feature_offset);
 
     proc_new_centers(membership, new_centers, index_str, feature_str, npoints, nclusters, nfeatures, members_offset);
+#endif
 }
 
 } // end extern "C"
 
-void kmeans_kernel_wrapper(unsigned int* features,
-                           unsigned int* clusters,
+void kmeans_kernel_wrapper(feature_t* features,
+                           feature_t* clusters,
                            int* membership,
-                           unsigned int* new_centers,
+                           center_sum_t* new_centers,
                            int npoints,
                            int nclusters,
                            int nfeatures,
                            unsigned feature_offset,
+#ifdef KMEANS_PRUNING
+                           unsigned members_offset,
+                           int* prev_membership,
+                           unsigned int* group_skip,
+                           double* bounds,
+                           unsigned skip_offset) {
+    kmeans(reinterpret_cast<ap_int<512>*>(features), reinterpret_cast<ap_int<512>*>(clusters),
+           reinterpret_cast<ap_int<512>*>(membership), reinterpret_cast<ap_int<512>*>(new_centers), npoints, nclusters,
+           nfeatures, feature_offset, members_offset, reinterpret_cast<ap_int<512>*>(prev_membership),
+           reinterpret_cast<ap_int<512>*>(group_skip), reinterpret_cast<ap_int<512>*>(bounds), skip_offset);
+}
+#else
                            unsigned members_offset) {
     kmeans(reinterpret_cast<ap_int<512>*>(features), reinterpret_cast<ap_int<512>*>(clusters),
            reinterpret_cast<ap_int<512>*>(membership), reinterpret_cast<ap_int<512>*>(new_centers), npoints, nclusters,
            nfeatures, feature_offset, members_offset);
 }
+#endif
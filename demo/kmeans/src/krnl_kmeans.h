@@ -17,6 +17,7 @@
 #pragma once
 
 #include "kmeans_config.h"
+#include "kmeans_feature.h"
 #include <assert.h>
 #include <stdio.h>
 #include <string.h>
@@ -25,12 +26,20 @@
 #define CONST_NCLUSTERS 100
 #define CONST_NFEATURES 34
 
-void kmeans_kernel_wrapper(unsigned int* feature,
-                           unsigned int* clusters,
+void kmeans_kernel_wrapper(feature_t* feature,
+                           feature_t* clusters,
                            int* membership,
-                           unsigned int* new_centers,
+                           center_sum_t* new_centers,
                            int npoints,
                            int nclusters,
                            int nfeatures,
                            unsigned feature_offset,
+#ifdef KMEANS_PRUNING
+                           unsigned members_offset,
+                           int* prev_membership,
+                           unsigned int* group_skip,
+                           double* bounds,
+                           unsigned skip_offset);
+#else
                            unsigned members_offset);
+#endif
@@ -11,3 +11,8 @@ ifeq ($(ENABLE_ASYNC_FLOW), yes)
 LDFLAGS += -laio
 CXXFLAGS += -DASYNC_READ
 endif
+
+ifeq ($(ENABLE_IO_URING), yes)
+LDFLAGS += -luring
+CXXFLAGS += -DIO_URING
+endif
@@ -31,13 +31,25 @@
 // One cycle of data process includes: p2p data transfer (p), kernel copy (c)
 // and XDMA (x). Conceptually, x, c and p happens consecutively. The pipeline
 // is designed so that c(n) and x(n) will happen in parallel with p(n+1).
+//
+// With -s, the P2P transfers alone are swept over chunk sizes, queue depths
+// and numbers of files instead, through io_uring, libaio or pread/pwrite.
 
+#include "bench.h"
 #include "cmdlineparser.h"
+#include "io_engine.h"
+#include <algorithm>
 #include <chrono>
 #include <fcntl.h>
+#include <fstream>
 #include <iomanip>
 #include <iostream>
+#include <math.h>
+#include <memory>
+#include <sstream>
 #include <string.h>
+#include <sys/stat.h>
+#include <thread>
 #include <unistd.h>
 
 #ifdef ASYNC_READ
@@ -336,9 +348,394 @@ std::vector<unsigned char> readBinary(const std::string& fileName) {
     }
 }
 
+// Splits a comma separated list
+static vector<string> split(const string& list) {
+    vector<string> items;
+    stringstream stream(list);
+    string item;
+    while (getline(stream, item, ',')) {
+        items.push_back(item);
+    }
+    return items;
+}
+
+static vector<unsigned int> split_uint(const string& list) {
+    vector<unsigned int> values;
+    for (auto& item : split(list)) values.push_back(stoi(item));
+    return values;
+}
+
+// Value below which a fraction p of the sorted samples are
+static double percentile(const vector<double>& sorted, double p) {
+    if (sorted.empty()) return 0;
+    size_t index = (size_t)ceil(p * sorted.size());
+    return sorted[max(index, (size_t)1) - 1];
+}
+
+// Opens the files of the sweep. The regular files, e.g. on tmpfs when there
+// is no NVMe SSD, are made at least bytes long so that every read gets data.
+static bool open_files(const vector<string>& paths, uint64_t bytes, vector<int>& fds) {
+    const size_t fill_unit = 1024 * 1024;
+    char* fill = (char*)aligned_alloc(4096, fill_unit);
+    memset(fill, 'y', fill_unit);
+    bool ok = true;
+    for (auto& path : paths) {
+        int fd = open(path.c_str(), O_RDWR | O_CREAT | O_DIRECT, 0644);
+        if (fd < 0 && errno == EINVAL) {
+            // tmpfs has no O_DIRECT
+            cout << "WARNING: " << path << " does not support O_DIRECT, going through the page cache" << endl;
+            fd = open(path.c_str(), O_RDWR | O_CREAT, 0644);
+        }
+        if (fd < 0) {
+            cerr << "ERR: open " << path << " failed: " << strerror(errno) << endl;
+            ok = false;
+            break;
+        }
+        fds.push_back(fd);
+
+        struct stat st;
+        if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode)) continue;
+        for (uint64_t offset = st.st_size / fill_unit * fill_unit; offset < bytes; offset += fill_unit) {
+            if (pwrite(fd, fill, fill_unit, offset) != (ssize_t)fill_unit) {
+                cerr << "ERR: pwrite failed for " << path << ", err: " << strerror(errno) << endl;
+                ok = false;
+                break;
+            }
+        }
+    }
+    free(fill);
+    return ok;
+}
+
+// One file of a point of the sweep, read or written by its own thread
+// through its own engine, from depth buffers of one chunk each. The buffers
+// are a mapped P2P BO, or host memory when there is no P2P BAR.
+class Stream {
+   public:
+    ~Stream() {
+        // The engine goes first, its teardown cancels or waits for any
+        // request still transferring to the buffers
+        engine.reset();
+        cl_int err;
+        if (bo) {
+            OCL_CHECK(err, err = clEnqueueUnmapMemObject(command_queue, bo, buffers, 0, nullptr, nullptr));
+            clFinish(command_queue);
+            OCL_CHECK(err, err = clReleaseMemObject(bo));
+        } else {
+            free(buffers);
+        }
+    }
+
+    Stream(int file, size_t size, bool p2p) {
+        fd = file;
+        buffers = nullptr;
+        bo = nullptr;
+        ok = true;
+        if (!p2p) {
+            buffers = (char*)aligned_alloc(4096, size);
+            return;
+        }
+
+        cl_int err;
+        cl_mem_ext_ptr_t p2pBoExt = {XCL_MEM_EXT_P2P_BUFFER, nullptr, 0};
+        bo = clCreateBuffer(context, CL_MEM_READ_WRITE | CL_MEM_EXT_PTR_XILINX, size, &p2pBoExt, &err);
+        if (err != CL_SUCCESS) {
+            bo = nullptr;
+            return;
+        }
+        buffers = (char*)clEnqueueMapBuffer(command_queue, bo, CL_TRUE, CL_MAP_WRITE | CL_MAP_READ, 0, size, 0,
+                                            nullptr, nullptr, &err);
+        if (err != CL_SUCCESS) buffers = nullptr;
+    }
+
+    // Moves bytes of the file in chunks, keeping up to depth of them in
+    // flight, and appends the latency of each chunk. After an error no more
+    // chunks are issued, but the ones already issued are still reaped, so
+    // none of them transfers to the buffers once run() returned.
+    void run(size_t chunk, unsigned int depth, uint64_t bytes, bool isWrite, vector<double>& latency_us) {
+        uint64_t count = bytes / chunk, issued = 0, completed = 0;
+        vector<chrono::high_resolution_clock::time_point> submitted(depth);
+        vector<IoEngine::Completion> done;
+        bool failed = false;
+        auto issue = [&](unsigned int slot) {
+            submitted[slot] = chrono::high_resolution_clock::now();
+            if (!engine->prepare(fd, buffers + slot * chunk, chunk, issued * chunk, isWrite, slot)) return false;
+            issued++;
+            return true;
+        };
+
+        for (unsigned int slot = 0; slot < depth && issued < count && !failed; slot++) {
+            failed = !issue(slot);
+        }
+        while (completed < issued) {
+            done.clear();
+            if (!engine->submit() || !engine->wait(done)) {
+                // Nothing left can be reaped, ~Stream() destroys the engine
+                // before the buffers
+                ok = false;
+                return;
+            }
+            chrono::high_resolution_clock::time_point now = chrono::high_resolution_clock::now();
+            for (auto& c : done) {
+                completed++;
+                if (c.result != (ssize_t)chunk && !failed) {
+                    cerr << "ERR: " << (isWrite ? "pwrite" : "pread") << " of chunk " << c.slot << " returned "
+                         << (c.result < 0 ? string(strerror(-c.result)) : to_string(c.result)) << endl;
+                    failed = true;
+                }
+                if (failed) continue;
+                latency_us.push_back(chrono::duration<double, micro>(now - submitted[c.slot]).count());
+                if (issued < count) failed = !issue(c.slot);
+            }
+        }
+        if (failed) ok = false;
+    }
+
+    int fd;
+    char* buffers;
+    cl_mem bo;
+    unique_ptr<IoEngine> engine;
+    bool ok;
+};
+
+// Results of one point of the sweep, with the latencies of the chunks in
+// microseconds from their submission to their completion
+struct Profile {
+    string engine;
+    uint64_t chunk;
+    unsigned int files;
+    unsigned int depth;
+    double mbps;
+    vector<double> latency_us;
+};
+
+// Reads or writes bytes of each of the first num_files files per repetition,
+// one thread and engine per file. Returns false on an I/O error, and leaves
+// profile.files to 0 when the buffers could not be allocated.
+static bool profile(sda::utils::BandwidthBench& bench,
+                    const vector<int>& fds,
+                    const string& engine,
+                    bool p2p,
+                    bool isWrite,
+                    size_t chunk,
+                    unsigned int num_files,
+                    unsigned int depth,
+                    uint64_t bytes,
+                    Profile& result) {
+    result = {engine, chunk, 0, depth, 0, {}};
+    vector<unique_ptr<Stream> > streams;
+    for (unsigned int i = 0; i < num_files; i++) {
+        Stream* s = new Stream(fds[i], chunk * depth, p2p);
+        streams.push_back(unique_ptr<Stream>(s));
+        if (!s->buffers) {
+            cout << "WARNING: cannot allocate " << num_files << " x " << chunk * depth / 1024
+                 << "KB of buffers, skipping " << chunk / 1024 << "KB chunks at depth " << depth << endl;
+            return true;
+        }
+        memset(s->buffers, 'w', chunk * depth);
+        s->engine = IoEngine::create(engine, depth);
+    }
+
+    // The warm-up repetitions are left out of the latencies
+    vector<vector<double> > latency_us(num_files);
+    unsigned int repetition = 0;
+    bool ok = true;
+    string config = engine + "_f" + to_string(num_files) + "_qd" + to_string(depth);
+    sda::utils::BandwidthBench::Point point = {p2p ? "p2p" : "host", isWrite ? "write" : "read", config, num_files,
+                                               chunk, (double)bytes * num_files};
+    auto& mbps = bench.run(point, [&] {
+        bool warmup = repetition++ < bench.options().warmup;
+        if (!ok) return;
+        vector<vector<double> > latency_rep(num_files);
+        vector<thread> workers;
+        for (unsigned int i = 1; i < num_files; i++) {
+            workers.push_back(
+                thread(&Stream::run, streams[i].get(), chunk, depth, bytes, isWrite, ref(latency_rep[i])));
+        }
+        streams[0]->run(chunk, depth, bytes, isWrite, latency_rep[0]);
+        for (auto& worker : workers) {
+            worker.join();
+        }
+        for (auto& s : streams) ok = ok && s->ok;
+        if (warmup) return;
+        for (unsigned int i = 0; i < num_files; i++) {
+            latency_us[i].insert(latency_us[i].end(), latency_rep[i].begin(), latency_rep[i].end());
+        }
+    });
+
+    result.files = num_files;
+    result.mbps = mbps.median;
+    for (auto& l : latency_us) result.latency_us.insert(result.latency_us.end(), l.begin(), l.end());
+    sort(result.latency_us.begin(), result.latency_us.end());
+    return ok;
+}
+
+// Sweeps the chunk sizes, file counts and queue depths with the engine
+static bool sweep(sda::utils::BandwidthBench& bench,
+                  const vector<int>& fds,
+                  const string& engine,
+                  bool p2p,
+                  bool isWrite,
+                  const vector<unsigned int>& file_counts,
+                  const vector<unsigned int>& depths,
+                  uint64_t bytes,
+                  vector<Profile>& profiles) {
+    vector<unsigned int> counts;
+    for (auto num_files : file_counts) {
+        if (num_files == 0 || num_files > fds.size())
+            cout << "WARNING: Skipping " << num_files << " files, " << fds.size() << " given" << endl;
+        else
+            counts.push_back(num_files);
+    }
+    for (auto chunk : bench.sizes()) {
+        for (auto num_files : counts) {
+            for (auto depth : depths) {
+                // A file cannot have more than its size in flight, and the
+                // sync engine has a single request in flight
+                if (depth == 0 || chunk * depth > bytes || (engine == "sync" && depth > 1)) continue;
+                Profile result;
+                if (!profile(bench, fds, engine, p2p, isWrite, chunk, num_files, depth, bytes, result)) return false;
+                if (result.files) profiles.push_back(result);
+            }
+        }
+    }
+    return true;
+}
+
+static void print_profiles(const vector<Profile>& profiles) {
+    printf("\nChunk latency (us from submission to completion)\n");
+    printf("%-8s %8s %5s %5s %10s %9s %9s %9s %9s %9s\n", "engine", "chunk", "files", "depth", "MB/s", "p50", "p90",
+           "p99", "p99.9", "max");
+    for (auto& p : profiles) {
+        printf("%-8s %8s %5u %5u %10.1f %9.1f %9.1f %9.1f %9.1f %9.1f\n", p.engine.c_str(),
+               sda::utils::BandwidthBench::sizeString(p.chunk).c_str(), p.files, p.depth, p.mbps,
+               percentile(p.latency_us, 0.5), percentile(p.latency_us, 0.9), percentile(p.latency_us, 0.99),
+               percentile(p.latency_us, 0.999), percentile(p.latency_us, 1));
+    }
+}
+
+static bool write_profiles(const vector<Profile>& profiles, const string& filename) {
+    ofstream file(filename);
+    if (!file) {
+        cout << "ERROR : cannot write " << filename << endl;
+        return false;
+    }
+    file << "engine,chunk,files,depth,mbps,p50_us,p90_us,p99_us,p999_us,max_us\n";
+    for (auto& p : profiles) {
+        file << p.engine << "," << p.chunk << "," << p.files << "," << p.depth << "," << p.mbps << ","
+             << percentile(p.latency_us, 0.5) << "," << percentile(p.latency_us, 0.9) << ","
+             << percentile(p.latency_us, 0.99) << "," << percentile(p.latency_us, 0.999) << ","
+             << percentile(p.latency_us, 1) << "\n";
+    }
+    cout << "Latencies written to " << filename << endl;
+    return true;
+}
+
+// Creates the context and the command queue of a device, and the program of
+// the xclbin
+cl_program open_device(cl_uint dev_id, const std::string& binaryFile) {
+    cl_int err = CL_SUCCESS;
+    int error;
+    cl_platform_id platform = nullptr;
+    error = clGetPlatformIDs(1, &platform, nullptr);
+
+    cl_uint num_devices = 0;
+    error = clGetDeviceIDs(platform, CL_DEVICE_TYPE_ACCELERATOR, 0, nullptr, &num_devices);
+    if (error != CL_SUCCESS) {
+        printf("Error: no devices\n");
+        exit(EXIT_FAILURE);
+    }
+    std::vector<cl_device_id> devices(num_devices);
+    error = clGetDeviceIDs(platform, CL_DEVICE_TYPE_ACCELERATOR, num_devices, devices.data(), nullptr);
+    if (error != CL_SUCCESS) {
+        printf("Error: could not determine device name\n");
+        exit(EXIT_FAILURE);
+    }
+    if (dev_id >= num_devices) {
+        cout << "The device_id provided using -d flag is outside the range of "
+                "available devices\n";
+        exit(EXIT_FAILURE);
+    }
+    cl_device_id device = devices[dev_id];
+
+    context = clCreateContext(0, 1, &device, nullptr, nullptr, &err);
+    if (err != CL_SUCCESS) std::cout << "clCreateContext call: Failed to create a compute context" << err << std::endl;
+
+    command_queue =
+        clCreateCommandQueue(context, device, CL_QUEUE_PROFILING_ENABLE | CL_QUEUE_OUT_OF_ORDER_EXEC_MODE_ENABLE, &err);
+    if (err != CL_SUCCESS) std::cout << "clCreateCommandQueue call: Failed to create command queue" << err << std::endl;
+
+    // Read xclbin and create program
+    std::vector<unsigned char> binary = readBinary(binaryFile);
+    size_t binary_size = binary.size();
+    const unsigned char* binary_data = binary.data();
+    cl_program program = clCreateProgramWithBinary(context, 1, &device, &binary_size, &binary_data, nullptr, &err);
+    return program;
+}
+
+// Sweep of the P2P transfers alone, without the kernel and the XDMA. Without
+// an xclbin, or with -hb, the buffers are in host memory, so that the engines
+// can be tried on regular files when there is no NVMe SSD or P2P BAR.
+static int run_sweep(sda::utils::CmdLineParser& parser,
+                     sda::utils::BandwidthBench& bench,
+                     const vector<string>& paths,
+                     bool isWrite,
+                     const string& binaryFile,
+                     cl_uint dev_id) {
+    // The engine actually available, after the fallbacks
+    unique_ptr<IoEngine> engine = IoEngine::create(parser.value("engine"), 1);
+    if (!engine) return EXIT_FAILURE;
+    uint64_t bytes = sda::utils::BandwidthBench::parseSize(parser.value("file_size"));
+    string latency_csv = parser.value("latency_csv");
+
+    bool p2p = !binaryFile.empty() && !parser.value_to_bool("host_buffers");
+    cl_program program = nullptr;
+    if (p2p) {
+        program = open_device(dev_id, binaryFile);
+        bench.setInfo("xclbin", binaryFile);
+    } else {
+        cout << "INFO: No P2P buffers, reading and writing host memory" << endl;
+    }
+    cout << "INFO: " << engine->name() << " engine, " << bytes / 1024 << "KB per file, "
+         << (isWrite ? "writing" : "reading") << " " << paths.size() << " files" << endl;
+
+    vector<int> fds;
+    vector<Profile> profiles;
+    bool ok = open_files(paths, bytes, fds) &&
+              sweep(bench, fds, engine->name(), p2p, isWrite, split_uint(parser.value("files")),
+                    split_uint(parser.value("depths")), bytes, profiles);
+    for (auto fd : fds) close(fd);
+    if (p2p) {
+        clReleaseProgram(program);
+        clReleaseCommandQueue(command_queue);
+        clReleaseContext(context);
+    }
+
+    print_profiles(profiles);
+    if (!ok || (!latency_csv.empty() && !write_profiles(profiles, latency_csv)) || !bench.write() || !bench.check()) {
+        cout << "INFO: Test failed" << endl;
+        return EXIT_FAILURE;
+    }
+    cout << "INFO: Test passed" << endl;
+    return EXIT_SUCCESS;
+}
+
 int main(int argc, char** argv) {
     // Command Line Parser
     sda::utils::CmdLineParser parser;
+    sda::utils::BandwidthBench bench("p2p_overlap_bandwidth");
+    bench.options().min_size = 16 * 1024;
+    bench.options().max_size = 4 * 1024 * 1024;
+    bench.options().reps = 3;
+    bench.options().max_reps = 10;
+    std::string file_size = "256M";
+    if (xcl::is_emulation()) {
+        bench.options().max_size = 64 * 1024;
+        bench.options().reps = 1;
+        bench.options().max_reps = 3;
+        bench.options().warmup = 0;
+        file_size = "1M";
+    }
 
     // Switches
     //**************//"<Full Arg>",  "<Short Arg>", "<Description>", "<Default>"
@@ -347,7 +744,16 @@ int main(int argc, char** argv) {
     parser.addSwitch("--input_file", "-f", "input file string", "");
     parser.addSwitch("--device", "-d", "device id", "0");
     parser.addSwitch("--mode", "-m", "mode r/w", "r");
+    parser.addSwitch("--sweep", "-s", "sweep the P2P transfers alone over chunk sizes, files and depths", "", true);
+    parser.addSwitch("--engine", "-e", "I/O engine of the sweep, io_uring, libaio or sync", "io_uring");
+    parser.addSwitch("--depths", "-q", "requests in flight per file", "1,8,32");
+    parser.addSwitch("--files", "-nf", "numbers of files, out of the comma separated -p or -f list", "1,2,4");
+    parser.addSwitch("--file_size", "-fs", "bytes moved per file and repetition", file_size);
+    parser.addSwitch("--host_buffers", "-hb", "sweep with host buffers instead of P2P buffers", "", true);
+    parser.addSwitch("--latency_csv", "-lc", "CSV file of the latencies", "");
+    bench.addSwitches(parser);
     parser.parse(argc, argv);
+    bench.parse(parser);
 
     // Read settings
     auto binaryFile = parser.value("xclbin_file");
@@ -361,6 +767,15 @@ int main(int argc, char** argv) {
         chunk_size = total_size / num_chunks;
     }
 
+    if (parser.value_to_bool("sweep")) {
+        vector<string> paths = split(filepath.empty() ? parser.value("input_file") : filepath);
+        if (paths.empty() || (mode != "r" && mode != "w")) {
+            parser.printHelp();
+            return EXIT_FAILURE;
+        }
+        return run_sweep(parser, bench, paths, mode == "w", binaryFile, dev_id);
+    }
+
     if (argc < 5) {
         parser.printHelp();
         return EXIT_FAILURE;
@@ -400,41 +815,7 @@ int main(int argc, char** argv) {
     cout << "INFO: Successfully opened NVME SSD " << filename << endl;
 
     cl_int err = CL_SUCCESS;
-    int error;
-    cl_platform_id platform = nullptr;
-    error = clGetPlatformIDs(1, &platform, nullptr);
-
-    cl_uint num_devices = 0;
-    error = clGetDeviceIDs(platform, CL_DEVICE_TYPE_ACCELERATOR, 0, nullptr, &num_devices);
-    if (error != CL_SUCCESS) {
-        printf("Error: no devices\n");
-        exit(EXIT_FAILURE);
-    }
-    std::vector<cl_device_id> devices(num_devices);
-    error = clGetDeviceIDs(platform, CL_DEVICE_TYPE_ACCELERATOR, num_devices, devices.data(), nullptr);
-    if (error != CL_SUCCESS) {
-        printf("Error: could not determine device name\n");
-        exit(EXIT_FAILURE);
-    }
-    cl_device_id device = devices.front();
-    if (dev_id <= num_devices)
-        device = devices[dev_id];
-    else
-        cout << "The device_id provided using -d flag is outside the range of "
-                "available devices\n";
-
-    context = clCreateContext(0, 1, &device, nullptr, nullptr, &err);
-    if (err != CL_SUCCESS) std::cout << "clCreateContext call: Failed to create a compute context" << err << std::endl;
-
-    command_queue =
-        clCreateCommandQueue(context, device, CL_QUEUE_PROFILING_ENABLE | CL_QUEUE_OUT_OF_ORDER_EXEC_MODE_ENABLE, &err);
-    if (err != CL_SUCCESS) std::cout << "clCreateCommandQueue call: Failed to create command queue" << err << std::endl;
-
-    // Read xclbin and create program
-    std::vector<unsigned char> binary = readBinary(binaryFile);
-    size_t binary_size = binary.size();
-    const unsigned char* binary_data = binary.data();
-    cl_program program = clCreateProgramWithBinary(context, 1, &device, &binary_size, &binary_data, nullptr, &err);
+    cl_program program = open_device(dev_id, binaryFile);
 
 #ifdef ASYNC_READ
     io_context_t ctx;
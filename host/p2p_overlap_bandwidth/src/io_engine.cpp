@@ -0,0 +1,229 @@
+/**
+* Copyright (C) 2019-2021 Xilinx, Inc
+*
+* Licensed under the Apache License, Version 2.0 (the "License"). You may
+* not use this file except in compliance with the License. A copy of the
+* License is located at
+*
+*     http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+* WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the
+* License for the specific language governing permissions and limitations
+* under the License.
+*/
+#include "io_engine.h"
+
+#include <errno.h>
+#include <iostream>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+
+#ifdef IO_URING
+#include <liburing.h>
+#endif
+
+#ifdef ASYNC_READ
+#include <libaio.h>
+#endif
+
+#ifdef IO_URING
+// One submission and completion ring of depth entries. The whole batch
+// queued by prepare() goes to the kernel with a single io_uring_submit().
+class UringEngine : public IoEngine {
+   public:
+    UringEngine() : m_ready(false) {}
+    ~UringEngine() {
+        if (m_ready) io_uring_queue_exit(&m_ring);
+    }
+
+    bool init(unsigned int depth) {
+        int ret = io_uring_queue_init(depth, &m_ring, 0);
+        if (ret < 0) {
+            std::cout << "WARNING: io_uring_queue_init failed: " << strerror(-ret) << std::endl;
+            return false;
+        }
+        m_ready = true;
+        return true;
+    }
+
+    const char* name() const { return "io_uring"; }
+
+    bool prepare(int fd, void* buf, size_t len, off_t offset, bool write, unsigned int slot) {
+        struct io_uring_sqe* sqe = io_uring_get_sqe(&m_ring);
+        if (!sqe) {
+            std::cout << "ERROR: io_uring submission queue is full" << std::endl;
+            return false;
+        }
+        if (write)
+            io_uring_prep_write(sqe, fd, buf, len, offset);
+        else
+            io_uring_prep_read(sqe, fd, buf, len, offset);
+        io_uring_sqe_set_data(sqe, (void*)(uintptr_t)slot);
+        return true;
+    }
+
+    bool submit() {
+        int ret = io_uring_submit(&m_ring);
+        if (ret < 0) {
+            std::cout << "ERROR: io_uring_submit failed: " << strerror(-ret) << std::endl;
+            return false;
+        }
+        return true;
+    }
+
+    bool wait(std::vector<Completion>& done) {
+        struct io_uring_cqe* cqe;
+        int ret;
+        while ((ret = io_uring_wait_cqe(&m_ring, &cqe)) == -EINTR)
+            ;
+        if (ret < 0) {
+            std::cout << "ERROR: io_uring_wait_cqe failed: " << strerror(-ret) << std::endl;
+            return false;
+        }
+        do {
+            done.push_back({(unsigned int)(uintptr_t)io_uring_cqe_get_data(cqe), (ssize_t)cqe->res});
+            io_uring_cqe_seen(&m_ring, cqe);
+        } while (io_uring_peek_cqe(&m_ring, &cqe) == 0);
+        return true;
+    }
+
+   private:
+    struct io_uring m_ring;
+    bool m_ready;
+};
+#endif
+
+#ifdef ASYNC_READ
+// One libaio context of depth requests. Each slot owns its iocb, which
+// must stay in place until the request completed.
+class AioEngine : public IoEngine {
+   public:
+    AioEngine() : m_ready(false) { memset(&m_ctx, 0, sizeof(m_ctx)); }
+    ~AioEngine() {
+        if (m_ready) io_destroy(m_ctx);
+    }
+
+    bool init(unsigned int depth) {
+        int ret = io_setup(depth, &m_ctx);
+        if (ret < 0) {
+            std::cout << "WARNING: io_setup failed: " << strerror(-ret) << std::endl;
+            return false;
+        }
+        m_iocbs.resize(depth);
+        m_events.resize(depth);
+        m_ready = true;
+        return true;
+    }
+
+    const char* name() const { return "libaio"; }
+
+    bool prepare(int fd, void* buf, size_t len, off_t offset, bool write, unsigned int slot) {
+        if (slot >= m_iocbs.size()) {
+            std::cout << "ERROR: libaio slot " << slot << " is out of the queue depth" << std::endl;
+            return false;
+        }
+        struct iocb* io = &m_iocbs[slot];
+        if (write)
+            io_prep_pwrite(io, fd, buf, len, offset);
+        else
+            io_prep_pread(io, fd, buf, len, offset);
+        io->data = (void*)(uintptr_t)slot;
+        m_pending.push_back(io);
+        return true;
+    }
+
+    bool submit() {
+        size_t submitted = 0;
+        while (submitted < m_pending.size()) {
+            int ret = io_submit(m_ctx, m_pending.size() - submitted, m_pending.data() + submitted);
+            if (ret < 0) {
+                std::cout << "ERROR: io_submit failed: " << strerror(-ret) << std::endl;
+                return false;
+            }
+            submitted += ret;
+        }
+        m_pending.clear();
+        return true;
+    }
+
+    bool wait(std::vector<Completion>& done) {
+        int ret;
+        while ((ret = io_getevents(m_ctx, 1, m_events.size(), m_events.data(), nullptr)) == -EINTR)
+            ;
+        if (ret < 0) {
+            std::cout << "ERROR: io_getevents failed: " << strerror(-ret) << std::endl;
+            return false;
+        }
+        for (int i = 0; i < ret; i++) {
+            done.push_back({(unsigned int)(uintptr_t)m_events[i].data, (ssize_t)(long)m_events[i].res});
+        }
+        return true;
+    }
+
+   private:
+    io_context_t m_ctx;
+    bool m_ready;
+    std::vector<struct iocb> m_iocbs;
+    std::vector<struct iocb*> m_pending;
+    std::vector<struct io_event> m_events;
+};
+#endif
+
+// Blocking pread/pwrite, so every request has completed when prepare()
+// returns and the queue depth is always 1
+class SyncEngine : public IoEngine {
+   public:
+    const char* name() const { return "sync"; }
+
+    bool prepare(int fd, void* buf, size_t len, off_t offset, bool write, unsigned int slot) {
+        ssize_t ret = write ? pwrite(fd, buf, len, offset) : pread(fd, buf, len, offset);
+        m_done.push_back({slot, ret < 0 ? -errno : ret});
+        return true;
+    }
+
+    bool submit() { return true; }
+
+    bool wait(std::vector<Completion>& done) {
+        if (m_done.empty()) {
+            std::cout << "ERROR: no request to wait for" << std::endl;
+            return false;
+        }
+        done.insert(done.end(), m_done.begin(), m_done.end());
+        m_done.clear();
+        return true;
+    }
+
+   private:
+    std::vector<Completion> m_done;
+};
+
+std::unique_ptr<IoEngine> IoEngine::create(const std::string& name, unsigned int depth) {
+    if (name != "io_uring" && name != "libaio" && name != "sync") {
+        std::cout << "ERROR: unknown I/O engine " << name << ", use io_uring, libaio or sync" << std::endl;
+        return nullptr;
+    }
+    if (name == "io_uring") {
+#ifdef IO_URING
+        std::unique_ptr<UringEngine> engine(new UringEngine);
+        if (engine->init(depth)) return std::move(engine);
+#else
+        std::cout << "WARNING: host built without io_uring, build it with ENABLE_IO_URING=yes" << std::endl;
+#endif
+    }
+    if (name != "sync") {
+#ifdef ASYNC_READ
+        std::unique_ptr<AioEngine> engine(new AioEngine);
+        if (engine->init(depth)) return std::move(engine);
+#else
+        std::cout << "WARNING: host built without libaio, build it with ENABLE_ASYNC_FLOW=yes" << std::endl;
+#endif
+    }
+#if !defined(IO_URING) && !defined(ASYNC_READ)
+    (void)depth;
+#endif
+    if (name != "sync") std::cout << "WARNING: falling back to blocking pread/pwrite" << std::endl;
+    return std::unique_ptr<IoEngine>(new SyncEngine);
+}
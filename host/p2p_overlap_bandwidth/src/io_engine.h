@@ -0,0 +1,58 @@
+/**
+* Copyright (C) 2019-2021 Xilinx, Inc
+*
+* Licensed under the Apache License, Version 2.0 (the "License"). You may
+* not use this file except in compliance with the License. A copy of the
+* License is located at
+*
+*     http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+* WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the
+* License for the specific language governing permissions and limitations
+* under the License.
+*/
+#ifndef IO_ENGINE_H_
+#define IO_ENGINE_H_
+
+#include <memory>
+#include <string>
+#include <sys/types.h>
+#include <vector>
+
+/*!
+ * Submits reads and writes of a file with up to depth of them in flight.
+ * Requests are queued by prepare() and handed to the kernel together by
+ * submit(), then reaped by wait(). Each request carries a slot, the index
+ * of the buffer it uses, which comes back with its completion.
+ *
+ * "io_uring" needs a host built with ENABLE_IO_URING=yes (liburing) and
+ * "libaio" one built with ENABLE_ASYNC_FLOW=yes. "sync" runs each request
+ * with pread/pwrite in prepare(), one at a time.
+ */
+class IoEngine {
+   public:
+    struct Completion {
+        unsigned int slot;
+        ssize_t result; // bytes transferred, or -errno
+    };
+
+    virtual ~IoEngine() {}
+
+    virtual const char* name() const = 0;
+    virtual bool prepare(int fd, void* buf, size_t len, off_t offset, bool write, unsigned int slot) = 0;
+    virtual bool submit() = 0;
+
+    // Blocks until at least one request completed and appends the completed
+    // ones to done
+    virtual bool wait(std::vector<Completion>& done) = 0;
+
+    /*!
+     * Engine of the given name, else the next one available out of
+     * io_uring, libaio and sync, with a warning
+     */
+    static std::unique_ptr<IoEngine> create(const std::string& name, unsigned int depth);
+};
+
+#endif /* IO_ENGINE_H_ */
@@ -14,11 +14,11 @@
 * under the License.
 */
 
+#include "bench.h"
 #include "cmdlineparser.h"
 #include <iostream>
 #include <iomanip>
 #include <vector>
-#include <chrono>
 #include "xcl2.hpp"
 
 #include "experimental/xrt_device.h"
@@ -28,12 +28,26 @@
 int main(int argc, char* argv[]) {
     // Command Line Parser
     sda::utils::CmdLineParser parser;
+    sda::utils::BandwidthBench bench("iops_fast_adapter_xrt");
+    bench.setUnit("ops/s", 1);
+    // -z selects the command counts of the sweep
+    bench.options().min_size = 1;
+    bench.options().max_size = 1000000;
+    bench.options().reps = 5;
+    bench.options().max_reps = 20;
+    if (xcl::is_emulation()) {
+        bench.options().reps = 1;
+        bench.options().max_reps = 3;
+        bench.options().warmup = 0;
+    }
 
     // Switches
     //**************//"<Full Arg>",  "<Short Arg>", "<Description>", "<Default>"
     parser.addSwitch("--xclbin_file", "-x", "input binary file string", "");
     parser.addSwitch("--device_id", "-d", "device index", "0");
+    bench.addSwitches(parser);
     parser.parse(argc, argv);
+    bench.parse(parser);
 
     // Read settings
     std::string binaryFile = parser.value("xclbin_file");
@@ -70,32 +84,37 @@ int main(int argc, char* argv[]) {
     }
     std::cout << "Allocated commands, expect " << expected_cmds << ", created " << cmds.size() << std::endl;
 
+    bench.setInfo("xclbin", binaryFile);
     for (auto num_cmds : cmds_per_run) {
-        uint32_t i = 0;
-        unsigned int issued = 0, completed = 0;
-        auto start = std::chrono::high_resolution_clock::now();
+        if (num_cmds < bench.options().min_size || num_cmds > bench.options().max_size) continue;
+        // Every repetition keeps up to cmds.size() commands in flight until
+        // num_cmds of them completed
+        auto& result = bench.run({"iops", "start", "FA_hello", 1, num_cmds, (double)num_cmds}, [&] {
+            uint32_t i = 0;
+            unsigned int issued = 0, completed = 0;
+
+            for (auto& cmd : cmds) {
+                cmd.start();
+                if (++issued == num_cmds) break;
+            }
 
-        for (auto& cmd : cmds) {
-            cmd.start();
-            if (++issued == num_cmds) break;
-        }
+            while (completed < num_cmds) {
+                cmds[i].wait();
 
-        while (completed < num_cmds) {
-            cmds[i].wait();
+                completed++;
+                if (issued < num_cmds) {
+                    cmds[i].start();
+                    issued++;
+                }
 
-            completed++;
-            if (issued < num_cmds) {
-                cmds[i].start();
-                issued++;
+                if (++i == cmds.size()) i = 0;
             }
-
-            if (++i == cmds.size()) i = 0;
-        }
-
-        auto end = std::chrono::high_resolution_clock::now();
-        double duration = std::chrono::duration_cast<std::chrono::microseconds>(end - start).count();
-        std::cout << "Commands: " << std::setw(7) << num_cmds << " iops: " << (num_cmds * 1000.0 * 1000.0 / duration)
-                  << std::endl;
+        });
+        std::cout << "Commands: " << std::setw(7) << num_cmds << " iops: " << result.median << std::endl;
+    }
+    if (!bench.write() || !bench.check()) {
+        std::cout << "TEST FAILED\n";
+        return EXIT_FAILURE;
     }
     std::cout << "TEST PASSED\n";
     return 0;
@@ -14,30 +14,123 @@
 * under the License.
 */
 
+#include "bench.h"
 #include "cmdlineparser.h"
+#include "latency_histogram.h"
 #include "xcl2.hpp"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <fstream>
 #include <unistd.h>
+#include <vector>
+
+// Latency histogram of the timed runs of one kernel, direction and size,
+// merged from the histograms the kernel writes after each run
+struct LatencyHistogram {
+    std::string width;
+    std::string direction;
+    int64_t bl;
+    int64_t ot;
+    uint64_t size;
+    int64_t words;
+    int64_t samples;
+    int64_t dropped;
+    int64_t min;
+    int64_t max;
+    std::vector<int64_t> bins;
+};
+
+static void merge_histogram(LatencyHistogram& histogram, const int64_t* hist) {
+    histogram.dropped += hist[LATENCY_DROPPED];
+    if (hist[LATENCY_SAMPLES] == 0) return;
+    if (histogram.samples == 0 || hist[LATENCY_MIN] < histogram.min) histogram.min = hist[LATENCY_MIN];
+    histogram.max = std::max(histogram.max, hist[LATENCY_MAX]);
+    histogram.samples += hist[LATENCY_SAMPLES];
+    histogram.words = hist[LATENCY_WORDS];
+    for (int i = 0; i < LATENCY_BINS; i++) histogram.bins[i] += hist[LATENCY_HEADER + i];
+}
+
+// Cycles below which a fraction q of the samples are, from the lowest cycles
+// of their bin, within the exact min and max
+static int64_t latency_quantile(const LatencyHistogram& histogram, double q) {
+    int64_t rank = std::max((int64_t)std::ceil(q * histogram.samples), (int64_t)1);
+    int64_t seen = 0;
+    for (int i = 0; i < LATENCY_BINS; i++) {
+        seen += histogram.bins[i];
+        if (seen >= rank) return std::min(std::max(latency_bin_cycles(i), histogram.min), histogram.max);
+    }
+    return histogram.max;
+}
+
+static void print_latency(const std::vector<LatencyHistogram>& histograms, float frequency) {
+    printf("\nKernel->AXI Burst latency from request to response of a burst of Words words, in ns at %.0f MHz\n",
+           frequency);
+    printf("%-6s %-10s %3s %3s %8s %6s %9s %8s %10s %10s %10s %10s\n", "Width", "Direction", "BL", "OT", "Size",
+           "Words", "Samples", "Dropped", "Min", "Median", "p99", "Max");
+    double ns = 1000.0 / frequency;
+    for (auto& h : histograms) {
+        if (h.samples == 0) continue;
+        printf("%-6s %-10s %3ld %3ld %8s %6ld %9ld %8ld %10.1f %10.1f %10.1f %10.1f\n", h.width.c_str(),
+               h.direction.c_str(), (long)h.bl, (long)h.ot, xcl::convert_size(h.size).c_str(), (long)h.words,
+               (long)h.samples, (long)h.dropped, h.min * ns, latency_quantile(h, 0.5) * ns,
+               latency_quantile(h, 0.99) * ns, h.max * ns);
+    }
+}
+
+// One line per non-empty bin, with the lowest cycles of the bin
+static bool write_latency(const std::string& filename, const std::vector<LatencyHistogram>& histograms) {
+    std::ofstream file(filename.c_str());
+    file << "width,direction,burst_length,num_outstanding,size,words,cycles,samples\n";
+    for (auto& h : histograms) {
+        for (int i = 0; i < LATENCY_BINS; i++) {
+            if (h.bins[i] == 0) continue;
+            file << h.width << "," << h.direction << "," << h.bl << "," << h.ot << "," << h.size << "," << h.words
+                 << "," << latency_bin_cycles(i) << "," << h.bins[i] << "\n";
+        }
+    }
+    if (!file.good()) {
+        printf("Error: cannot write the latency histograms to %s\n", filename.c_str());
+        return false;
+    }
+    printf("Latency histograms written to %s\n", filename.c_str());
+    return true;
+}
 
 int main(int argc, char** argv) {
     // Command Line Parser
     sda::utils::CmdLineParser parser;
+    sda::utils::BandwidthBench bench("axi_burst_performance");
+
+    bench.options().min_size = 16 * 1024 * 1024;
+    bench.options().max_size = 16 * 1024 * 1024;
+    if (xcl::is_emulation()) {
+        bench.options().min_size = 16 * 1024;
+        bench.options().max_size = 16 * 1024;
+        bench.options().reps = 1;
+        bench.options().max_reps = 3;
+        bench.options().warmup = 0;
+    }
 
     // Switches
     //**************//"<Full Arg>",  "<Short Arg>", "<Description>", "<Default>"
     parser.addSwitch("--xclbin_file_testKernel_256", "-x1", "testKernel_256 binary file string", "");
     parser.addSwitch("--xclbin_file_testKernel_512", "-x2", "testKernel_512 binary file string", "");
     parser.addSwitch("--frequency", "-f", "Operating frequency, in MHz", "300");
-    parser.addSwitch("--buf_size_mb", "-m", "Test buffer size, in MB", "16");
-    parser.addSwitch("--buf_size_kb", "-k", "Test buffer size, in KB", "0");
+    parser.addSwitch("--latency", "-lt", "sample the latency every N bursts (0 = off)", "0");
+    parser.addSwitch("--latency_csv", "-lc", "write the latency histograms to this .csv file", "");
+    bench.addSwitches(parser);
     parser.parse(argc, argv);
+    bench.parse(parser);
 
     std::string xclbinFile1 = parser.value("xclbin_file_testKernel_256");
     std::string xclbinFile2 = parser.value("xclbin_file_testKernel_512");
     std::string xclbinFile[] = {xclbinFile1, xclbinFile2};
     std::string Data_Width[] = {"256", "512"};
     float frequency = stof(parser.value("frequency"));
-    int64_t buf_size_mb = stoi(parser.value("buf_size_mb"));
-    int64_t buf_size_kb = stoi(parser.value("buf_size_kb"));
+    int sample_bursts = std::max(parser.value_to_int("latency"), 0);
+    std::string latency_csv = parser.value("latency_csv");
+    std::vector<LatencyHistogram> histograms;
 
     if (argc < 3) {
         parser.printHelp();
@@ -45,10 +138,12 @@ int main(int argc, char** argv) {
     }
 
     int64_t errors = 0;
+    // The data buffer is allocated for the largest transfer of the sweep
+    int64_t buf_size_bytes = bench.options().max_size;
 
     for (int p = 0; p < 2; p++) {
         if (xclbinFile[p].empty()) {
-            std::cerr << "ERROR: xclbin file must be specified with the -x" + std::to_string(p) + " option"
+            std::cerr << "ERROR: xclbin file must be specified with the -x" + std::to_string(p + 1) + " option"
                       << std::endl;
             parser.printHelp();
             return EXIT_FAILURE;
@@ -64,20 +159,13 @@ int main(int argc, char** argv) {
         cl::Context context;
         cl::Kernel krnl[6];
 
-        if (xcl::is_emulation()) {
-            buf_size_kb = 16;
-        }
-
-        if (buf_size_kb == 0) {
-            buf_size_kb = buf_size_mb * 1024;
-        }
-        int64_t buf_size_bytes = buf_size_kb * 1024; // buffer size in bytes
         int64_t kernel_info[4];
 
         std::cout << "\nTest parameters\n";
         std::cout << " - xclbin file   : " << xclbinFile[p].c_str() << std::endl;
         std::cout << " - frequency     : " << frequency << " MHz" << std::endl;
-        std::cout << " - buffer size   : " << xcl::convert_size(buf_size_bytes).c_str() << std::endl;
+        std::cout << " - buffer size   : " << xcl::convert_size(bench.options().min_size).c_str() << " to "
+                  << xcl::convert_size(bench.options().max_size).c_str() << std::endl;
         std::cout << "\n";
 
         auto devices = xcl::get_xil_devices();
@@ -103,6 +191,7 @@ int main(int argc, char** argv) {
                     std::string krnl_name_full = "test_kernel_maxi_" + Data_Width[p] + "bit_" + std::to_string(i + 1);
                     OCL_CHECK(err, krnl[i] = cl::Kernel(program, krnl_name_full.c_str(), &err));
                 }
+                bench.setInfo("device", device.getInfo<CL_DEVICE_NAME>());
                 valid_device = true;
                 break; // we break because we found a valid device
             }
@@ -115,14 +204,18 @@ int main(int argc, char** argv) {
         // Create the buffers
         OCL_CHECK(err, cl::Buffer infoBuf(context, CL_MEM_WRITE_ONLY, sizeof(kernel_info), nullptr, &err));
         OCL_CHECK(err, cl::Buffer dataBuf(context, CL_MEM_READ_WRITE, buf_size_bytes, nullptr, &err));
+        OCL_CHECK(err, cl::Buffer histBuf(context, CL_MEM_WRITE_ONLY, sizeof(int64_t) * LATENCY_SIZE, nullptr, &err));
         // Pin the buffers to kernel arguments
         for (int i = 0; i < 6; i++) {
             OCL_CHECK(err, err = krnl[i].setArg(2, infoBuf));
             OCL_CHECK(err, err = krnl[i].setArg(3, dataBuf));
+            OCL_CHECK(err, err = krnl[i].setArg(4, histBuf));
+            OCL_CHECK(err, err = krnl[i].setArg(5, sample_bursts));
         }
         // Make buffers resident in the device
-        OCL_CHECK(err, err = q.enqueueMigrateMemObjects({infoBuf, dataBuf}, CL_MIGRATE_MEM_OBJECT_CONTENT_UNDEFINED,
-                                                        nullptr, nullptr));
+        OCL_CHECK(err, err = q.enqueueMigrateMemObjects({infoBuf, dataBuf, histBuf},
+                                                        CL_MIGRATE_MEM_OBJECT_CONTENT_UNDEFINED, nullptr, nullptr));
+        std::vector<int64_t> hist(LATENCY_SIZE);
         q.finish();
 
         // Initialize data buffer
@@ -131,36 +224,57 @@ int main(int argc, char** argv) {
             dat[i] = 255;
         }
         OCL_CHECK(err, err = q.enqueueWriteBuffer(dataBuf, CL_TRUE, 0, buf_size_bytes, dat, nullptr, nullptr));
+        delete[] dat;
 
         std::string direction[] = {"WRITE", "READ"};
+        std::string bench_direction[] = {"write", "read"};
 
         for (int dir = 0; dir < 2; dir++) {
             std::cout << "\nKernel->AXI Burst " << direction[dir].c_str() << " performance" << std::endl;
             for (int id = 0; id < 6; id++) {
-                // Run the test
-                OCL_CHECK(err, err = krnl[id].setArg(0, buf_size_bytes));
-                OCL_CHECK(err, err = krnl[id].setArg(1, dir));
-                OCL_CHECK(err, err = q.enqueueTask(krnl[id]));
-                q.finish();
-
-                // Report results
-                OCL_CHECK(err, err = q.enqueueReadBuffer(infoBuf, CL_TRUE, 0, sizeof(kernel_info), kernel_info, nullptr,
-                                                         nullptr));
-                int64_t duration_cy = kernel_info[0];
-                double duration_ns = (double)(duration_cy * 1000) / frequency;
-                double duration_sec = duration_ns / (1000 * 1000 * 1000);
-                double throughput_bps = buf_size_bytes / duration_sec;
-                double throughput_gbps = throughput_bps / (1024 * 1024 * 1024);
-                errors = kernel_info[1];
-                if (!xcl::is_emulation() or xcl::is_hw_emulation()) {
-                    std::cout << "Data Width = " << Data_Width[p];
-                    std::cout << " burst_length = " << kernel_info[2];
-                    std::cout << " num_outstanding = " << kernel_info[3];
-                    std::cout << " buffer_size = " << xcl::convert_size(buf_size_bytes).c_str();
-                    std::cout << " | throughput = " << throughput_gbps << " GB/sec" << std::endl;
-                }
-                if (errors) {
-                    std::cerr << "  ERROR: kernel return code !=0" << std::endl;
+                for (uint64_t size : bench.sizes()) {
+                    OCL_CHECK(err, err = krnl[id].setArg(0, (int64_t)size));
+                    OCL_CHECK(err, err = krnl[id].setArg(1, dir));
+
+                    // Each run is timed by the cycle counter of the kernel. sw_emu has no
+                    // clock, so its runs are timed by the host instead.
+                    std::string test = Data_Width[p] + "bit_" + std::to_string(id + 1);
+                    LatencyHistogram histogram = {Data_Width[p], bench_direction[dir], 0, 0, size, 0, 0, 0, 0, 0,
+                                                  std::vector<int64_t>(LATENCY_BINS, 0)};
+                    unsigned int run = 0;
+                    auto& result = bench.runTimed({test, bench_direction[dir], "DDR[0]", 1, size, (double)size}, [&] {
+                        auto start = std::chrono::steady_clock::now();
+                        OCL_CHECK(err, err = q.enqueueTask(krnl[id]));
+                        q.finish();
+                        std::chrono::duration<double> wall = std::chrono::steady_clock::now() - start;
+
+                        OCL_CHECK(err, err = q.enqueueReadBuffer(infoBuf, CL_TRUE, 0, sizeof(kernel_info),
+                                                                 kernel_info, nullptr, nullptr));
+                        if (kernel_info[1]) {
+                            std::cerr << "  ERROR: kernel return code !=0" << std::endl;
+                            errors++;
+                        }
+                        // The histograms of the warm-up runs are left out
+                        if (sample_bursts && run++ >= bench.options().warmup) {
+                            OCL_CHECK(err, err = q.enqueueReadBuffer(histBuf, CL_TRUE, 0, sizeof(int64_t) * hist.size(),
+                                                                     hist.data(), nullptr, nullptr));
+                            merge_histogram(histogram, hist.data());
+                        }
+                        if (xcl::is_emulation() and !xcl::is_hw_emulation()) return wall.count();
+                        return kernel_info[0] / (frequency * 1000.0 * 1000.0);
+                    });
+
+                    // Report results, median throughput from MB/s to GB/s
+                    if (!xcl::is_emulation() or xcl::is_hw_emulation()) {
+                        std::cout << "Data Width = " << Data_Width[p];
+                        std::cout << " burst_length = " << kernel_info[2];
+                        std::cout << " num_outstanding = " << kernel_info[3];
+                        std::cout << " buffer_size = " << xcl::convert_size(size).c_str();
+                        std::cout << " | throughput = " << result.median / 1024 << " GB/sec" << std::endl;
+                    }
+                    histogram.bl = kernel_info[2];
+                    histogram.ot = kernel_info[3];
+                    if (sample_bursts) histograms.push_back(histogram);
                 }
             }
         }
@@ -172,6 +286,9 @@ int main(int argc, char** argv) {
         }
     }
 
+    if (sample_bursts && (!xcl::is_emulation() or xcl::is_hw_emulation())) print_latency(histograms, frequency);
+    if (!latency_csv.empty() && !write_latency(latency_csv, histograms)) errors++;
+    if (!bench.write() || !bench.check()) errors++;
     std::cout << "\nTEST " << ((!errors) ? "PASSED" : "FAILED") << std::endl;
     return ((!errors) ? EXIT_SUCCESS : EXIT_FAILURE);
 }
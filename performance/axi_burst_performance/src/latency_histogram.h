@@ -0,0 +1,62 @@
+/**
+* Copyright (C) 2019-2021 Xilinx, Inc
+*
+* Licensed under the Apache License, Version 2.0 (the "License"). You may
+* not use this file except in compliance with the License. A copy of the
+* License is located at
+*
+*     http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+* WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the
+* License for the specific language governing permissions and limitations
+* under the License.
+*/
+#ifndef LATENCY_HISTOGRAM_H_
+#define LATENCY_HISTOGRAM_H_
+
+#include <stdint.h>
+
+// Latency histogram written by the kernels after each run: a header followed
+// by the bins, all int64_t
+#define LATENCY_SAMPLES 0 // number of samples
+#define LATENCY_MIN 1     // lowest sample, in cycles
+#define LATENCY_MAX 2     // highest sample, in cycles
+#define LATENCY_WORDS 3   // words of a sampled burst
+#define LATENCY_DROPPED 4 // samples dropped while the histogram fell behind
+#define LATENCY_HEADER 5
+
+// One bin per cycle below 16 cycles, then 16 bins per power of 2 up to 2^32
+// cycles, so every bin is within 6.25% of its samples
+#define LATENCY_SUB_BINS 16
+#define LATENCY_BINS ((32 - 3) * LATENCY_SUB_BINS)
+#define LATENCY_SIZE (LATENCY_HEADER + LATENCY_BINS)
+
+// Marks the response of a sampled burst on the command stream of the
+// counter, and the end of the samples on the stream of the histogram
+#define LATENCY_MARK -1
+// Marks the request of a sampled burst on the command stream of the counter
+#define LATENCY_ISSUE -2
+// Sampled bursts the counter can hold between request and response, more
+// than the outstanding transactions of any kernel
+#define LATENCY_IN_FLIGHT 64
+
+inline int latency_bin(int64_t cycles) {
+    if (cycles < LATENCY_SUB_BINS) return cycles < 0 ? 0 : (int)cycles;
+    if (cycles >> 32) return LATENCY_BINS - 1;
+    int msb = 4;
+    for (int b = 5; b < 32; b++) {
+        if (cycles >> b) msb = b;
+    }
+    return (msb - 3) * LATENCY_SUB_BINS + (int)((cycles >> (msb - 4)) & (LATENCY_SUB_BINS - 1));
+}
+
+// Lowest number of cycles of a bin
+inline int64_t latency_bin_cycles(int bin) {
+    if (bin < LATENCY_SUB_BINS) return bin;
+    int msb = bin / LATENCY_SUB_BINS + 3;
+    return (int64_t)(LATENCY_SUB_BINS + bin % LATENCY_SUB_BINS) << (msb - 4);
+}
+
+#endif /* LATENCY_HISTOGRAM_H_ */
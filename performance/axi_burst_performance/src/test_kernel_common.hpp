@@ -15,62 +15,162 @@
 */
 
 #include "ap_int.h"
+#include "hls_burst_maxi.h"
 #include "hls_stream.h"
+#include "latency_histogram.h"
 #include <cstdint>
 #include <string.h>
 
-template <typename T>
+// The buffers are read and written in explicit bursts of BL words, with up
+// to OT of them in flight, so that the request of a burst and its response
+// can be told apart. Every sample_bursts bursts (0 = no sampling), the
+// counter is sent LATENCY_ISSUE when the request of the burst is issued and
+// LATENCY_MARK when its response arrives: the B response of a write, the
+// last word of a read.
 
-void writeBuffer(T* mem, int64_t buf_size, int burst_size) {
+// Whether a burst, counted modulo sample_bursts, is sampled
+static bool sampled(int& count, int sample_bursts) {
+    if (sample_bursts == 0) return false;
+    bool sample = (count == 0);
+    if (++count == sample_bursts) count = 0;
+    return sample;
+}
+
+template <typename T, int BL, int OT>
+void writeBuffer(
+    hls::burst_maxi<T> mem, int64_t buf_size, int burst_size, hls::stream<int64_t>& cmd, int sample_bursts) {
     buf_size = (buf_size / 1024) * 1024; // Make HLS see that buf_size is a multiple of 1024
+    int64_t words = buf_size / burst_size;
+    int64_t bursts = (words + BL - 1) / BL;
+    int64_t responded = 0;
+    int issued_count = 0, responded_count = 0;
+    int word = 0;
 
 write_buffer:
-    for (int64_t i = 0; i < buf_size / burst_size; i++) {
-        mem[i] = i;
+    for (int64_t i = 0; i < words; i++) {
+#pragma HLS PIPELINE II = 1
+        if (word == 0) {
+            int len = (words - i < BL) ? (int)(words - i) : BL;
+            mem.write_request(i, len);
+            if (sampled(issued_count, sample_bursts)) cmd.write(LATENCY_ISSUE);
+        }
+        mem.write(i);
+        if (++word == BL || i == words - 1) {
+            word = 0;
+            // Wait for the oldest response once OT bursts are in flight
+            if (i / BL - responded + 1 >= OT) {
+                mem.write_response();
+                if (sampled(responded_count, sample_bursts)) cmd.write(LATENCY_MARK);
+                responded++;
+            }
+        }
     }
-}
 
-template <typename T>
+write_responses:
+    for (; responded < bursts; responded++) {
+        mem.write_response();
+        if (sampled(responded_count, sample_bursts)) cmd.write(LATENCY_MARK);
+    }
+}
 
-void readBuffer(T* mem, int64_t buf_size, int64_t& err, int burst_size) {
+template <typename T, int BL, int OT>
+void readBuffer(hls::burst_maxi<T> mem,
+                int64_t buf_size,
+                int64_t& err,
+                int burst_size,
+                hls::stream<int64_t>& cmd,
+                int sample_bursts) {
     int64_t tmp = 0;
 
     buf_size = (buf_size / 1024) * 1024; // Make HLS see that buf_size is a multiple of 1024
+    int64_t words = buf_size / burst_size;
+    int64_t bursts = (words + BL - 1) / BL;
+    int64_t requested = 0;
+    int issued_count = 0, responded_count = 0;
+    int word = 0;
+
+    // Request the first OT bursts, then one more as each one is read
+read_requests:
+    for (; requested < bursts && requested < OT; requested++) {
+        int64_t first = requested * BL;
+        mem.read_request(first, (words - first < BL) ? (int)(words - first) : BL);
+        if (sampled(issued_count, sample_bursts)) cmd.write(LATENCY_ISSUE);
+    }
 
 read_buffer:
-    for (int64_t i = 0; i < buf_size / burst_size; i++) {
-        tmp += (mem[i] != i) ? 1 : 0;
+    for (int64_t i = 0; i < words; i++) {
+#pragma HLS PIPELINE II = 1
+        tmp += (mem.read() != i) ? 1 : 0;
+        if (++word == BL || i == words - 1) {
+            word = 0;
+            if (sampled(responded_count, sample_bursts)) cmd.write(LATENCY_MARK);
+            if (requested < bursts) {
+                int64_t first = requested * BL;
+                mem.read_request(first, (words - first < BL) ? (int)(words - first) : BL);
+                if (sampled(issued_count, sample_bursts)) cmd.write(LATENCY_ISSUE);
+                requested++;
+            }
+        }
     }
 
     err = tmp;
 }
 
 // Template to avoid signature conflict in sw_emu
-template <typename T, int DUMMY = 0>
-void testKernelProc(T* mem, int64_t buf_size, int direction, hls::stream<int64_t>& cmd, int burst_size) {
+template <typename T, int BL, int OT>
+void testKernelProc(hls::burst_maxi<T> mem,
+                    int64_t buf_size,
+                    int direction,
+                    hls::stream<int64_t>& cmd,
+                    int burst_size,
+                    int sample_bursts) {
     if (direction == 0) {
         cmd.write(0); // Send a command to start the counter
-        writeBuffer(mem, buf_size, burst_size);
+        writeBuffer<T, BL, OT>(mem, buf_size, burst_size, cmd, sample_bursts);
         cmd.write(0); // Send a command to stop the counter
     } else {
         int64_t err;
         cmd.write(0); // Send a command to start the counter
-        readBuffer(mem, buf_size, err, burst_size);
+        readBuffer<T, BL, OT>(mem, buf_size, err, burst_size, cmd, sample_bursts);
         cmd.write(err); // Send a command to stop the counter
     }
 }
 
 // Template to avoid signature conflict in sw_emu
 template <int DUMMY = 0>
-void perfCounterProc(hls::stream<int64_t>& cmd, int64_t* out, int direction, int bl, int ot) {
+void perfCounterProc(
+    hls::stream<int64_t>& cmd, hls::stream<int64_t>& samples, int64_t* out, int direction, int bl, int ot) {
+    // Cycles at which the sampled bursts in flight were issued, oldest first,
+    // as the responses of a port come back in order
+    int64_t issued[LATENCY_IN_FLIGHT];
+    int head = 0, tail = 0;
+    int64_t dropped = 0;
+
     int64_t val;
     // wait to receive a value to start counting
     int64_t cnt = cmd.read();
-// keep counting until a value is available
+// keep counting until a value other than a sample command is available.
+// The latency of each sampled burst goes to the histogram without waiting:
+// when the histogram falls behind, the sample is dropped rather than
+// stalling the transfer.
 count:
-    while (cmd.read_nb(val) == false) {
+    while (true) {
+#pragma HLS PIPELINE II = 1
+#pragma HLS DEPENDENCE variable = issued inter false
+        if (cmd.read_nb(val)) {
+            if (val >= 0) break;
+            if (val == LATENCY_ISSUE) {
+                issued[tail] = cnt;
+                tail = (tail + 1) % LATENCY_IN_FLIGHT;
+            } else {
+                if (!samples.write_nb(cnt - issued[head])) dropped++;
+                head = (head + 1) % LATENCY_IN_FLIGHT;
+            }
+        }
         cnt++;
     }
+    samples.write(LATENCY_MARK);
+    samples.write(dropped);
 
     // write out kernel statistics to global memory
     int64_t tmp[4];
@@ -80,3 +180,37 @@ count:
     tmp[3] = ot;
     memcpy(out, tmp, 4 * sizeof(int64_t));
 }
+
+// Bins the samples of the counter and writes the histogram to global memory,
+// in the layout of latency_histogram.h
+// Template to avoid signature conflict in sw_emu
+template <int DUMMY = 0>
+void latencyHistogramProc(hls::stream<int64_t>& samples, int64_t* hist, int burst_words) {
+    int64_t bins[LATENCY_BINS];
+clear_bins:
+    for (int i = 0; i < LATENCY_BINS; i++) {
+        bins[i] = 0;
+    }
+
+    int64_t count = 0;
+    int64_t min = 0;
+    int64_t max = 0;
+bin_samples:
+    while (true) {
+        int64_t sample = samples.read();
+        if (sample == LATENCY_MARK) break;
+        bins[latency_bin(sample)]++;
+        if (count == 0 || sample < min) min = sample;
+        if (sample > max) max = sample;
+        count++;
+    }
+
+    int64_t header[LATENCY_HEADER];
+    header[LATENCY_SAMPLES] = count;
+    header[LATENCY_DROPPED] = samples.read();
+    header[LATENCY_MIN] = min;
+    header[LATENCY_MAX] = max;
+    header[LATENCY_WORDS] = burst_words;
+    memcpy(hist, header, LATENCY_HEADER * sizeof(int64_t));
+    memcpy(hist + LATENCY_HEADER, bins, LATENCY_BINS * sizeof(int64_t));
+}
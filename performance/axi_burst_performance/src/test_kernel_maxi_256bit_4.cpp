@@ -17,15 +17,25 @@
 #include "test_kernel_common.hpp"
 
 extern "C" {
-void test_kernel_maxi_256bit_4(int64_t buf_size, int direction, int64_t* perf, ap_int<256>* mem) {
+void test_kernel_maxi_256bit_4(int64_t buf_size,
+                               int direction,
+                               int64_t* perf,
+                               hls::burst_maxi<ap_int<256> > mem,
+                               int64_t* hist,
+                               int sample_bursts) {
 #pragma HLS INTERFACE m_axi port = mem bundle = aximm0 num_write_outstanding = 32 max_write_burst_length = \
     4 num_read_outstanding = 32 max_read_burst_length = 4 offset = slave
+#pragma HLS INTERFACE m_axi port = hist bundle = aximm1 offset = slave
 
 #pragma HLS DATAFLOW
 
     hls::stream<int64_t> cmd;
+    hls::stream<int64_t> samples;
+    // Holds the samples while the histogram is cleared
+#pragma HLS STREAM variable = samples depth = 512
 
-    testKernelProc(mem, buf_size, direction, cmd, 32);
-    perfCounterProc(cmd, perf, direction, 4, 32);
+    testKernelProc<ap_int<256>, 4, 32>(mem, buf_size, direction, cmd, 32, sample_bursts);
+    perfCounterProc(cmd, samples, perf, direction, 4, 32);
+    latencyHistogramProc(samples, hist, 4);
 }
 }
@@ -0,0 +1,234 @@
+/**
+* Copyright (C) 2019-2021 Xilinx, Inc
+*
+* Licensed under the Apache License, Version 2.0 (the "License"). You may
+* not use this file except in compliance with the License. A copy of the
+* License is located at
+*
+*     http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+* WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the
+* License for the specific language governing permissions and limitations
+* under the License.
+*/
+
+#include "bench.h"
+#include "cmdlineparser.h"
+#include "traffic_gen.h"
+#include "xcl2.hpp"
+#include <algorithm>
+#include <chrono>
+#include <map>
+#include <sstream>
+#include <vector>
+
+static std::vector<int> parse_list(const std::string& list, const char* what, int min, int max) {
+    std::vector<int> values;
+    std::stringstream stream(list);
+    std::string item;
+    while (std::getline(stream, item, ',')) {
+        if (item.empty()) continue;
+        int value = atoi(item.c_str());
+        if (value < min || value > max) {
+            printf("Error: invalid %s %s, expected %d to %d\n", what, item.c_str(), min, max);
+            exit(EXIT_FAILURE);
+        }
+        values.push_back(value);
+    }
+    if (values.empty()) {
+        printf("Error: no %s given\n", what);
+        exit(EXIT_FAILURE);
+    }
+    return values;
+}
+
+// Prints the median throughput (GB/s) of every burst length and outstanding
+// transactions of a data width, direction and size
+static void print_table(const std::map<std::pair<int, int>, double>& gbps,
+                        const std::vector<int>& burst_lengths,
+                        const std::vector<int>& outstanding,
+                        int width,
+                        const std::string& direction,
+                        uint64_t size) {
+    printf("\n%d bit %s throughput (GB/s), buffer size = %s\n%-12s", width, direction.c_str(),
+           xcl::convert_size(size).c_str(), "BL \\ OT");
+    for (int ot : outstanding) printf(" %8d", ot);
+    printf("\n");
+    for (int bl : burst_lengths) {
+        printf("%-12d", bl);
+        for (int ot : outstanding) {
+            auto cell = gbps.find(std::make_pair(bl, ot));
+            if (cell == gbps.end()) {
+                printf(" %8s", "-");
+            } else {
+                printf(" %8.2f", cell->second);
+            }
+        }
+        printf("\n");
+    }
+}
+
+int main(int argc, char** argv) {
+    // Command Line Parser
+    sda::utils::CmdLineParser parser;
+    sda::utils::BandwidthBench bench("axi_burst_sweep");
+
+    bench.options().min_size = 16 * 1024 * 1024;
+    bench.options().max_size = 16 * 1024 * 1024;
+    if (xcl::is_emulation()) {
+        bench.options().min_size = 16 * 1024;
+        bench.options().max_size = 16 * 1024;
+        bench.options().reps = 1;
+        bench.options().max_reps = 3;
+        bench.options().warmup = 0;
+    }
+
+    // Switches
+    //**************//"<Full Arg>",  "<Short Arg>", "<Description>", "<Default>"
+    parser.addSwitch("--xclbin_file", "-x", "input binary file string", "");
+    parser.addSwitch("--frequency", "-f", "Operating frequency, in MHz", "300");
+    parser.addSwitch("--burst_lengths", "-bl", "burst lengths in words, at most " + std::to_string(MAX_BURST_LENGTH),
+                     "4,16,32");
+    parser.addSwitch("--outstanding", "-ot", "outstanding transactions, at most " + std::to_string(MAX_OUTSTANDING),
+                     "4,32");
+    parser.addSwitch("--widths", "-dw", "data widths, 256 and/or 512 bits", "256,512");
+    parser.addSwitch("--directions", "-dr", "write and/or read", "write,read");
+    bench.addSwitches(parser);
+    parser.parse(argc, argv);
+    bench.parse(parser);
+
+    std::string binaryFile = parser.value("xclbin_file");
+    if (binaryFile.empty()) {
+        parser.printHelp();
+        return EXIT_FAILURE;
+    }
+    float frequency = stof(parser.value("frequency"));
+    std::vector<int> burst_lengths = parse_list(parser.value("burst_lengths"), "burst length", 1, MAX_BURST_LENGTH);
+    std::vector<int> outstanding = parse_list(parser.value("outstanding"), "outstanding transactions", 1,
+                                              MAX_OUTSTANDING);
+    std::vector<int> widths = parse_list(parser.value("widths"), "data width", 256, 512);
+    for (int width : widths) {
+        if (width != 256 && width != 512) {
+            printf("Error: invalid data width %d, expected 256 or 512\n", width);
+            return EXIT_FAILURE;
+        }
+    }
+    std::vector<std::string> directions;
+    std::stringstream stream(parser.value("directions"));
+    std::string direction;
+    while (std::getline(stream, direction, ',')) {
+        if (direction != "write" && direction != "read") {
+            printf("Error: invalid direction %s, expected write or read\n", direction.c_str());
+            return EXIT_FAILURE;
+        }
+        directions.push_back(direction);
+    }
+
+    std::cout << "\nTest parameters\n";
+    std::cout << " - xclbin file   : " << binaryFile << std::endl;
+    std::cout << " - frequency     : " << frequency << " MHz" << std::endl;
+    std::cout << " - buffer size   : " << xcl::convert_size(bench.options().min_size).c_str() << " to "
+              << xcl::convert_size(bench.options().max_size).c_str() << std::endl;
+    std::cout << "\n";
+
+    xcl::Session session(binaryFile);
+    cl::Context context = session.context();
+    cl::CommandQueue q = session.createQueue(CL_QUEUE_PROFILING_ENABLE);
+    bench.setInfo("device", session.device().getInfo<CL_DEVICE_NAME>());
+    bench.setInfo("xclbin", binaryFile);
+    cl_int err;
+    OCL_CHECK(err, cl::Kernel krnl(session.program(), "krnl_traffic_gen", &err));
+
+    // Both ports of the kernel access the same buffer, allocated for the
+    // largest transfer of the sweep
+    uint64_t buf_size_bytes = bench.options().max_size;
+    int64_t kernel_info[PERF_SIZE];
+    OCL_CHECK(err, cl::Buffer infoBuf(context, CL_MEM_WRITE_ONLY, sizeof(kernel_info), nullptr, &err));
+    OCL_CHECK(err, cl::Buffer dataBuf(context, CL_MEM_READ_WRITE, buf_size_bytes, nullptr, &err));
+    OCL_CHECK(err, err = krnl.setArg(0, dataBuf));
+    OCL_CHECK(err, err = krnl.setArg(1, dataBuf));
+    OCL_CHECK(err, err = krnl.setArg(2, infoBuf));
+
+    int64_t errors = 0;
+    std::string Direction[] = {"WRITE", "READ"};
+    for (int width : widths) {
+        uint64_t word_bytes = width / 8;
+        for (auto& direction : directions) {
+            int dir = direction == "read";
+            // The reads expect word i to hold i, whatever the bursts of the
+            // writes before them covered
+            if (dir) {
+                std::vector<uint64_t> init(buf_size_bytes / sizeof(uint64_t), 0);
+                for (uint64_t i = 0; i < buf_size_bytes / word_bytes; i++) init[i * word_bytes / sizeof(uint64_t)] = i;
+                OCL_CHECK(err, err = q.enqueueWriteBuffer(dataBuf, CL_TRUE, 0, buf_size_bytes, init.data()));
+            }
+
+            std::cout << "\nKernel->AXI Burst " << Direction[dir] << " performance" << std::endl;
+            std::map<uint64_t, std::map<std::pair<int, int>, double> > tables;
+            for (int bl : burst_lengths) {
+                for (int ot : outstanding) {
+                    for (uint64_t size : bench.sizes()) {
+                        // Whole bursts only, the bytes moved may be a little
+                        // below the size for burst lengths that do not divide it
+                        int64_t bursts = size / word_bytes / bl;
+                        if (bursts == 0) continue;
+                        OCL_CHECK(err, err = krnl.setArg(3, width));
+                        OCL_CHECK(err, err = krnl.setArg(4, dir));
+                        OCL_CHECK(err, err = krnl.setArg(5, bursts));
+                        OCL_CHECK(err, err = krnl.setArg(6, bl));
+                        OCL_CHECK(err, err = krnl.setArg(7, ot));
+
+                        // Each run is timed by the cycle counter of the kernel. sw_emu has no
+                        // clock, so its runs are timed by the host instead.
+                        std::string test =
+                            std::to_string(width) + "_b" + std::to_string(bl) + "_o" + std::to_string(ot);
+                        double bytes = (double)bursts * bl * word_bytes;
+                        auto& result = bench.runTimed({test, direction, "DDR[0]", 1, size, bytes}, [&] {
+                            auto start = std::chrono::steady_clock::now();
+                            OCL_CHECK(err, err = q.enqueueTask(krnl));
+                            OCL_CHECK(err, err = q.finish());
+                            std::chrono::duration<double> wall = std::chrono::steady_clock::now() - start;
+
+                            OCL_CHECK(err, err = q.enqueueReadBuffer(infoBuf, CL_TRUE, 0, sizeof(kernel_info),
+                                                                     kernel_info, nullptr, nullptr));
+                            if (kernel_info[PERF_ERRORS]) {
+                                std::cerr << "  ERROR: " << kernel_info[PERF_ERRORS] << " words read with a wrong value"
+                                          << std::endl;
+                                errors++;
+                            }
+                            if (xcl::is_emulation() and !xcl::is_hw_emulation()) return wall.count();
+                            return kernel_info[PERF_CYCLES] / (frequency * 1000.0 * 1000.0);
+                        });
+                        tables[size][std::make_pair(bl, ot)] = result.median / 1024;
+
+                        // Report results, median throughput from MB/s to GB/s
+                        if (!xcl::is_emulation() or xcl::is_hw_emulation()) {
+                            std::cout << "Data Width = " << width;
+                            std::cout << " burst_length = " << bl;
+                            std::cout << " num_outstanding = " << ot;
+                            std::cout << " buffer_size = " << xcl::convert_size(size).c_str();
+                            std::cout << " | throughput = " << result.median / 1024 << " GB/sec" << std::endl;
+                        }
+                    }
+                }
+            }
+            if (!xcl::is_emulation() or xcl::is_hw_emulation()) {
+                for (auto& table : tables) {
+                    print_table(table.second, burst_lengths, outstanding, width, direction, table.first);
+                }
+            }
+        }
+    }
+
+    if (xcl::is_emulation() and !xcl::is_hw_emulation()) {
+        std::cout << "\nNot reporting performance throughput for sw_emu as clock signal is not present for time "
+                     "calculation."
+                  << std::endl;
+    }
+
+    if (!bench.write() || !bench.check()) errors++;
+    std::cout << "\nTEST " << ((!errors) ? "PASSED" : "FAILED") << std::endl;
+    return ((!errors) ? EXIT_SUCCESS : EXIT_FAILURE);
+}
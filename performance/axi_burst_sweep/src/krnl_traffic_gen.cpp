@@ -0,0 +1,162 @@
+/**
+* Copyright (C) 2019-2021 Xilinx, Inc
+*
+* Licensed under the Apache License, Version 2.0 (the "License"). You may
+* not use this file except in compliance with the License. A copy of the
+* License is located at
+*
+*     http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+* WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the
+* License for the specific language governing permissions and limitations
+* under the License.
+*/
+
+/*******************************************************************************
+Description:
+    Traffic generator kernel: writes or reads a buffer with bursts whose
+    length, outstanding transactions and data width are runtime arguments.
+    The bursts are issued with the manual burst API of Vitis HLS,
+    hls::burst_maxi, up to the limits of traffic_gen.h that the m_axi
+    adapters are built for.
+*******************************************************************************/
+
+#include "ap_int.h"
+#include "hls_burst_maxi.h"
+#include "hls_stream.h"
+#include "traffic_gen.h"
+#include <cstdint>
+#include <string.h>
+
+typedef ap_uint<256> word256_t;
+typedef ap_uint<512> word512_t;
+
+// Writes word i with value i, in bursts of burst_length words. A new burst
+// is only started once at most outstanding - 1 bursts wait for their
+// response.
+template <typename T>
+void writeBursts(hls::burst_maxi<T> mem, int64_t bursts, int burst_length, int outstanding) {
+    int64_t words = bursts * burst_length;
+    int64_t burst = 0;
+    int64_t responses = 0;
+    int word = 0;
+
+write_bursts:
+    for (int64_t i = 0; i < words; i++) {
+#pragma HLS PIPELINE II = 1
+        if (word == 0) mem.write_request(i, burst_length);
+        mem.write(i);
+        if (++word == burst_length) {
+            word = 0;
+            burst++;
+            if (burst - responses == outstanding) {
+                mem.write_response();
+                responses++;
+            }
+        }
+    }
+
+write_responses:
+    for (; responses < bursts; responses++) {
+        mem.write_response();
+    }
+}
+
+// Reads word i and checks its value, keeping outstanding burst requests
+// ahead of the burst being received
+template <typename T>
+void readBursts(hls::burst_maxi<T> mem, int64_t bursts, int burst_length, int outstanding, int64_t& err) {
+    int64_t words = bursts * burst_length;
+    int64_t requests = 0;
+    int64_t tmp = 0;
+    int word = 0;
+
+read_requests:
+    for (; requests < bursts && requests < outstanding; requests++) {
+        mem.read_request(requests * burst_length, burst_length);
+    }
+
+read_bursts:
+    for (int64_t i = 0; i < words; i++) {
+#pragma HLS PIPELINE II = 1
+        tmp += (mem.read() != i) ? 1 : 0;
+        if (++word == burst_length) {
+            word = 0;
+            if (requests < bursts) {
+                mem.read_request(requests * burst_length, burst_length);
+                requests++;
+            }
+        }
+    }
+
+    err = tmp;
+}
+
+void trafficProc(hls::burst_maxi<word256_t> mem256,
+                 hls::burst_maxi<word512_t> mem512,
+                 int width,
+                 int direction,
+                 int64_t bursts,
+                 int burst_length,
+                 int outstanding,
+                 hls::stream<int64_t>& cmd) {
+    int64_t err = 0;
+    cmd.write(0); // Send a command to start the counter
+    if (direction == 0) {
+        if (width == 256) {
+            writeBursts(mem256, bursts, burst_length, outstanding);
+        } else {
+            writeBursts(mem512, bursts, burst_length, outstanding);
+        }
+    } else {
+        if (width == 256) {
+            readBursts(mem256, bursts, burst_length, outstanding, err);
+        } else {
+            readBursts(mem512, bursts, burst_length, outstanding, err);
+        }
+    }
+    cmd.write(err); // Send a command to stop the counter
+}
+
+void perfCounterProc(hls::stream<int64_t>& cmd, int64_t* out) {
+    int64_t val;
+    // wait to receive a value to start counting
+    int64_t cnt = cmd.read();
+// keep counting until a value is available
+count:
+    while (cmd.read_nb(val) == false) {
+        cnt++;
+    }
+
+    // write out kernel statistics to global memory
+    int64_t tmp[PERF_SIZE];
+    tmp[PERF_CYCLES] = cnt;
+    tmp[PERF_ERRORS] = val;
+    memcpy(out, tmp, PERF_SIZE * sizeof(int64_t));
+}
+
+extern "C" {
+void krnl_traffic_gen(hls::burst_maxi<word256_t> mem256,
+                      hls::burst_maxi<word512_t> mem512,
+                      int64_t* perf,
+                      int width,
+                      int direction,
+                      int64_t bursts,
+                      int burst_length,
+                      int outstanding) {
+#pragma HLS INTERFACE m_axi port = mem256 bundle = aximm0 max_write_burst_length = 64 num_write_outstanding = 32 \
+    max_read_burst_length = 64 num_read_outstanding = 32 offset = slave
+#pragma HLS INTERFACE m_axi port = mem512 bundle = aximm1 max_write_burst_length = 64 num_write_outstanding = 32 \
+    max_read_burst_length = 64 num_read_outstanding = 32 offset = slave
+#pragma HLS INTERFACE m_axi port = perf bundle = aximm2 offset = slave
+
+#pragma HLS DATAFLOW
+
+    hls::stream<int64_t> cmd;
+
+    trafficProc(mem256, mem512, width, direction, bursts, burst_length, outstanding, cmd);
+    perfCounterProc(cmd, perf);
+}
+}
@@ -0,0 +1,29 @@
+/**
+* Copyright (C) 2019-2021 Xilinx, Inc
+*
+* Licensed under the Apache License, Version 2.0 (the "License"). You may
+* not use this file except in compliance with the License. A copy of the
+* License is located at
+*
+*     http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+* WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the
+* License for the specific language governing permissions and limitations
+* under the License.
+*/
+#ifndef TRAFFIC_GEN_H_
+#define TRAFFIC_GEN_H_
+
+// Largest burst length (words) and outstanding transactions a run can ask
+// for: the m_axi adapters of the traffic generator are built for them
+#define MAX_BURST_LENGTH 64
+#define MAX_OUTSTANDING 32
+
+// Kernel statistics written to the perf buffer after each run
+#define PERF_CYCLES 0 // cycles between the start and the end of the transfer
+#define PERF_ERRORS 1 // words read with an unexpected value
+#define PERF_SIZE 2
+
+#endif /* TRAFFIC_GEN_H_ */
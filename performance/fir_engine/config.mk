@@ -0,0 +1,7 @@
+# Number of taps of the filters, e.g. make run TAPS=32. The kernels use
+# TAPS x 512 / (sample width) multipliers each.
+TAPS := 16
+
+VPP_FLAGS += -DFIR_TAPS=$(TAPS)
+
+CXXFLAGS += -DFIR_TAPS=$(TAPS)
@@ -0,0 +1,152 @@
+#
+# Copyright 2019-2021 Xilinx, Inc.
+#
+# Licensed under the Apache License, Version 2.0 (the "License");
+# you may not use this file except in compliance with the License.
+# You may obtain a copy of the License at
+#
+#     http://www.apache.org/licenses/LICENSE-2.0
+#
+# Unless required by applicable law or agreed to in writing, software
+# distributed under the License is distributed on an "AS IS" BASIS,
+# WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+# See the License for the specific language governing permissions and
+# limitations under the License.
+# makefile-generator v1.0.3
+#
+
+############################## Help Section ##############################
+ifneq ($(findstring Makefile, $(MAKEFILE_LIST)), Makefile)
+help:
+	$(ECHO) "Makefile Usage:"
+	$(ECHO) "  make all TARGET=<sw_emu/hw_emu/hw> PLATFORM=<FPGA platform>"
+	$(ECHO) "      Command to generate the design for specified Target and Shell."
+	$(ECHO) ""
+	$(ECHO) "  make clean "
+	$(ECHO) "      Command to remove the generated non-hardware files."
+	$(ECHO) ""
+	$(ECHO) "  make cleanall"
+	$(ECHO) "      Command to remove all the generated files."
+	$(ECHO) ""
+	$(ECHO) "  make test PLATFORM=<FPGA platform>"
+	$(ECHO) "      Command to run the application. This is same as 'run' target but does not have any makefile dependency."
+	$(ECHO) ""
+	$(ECHO) "  make run TARGET=<sw_emu/hw_emu/hw> PLATFORM=<FPGA platform>"
+	$(ECHO) "      Command to run application in emulation."
+	$(ECHO) ""
+	$(ECHO) "  make build TARGET=<sw_emu/hw_emu/hw> PLATFORM=<FPGA platform>"
+	$(ECHO) "      Command to build xclbin application."
+	$(ECHO) ""
+	$(ECHO) "  make host"
+	$(ECHO) "      Command to build host application."
+	$(ECHO) ""
+endif
+
+############################## Setting up Project Variables ##############################
+TARGET := hw
+include ./utils.mk
+
+TEMP_DIR := ./_x.$(TARGET).$(XSA)
+BUILD_DIR := ./build_dir.$(TARGET).$(XSA)
+
+LINK_OUTPUT := $(BUILD_DIR)/fir.link.xclbin
+PACKAGE_OUT = ./package.$(TARGET)
+
+VPP_PFLAGS := 
+CMD_ARGS = -x $(BUILD_DIR)/fir.xclbin
+include config.mk
+
+CXXFLAGS += -I$(XILINX_XRT)/include -I$(XILINX_VIVADO)/include -Wall -O0 -g -std=c++1y
+LDFLAGS += -L$(XILINX_XRT)/lib -pthread -lOpenCL
+
+########################## Checking if PLATFORM in allowlist #######################
+PLATFORM_BLOCKLIST += nodma u25_ 
+############################## Setting up Host Variables ##############################
+#Include Required Host Source Files
+CXXFLAGS += -I$(XF_PROJ_ROOT)/common/includes/xcl2
+CXXFLAGS += -I$(XF_PROJ_ROOT)/common/includes/cmdparser
+CXXFLAGS += -I$(XF_PROJ_ROOT)/common/includes/logger
+CXXFLAGS += -I$(XF_PROJ_ROOT)/common/includes/bench
+HOST_SRCS += $(XF_PROJ_ROOT)/common/includes/xcl2/xcl2.cpp $(XF_PROJ_ROOT)/common/includes/cmdparser/cmdlineparser.cpp $(XF_PROJ_ROOT)/common/includes/logger/logger.cpp $(XF_PROJ_ROOT)/common/includes/bench/bench.cpp ./src/fir_cpu.cpp ./src/host.cpp 
+# Host compiler global settings
+CXXFLAGS += -fmessage-length=0 -O3
+LDFLAGS += -lrt -lstdc++ 
+LDFLAGS += -pthread
+
+############################## Setting up Kernel Variables ##############################
+# Kernel compiler global settings
+VPP_FLAGS += -t $(TARGET) --platform $(PLATFORM) --save-temps 
+
+
+EXECUTABLE = ./fir_engine
+EMCONFIG_DIR = $(TEMP_DIR)
+
+############################## Setting Targets ##############################
+.PHONY: all clean cleanall docs emconfig
+all: check-platform check-device check-vitis $(EXECUTABLE) $(BUILD_DIR)/fir.xclbin emconfig
+
+.PHONY: host
+host: $(EXECUTABLE)
+
+.PHONY: build
+build: check-vitis check-device $(BUILD_DIR)/fir.xclbin
+
+.PHONY: xclbin
+xclbin: build
+
+############################## Setting Rules for Binary Containers (Building Kernels) ##############################
+$(TEMP_DIR)/fir_int16.xo: src/fir_int16.cpp
+	mkdir -p $(TEMP_DIR)
+	v++ $(VPP_FLAGS) -c -k fir_int16 --temp_dir $(TEMP_DIR)  -I'$(<D)' -o'$@' '$<'
+$(TEMP_DIR)/fir_int32.xo: src/fir_int32.cpp
+	mkdir -p $(TEMP_DIR)
+	v++ $(VPP_FLAGS) -c -k fir_int32 --temp_dir $(TEMP_DIR)  -I'$(<D)' -o'$@' '$<'
+$(TEMP_DIR)/fir_fixed.xo: src/fir_fixed.cpp
+	mkdir -p $(TEMP_DIR)
+	v++ $(VPP_FLAGS) -c -k fir_fixed --temp_dir $(TEMP_DIR)  -I'$(<D)' -o'$@' '$<'
+$(TEMP_DIR)/fir_float.xo: src/fir_float.cpp
+	mkdir -p $(TEMP_DIR)
+	v++ $(VPP_FLAGS) -c -k fir_float --temp_dir $(TEMP_DIR)  -I'$(<D)' -o'$@' '$<'
+
+$(BUILD_DIR)/fir.xclbin: $(TEMP_DIR)/fir_int16.xo $(TEMP_DIR)/fir_int32.xo $(TEMP_DIR)/fir_fixed.xo $(TEMP_DIR)/fir_float.xo
+	mkdir -p $(BUILD_DIR)
+	v++ $(VPP_FLAGS) -l $(VPP_LDFLAGS) --temp_dir $(TEMP_DIR) -o'$(LINK_OUTPUT)' $(+)
+	v++ -p $(LINK_OUTPUT) $(VPP_FLAGS) --package.out_dir $(PACKAGE_OUT) -o $(BUILD_DIR)/fir.xclbin
+
+############################## Setting Rules for Host (Building Host Executable) ##############################
+$(EXECUTABLE): $(HOST_SRCS) | check-xrt
+		g++ -o $@ $^ $(CXXFLAGS) $(LDFLAGS)
+
+emconfig:$(EMCONFIG_DIR)/emconfig.json
+$(EMCONFIG_DIR)/emconfig.json:
+	emconfigutil --platform $(PLATFORM) --od $(EMCONFIG_DIR)
+
+############################## Setting Essential Checks and Running Rules ##############################
+run: all
+ifeq ($(TARGET),$(filter $(TARGET),sw_emu hw_emu))
+	cp -rf $(EMCONFIG_DIR)/emconfig.json .
+	XCL_EMULATION_MODE=$(TARGET) $(EXECUTABLE) $(CMD_ARGS)
+else
+	$(EXECUTABLE) $(CMD_ARGS)
+endif
+
+.PHONY: test
+test: $(EXECUTABLE)
+ifeq ($(TARGET),$(filter $(TARGET),sw_emu hw_emu))
+	XCL_EMULATION_MODE=$(TARGET) $(EXECUTABLE) $(CMD_ARGS)
+else
+	$(EXECUTABLE) $(CMD_ARGS)
+endif
+
+############################## Cleaning Rules ##############################
+# Cleaning stuff
+clean:
+	-$(RMDIR) $(EXECUTABLE) $(XCLBIN)/{*sw_emu*,*hw_emu*} 
+	-$(RMDIR) profile_* TempConfig system_estimate.xtxt *.rpt *.csv 
+	-$(RMDIR) src/*.ll *v++* .Xil emconfig.json dltmp* xmltmp* *.log *.jou *.wcfg *.wdb
+
+cleanall: clean
+	-$(RMDIR) build_dir*
+	-$(RMDIR) package.*
+	-$(RMDIR) _x* *xclbin.run_summary qemu-memory-_* emulation _vimage pl* start_simulation.sh *.xclbin
+
@@ -0,0 +1,99 @@
+/**
+* Copyright (C) 2019-2021 Xilinx, Inc
+*
+* Licensed under the Apache License, Version 2.0 (the "License"). You may
+* not use this file except in compliance with the License. A copy of the
+* License is located at
+*
+*     http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+* WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the
+* License for the specific language governing permissions and limitations
+* under the License.
+*/
+
+#include "fir_cpu.h"
+
+#include <algorithm>
+#include <thread>
+#include <vector>
+
+// Outputs computed at a time, so that their accumulators stay in the L1 cache
+#define CPU_BLOCK 1024
+
+// Outputs of the kernels from their accumulators, see fir_engine.h
+static inline void store(int16_t& y, int32_t acc) {
+    y = (int16_t)(acc >> 15);
+}
+
+static inline void store(int32_t& y, int32_t acc) {
+    y = acc;
+}
+
+static inline void store(float& y, float acc) {
+    y = acc;
+}
+
+// Outputs [first, last) of the signal x. The taps are the outer loop, so
+// that the inner loop is a multiply-add over consecutive samples, which the
+// compiler vectorizes. The products are added in the order of the kernels.
+template <typename T, typename ACC>
+static void filter(const T* x, T* y, const T* coeff, int taps, size_t first, size_t last) {
+    ACC acc[CPU_BLOCK];
+    for (size_t n0 = first; n0 < last; n0 += CPU_BLOCK) {
+        int len = std::min((size_t)CPU_BLOCK, last - n0);
+        for (int n = 0; n < len; n++) acc[n] = 0;
+        for (int t = 0; t < taps; t++) {
+            ACC c = coeff[t];
+            // x[n0 + n - t] is before the start of the signal for n < t - n0
+            int start = (size_t)t > n0 ? t - n0 : 0;
+            for (int n = start; n < len; n++) acc[n] += c * (ACC)x[n0 + n - t];
+        }
+        for (int n = 0; n < len; n++) store(y[n0 + n], acc[n]);
+    }
+}
+
+// Splits the channels x length outputs in one range per thread, cut at the
+// channel boundaries, so that a single long signal uses every thread too
+template <typename T, typename ACC>
+static void filter_channels(
+    const T* in, T* out, const T* coeff, int taps, int channels, int length, unsigned int threads) {
+    size_t total = (size_t)channels * length;
+    size_t range = (total + threads - 1) / threads;
+    auto work = [&](size_t begin, size_t end) {
+        while (begin < end) {
+            size_t channel = begin / length;
+            size_t first = begin % length;
+            size_t last = std::min((size_t)length, first + (end - begin));
+            const T* x = in + channel * length;
+            filter<T, ACC>(x, out + channel * length, coeff, taps, first, last);
+            begin += last - first;
+        }
+    };
+
+    std::vector<std::thread> workers;
+    for (size_t begin = range; begin < total; begin += range) {
+        workers.push_back(std::thread(work, begin, std::min(begin + range, total)));
+    }
+    work(0, std::min(range, total));
+    for (auto& worker : workers) {
+        worker.join();
+    }
+}
+
+void fir_cpu(const int16_t* in, int16_t* out, const int16_t* coeff, int taps, int channels, int length,
+             unsigned int threads) {
+    filter_channels<int16_t, int32_t>(in, out, coeff, taps, channels, length, threads);
+}
+
+void fir_cpu(const int32_t* in, int32_t* out, const int32_t* coeff, int taps, int channels, int length,
+             unsigned int threads) {
+    filter_channels<int32_t, int32_t>(in, out, coeff, taps, channels, length, threads);
+}
+
+void fir_cpu(const float* in, float* out, const float* coeff, int taps, int channels, int length,
+             unsigned int threads) {
+    filter_channels<float, float>(in, out, coeff, taps, channels, length, threads);
+}
@@ -0,0 +1,32 @@
+/**
+* Copyright (C) 2019-2021 Xilinx, Inc
+*
+* Licensed under the Apache License, Version 2.0 (the "License"). You may
+* not use this file except in compliance with the License. A copy of the
+* License is located at
+*
+*     http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+* WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the
+* License for the specific language governing permissions and limitations
+* under the License.
+*/
+#ifndef FIR_CPU_H
+#define FIR_CPU_H
+
+#include <stdint.h>
+
+// Vectorized multi-threaded references of the FIR kernels, on the same data:
+// channels signals of length samples, one after the other, each filtered as
+// if preceded by zeros. The int16_t one also stands for the Q15 fixed point
+// kernel, whose samples it filters as raw integers.
+void fir_cpu(const int16_t* in, int16_t* out, const int16_t* coeff, int taps, int channels, int length,
+             unsigned int threads);
+void fir_cpu(const int32_t* in, int32_t* out, const int32_t* coeff, int taps, int channels, int length,
+             unsigned int threads);
+void fir_cpu(const float* in, float* out, const float* coeff, int taps, int channels, int length,
+             unsigned int threads);
+
+#endif
@@ -0,0 +1,191 @@
+/**
+* Copyright (C) 2019-2021 Xilinx, Inc
+*
+* Licensed under the Apache License, Version 2.0 (the "License"). You may
+* not use this file except in compliance with the License. A copy of the
+* License is located at
+*
+*     http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+* WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the
+* License for the specific language governing permissions and limitations
+* under the License.
+*/
+
+/*
+
+  Templated FIR Engine
+
+  The shift register FIR of cpp_kernels/shift_register, with the number of
+  taps, the sample type and the samples per cycle as template parameters:
+
+      fir_engine<T, TAPS, PAR>(in, out, coeff, channels, words)
+
+  The samples move through 512-bit words, PAR samples of type T per word, so
+  PAR is 512 / width of T for a full port. Each cycle shifts a word of new
+  samples into the shift register and computes PAR outputs of TAPS products
+  each, so TAPS x PAR multipliers work in parallel.
+
+  One call filters channels independent signals of words x PAR samples each,
+  stored one after the other. The shift register starts from zeros at the
+  first word of every channel, so a signal never sees the samples of the
+  previous one, and the pipeline does not drain between the channels.
+
+  The TAPS coefficients are packed PAR per word as well, the first one in the
+  low bits of the first word, and the output word i holds the outputs of the
+  input word i:
+
+      y[n] = coeff[0] * x[n] + coeff[1] * x[n - 1] + ... + coeff[TAPS - 1] * x[n - TAPS + 1]
+
+  with x[n] = 0 before the start of the channel.
+
+  FirSample<T> gives the width of T, its accumulator type and the
+  conversions between T and its bits. The sample types are:
+
+      short       : 16-bit integers, 32-bit accumulator, output acc >> 15 (Q15 coefficients)
+      int         : 32-bit integers, 32-bit accumulator, output acc
+      fir_fixed_t : ap_fixed<16, 1> (Q15), ap_fixed<40, 10> accumulator
+      float       : float accumulator
+*/
+
+#ifndef FIR_ENGINE_H
+#define FIR_ENGINE_H
+
+#include <ap_fixed.h>
+#include <ap_int.h>
+
+#define FIR_WIDTH 512
+
+// Number of taps of the filters, set by config.mk
+#ifndef FIR_TAPS
+#define FIR_TAPS 16
+#endif
+
+typedef ap_uint<FIR_WIDTH> fir_word_t;
+typedef ap_fixed<16, 1> fir_fixed_t;
+
+// TRIPCOUNT identifier
+const unsigned int c_words = 16 * 1024;
+
+template <typename T>
+struct FirSample;
+
+template <>
+struct FirSample<short> {
+    static const int width = 16;
+    typedef int acc_t;
+    static short get(ap_uint<width> bits) { return (short)bits.to_int(); }
+    static ap_uint<width> put(short value) { return (ap_uint<width>)value; }
+    static short out(acc_t acc) { return (short)(acc >> 15); }
+};
+
+template <>
+struct FirSample<int> {
+    static const int width = 32;
+    typedef int acc_t;
+    static int get(ap_uint<width> bits) { return (int)bits.to_uint(); }
+    static ap_uint<width> put(int value) { return (ap_uint<width>)value; }
+    static int out(acc_t acc) { return acc; }
+};
+
+template <>
+struct FirSample<fir_fixed_t> {
+    static const int width = 16;
+    typedef ap_fixed<40, 10> acc_t;
+    static fir_fixed_t get(ap_uint<width> bits) {
+        fir_fixed_t value;
+        value.range() = bits;
+        return value;
+    }
+    static ap_uint<width> put(fir_fixed_t value) { return value.range(); }
+    static fir_fixed_t out(acc_t acc) { return (fir_fixed_t)acc; }
+};
+
+template <>
+struct FirSample<float> {
+    static const int width = 32;
+    typedef float acc_t;
+    static float get(ap_uint<width> bits) {
+        union {
+            unsigned int u;
+            float f;
+        } value;
+        value.u = bits.to_uint();
+        return value.f;
+    }
+    static ap_uint<width> put(float f) {
+        union {
+            unsigned int u;
+            float f;
+        } value;
+        value.f = f;
+        return value.u;
+    }
+    static float out(acc_t acc) { return acc; }
+};
+
+template <typename T, int TAPS, int PAR>
+void fir_engine(const fir_word_t* in, fir_word_t* out, const fir_word_t* coeff, int channels, int words) {
+    typedef FirSample<T> S;
+    typedef typename S::acc_t acc_t;
+
+    T coeff_reg[TAPS];
+#pragma HLS ARRAY_PARTITION variable = coeff_reg complete dim = 0
+
+    // The last TAPS - 1 samples of the previous word, oldest first, followed
+    // by the PAR samples of the current word. All of them are used in the
+    // same cycle, so the array is partitioned into registers.
+    T shift_reg[TAPS - 1 + PAR];
+#pragma HLS ARRAY_PARTITION variable = shift_reg complete dim = 0
+
+read_coeff:
+    for (int t = 0; t < TAPS; t++) {
+#pragma HLS PIPELINE II = 1
+        int p = t % PAR;
+        coeff_reg[t] = S::get(coeff[t / PAR].range(S::width * (p + 1) - 1, S::width * p));
+    }
+
+    int w = 0;
+filter:
+    for (int i = 0; i < channels * words; i++) {
+#pragma HLS LOOP_TRIPCOUNT min = c_words max = c_words
+#pragma HLS PIPELINE II = 1
+        fir_word_t x = in[i];
+        fir_word_t y;
+
+    // A new channel starts from an empty shift register
+    clear_loop:
+        for (int s = 0; s < TAPS - 1; s++) {
+            if (w == 0) shift_reg[s] = 0;
+        }
+
+    load_loop:
+        for (int p = 0; p < PAR; p++) {
+            shift_reg[TAPS - 1 + p] = S::get(x.range(S::width * (p + 1) - 1, S::width * p));
+        }
+
+    // PAR outputs, each the products of the TAPS coefficients with the
+    // samples ending at its own
+    mac_loop:
+        for (int p = 0; p < PAR; p++) {
+            acc_t acc = 0;
+            for (int t = 0; t < TAPS; t++) {
+                acc += coeff_reg[t] * shift_reg[TAPS - 1 + p - t];
+            }
+            y.range(S::width * (p + 1) - 1, S::width * p) = S::put(S::out(acc));
+        }
+        out[i] = y;
+
+    // This is the shift register operation, by a whole word of samples
+    shift_loop:
+        for (int s = 0; s < TAPS - 1; s++) {
+            shift_reg[s] = shift_reg[s + PAR];
+        }
+
+        w = (w == words - 1) ? 0 : w + 1;
+    }
+}
+
+#endif
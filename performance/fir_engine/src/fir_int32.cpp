@@ -0,0 +1,35 @@
+/**
+* Copyright (C) 2019-2021 Xilinx, Inc
+*
+* Licensed under the Apache License, Version 2.0 (the "License"). You may
+* not use this file except in compliance with the License. A copy of the
+* License is located at
+*
+*     http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+* WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the
+* License for the specific language governing permissions and limitations
+* under the License.
+*/
+
+// FIR_TAPS tap filter of 32-bit integer samples, FIR_WIDTH / 32 per cycle.
+// See fir_engine.h for the layout of the arguments.
+
+#include "fir_engine.h"
+
+extern "C" {
+void fir_int32(const fir_word_t* in,    // Read-Only Input Samples
+               fir_word_t* out,         // Output Samples
+               const fir_word_t* coeff, // Read-Only Coefficients
+               int channels,            // Number of signals
+               int words                // Words of FIR_WIDTH bits per signal
+               ) {
+#pragma HLS INTERFACE m_axi port = in offset = slave bundle = gmem0 max_read_burst_length = 64
+#pragma HLS INTERFACE m_axi port = out offset = slave bundle = gmem1 max_write_burst_length = 64
+#pragma HLS INTERFACE m_axi port = coeff offset = slave bundle = gmem0
+
+    fir_engine<int, FIR_TAPS, FIR_WIDTH / 32>(in, out, coeff, channels, words);
+}
+}
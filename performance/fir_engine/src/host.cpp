@@ -0,0 +1,287 @@
+/**
+* Copyright (C) 2019-2021 Xilinx, Inc
+*
+* Licensed under the Apache License, Version 2.0 (the "License"). You may
+* not use this file except in compliance with the License. A copy of the
+* License is located at
+*
+*     http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+* WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the
+* License for the specific language governing permissions and limitations
+* under the License.
+*/
+
+/*******************************************************************************
+
+Description:
+
+    Multi-channel FIR filters on the templated FIR engine, one kernel per
+    sample type. Each kernel call filters a batch of independent signals of
+    the same length, and its throughput, in MSamples/s, is compared with a
+    vectorized multi-threaded CPU implementation.
+
+*******************************************************************************/
+#include "bench.h"
+#include "cmdlineparser.h"
+#include "fir_cpu.h"
+#include "xcl2.hpp"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <iostream>
+#include <sstream>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+// Width of the kernel ports, see fir_engine.h
+#define FIR_WIDTH 512
+
+// Number of taps of the kernels, set by config.mk
+#ifndef FIR_TAPS
+#define FIR_TAPS 16
+#endif
+
+template <typename T>
+using samples_t = std::vector<T, aligned_allocator<T> >;
+
+// Splits a comma separated list
+static std::vector<std::string> split(const std::string& list) {
+    std::vector<std::string> items;
+    std::stringstream stream(list);
+    std::string item;
+    while (getline(stream, item, ',')) {
+        items.push_back(item);
+    }
+    return items;
+}
+
+// Windowed sinc low pass filter, cut at a quarter of the sampling rate
+static std::vector<double> lowpass(int taps) {
+    const double pi = 3.14159265358979323846;
+    std::vector<double> h(taps);
+    for (int t = 0; t < taps; t++) {
+        double m = t - (taps - 1) / 2.0;
+        double sinc = (m == 0) ? 0.5 : sin(pi * m / 2) / (pi * m);
+        double hamming = (taps == 1) ? 1 : 0.54 - 0.46 * cos(2 * pi * t / (taps - 1));
+        h[t] = sinc * hamming;
+    }
+    return h;
+}
+
+// Scales value to the integer samples, the float ones stay in [-1, 1]
+template <typename T>
+static T sample(double value, double scale) {
+    return std::is_integral<T>::value ? (T)std::lround(value * scale) : (T)value;
+}
+
+template <typename T>
+static bool equal(T a, T b) {
+    return a == b;
+}
+
+// The kernel adds the products in the same order, so only the rounding of
+// the compilers can differ
+template <>
+bool equal<float>(float a, float b) {
+    return std::fabs(a - b) <= 1e-5 * (1 + std::fabs(b));
+}
+
+// Filters the channels on the kernel and the CPU for each length of the
+// bench, and compares the outputs. sample_scale and coeff_scale are the
+// values of 1.0 in the integer samples and coefficients.
+template <typename T>
+static bool run_type(sda::utils::BandwidthBench& bench,
+                     cl::Context& context,
+                     cl::CommandQueue& q,
+                     cl::Kernel& krnl,
+                     const std::string& type,
+                     double sample_scale,
+                     double coeff_scale,
+                     const std::vector<int>& channel_counts,
+                     unsigned int threads,
+                     bool run_cpu) {
+    cl_int err;
+    const int par = FIR_WIDTH / (8 * sizeof(T));
+
+    // Coefficients, zero padded to whole words
+    std::vector<double> h = lowpass(FIR_TAPS);
+    samples_t<T> coeff((FIR_TAPS + par - 1) / par * par, 0);
+    for (int t = 0; t < FIR_TAPS; t++) coeff[t] = sample<T>(h[t], coeff_scale);
+    OCL_CHECK(err, cl::Buffer buffer_coeff(context, CL_MEM_USE_HOST_PTR | CL_MEM_READ_ONLY, sizeof(T) * coeff.size(),
+                                           coeff.data(), &err));
+
+    for (int channels : channel_counts) {
+        for (uint64_t size : bench.sizes()) {
+            // Whole words per channel
+            int words = (size + par - 1) / par;
+            int length = words * par;
+            size_t samples = (size_t)channels * length;
+
+            // Create the test data
+            samples_t<T> in(samples), out(samples), gold(samples);
+            for (size_t i = 0; i < samples; i++) in[i] = sample<T>(2.0 * rand() / RAND_MAX - 1, sample_scale);
+
+            // Allocate Buffer in Global Memory
+            size_t samples_bytes = sizeof(T) * samples;
+            OCL_CHECK(err, cl::Buffer buffer_in(context, CL_MEM_USE_HOST_PTR | CL_MEM_READ_ONLY, samples_bytes,
+                                                in.data(), &err));
+            OCL_CHECK(err, cl::Buffer buffer_out(context, CL_MEM_USE_HOST_PTR | CL_MEM_WRITE_ONLY, samples_bytes,
+                                                 out.data(), &err));
+            OCL_CHECK(err, err = krnl.setArg(0, buffer_in));
+            OCL_CHECK(err, err = krnl.setArg(1, buffer_out));
+            OCL_CHECK(err, err = krnl.setArg(2, buffer_coeff));
+            OCL_CHECK(err, err = krnl.setArg(3, channels));
+            OCL_CHECK(err, err = krnl.setArg(4, words));
+
+            // Copy input data to device global memory
+            OCL_CHECK(err, err = q.enqueueMigrateMemObjects({buffer_in, buffer_coeff}, 0 /* 0 means from host*/));
+            OCL_CHECK(err, err = q.finish());
+
+            std::string batch = "channels_" + std::to_string(channels);
+            bench.run({"fpga", type, batch, 1, (uint64_t)length, (double)samples}, [&] {
+                OCL_CHECK(err, err = q.enqueueTask(krnl));
+                OCL_CHECK(err, err = q.finish());
+            });
+
+            // Copy Result from Device Global Memory to Host Local Memory
+            OCL_CHECK(err, err = q.enqueueMigrateMemObjects({buffer_out}, CL_MIGRATE_MEM_OBJECT_HOST));
+            OCL_CHECK(err, err = q.finish());
+
+            if (run_cpu) {
+                bench.run({"cpu", type, batch, threads, (uint64_t)length, (double)samples},
+                          [&] { fir_cpu(in.data(), gold.data(), coeff.data(), FIR_TAPS, channels, length, threads); });
+            } else {
+                // Only the first channel, on one thread
+                fir_cpu(in.data(), gold.data(), coeff.data(), FIR_TAPS, 1, length, 1);
+                samples = length;
+            }
+
+            for (size_t i = 0; i < samples; i++) {
+                if (!equal(out[i], gold[i])) {
+                    std::cout << "Error: Result mismatch" << std::endl;
+                    std::cout << type << " channel = " << i / length << " i = " << i % length
+                              << " CPU result = " << gold[i] << " Device result = " << out[i] << std::endl;
+                    return false;
+                }
+            }
+        }
+    }
+    return true;
+}
+
+int main(int argc, char** argv) {
+    // Command Line Parser
+    sda::utils::CmdLineParser parser;
+    sda::utils::BandwidthBench bench("fir_engine");
+    bench.setUnit("MSamples/s", 1000.0 * 1000);
+    bench.options().min_size = 16 * 1024;
+    bench.options().max_size = 1024 * 1024;
+    bench.options().reps = 3;
+    bench.options().max_reps = 10;
+    std::string channels_default = "1,16,64";
+    if (xcl::is_emulation()) {
+        bench.options().min_size = 1024;
+        bench.options().max_size = 2048;
+        bench.options().reps = 1;
+        bench.options().max_reps = 3;
+        bench.options().warmup = 0;
+        channels_default = "1,4";
+    }
+
+    // Switches
+    //**************//"<Full Arg>",  "<Short Arg>", "<Description>", "<Default>"
+    parser.addSwitch("--xclbin_file", "-x", "input binary file string", "");
+    parser.addSwitch("--types", "-ty", "sample types: int16, int32, fixed, float", "int16,int32,fixed,float");
+    parser.addSwitch("--channels", "-ch", "numbers of signals filtered by one kernel call", channels_default);
+    parser.addSwitch("--threads", "-th", "threads of the CPU implementation (0 = all cores)", "0");
+    parser.addSwitch("--no_cpu", "-nc", "skip the CPU implementation, check the first channel only", "", true);
+    bench.addSwitches(parser);
+    parser.parse(argc, argv);
+    bench.parse(parser);
+
+    // Read settings
+    std::string binaryFile = parser.value("xclbin_file");
+    std::vector<std::string> types = split(parser.value("types"));
+    std::vector<int> channel_counts;
+    for (auto& item : split(parser.value("channels"))) channel_counts.push_back(std::max(std::stoi(item), 1));
+    unsigned int threads = std::max(parser.value_to_int("threads"), 0);
+    if (threads == 0) threads = std::max(std::thread::hardware_concurrency(), 1u);
+    bool run_cpu = !parser.value_to_bool("no_cpu");
+
+    if (argc < 3) {
+        parser.printHelp();
+        return EXIT_FAILURE;
+    }
+
+    for (auto& type : types) {
+        if (type != "int16" && type != "int32" && type != "fixed" && type != "float") {
+            std::cout << "ERROR : unknown sample type " << type << ", use int16, int32, fixed or float" << std::endl;
+            return EXIT_FAILURE;
+        }
+    }
+
+    cl_int err;
+    cl::CommandQueue q;
+    cl::Context context;
+    cl::Program program;
+
+    // OPENCL HOST CODE AREA START
+    auto devices = xcl::get_xil_devices();
+
+    // read_binary_file() is a utility API which will load the binaryFile
+    // and will return the pointer to file buffer.
+    auto fileBuf = xcl::read_binary_file(binaryFile);
+    cl::Program::Binaries bins{{fileBuf.data(), fileBuf.size()}};
+    bool valid_device = false;
+    for (unsigned int i = 0; i < devices.size(); i++) {
+        auto device = devices[i];
+        // Creating Context and Command Queue for selected Device
+        OCL_CHECK(err, context = cl::Context(device, nullptr, nullptr, nullptr, &err));
+        OCL_CHECK(err, q = cl::CommandQueue(context, device, CL_QUEUE_PROFILING_ENABLE, &err));
+
+        std::cout << "Trying to program device[" << i << "]: " << device.getInfo<CL_DEVICE_NAME>() << std::endl;
+        program = cl::Program(context, {device}, bins, nullptr, &err);
+        if (err != CL_SUCCESS) {
+            std::cout << "Failed to program device[" << i << "] with xclbin file!\n";
+        } else {
+            std::cout << "Device[" << i << "]: program successful!\n";
+            bench.setInfo("device", device.getInfo<CL_DEVICE_NAME>());
+            valid_device = true;
+            break; // we break because we found a valid device
+        }
+    }
+    if (!valid_device) {
+        std::cout << "Failed to program any device found, exit!\n";
+        exit(EXIT_FAILURE);
+    }
+
+    bench.setInfo("xclbin", binaryFile);
+    bench.setInfo("taps", std::to_string(FIR_TAPS));
+    std::cout << FIR_TAPS << " tap filters, " << threads << " CPU threads" << std::endl;
+
+    bool match = true;
+    for (auto& type : types) {
+        std::string krnl_name = "fir_" + type;
+        OCL_CHECK(err, cl::Kernel krnl(program, krnl_name.c_str(), &err));
+        if (type == "int16") {
+            match = run_type<int16_t>(bench, context, q, krnl, type, 4096, 32768, channel_counts, threads, run_cpu);
+        } else if (type == "int32") {
+            match = run_type<int32_t>(bench, context, q, krnl, type, 65536, 256, channel_counts, threads, run_cpu);
+        } else if (type == "fixed") {
+            // Q15 samples and coefficients, filtered as raw integers on the CPU
+            match = run_type<int16_t>(bench, context, q, krnl, type, 4096, 32768, channel_counts, threads, run_cpu);
+        } else {
+            match = run_type<float>(bench, context, q, krnl, type, 1, 1, channel_counts, threads, run_cpu);
+        }
+        if (!match) break;
+    }
+    // OPENCL HOST CODE AREA END
+
+    if (!bench.write() || !bench.check()) match = false;
+    std::cout << "TEST " << (match ? "PASSED" : "FAILED") << std::endl;
+    return (match ? EXIT_SUCCESS : EXIT_FAILURE);
+}
@@ -0,0 +1,423 @@
+/**
+* Copyright (C) 2019-2021 Xilinx, Inc
+*
+* Licensed under the Apache License, Version 2.0 (the "License"). You may
+* not use this file except in compliance with the License. A copy of the
+* License is located at
+*
+*     http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+* WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the
+* License for the specific language governing permissions and limitations
+* under the License.
+*/
+
+/********************************************************************************************
+ * Description:
+ * Host driver of the HBM access pattern generator. For every HBM pseudo-channel
+ * (PC), it runs the sequential, strided, gather, Zipfian and interleaved patterns
+ * of the krnl_pattern kernels with every burst length, stride and number of
+ * outstanding transactions of the sweep, reads and writes, and prints a
+ * bandwidth heatmap of the configurations over the PCs.
+ *
+ ******************************************************************************************/
+
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <random>
+#include <sstream>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+#include "bench.h"
+#include "cmdlineparser.h"
+#include "pattern.h"
+#include "xcl2.hpp"
+
+#define MAX_HBM_PC_COUNT 32
+
+using sda::utils::BandwidthBench;
+
+static const char* pattern_names[PATTERN_COUNT] = {"sequential", "strided", "gather", "zipf", "interleaved"};
+
+// One configuration of the sweep, in words
+struct Config {
+    Pattern pattern;
+    uint32_t burst;
+    uint32_t stride;
+    unsigned int outstanding;
+
+    std::string label() const {
+        std::string label = pattern_names[pattern];
+        if (pattern == PATTERN_STRIDED) label += "/s" + BandwidthBench::sizeString((uint64_t)stride * WORD_BYTES);
+        return label + "/b" + BandwidthBench::sizeString((uint64_t)burst * WORD_BYTES) + "/o" +
+               std::to_string(outstanding);
+    }
+};
+
+// One row of the heatmap, throughput in GB/s for every PC of the sweep
+struct HeatmapRow {
+    std::string direction;
+    std::string config;
+    std::vector<double> gbps;
+};
+
+static std::vector<std::string> split(const std::string& list) {
+    std::vector<std::string> items;
+    std::stringstream stream(list);
+    std::string item;
+    while (std::getline(stream, item, ',')) {
+        if (!item.empty()) items.push_back(item);
+    }
+    return items;
+}
+
+// Sizes in bytes of a list, converted to words
+static std::vector<uint32_t> parse_words(const std::string& list, const char* what) {
+    std::vector<uint32_t> words;
+    for (auto& item : split(list)) {
+        uint64_t bytes = BandwidthBench::parseSize(item);
+        if (bytes == 0 || bytes % WORD_BYTES) {
+            printf("Error: %s %s is not a multiple of %d bytes\n", what, item.c_str(), WORD_BYTES);
+            exit(EXIT_FAILURE);
+        }
+        words.push_back(bytes / WORD_BYTES);
+    }
+    return words;
+}
+
+// First words of the runs of the gather and zipf patterns. The runs start on
+// a multiple of burst. Gather picks every burst uniformly, zipf picks the
+// burst of rank k with a probability proportional to 1 / k^s, the ranks
+// being shuffled over the buffer.
+static void make_index(Pattern pattern,
+                       uint32_t runs,
+                       uint32_t burst,
+                       uint32_t words,
+                       double s,
+                       std::mt19937& gen,
+                       std::vector<uint32_t>& index) {
+    uint32_t blocks = words / burst;
+    index.resize(runs);
+    if (pattern == PATTERN_GATHER) {
+        std::uniform_int_distribution<uint32_t> block(0, blocks - 1);
+        for (auto& start : index) start = block(gen) * burst;
+        return;
+    }
+
+    std::vector<double> cdf(blocks);
+    double total = 0;
+    for (uint32_t k = 0; k < blocks; k++) {
+        total += 1.0 / std::pow(k + 1.0, s);
+        cdf[k] = total;
+    }
+    std::vector<uint32_t> rank_block(blocks);
+    for (uint32_t k = 0; k < blocks; k++) rank_block[k] = k;
+    std::shuffle(rank_block.begin(), rank_block.end(), gen);
+
+    std::uniform_real_distribution<double> uniform(0, total);
+    for (auto& start : index) {
+        size_t rank = std::lower_bound(cdf.begin(), cdf.end(), uniform(gen)) - cdf.begin();
+        start = rank_block[std::min(rank, (size_t)blocks - 1)] * burst;
+    }
+}
+
+// Replays the runs of patternProc() and returns the sum of the first lane of
+// the words read
+static uint32_t expected_sum(const Config& config,
+                             uint32_t runs,
+                             uint32_t limit,
+                             uint32_t ports,
+                             const std::vector<uint32_t>& index) {
+    uint32_t sum = 0, next = 0, port = 0;
+    uint32_t step = config.pattern == PATTERN_STRIDED ? config.stride : config.burst;
+    for (uint32_t r = 0; r < runs; r++) {
+        bool gather = config.pattern == PATTERN_GATHER || config.pattern == PATTERN_ZIPF;
+        uint32_t start = gather ? index[r] : next;
+        if (config.pattern != PATTERN_INTERLEAVED || ++port == ports) {
+            port = 0;
+            next += step;
+            if (next >= limit) next -= limit;
+        }
+        for (uint32_t j = 0; j < config.burst; j++) sum += LANE_VALUE(start + j, 0);
+    }
+    return sum;
+}
+
+static cl::Buffer pc_buffer(const cl::Context& context, int pc, size_t size) {
+    cl_int err;
+    cl_mem_ext_ptr_t ext;
+    ext.obj = nullptr;
+    ext.param = 0;
+    ext.flags = pc | XCL_MEM_TOPOLOGY;
+    OCL_CHECK(err, cl::Buffer buffer(context, CL_MEM_READ_WRITE | CL_MEM_EXT_PTR_XILINX, size, &ext, &err));
+    return buffer;
+}
+
+// Prints one shade per PC, from ' ' (no throughput) to '@' (the highest of the
+// direction)
+static void print_heatmap(const std::vector<HeatmapRow>& rows,
+                          const std::string& direction,
+                          const std::vector<int>& pcs) {
+    const char shades[] = " .:-=+*#%@";
+    double max = 0;
+    for (auto& row : rows) {
+        if (row.direction == direction) max = std::max(max, *std::max_element(row.gbps.begin(), row.gbps.end()));
+    }
+    if (max == 0) return;
+
+    printf("\n%s bandwidth heatmap, '@' = %.2f GB/s\n%-28s", direction.c_str(), max, "HBM PC");
+    for (int pc : pcs) printf("%3d", pc);
+    printf(" %9s\n", "Best GB/s");
+    for (auto& row : rows) {
+        if (row.direction != direction) continue;
+        printf("%-28s", row.config.c_str());
+        for (double gbps : row.gbps) printf("  %c", shades[(int)std::lround(gbps / max * (sizeof(shades) - 2))]);
+        printf(" %9.2f\n", *std::max_element(row.gbps.begin(), row.gbps.end()));
+    }
+}
+
+static bool write_heatmap(const std::string& filename,
+                          const std::vector<HeatmapRow>& rows,
+                          const std::vector<int>& pcs) {
+    std::ofstream file(filename.c_str());
+    file << "direction,config";
+    for (int pc : pcs) file << ",HBM" << pc;
+    file << "\n";
+    for (auto& row : rows) {
+        file << row.direction << "," << row.config;
+        for (double gbps : row.gbps) file << "," << gbps;
+        file << "\n";
+    }
+    if (!file.good()) {
+        printf("Error: cannot write the heatmap to %s\n", filename.c_str());
+        return false;
+    }
+    printf("Heatmap written to %s\n", filename.c_str());
+    return true;
+}
+
+int main(int argc, char* argv[]) {
+    // Command Line Parser
+    sda::utils::CmdLineParser parser;
+    BandwidthBench bench("hbm_access_patterns");
+
+    // Each measurement accesses about the working set size of -z
+    std::string pc_range = "0:31";
+    std::string bursts = "64,256,1K,4K";
+    std::string strides = "4K,64K,1M";
+    bench.options().min_size = 64 * 1024 * 1024;
+    bench.options().max_size = 64 * 1024 * 1024;
+    bench.options().reps = 3;
+    bench.options().max_reps = 10;
+
+    // reducing the sweep to run faster in emulation mode
+    if (xcl::is_emulation()) {
+        pc_range = "0:1";
+        bursts = "64,1K";
+        strides = "4K";
+        bench.options().min_size = 64 * 1024;
+        bench.options().max_size = 64 * 1024;
+        bench.options().reps = 1;
+        bench.options().max_reps = 3;
+        bench.options().warmup = 0;
+    }
+
+    // Switches
+    //**************//"<Full Arg>",  "<Short Arg>", "<Description>", "<Default>"
+    parser.addSwitch("--xclbin_file", "-x", "input binary file string", "");
+    parser.addSwitch("--pcs", "-pc", "HBM pseudo-channels first:last", pc_range);
+    parser.addSwitch("--patterns", "-pt", "sequential, strided, gather, zipf and/or interleaved",
+                     "sequential,strided,gather,zipf,interleaved");
+    parser.addSwitch("--bursts", "-bl", "bytes accessed by each run of consecutive words", bursts);
+    parser.addSwitch("--strides", "-st", "bytes between the runs of the strided pattern", strides);
+    parser.addSwitch("--outstanding", "-ot", "outstanding transactions, 4 and/or 32", "4,32");
+    parser.addSwitch("--directions", "-dr", "read and/or write", "read,write");
+    parser.addSwitch("--zipf", "-zf", "exponent s of the Zipfian pattern", "0.99");
+    parser.addSwitch("--heatmap", "-hm", "write the heatmap to this .csv file", "");
+    bench.addSwitches(parser);
+    parser.parse(argc, argv);
+    bench.parse(parser);
+
+    std::string binaryFile = parser.value("xclbin_file");
+    if (binaryFile.empty()) {
+        parser.printHelp();
+        return EXIT_FAILURE;
+    }
+
+    std::vector<int> pcs;
+    pc_range = parser.value("pcs");
+    int first = atoi(pc_range.c_str());
+    int last = pc_range.find(':') == std::string::npos ? first : atoi(pc_range.substr(pc_range.find(':') + 1).c_str());
+    for (int pc = first; pc <= last; pc++) pcs.push_back(pc);
+    if (pcs.empty() || first < 0 || last >= MAX_HBM_PC_COUNT) {
+        printf("Error: invalid pseudo-channels %s, expected first:last within 0:%d\n", pc_range.c_str(),
+               MAX_HBM_PC_COUNT - 1);
+        return EXIT_FAILURE;
+    }
+
+    std::vector<Pattern> patterns;
+    for (auto& name : split(parser.value("patterns"))) {
+        auto found = std::find(pattern_names, pattern_names + PATTERN_COUNT, name);
+        if (found == pattern_names + PATTERN_COUNT) {
+            printf("Error: unknown pattern %s\n", name.c_str());
+            return EXIT_FAILURE;
+        }
+        patterns.push_back((Pattern)(found - pattern_names));
+    }
+    std::vector<unsigned int> outstanding;
+    for (auto& item : split(parser.value("outstanding"))) {
+        if (item != "4" && item != "32") {
+            printf("Error: the kernels have 4 or 32 outstanding transactions, not %s\n", item.c_str());
+            return EXIT_FAILURE;
+        }
+        outstanding.push_back(atoi(item.c_str()));
+    }
+    std::vector<uint32_t> burst_words = parse_words(parser.value("bursts"), "burst");
+    std::vector<uint32_t> stride_words = parse_words(parser.value("strides"), "stride");
+    std::vector<std::string> directions = split(parser.value("directions"));
+    double zipf = atof(parser.value("zipf").c_str());
+
+    // The configurations of the sweep, the strides only apply to the strided
+    // pattern
+    std::vector<Config> configs;
+    for (unsigned int ot : outstanding) {
+        for (Pattern pattern : patterns) {
+            for (uint32_t burst : burst_words) {
+                if (pattern != PATTERN_STRIDED) {
+                    configs.push_back({pattern, burst, burst, ot});
+                    continue;
+                }
+                for (uint32_t stride : stride_words) configs.push_back({pattern, burst, stride, ot});
+            }
+        }
+    }
+
+    xcl::Session session(binaryFile);
+    cl::Context context = session.context();
+    cl::CommandQueue q = session.createQueue(CL_QUEUE_PROFILING_ENABLE);
+    bench.setInfo("device", session.device().getInfo<CL_DEVICE_NAME>());
+    bench.setInfo("xclbin", binaryFile);
+    cl_int err;
+    cl::Kernel kernels[2];
+    OCL_CHECK(err, kernels[0] = cl::Kernel(session.program(), "krnl_pattern_o4", &err));
+    OCL_CHECK(err, kernels[1] = cl::Kernel(session.program(), "krnl_pattern_o32", &err));
+
+    // One data buffer per PC, allocated for the largest working set and filled
+    // with the values the writes store. The index list of a PC is in the next
+    // PC of the sweep, so that it does not share the PC being measured.
+    size_t n = pcs.size();
+    uint32_t max_words = bench.options().max_size / WORD_BYTES;
+    std::vector<uint32_t, aligned_allocator<uint32_t> > init((size_t)max_words * WORD_LANES);
+    for (uint32_t w = 0; w < max_words; w++) {
+        for (int k = 0; k < WORD_LANES; k++) init[(size_t)w * WORD_LANES + k] = LANE_VALUE(w, k);
+    }
+    std::vector<cl::Buffer> data(n), index_buffers(n);
+    for (size_t i = 0; i < n; i++) {
+        data[i] = pc_buffer(context, pcs[i], (size_t)max_words * WORD_BYTES);
+        index_buffers[i] = pc_buffer(context, pcs[(i + 1) % n], (size_t)max_words * sizeof(uint32_t));
+        OCL_CHECK(err, err = q.enqueueWriteBuffer(data[i], CL_FALSE, 0, (size_t)max_words * WORD_BYTES, init.data()));
+    }
+    OCL_CHECK(err, cl::Buffer info_buffer(context, CL_MEM_WRITE_ONLY, 2 * sizeof(uint32_t), nullptr, &err));
+    OCL_CHECK(err, err = q.finish());
+
+    std::mt19937 gen(42);
+    std::vector<uint32_t> index;
+    std::vector<HeatmapRow> rows;
+    bool match = true;
+
+    for (uint64_t size : bench.sizes()) {
+        uint32_t words = size / WORD_BYTES;
+        for (auto& direction : directions) {
+            uint32_t write = direction == "write";
+            for (auto& config : configs) {
+                // Every run starts below limit so that it ends within the buffer
+                if (config.burst > words || (config.pattern == PATTERN_STRIDED &&
+                                             config.stride >= words - config.burst + 1)) {
+                    printf("Skipping %s, larger than the %s working set\n", config.label().c_str(),
+                           BandwidthBench::sizeString(size).c_str());
+                    continue;
+                }
+                cl::Kernel& krnl = kernels[config.outstanding == 4 ? 0 : 1];
+                uint32_t runs = words / config.burst;
+                uint32_t limit = words - config.burst + 1;
+                uint32_t ports = config.pattern == PATTERN_INTERLEAVED ? std::min((size_t)MAX_PORTS, n) : 1;
+                HeatmapRow row = {direction, config.label(), std::vector<double>()};
+                if (bench.sizes().size() > 1) row.config += "/z" + BandwidthBench::sizeString(size);
+
+                for (size_t i = 0; i < n; i++) {
+                    if (config.pattern == PATTERN_GATHER || config.pattern == PATTERN_ZIPF) {
+                        make_index(config.pattern, runs, config.burst, words, zipf, gen, index);
+                        OCL_CHECK(err, err = q.enqueueWriteBuffer(index_buffers[i], CL_TRUE, 0,
+                                                                  runs * sizeof(uint32_t), index.data()));
+                    }
+                    std::string banks = "HBM[" + std::to_string(pcs[i]);
+                    for (uint32_t p = 0; p < MAX_PORTS; p++) {
+                        // The ports past the interleaved ones are not accessed
+                        size_t port_pc = (i + p % ports) % n;
+                        OCL_CHECK(err, err = krnl.setArg(p, data[port_pc]));
+                        if (p > 0 && p < ports) banks += "," + std::to_string(pcs[port_pc]);
+                    }
+                    banks += "]";
+                    OCL_CHECK(err, err = krnl.setArg(4, index_buffers[i]));
+                    OCL_CHECK(err, err = krnl.setArg(5, info_buffer));
+                    OCL_CHECK(err, err = krnl.setArg(6, (uint32_t)config.pattern));
+                    OCL_CHECK(err, err = krnl.setArg(7, runs));
+                    OCL_CHECK(err, err = krnl.setArg(8, config.burst));
+                    OCL_CHECK(err, err = krnl.setArg(9, config.stride));
+                    OCL_CHECK(err, err = krnl.setArg(10, limit));
+                    OCL_CHECK(err, err = krnl.setArg(11, ports));
+                    OCL_CHECK(err, err = krnl.setArg(12, write));
+
+                    // Timed from the profiling info of the kernel events
+                    double bytes = (double)runs * config.burst * WORD_BYTES;
+                    auto& result = bench.runTimed({row.config, direction, banks, 1, size, bytes}, [&] {
+                        cl::Event event;
+                        OCL_CHECK(err, err = q.enqueueTask(krnl, nullptr, &event));
+                        OCL_CHECK(err, err = event.wait());
+                        unsigned long end = OCL_CHECK(err, event.getProfilingInfo<CL_PROFILING_COMMAND_END>(&err));
+                        unsigned long start =
+                            OCL_CHECK(err, event.getProfilingInfo<CL_PROFILING_COMMAND_START>(&err));
+                        return (end - start) / ((double)1000000000);
+                    });
+                    row.gbps.push_back(result.median / 1024);
+
+                    // Check the words accessed by the last run of the kernel
+                    uint32_t info[2];
+                    OCL_CHECK(err, err = q.enqueueReadBuffer(info_buffer, CL_TRUE, 0, sizeof(info), info));
+                    uint32_t sum = write ? 0 : expected_sum(config, runs, limit, ports, index);
+                    if (info[0] != sum || info[1] != runs * config.burst) {
+                        printf("Error: %s %s on %s accessed %u words with sum %u, expected %u words with sum %u\n",
+                               direction.c_str(), config.label().c_str(), banks.c_str(), info[1], info[0],
+                               runs * config.burst, sum);
+                        match = false;
+                    }
+                }
+                rows.push_back(row);
+            }
+        }
+    }
+
+    // The writes store the initial values, any other value was written to a
+    // wrong address
+    std::vector<uint32_t, aligned_allocator<uint32_t> > readback(init.size());
+    for (size_t i = 0; i < n && match; i++) {
+        OCL_CHECK(err, err = q.enqueueReadBuffer(data[i], CL_TRUE, 0, (size_t)max_words * WORD_BYTES,
+                                                 readback.data()));
+        if (readback != init) {
+            printf("Error: the buffer of HBM[%d] was corrupted by the writes\n", pcs[i]);
+            match = false;
+        }
+    }
+
+    for (auto& direction : directions) print_heatmap(rows, direction, pcs);
+    if (!parser.value("heatmap").empty() && !write_heatmap(parser.value("heatmap"), rows, pcs)) match = false;
+    if (!bench.write() || !bench.check()) match = false;
+
+    std::cout << (match ? "TEST PASSED" : "TEST FAILED") << std::endl;
+    return (match ? EXIT_SUCCESS : EXIT_FAILURE);
+}
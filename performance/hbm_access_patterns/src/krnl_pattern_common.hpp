@@ -0,0 +1,101 @@
+/**
+* Copyright (C) 2019-2021 Xilinx, Inc
+*
+* Licensed under the Apache License, Version 2.0 (the "License"). You may
+* not use this file except in compliance with the License. A copy of the
+* License is located at
+*
+*     http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+* WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the
+* License for the specific language governing permissions and limitations
+* under the License.
+*/
+
+#include "pattern.h"
+#include <ap_int.h>
+#include <stdint.h>
+
+typedef ap_uint<WORD_BYTES * 8> word_t;
+
+// Template to avoid signature conflict in sw_emu
+template <int DUMMY = 0>
+void readRun(word_t* mem, uint32_t start, uint32_t burst, uint32_t& sum) {
+read_run:
+    for (uint32_t j = 0; j < burst; j++) {
+#pragma HLS PIPELINE II = 1
+#pragma HLS LOOP_TRIPCOUNT min = 1 max = 64
+        word_t word = mem[start + j];
+        sum += (uint32_t)word.range(31, 0);
+    }
+}
+
+template <int DUMMY = 0>
+void writeRun(word_t* mem, uint32_t start, uint32_t burst) {
+write_run:
+    for (uint32_t j = 0; j < burst; j++) {
+#pragma HLS PIPELINE II = 1
+#pragma HLS LOOP_TRIPCOUNT min = 1 max = 64
+        word_t word;
+        for (int k = 0; k < WORD_LANES; k++) {
+#pragma HLS UNROLL
+            word.range(32 * k + 31, 32 * k) = LANE_VALUE(start + j, k);
+        }
+        mem[start + j] = word;
+    }
+}
+
+// Accesses runs runs of burst words following pattern. The runs start
+// below limit, so that they end within the buffers. info returns the sum
+// of the first lane of the words read and the number of words accessed.
+template <int DUMMY = 0>
+void patternProc(word_t* mem0,
+                 word_t* mem1,
+                 word_t* mem2,
+                 word_t* mem3,
+                 const uint32_t* index,
+                 uint32_t* info,
+                 uint32_t pattern,
+                 uint32_t runs,
+                 uint32_t burst,
+                 uint32_t stride,
+                 uint32_t limit,
+                 uint32_t ports,
+                 uint32_t write) {
+    uint32_t sum = 0;
+    uint32_t next = 0;
+    uint32_t port = 0;
+    uint32_t step = pattern == PATTERN_STRIDED ? stride : burst;
+
+runs:
+    for (uint32_t r = 0; r < runs; r++) {
+#pragma HLS LOOP_TRIPCOUNT min = 1 max = 1048576
+        uint32_t start = (pattern == PATTERN_GATHER || pattern == PATTERN_ZIPF) ? index[r] : next;
+        uint32_t p = pattern == PATTERN_INTERLEAVED ? port : 0;
+
+        // The interleaved runs move on once every port got its run
+        if (pattern != PATTERN_INTERLEAVED || ++port == ports) {
+            port = 0;
+            next += step;
+            if (next >= limit) next -= limit;
+        }
+
+        // Each port needs its own accesses, HLS cannot select between them
+        if (write) {
+            if (p == 0) writeRun(mem0, start, burst);
+            if (p == 1) writeRun(mem1, start, burst);
+            if (p == 2) writeRun(mem2, start, burst);
+            if (p == 3) writeRun(mem3, start, burst);
+        } else {
+            if (p == 0) readRun(mem0, start, burst, sum);
+            if (p == 1) readRun(mem1, start, burst, sum);
+            if (p == 2) readRun(mem2, start, burst, sum);
+            if (p == 3) readRun(mem3, start, burst, sum);
+        }
+    }
+
+    info[0] = sum;
+    info[1] = runs * burst;
+}
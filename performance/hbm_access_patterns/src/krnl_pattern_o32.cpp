@@ -0,0 +1,51 @@
+/**
+* Copyright (C) 2019-2021 Xilinx, Inc
+*
+* Licensed under the Apache License, Version 2.0 (the "License"). You may
+* not use this file except in compliance with the License. A copy of the
+* License is located at
+*
+*     http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+* WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the
+* License for the specific language governing permissions and limitations
+* under the License.
+*/
+
+/*******************************************************************************
+Description:
+    Access pattern generator with up to 32 outstanding transactions and
+    bursts of up to 64 beats on each memory port. See krnl_pattern_common.hpp.
+*******************************************************************************/
+#include "krnl_pattern_common.hpp"
+
+extern "C" {
+void krnl_pattern_o32(word_t* mem0,
+                      word_t* mem1,
+                      word_t* mem2,
+                      word_t* mem3,
+                      const uint32_t* index,
+                      uint32_t* info,
+                      uint32_t pattern,
+                      uint32_t runs,
+                      uint32_t burst,
+                      uint32_t stride,
+                      uint32_t limit,
+                      uint32_t ports,
+                      uint32_t write) {
+#pragma HLS INTERFACE m_axi port = mem0 offset = slave bundle = gmem0 num_read_outstanding = 32 \
+    num_write_outstanding = 32 max_read_burst_length = 64 max_write_burst_length = 64
+#pragma HLS INTERFACE m_axi port = mem1 offset = slave bundle = gmem1 num_read_outstanding = 32 \
+    num_write_outstanding = 32 max_read_burst_length = 64 max_write_burst_length = 64
+#pragma HLS INTERFACE m_axi port = mem2 offset = slave bundle = gmem2 num_read_outstanding = 32 \
+    num_write_outstanding = 32 max_read_burst_length = 64 max_write_burst_length = 64
+#pragma HLS INTERFACE m_axi port = mem3 offset = slave bundle = gmem3 num_read_outstanding = 32 \
+    num_write_outstanding = 32 max_read_burst_length = 64 max_write_burst_length = 64
+#pragma HLS INTERFACE m_axi port = index offset = slave bundle = gmem4
+#pragma HLS INTERFACE m_axi port = info offset = slave bundle = gmem5
+
+    patternProc(mem0, mem1, mem2, mem3, index, info, pattern, runs, burst, stride, limit, ports, write);
+}
+}
@@ -0,0 +1,39 @@
+/**
+* Copyright (C) 2019-2021 Xilinx, Inc
+*
+* Licensed under the Apache License, Version 2.0 (the "License"). You may
+* not use this file except in compliance with the License. A copy of the
+* License is located at
+*
+*     http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+* WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the
+* License for the specific language governing permissions and limitations
+* under the License.
+*/
+#ifndef PATTERN_H_
+#define PATTERN_H_
+
+// Access patterns of the krnl_pattern kernels. Every pattern is a list of
+// runs, each run accessing burst consecutive 512-bit words from its first
+// word.
+enum Pattern {
+    PATTERN_SEQUENTIAL = 0,  // each run starts where the previous one ended
+    PATTERN_STRIDED = 1,     // each run starts stride words after the previous one
+    PATTERN_GATHER = 2,      // the first words of the runs are read from the index list
+    PATTERN_ZIPF = 3,        // same as gather, with a Zipfian index list
+    PATTERN_INTERLEAVED = 4, // sequential, with the runs rotating over the memory ports
+    PATTERN_COUNT = 5
+};
+
+#define WORD_BYTES 64
+#define WORD_LANES 16 // 32-bit lanes of a word
+#define MAX_PORTS 4
+
+// The memory ports hold word w as lanes w * WORD_LANES + k, which is also
+// what the writes store, so that reads can be checked after writes
+#define LANE_VALUE(w, k) ((uint32_t)((w)*WORD_LANES + (k)))
+
+#endif
@@ -0,0 +1,8 @@
+#HBM connectivity of the CUs (0/1): 0 for 4 fixed pseudo-channels per CU,
+#1 for every pseudo-channel on every port, needed by the matrix (-m)
+MATRIX:= 0
+ifeq ($(MATRIX),1)
+HBM_CONFIG:= krnl_vaddmul_matrix.cfg
+else
+HBM_CONFIG:= krnl_vaddmul.cfg
+endif
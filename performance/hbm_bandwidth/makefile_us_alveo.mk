@@ -53,7 +53,9 @@ LINK_OUTPUT := $(BUILD_DIR)/krnl_vaddmul.link.xclbin
 PACKAGE_OUT = ./package.$(TARGET)
 
 VPP_PFLAGS := 
-CMD_ARGS = $(BUILD_DIR)/krnl_vaddmul.xclbin
+CMD_ARGS = -x $(BUILD_DIR)/krnl_vaddmul.xclbin
+include config.mk
+
 CXXFLAGS += -I$(XILINX_XRT)/include -I$(XILINX_VIVADO)/include -Wall -O0 -g -std=c++1y
 LDFLAGS += -L$(XILINX_XRT)/lib -pthread -lOpenCL
 
@@ -62,7 +64,10 @@ PLATFORM_BLOCKLIST += u25_ u30 u200 zc vck u250 aws-vu9p-f1 samsung u2_ x3522pv
 ############################## Setting up Host Variables ##############################
 #Include Required Host Source Files
 CXXFLAGS += -I$(XF_PROJ_ROOT)/common/includes/xcl2
-HOST_SRCS += $(XF_PROJ_ROOT)/common/includes/xcl2/xcl2.cpp ./src/host.cpp 
+CXXFLAGS += -I$(XF_PROJ_ROOT)/common/includes/cmdparser
+CXXFLAGS += -I$(XF_PROJ_ROOT)/common/includes/logger
+CXXFLAGS += -I$(XF_PROJ_ROOT)/common/includes/bench
+HOST_SRCS += $(XF_PROJ_ROOT)/common/includes/xcl2/xcl2.cpp $(XF_PROJ_ROOT)/common/includes/cmdparser/cmdlineparser.cpp $(XF_PROJ_ROOT)/common/includes/logger/logger.cpp $(XF_PROJ_ROOT)/common/includes/bench/bench.cpp ./src/host.cpp 
 # Host compiler global settings
 CXXFLAGS += -fmessage-length=0
 LDFLAGS += -lrt -lstdc++ 
@@ -73,7 +78,7 @@ VPP_FLAGS += -t $(TARGET) --platform $(PLATFORM) --save-temps
 
 
 # Kernel linker flags
-VPP_LDFLAGS_krnl_vaddmul += --config ./krnl_vaddmul.cfg
+VPP_LDFLAGS_krnl_vaddmul += --config ./$(HBM_CONFIG)
 EXECUTABLE = ./hbm_bandwidth
 EMCONFIG_DIR = $(TEMP_DIR)
 
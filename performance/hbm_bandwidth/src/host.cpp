@@ -28,12 +28,17 @@
  ******************************************************************************************/
 
 #include <algorithm>
+#include <fstream>
 #include <iostream>
+#include <map>
+#include <sstream>
 #include <stdint.h>
 #include <stdlib.h>
 #include <string.h>
 #include <vector>
 
+#include "bench.h"
+#include "cmdlineparser.h"
 #include "xcl2.hpp"
 
 #define NUM_KERNEL 3
@@ -73,11 +78,267 @@ bool verify(std::vector<int, aligned_allocator<int> >& source_sw_add_results,
     return check;
 }
 
-int main(int argc, char* argv[]) {
-    if (argc != 2) {
-        printf("Usage: %s <XCLBIN> \n", argv[0]);
-        return -1;
+static std::vector<std::string> split(const std::string& list) {
+    std::vector<std::string> items;
+    std::stringstream stream(list);
+    std::string item;
+    while (std::getline(stream, item, ',')) {
+        if (!item.empty()) items.push_back(item);
     }
+    return items;
+}
+
+// Pseudo-channels behind one switch of the HBM subsystem
+#define PC_GROUP 4
+
+// Buffers of a CU on one pseudo-channel, in the order of the kernel arguments
+struct CuBuffers {
+    cl::Buffer in1;
+    cl::Buffer in2;
+    cl::Buffer out_add;
+    cl::Buffer out_mul;
+};
+
+// Median bandwidth (GB/s) of every pseudo-channel and CU
+struct Matrix {
+    std::string scenario;
+    std::vector<std::vector<double> > gbps;
+};
+
+static cl::Buffer pc_buffer(cl::Context& context, int pc, size_t size) {
+    cl_int err;
+    cl_mem_ext_ptr_t ext;
+    ext.obj = nullptr;
+    ext.param = 0;
+    ext.flags = pc | XCL_MEM_TOPOLOGY;
+    OCL_CHECK(err, cl::Buffer buffer(context, CL_MEM_READ_WRITE | CL_MEM_EXT_PTR_XILINX, size, &ext, &err));
+    return buffer;
+}
+
+// Points a CU to its buffers on one pseudo-channel. Fails when the xclbin does
+// not connect the CU to it.
+static bool set_buffers(cl::Kernel& krnl, CuBuffers& buffers, unsigned int size, unsigned int num_times) {
+    cl_int err = krnl.setArg(0, buffers.in1);
+    if (err == CL_SUCCESS) err = krnl.setArg(1, buffers.in2);
+    if (err == CL_SUCCESS) err = krnl.setArg(2, buffers.out_add);
+    if (err == CL_SUCCESS) err = krnl.setArg(3, buffers.out_mul);
+    if (err != CL_SUCCESS) return false;
+    OCL_CHECK(err, err = krnl.setArg(4, size));
+    OCL_CHECK(err, err = krnl.setArg(5, num_times));
+    return true;
+}
+
+// Kernel duration from the profiling info of its event
+static double event_seconds(cl::Event& event) {
+    cl_int err;
+    unsigned long end = OCL_CHECK(err, event.getProfilingInfo<CL_PROFILING_COMMAND_END>(&err));
+    unsigned long start = OCL_CHECK(err, event.getProfilingInfo<CL_PROFILING_COMMAND_START>(&err));
+    return (end - start) / ((double)1000000000);
+}
+
+static void print_matrix(const std::vector<std::vector<double> >& cells,
+                         const std::vector<int>& pcs,
+                         const char* title) {
+    printf("\n%s\n%-8s", title, "HBM PC");
+    for (size_t cu = 0; cu < cells[0].size(); cu++) printf(" %8s", ("CU" + std::to_string(cu + 1)).c_str());
+    printf("\n");
+    for (size_t i = 0; i < pcs.size(); i++) {
+        printf("%-8d", pcs[i]);
+        for (double cell : cells[i]) printf(" %8.2f", cell);
+        printf("\n");
+    }
+}
+
+static bool write_matrices(const std::string& filename,
+                           const std::vector<Matrix>& matrices,
+                           const std::vector<int>& pcs) {
+    std::ofstream file(filename.c_str());
+    file << "scenario,pc,cu,gbps\n";
+    for (auto& matrix : matrices) {
+        for (size_t i = 0; i < pcs.size(); i++) {
+            for (size_t cu = 0; cu < matrix.gbps[i].size(); cu++) {
+                file << matrix.scenario << "," << pcs[i] << "," << cu + 1 << "," << matrix.gbps[i][cu] << "\n";
+            }
+        }
+    }
+    if (!file.good()) {
+        printf("Error: cannot write the matrices to %s\n", filename.c_str());
+        return false;
+    }
+    printf("Matrices written to %s\n", filename.c_str());
+    return true;
+}
+
+// The local group of a CU is the group of pseudo-channels it reaches fastest
+// on its own, the others are behind the lateral connections of the switches.
+// Prints the bandwidth of the local and remote pseudo-channels.
+static void print_locality(const Matrix& isolated, const std::vector<int>& pcs) {
+    printf("\n%-4s %-12s %12s %12s %9s\n", "CU", "Local PCs", "Local GB/s", "Remote GB/s", "Penalty");
+    for (size_t cu = 0; cu < isolated.gbps[0].size(); cu++) {
+        std::map<int, std::vector<size_t> > groups;
+        for (size_t i = 0; i < pcs.size(); i++) groups[pcs[i] / PC_GROUP].push_back(i);
+        int local = groups.begin()->first;
+        double local_gbps = 0;
+        for (auto& group : groups) {
+            double sum = 0;
+            for (size_t i : group.second) sum += isolated.gbps[i][cu];
+            if (sum / group.second.size() > local_gbps) {
+                local = group.first;
+                local_gbps = sum / group.second.size();
+            }
+        }
+        double gbps[2] = {0, 0};
+        int count[2] = {0, 0};
+        for (size_t i = 0; i < pcs.size(); i++) {
+            int remote = pcs[i] / PC_GROUP != local;
+            gbps[remote] += isolated.gbps[i][cu];
+            count[remote]++;
+        }
+        std::string local_pcs =
+            "HBM[" + std::to_string(local * PC_GROUP) + ":" + std::to_string(local * PC_GROUP + PC_GROUP - 1) + "]";
+        if (count[1] == 0) {
+            printf("%-4zu %-12s %12.2f %12s %9s\n", cu + 1, local_pcs.c_str(), gbps[0] / count[0], "-", "-");
+            continue;
+        }
+        printf("%-4zu %-12s %12.2f %12.2f %8.1f%%\n", cu + 1, local_pcs.c_str(), gbps[0] / count[0],
+               gbps[1] / count[1], 100 * (1 - gbps[1] / count[1] / (gbps[0] / count[0])));
+    }
+}
+
+// Measures every CU on every pseudo-channel of pcs: on its own, then with all
+// the CUs running concurrently in the contention scenarios
+//  same:  every CU on the same pseudo-channel
+//  group: every CU on a different pseudo-channel of the same group, rotated
+//         so that each CU visits each pseudo-channel of the group
+static bool run_matrix(cl::Context& context,
+                       cl::CommandQueue& q,
+                       std::vector<cl::Kernel>& krnls,
+                       unsigned int num_cus,
+                       const std::vector<int>& pcs,
+                       unsigned int size,
+                       unsigned int num_times,
+                       const std::vector<std::string>& scenarios,
+                       const std::string& csv,
+                       std::vector<int, aligned_allocator<int> >& source_in1,
+                       std::vector<int, aligned_allocator<int> >& source_in2,
+                       std::vector<int, aligned_allocator<int> >& source_sw_add_results,
+                       std::vector<int, aligned_allocator<int> >& source_sw_mul_results,
+                       sda::utils::BandwidthBench& bench) {
+    cl_int err;
+    size_t bytes = size * sizeof(uint32_t);
+    const auto& options = bench.options();
+
+    // Every CU has its 4 buffers on every pseudo-channel
+    std::vector<std::vector<CuBuffers> > buffers(pcs.size(), std::vector<CuBuffers>(num_cus));
+    for (size_t i = 0; i < pcs.size(); i++) {
+        for (unsigned int cu = 0; cu < num_cus; cu++) {
+            CuBuffers& b = buffers[i][cu];
+            b.in1 = pc_buffer(context, pcs[i], bytes);
+            b.in2 = pc_buffer(context, pcs[i], bytes);
+            b.out_add = pc_buffer(context, pcs[i], bytes);
+            b.out_mul = pc_buffer(context, pcs[i], bytes);
+            OCL_CHECK(err, err = q.enqueueWriteBuffer(b.in1, CL_FALSE, 0, bytes, source_in1.data()));
+            OCL_CHECK(err, err = q.enqueueWriteBuffer(b.in2, CL_FALSE, 0, bytes, source_in2.data()));
+        }
+    }
+    OCL_CHECK(err, err = q.finish());
+
+    std::vector<Matrix> matrices;
+    Matrix isolated;
+    isolated.scenario = "isolated";
+    isolated.gbps.assign(pcs.size(), std::vector<double>(num_cus));
+    for (size_t i = 0; i < pcs.size(); i++) {
+        std::string banks = "HBM[" + std::to_string(pcs[i]) + "]";
+        for (unsigned int cu = 0; cu < num_cus; cu++) {
+            if (!set_buffers(krnls[cu], buffers[i][cu], size, num_times)) {
+                printf("Error: CU%u is not connected to HBM[%d], build the xclbin with MATRIX=1\n", cu + 1, pcs[i]);
+                return false;
+            }
+
+            // Timed from the profiling info of the kernel events
+            auto& result = bench.runTimed(
+                {"cu" + std::to_string(cu + 1), "read_write", banks, 1, bytes, 4.0 * bytes * num_times}, [&] {
+                    cl::Event event;
+                    OCL_CHECK(err, err = q.enqueueTask(krnls[cu], nullptr, &event));
+                    OCL_CHECK(err, err = event.wait());
+                    return event_seconds(event);
+                });
+            isolated.gbps[i][cu] = result.median / 1024;
+        }
+    }
+    matrices.push_back(isolated);
+
+    for (auto& scenario : scenarios) {
+        Matrix matrix;
+        matrix.scenario = scenario;
+        matrix.gbps.assign(pcs.size(), std::vector<double>(num_cus));
+        std::string prefix = scenario == "same" ? "same_cu" : "grp_cu";
+
+        // Pseudo-channels of the CUs, as indexes of pcs, in each run
+        std::vector<std::vector<size_t> > runs;
+        for (size_t i = 0; i < pcs.size(); i++) {
+            if (scenario == "same") {
+                runs.push_back(std::vector<size_t>(num_cus, i));
+                continue;
+            }
+            // One run per pseudo-channel of a group, when its first is reached
+            if (i > 0 && pcs[i] / PC_GROUP == pcs[i - 1] / PC_GROUP) continue;
+            size_t members = 1;
+            while (i + members < pcs.size() && pcs[i + members] / PC_GROUP == pcs[i] / PC_GROUP) members++;
+            for (size_t rotation = 0; rotation < members; rotation++) {
+                std::vector<size_t> run;
+                for (unsigned int cu = 0; cu < num_cus; cu++) run.push_back(i + (cu + rotation) % members);
+                runs.push_back(run);
+            }
+        }
+
+        for (auto& run : runs) {
+            for (unsigned int cu = 0; cu < num_cus; cu++) set_buffers(krnls[cu], buffers[run[cu]][cu], size, num_times);
+
+            // All the CUs run together, each timed from its own event
+            std::vector<std::vector<double> > seconds(num_cus);
+            for (unsigned int rep = 0; rep < options.warmup + options.reps; rep++) {
+                std::vector<cl::Event> events(num_cus);
+                for (unsigned int cu = 0; cu < num_cus; cu++) {
+                    OCL_CHECK(err, err = q.enqueueTask(krnls[cu], nullptr, &events[cu]));
+                }
+                OCL_CHECK(err, err = q.finish());
+                for (unsigned int cu = 0; cu < num_cus; cu++) seconds[cu].push_back(event_seconds(events[cu]));
+            }
+            for (unsigned int cu = 0; cu < num_cus; cu++) {
+                std::string banks = "HBM[" + std::to_string(pcs[run[cu]]) + "]";
+                auto& result = bench.record(
+                    {prefix + std::to_string(cu + 1), "read_write", banks, num_cus, bytes, 4.0 * bytes * num_times},
+                    seconds[cu]);
+                matrix.gbps[run[cu]][cu] = result.median / 1024;
+            }
+        }
+        matrices.push_back(matrix);
+    }
+
+    // Every run wrote the same results, check the outputs of all the buffers
+    std::vector<int, aligned_allocator<int> > add(size), mul(size);
+    bool match = true;
+    for (size_t i = 0; i < pcs.size() && match; i++) {
+        for (unsigned int cu = 0; cu < num_cus && match; cu++) {
+            OCL_CHECK(err, err = q.enqueueReadBuffer(buffers[i][cu].out_add, CL_TRUE, 0, bytes, add.data()));
+            OCL_CHECK(err, err = q.enqueueReadBuffer(buffers[i][cu].out_mul, CL_TRUE, 0, bytes, mul.data()));
+            match = verify(source_sw_add_results, source_sw_mul_results, add, mul, size);
+        }
+    }
+
+    for (auto& matrix : matrices) {
+        print_matrix(matrix.gbps, pcs, (matrix.scenario + " bandwidth (GB/s)").c_str());
+    }
+    print_locality(isolated, pcs);
+    if (!csv.empty() && !write_matrices(csv, matrices, pcs)) match = false;
+    return match;
+}
+
+int main(int argc, char* argv[]) {
+    // Command Line Parser
+    sda::utils::CmdLineParser parser;
+    sda::utils::BandwidthBench bench("hbm_bandwidth");
 
     unsigned int dataSize = 64 * 1024 * 1024; // taking maximum possible data size value for an HBM bank
     unsigned int num_times = 1024;            // num_times specify, number of times a kernel
@@ -85,14 +346,85 @@ int main(int argc, char* argv[]) {
                                               // needed
     // to keep the kernel busy to test the actual bandwidth of all banks running
     // concurrently.
+    const uint64_t pc_bytes = dataSize * sizeof(uint32_t);
+
+    std::string matrix_size = "16M";
+    std::string pc_range = "0:31";
 
     // reducing the test data capacity to run faster in emulation mode
     if (xcl::is_emulation()) {
         dataSize = 1024;
         num_times = 64;
+        matrix_size = "4K";
+        pc_range = "0:7";
+        bench.options().reps = 1;
+        bench.options().max_reps = 3;
+        bench.options().warmup = 0;
     }
 
-    std::string binaryFile = argv[1];
+    // Switches
+    //**************//"<Full Arg>",  "<Short Arg>", "<Description>", "<Default>"
+    parser.addSwitch("--xclbin_file", "-x", "input binary file string", "");
+    parser.addSwitch("--iter_cnt", "-l", "kernel iterations, split over the timed repetitions",
+                     std::to_string(num_times));
+    parser.addSwitch("--matrix", "-m", "measure every CU on every pseudo-channel (xclbin built with MATRIX=1)", "",
+                     true);
+    parser.addSwitch("--matrix_size", "-ms", "bytes of each buffer of a CU in the matrix", matrix_size);
+    parser.addSwitch("--pcs", "-pc", "HBM pseudo-channels first:last of the matrix", pc_range);
+    parser.addSwitch("--contention", "-cs", "concurrent CU scenarios of the matrix: same and/or group, or none",
+                     "same,group");
+    parser.addSwitch("--matrix_csv", "-mc", "write the matrices to this .csv file", "");
+    bench.options().min_size = dataSize * sizeof(uint32_t);
+    bench.options().max_size = dataSize * sizeof(uint32_t);
+    bench.addSwitches(parser);
+    parser.parse(argc, argv);
+    bench.parse(parser);
+
+    std::string binaryFile = parser.value("xclbin_file");
+    if (binaryFile.empty()) {
+        parser.printHelp();
+        return EXIT_FAILURE;
+    }
+    bool matrix = parser.value_to_bool("matrix");
+    std::vector<int> pcs;
+    std::vector<std::string> scenarios;
+    if (matrix) {
+        pc_range = parser.value("pcs");
+        int first = atoi(pc_range.c_str());
+        int last =
+            pc_range.find(':') == std::string::npos ? first : atoi(pc_range.substr(pc_range.find(':') + 1).c_str());
+        for (int pc = first; pc <= last; pc++) pcs.push_back(pc);
+        if (pcs.empty() || first < 0 || last >= MAX_HBM_PC_COUNT) {
+            printf("Error: invalid pseudo-channels %s, expected first:last within 0:%d\n", pc_range.c_str(),
+                   MAX_HBM_PC_COUNT - 1);
+            return EXIT_FAILURE;
+        }
+        for (auto& scenario : split(parser.value("contention"))) {
+            if (scenario == "none") continue;
+            if (scenario != "same" && scenario != "group") {
+                printf("Error: unknown contention scenario %s, expected same, group or none\n", scenario.c_str());
+                return EXIT_FAILURE;
+            }
+            scenarios.push_back(scenario);
+        }
+
+        // All the CUs have their 4 buffers on the same pseudo-channel in the
+        // same scenario
+        uint64_t bytes = sda::utils::BandwidthBench::parseSize(parser.value("matrix_size"));
+        if (bytes < 64 || bytes % 64 || bytes * 4 * NUM_KERNEL > pc_bytes) {
+            printf("Error: the matrix buffers are multiples of 64 bytes, at most %u bytes\n",
+                   (unsigned int)(pc_bytes / 4 / NUM_KERNEL));
+            return EXIT_FAILURE;
+        }
+        dataSize = bytes / sizeof(uint32_t);
+    } else if (bench.options().max_size > dataSize * sizeof(uint32_t)) {
+        printf("Error: the buffers of a pseudo-channel are at most %u bytes\n",
+               (unsigned int)(dataSize * sizeof(uint32_t)));
+        return EXIT_FAILURE;
+    }
+    num_times = std::max(parser.value_to_int("iter_cnt") / (int)bench.options().reps, 1);
+    // The smaller buffers of the matrix run proportionally fewer iterations
+    if (matrix) num_times = std::max((unsigned int)((uint64_t)num_times * dataSize * sizeof(uint32_t) / pc_bytes), 1u);
     cl_int err;
     cl::CommandQueue q;
     std::string krnl_name = "krnl_vaddmul";
@@ -164,6 +496,7 @@ int main(int argc, char* argv[]) {
 
                 OCL_CHECK(err, krnls[i] = cl::Kernel(program, krnl_name_full.c_str(), &err));
             }
+            bench.setInfo("device", device.getInfo<CL_DEVICE_NAME>());
             valid_device = true;
             break; // we break because we found a valid device
         }
@@ -173,6 +506,17 @@ int main(int argc, char* argv[]) {
         exit(EXIT_FAILURE);
     }
 
+    bench.setInfo("xclbin", binaryFile);
+    unsigned int num_cus = bench.cus(NUM_KERNEL);
+    if (matrix) {
+        bool match = run_matrix(context, q, krnls, num_cus, pcs, dataSize, num_times, scenarios,
+                                parser.value("matrix_csv"), source_in1, source_in2, source_sw_add_results,
+                                source_sw_mul_results, bench);
+        if (!bench.write() || !bench.check()) match = false;
+        std::cout << (match ? "TEST PASSED" : "TEST FAILED") << std::endl;
+        return (match ? EXIT_SUCCESS : EXIT_FAILURE);
+    }
+
     std::vector<cl_mem_ext_ptr_t> inBufExt1(NUM_KERNEL);
     std::vector<cl_mem_ext_ptr_t> inBufExt2(NUM_KERNEL);
     std::vector<cl_mem_ext_ptr_t> outAddBufExt(NUM_KERNEL);
@@ -229,33 +573,33 @@ int main(int argc, char* argv[]) {
     }
     q.finish();
 
-    double kernel_time_in_sec = 0, result = 0;
-
-    std::chrono::duration<double> kernel_time(0);
+    std::string banks = "HBM[0:" + std::to_string(num_cus * 4 - 1) + "]";
+    unsigned int size = 0;
+
+    for (uint64_t bytes : bench.sizes()) {
+        size = bytes / sizeof(uint32_t);
+        for (unsigned int i = 0; i < num_cus; i++) {
+            // Setting the k_vadd Arguments
+            OCL_CHECK(err, err = krnls[i].setArg(0, buffer_input1[i]));
+            OCL_CHECK(err, err = krnls[i].setArg(1, buffer_input2[i]));
+            OCL_CHECK(err, err = krnls[i].setArg(2, buffer_output_add[i]));
+            OCL_CHECK(err, err = krnls[i].setArg(3, buffer_output_mul[i]));
+            OCL_CHECK(err, err = krnls[i].setArg(4, size));
+            OCL_CHECK(err, err = krnls[i].setArg(5, num_times));
+        }
 
-    auto kernel_start = std::chrono::high_resolution_clock::now();
-    for (int i = 0; i < NUM_KERNEL; i++) {
-        // Setting the k_vadd Arguments
-        OCL_CHECK(err, err = krnls[i].setArg(0, buffer_input1[i]));
-        OCL_CHECK(err, err = krnls[i].setArg(1, buffer_input2[i]));
-        OCL_CHECK(err, err = krnls[i].setArg(2, buffer_output_add[i]));
-        OCL_CHECK(err, err = krnls[i].setArg(3, buffer_output_mul[i]));
-        OCL_CHECK(err, err = krnls[i].setArg(4, dataSize));
-        OCL_CHECK(err, err = krnls[i].setArg(5, num_times));
-
-        // Invoking the kernel
-        OCL_CHECK(err, err = q.enqueueTask(krnls[i]));
+        // Every CU reads two buffers and writes two buffers num_times times
+        bench.run({"hbm", "read_write", banks, num_cus, bytes, 4.0 * bytes * num_times * num_cus}, [&] {
+            for (unsigned int i = 0; i < num_cus; i++) {
+                // Invoking the kernel
+                OCL_CHECK(err, err = q.enqueueTask(krnls[i]));
+            }
+            q.finish();
+        });
     }
-    q.finish();
-    auto kernel_end = std::chrono::high_resolution_clock::now();
-
-    kernel_time = std::chrono::duration<double>(kernel_end - kernel_start);
-
-    kernel_time_in_sec = kernel_time.count();
-    kernel_time_in_sec /= NUM_KERNEL;
 
     // Copy Result from Device Global Memory to Host Local Memory
-    for (int i = 0; i < NUM_KERNEL; i++) {
+    for (unsigned int i = 0; i < num_cus; i++) {
         OCL_CHECK(err, err = q.enqueueMigrateMemObjects({buffer_output_add[i], buffer_output_mul[i]},
                                                         CL_MIGRATE_MEM_OBJECT_HOST));
     }
@@ -263,19 +607,17 @@ int main(int argc, char* argv[]) {
 
     bool match = true;
 
-    for (int i = 0; i < NUM_KERNEL; i++) {
+    for (unsigned int i = 0; i < num_cus; i++) {
         match = verify(source_sw_add_results, source_sw_mul_results, source_hw_add_results[i], source_hw_mul_results[i],
-                       dataSize);
+                       size) &&
+                match;
     }
 
-    // Multiplying the actual data size by 4 because four buffers are being used.
-    result = 4 * (float)dataSize * num_times * sizeof(uint32_t);
-    result /= 1000;               // to KB
-    result /= 1000;               // to MB
-    result /= 1000;               // to GB
-    result /= kernel_time_in_sec; // to GBps
+    // Highest median throughput of the sweep, from MB/s to GB/s
+    double result = bench.best("hbm", "read_write") * 1024 * 1024 / (1000.0 * 1000 * 1000);
 
     std::cout << "THROUGHPUT = " << result << " GB/s" << std::endl;
+    if (!bench.write() || !bench.check()) match = false;
     // OPENCL HOST CODE AREA ENDS
 
     std::cout << (match ? "TEST PASSED" : "TEST FAILED") << std::endl;
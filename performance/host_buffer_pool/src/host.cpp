@@ -0,0 +1,154 @@
+/**
+* Copyright (C) 2019-2021 Xilinx, Inc
+*
+* Licensed under the Apache License, Version 2.0 (the "License"). You may
+* not use this file except in compliance with the License. A copy of the
+* License is located at
+*
+*     http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+* WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the
+* License for the specific language governing permissions and limitations
+* under the License.
+*/
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include "cmdlineparser.h"
+#include "xcl2.hpp"
+
+// Every buffer size is migrated for about this many bytes
+static const size_t bytes_per_size = 1UL << 30;
+
+// Migrates one buffer to the device and waits for it
+static void migrate(cl::CommandQueue& q, cl::Buffer& buffer) {
+    cl_int err;
+    OCL_CHECK(err, err = q.enqueueMigrateMemObjects({buffer}, 0 /* 0 means from host*/));
+    OCL_CHECK(err, err = q.finish());
+}
+
+// Each iteration allocates and fills a host buffer, wraps it in a
+// CL_MEM_USE_HOST_PTR cl::Buffer and migrates it to the device, as a host
+// program run does for its inputs. Returns the throughput in MB/s.
+static double aligned_run(cl::Context& context, cl::CommandQueue& q, size_t size, size_t iterations) {
+    cl_int err;
+    auto start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < iterations; i++) {
+        std::vector<char, aligned_allocator<char> > host(size, (char)i);
+        OCL_CHECK(err, cl::Buffer buffer(context, CL_MEM_USE_HOST_PTR | CL_MEM_READ_ONLY, size, host.data(), &err));
+        migrate(q, buffer);
+    }
+    std::chrono::duration<double> seconds = std::chrono::steady_clock::now() - start;
+    return size * iterations / seconds.count() / (1024 * 1024);
+}
+
+static double pooled_run(cl::Context& context, cl::CommandQueue& q, size_t size, size_t iterations) {
+    auto start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < iterations; i++) {
+        std::vector<char, xcl::pooled_allocator<char> > host(size, (char)i);
+        cl::Buffer buffer = xcl::BufferPool::instance().buffer(context, host.data(), size, CL_MEM_READ_ONLY);
+        migrate(q, buffer);
+    }
+    std::chrono::duration<double> seconds = std::chrono::steady_clock::now() - start;
+    return size * iterations / seconds.count() / (1024 * 1024);
+}
+
+static double pool_run(xcl::BufferPool& pool, cl::Context& context, cl::CommandQueue& q, size_t size,
+                       size_t iterations) {
+    auto start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < iterations; i++) {
+        char* host = (char*)pool.allocate(size);
+        memset(host, (char)i, size);
+        cl::Buffer buffer = pool.buffer(context, host, size, CL_MEM_READ_ONLY);
+        migrate(q, buffer);
+        pool.release(host);
+    }
+    std::chrono::duration<double> seconds = std::chrono::steady_clock::now() - start;
+    return size * iterations / seconds.count() / (1024 * 1024);
+}
+
+// Checks that a cached buffer still moves the current contents of its slab
+static bool verify(xcl::BufferPool& pool, cl::Context& context, cl::CommandQueue& q, size_t size) {
+    cl_int err;
+    bool match = true;
+    for (int pass = 0; pass < 2 && match; pass++) {
+        int* host = (int*)pool.allocate(size);
+        size_t count = size / sizeof(int);
+        for (size_t i = 0; i < count; i++) host[i] = i * 3 + pass;
+        cl::Buffer buffer = pool.buffer(context, host, size, CL_MEM_READ_WRITE);
+        migrate(q, buffer);
+        memset(host, 0, size);
+        OCL_CHECK(err, err = q.enqueueMigrateMemObjects({buffer}, CL_MIGRATE_MEM_OBJECT_HOST));
+        OCL_CHECK(err, err = q.finish());
+        for (size_t i = 0; i < count && match; i++) match = host[i] == (int)(i * 3 + pass);
+        pool.release(host);
+    }
+    return match;
+}
+
+int main(int argc, char** argv) {
+    sda::utils::CmdLineParser parser;
+    parser.addSwitch("--xclbin_file", "-x", "input binary file string", "");
+    parser.addSwitch("--page_size", "-p", "page size of the huge page pool: 4k, 2m or 1g", "2m");
+    parser.addSwitch("--numa_node", "-n", "NUMA node of the huge page pool (-1 = any)", "-1");
+    parser.addSwitch("--max_size", "-m", "largest buffer size in KB", "262144");
+    parser.parse(argc, argv);
+
+    std::string binaryFile = parser.value("xclbin_file");
+    std::string page = parser.value("page_size");
+    int numa_node = parser.value_to_int("numa_node");
+    size_t max_size = (size_t)parser.value_to_int("max_size") * 1024;
+    if (binaryFile.empty()) {
+        parser.printHelp();
+        return EXIT_FAILURE;
+    }
+
+    xcl::BufferPool::PageSize page_size = xcl::BufferPool::PAGE_2M;
+    if (page == "4k") {
+        page_size = xcl::BufferPool::PAGE_4K;
+    } else if (page == "1g") {
+        page_size = xcl::BufferPool::PAGE_1G;
+    } else if (page != "2m") {
+        std::cout << "Error: unknown page size " << page << ", expected 4k, 2m or 1g" << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    xcl::Session session(binaryFile);
+    cl::Context context = session.context();
+    cl::CommandQueue q = session.createQueue(CL_QUEUE_PROFILING_ENABLE);
+    xcl::BufferPool pool(page_size, numa_node);
+
+    // Warm up the device and the runtime before the first measurement
+    std::vector<char, aligned_allocator<char> > warmup(4096, 0);
+    cl_int err;
+    OCL_CHECK(err, cl::Buffer warmup_buffer(context, CL_MEM_USE_HOST_PTR, warmup.size(), warmup.data(), &err));
+    migrate(q, warmup_buffer);
+
+    printf("Host to device migration throughput (MB/s)\n");
+    printf("%12s %10s %12s %12s %12s %9s\n", "Size (KB)", "Buffers", "aligned", "pooled", ("pool " + page).c_str(),
+           "Speedup");
+    for (size_t size = 4096; size <= max_size; size *= 4) {
+        size_t iterations = std::min(std::max(bytes_per_size / size, (size_t)4), (size_t)1024);
+        if (xcl::is_emulation()) iterations = std::min(iterations, (size_t)4);
+        double aligned = aligned_run(context, q, size, iterations);
+        double pooled = pooled_run(context, q, size, iterations);
+        double huge = pool_run(pool, context, q, size, iterations);
+        printf("%12lu %10lu %12.1f %12.1f %12.1f %8.2fx\n", (unsigned long)(size / 1024), (unsigned long)iterations,
+               aligned, pooled, huge, std::max(pooled, huge) / aligned);
+    }
+    printf("Pooled slabs: %lu (%s), %s pool slabs: %lu (%s)%s\n", (unsigned long)xcl::BufferPool::instance().slabs(),
+           xcl::convert_size(xcl::BufferPool::instance().mappedBytes()).c_str(), page.c_str(),
+           (unsigned long)pool.slabs(), xcl::convert_size(pool.mappedBytes()).c_str(),
+           pool.hugePageFallback() ? ", huge pages unavailable" : "");
+
+    bool match = verify(pool, context, q, std::min(max_size, (size_t)(4 * 1024 * 1024)));
+    std::cout << "TEST " << (match ? "PASSED" : "FAILED") << std::endl;
+    return (match ? EXIT_SUCCESS : EXIT_FAILURE);
+}
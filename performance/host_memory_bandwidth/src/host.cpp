@@ -14,129 +14,104 @@
 * under the License.
 */
 
+#include "bench.h"
+#include "cmdlineparser.h"
 #include "xcl2.hpp"
 #include <CL/cl_ext_xilinx.h>
-
-int main(int argc, char* argv[]) {
-    if (argc != 2) {
-        std::cout << "Usage: " << argv[0] << " <xclbin>" << std::endl;
-        return EXIT_FAILURE;
+#include <sstream>
+
+#define LATENCY_SIZE (4 * 1024)
+#define LATENCY_RUNS 32
+
+// Best median throughput of a sweep per direction, in MB/s
+struct Best {
+    double read_write;
+    double read;
+    double write;
+};
+
+static std::vector<std::string> split(const std::string& list) {
+    std::vector<std::string> items;
+    std::stringstream stream(list);
+    std::string item;
+    while (std::getline(stream, item, ',')) {
+        items.push_back(item);
     }
+    return items;
+}
 
+// Host-only buffer of size bytes, allocated by the runtime or, to choose its
+// NUMA node and pages, over host memory of the caller
+static cl::Buffer host_only_buffer(cl::Context& context, size_t size, void* host_ptr) {
     cl_int err;
-    cl::Context context;
-    cl::CommandQueue q;
-    cl::Kernel krnl, krnl_read, krnl_write;
-    std::string binaryFile = argv[1];
-
-    // The get_xil_devices will return vector of Xilinx Devices
-    auto devices = xcl::get_xil_devices();
-
-    auto fileBuf = xcl::read_binary_file(binaryFile);
-
-    cl::Program::Binaries bins{{fileBuf.data(), fileBuf.size()}};
-    bool valid_device = false;
-    for (unsigned int i = 0; i < devices.size(); i++) {
-        auto device = devices[i];
-        // Creating Context and Command Queue for selected Device
-        OCL_CHECK(err, context = cl::Context(device, nullptr, nullptr, nullptr, &err));
-        OCL_CHECK(err, q = cl::CommandQueue(context, device,
-                                            CL_QUEUE_PROFILING_ENABLE | CL_QUEUE_OUT_OF_ORDER_EXEC_MODE_ENABLE, &err));
-
-        std::cout << "Trying to program device[" << i << "]: " << device.getInfo<CL_DEVICE_NAME>() << std::endl;
-        cl::Program program(context, {device}, bins, nullptr, &err);
-        if (err != CL_SUCCESS) {
-            std::cout << "Failed to program device[" << i << "] with xclbin file!\n";
-        } else {
-            std::cout << "Device[" << i << "]: program successful!\n";
-            OCL_CHECK(err, krnl = cl::Kernel(program, "bandwidth", &err));
-            OCL_CHECK(err, krnl_read = cl::Kernel(program, "read_bandwidth", &err));
-            OCL_CHECK(err, krnl_write = cl::Kernel(program, "write_bandwidth", &err));
-            valid_device = true;
-            break; // we break because we found a valid device
-        }
-    }
-    if (!valid_device) {
-        std::cout << "Failed to program any device found, exit!\n";
-        exit(EXIT_FAILURE);
-    }
-
-    double concurrent_max = 0;
-    double read_max = 0;
-    double write_max = 0;
-
-    for (size_t i = 4 * 1024; i <= 256 * 1024 * 1024; i *= 2) {
-        size_t iter = 1024;
-        size_t bufsize = i;
-
-        if (xcl::is_emulation()) {
-            iter = 2;
-            if (bufsize > 8 * 1024) break;
-        }
+    cl_mem_ext_ptr_t buffer_ext;
+    buffer_ext.flags = XCL_MEM_EXT_HOST_ONLY;
+    buffer_ext.obj = host_ptr;
+    buffer_ext.param = 0;
+
+    cl_mem_flags flags = CL_MEM_READ_WRITE | CL_MEM_EXT_PTR_XILINX | (host_ptr ? CL_MEM_USE_HOST_PTR : 0);
+    OCL_CHECK(err, cl::Buffer buffer(context, flags, size, &buffer_ext, &err));
+    return buffer;
+}
 
+// Sweeps the buffer sizes with the 3 kernels. The buffers are allocated by
+// the runtime, or over host_ptr[0] (input) and host_ptr[1] (output) when
+// given, which must hold the largest size of the sweep.
+static bool sweep(sda::utils::BandwidthBench& bench,
+                  cl::Context& context,
+                  cl::CommandQueue& q,
+                  cl::Kernel& krnl,
+                  cl::Kernel& krnl_read,
+                  cl::Kernel& krnl_write,
+                  size_t iter,
+                  const std::string& test,
+                  const std::string& banks,
+                  void* host_ptr[2],
+                  Best& best) {
+    cl_int err;
+    best = {0, 0, 0};
+    for (uint64_t bufsize : bench.sizes()) {
         /* Input buffer */
-        unsigned char* input_host = ((unsigned char*)malloc(bufsize));
-        if (input_host == nullptr) {
-            std::cout << "Error: Failed to allocate host side copy of OpenCL source "
-                      << "buffer of size " << bufsize << std::endl;
-            return EXIT_FAILURE;
-        }
-
+        std::vector<unsigned char> input_host(bufsize);
         for (size_t i = 0; i < bufsize; i++) {
             input_host[i] = i % 256;
         }
-        cl::Buffer* buffer[2];
 
         /* Host mem flags */
-        cl_mem_ext_ptr_t input_buffer_ext;
-        input_buffer_ext.flags = XCL_MEM_EXT_HOST_ONLY;
-        input_buffer_ext.obj = nullptr;
-        input_buffer_ext.param = 0;
-
-        cl_mem_ext_ptr_t output_buffer_ext;
-        output_buffer_ext.flags = XCL_MEM_EXT_HOST_ONLY;
-        output_buffer_ext.obj = nullptr;
-        output_buffer_ext.param = 0;
-
-        OCL_CHECK(err, buffer[0] = new cl::Buffer(context, CL_MEM_READ_WRITE | CL_MEM_EXT_PTR_XILINX, bufsize,
-                                                  &input_buffer_ext, &err));
-        OCL_CHECK(err, buffer[1] = new cl::Buffer(context, CL_MEM_READ_WRITE | CL_MEM_EXT_PTR_XILINX, bufsize,
-                                                  &output_buffer_ext, &err));
-
-        OCL_CHECK(err, err = krnl.setArg(0, *(buffer[0])));
-        OCL_CHECK(err, err = krnl.setArg(1, *(buffer[1])));
+        cl::Buffer buffer[2];
+        buffer[0] = host_only_buffer(context, bufsize, host_ptr ? host_ptr[0] : nullptr);
+        buffer[1] = host_only_buffer(context, bufsize, host_ptr ? host_ptr[1] : nullptr);
+
+        OCL_CHECK(err, err = krnl.setArg(0, buffer[0]));
+        OCL_CHECK(err, err = krnl.setArg(1, buffer[1]));
         OCL_CHECK(err, err = krnl.setArg(2, bufsize));
         OCL_CHECK(err, err = krnl.setArg(3, iter));
 
-        double dbytes = bufsize;
-        std::string size_str = xcl::convert_size(bufsize);
-
         /* Write input buffer */
         /* Map input buffer for PCIe write */
         unsigned char* map_input_buffer0;
         OCL_CHECK(err, map_input_buffer0 = (unsigned char*)q.enqueueMapBuffer(
-                           *(buffer[0]), CL_FALSE, CL_MAP_WRITE_INVALIDATE_REGION, 0, bufsize, nullptr, nullptr, &err));
+                           buffer[0], CL_FALSE, CL_MAP_WRITE_INVALIDATE_REGION, 0, bufsize, nullptr, nullptr, &err));
         OCL_CHECK(err, err = q.finish());
 
         /* prepare data to be written to the device */
         for (size_t i = 0; i < bufsize; i++) {
             map_input_buffer0[i] = input_host[i];
         }
-        OCL_CHECK(err, err = q.enqueueUnmapMemObject(*(buffer[0]), map_input_buffer0));
+        OCL_CHECK(err, err = q.enqueueUnmapMemObject(buffer[0], map_input_buffer0));
 
         OCL_CHECK(err, err = q.finish());
 
-        /* Execute Kernel */
-        auto start = std::chrono::high_resolution_clock::now();
-        q.enqueueTask(krnl);
-        q.finish();
-        auto end = std::chrono::high_resolution_clock::now();
-        double duration = std::chrono::duration_cast<std::chrono::microseconds>(end - start).count();
-        double msduration = duration / iter;
+        /* Execute Kernel, for Concurrent Read and Write */
+        auto& read_write = bench.run({test, "read_write", banks, 1, bufsize, 2.0 * bufsize * iter}, [&] {
+            q.enqueueTask(krnl);
+            q.finish();
+        });
+        best.read_write = std::max(best.read_write, read_write.median);
 
         /* Copy results back from OpenCL buffer */
         unsigned char* map_output_buffer0;
-        OCL_CHECK(err, map_output_buffer0 = (unsigned char*)q.enqueueMapBuffer(*(buffer[1]), CL_FALSE, CL_MAP_READ, 0,
+        OCL_CHECK(err, map_output_buffer0 = (unsigned char*)q.enqueueMapBuffer(buffer[1], CL_FALSE, CL_MAP_READ, 0,
                                                                                bufsize, nullptr, nullptr, &err));
         OCL_CHECK(err, err = q.finish());
 
@@ -145,79 +120,234 @@ int main(int argc, char* argv[]) {
             if (map_output_buffer0[i] != input_host[i]) {
                 std::cout << "ERROR : kernel failed to copy entry " << i << " input " << input_host[i] << " output "
                           << map_output_buffer0[i] << std::endl;
-                return EXIT_FAILURE;
+                return false;
             }
         }
+        OCL_CHECK(err, err = q.enqueueUnmapMemObject(buffer[1], map_output_buffer0));
+        OCL_CHECK(err, err = q.finish());
 
-        /* Profiling information */
-        double dsduration = msduration / ((double)1000000);
-
-        double bpersec = (dbytes / dsduration);
-        double gbpersec = (2 * bpersec) / ((double)1024 * 1024 * 1024); // For Concurrent Read and Write
-
-        std::cout << "Concurrent Read and Write Throughput = " << gbpersec << " (GB/sec) for buffer size " << size_str
-                  << std::endl;
-
-        if (gbpersec > concurrent_max) {
-            concurrent_max = gbpersec;
-        }
-
-        OCL_CHECK(err, err = krnl_read.setArg(0, *(buffer[0])));
+        OCL_CHECK(err, err = krnl_read.setArg(0, buffer[0]));
         OCL_CHECK(err, err = krnl_read.setArg(1, bufsize));
         OCL_CHECK(err, err = krnl_read.setArg(2, iter));
 
         /* Execute Kernel */
-        auto read_start = std::chrono::high_resolution_clock::now();
-        q.enqueueTask(krnl_read);
-        q.finish();
-        auto read_end = std::chrono::high_resolution_clock::now();
-        duration = std::chrono::duration_cast<std::chrono::microseconds>(read_end - read_start).count();
-        msduration = duration / iter;
+        auto& read = bench.run({test, "read", banks, 1, bufsize, 1.0 * bufsize * iter}, [&] {
+            q.enqueueTask(krnl_read);
+            q.finish();
+        });
+        best.read = std::max(best.read, read.median);
 
-        /* Profiling information */
-        dsduration = msduration / ((double)1000000);
+        OCL_CHECK(err, err = krnl_write.setArg(0, buffer[1]));
+        OCL_CHECK(err, err = krnl_write.setArg(1, bufsize));
+        OCL_CHECK(err, err = krnl_write.setArg(2, iter));
 
-        bpersec = (dbytes / dsduration);
-        gbpersec = bpersec / ((double)1024 * 1024 * 1024);
+        /* Execute Kernel */
+        auto& write = bench.run({test, "write", banks, 1, bufsize, 1.0 * bufsize * iter}, [&] {
+            q.enqueueTask(krnl_write);
+            q.finish();
+        });
+        best.write = std::max(best.write, write.median);
+    }
+    return true;
+}
 
-        std::cout << "Read Throughput = " << gbpersec << " (GB/sec) for buffer size " << size_str << std::endl;
+// Shortest of LATENCY_RUNS single reads of LATENCY_SIZE bytes at host_ptr,
+// from the submission of the task to its end, in us
+static double read_latency(cl::Context& context, cl::CommandQueue& q, cl::Kernel& krnl_read, void* host_ptr) {
+    cl_int err;
+    cl::Buffer buffer = host_only_buffer(context, LATENCY_SIZE, host_ptr);
+    int64_t size = LATENCY_SIZE, iter = 1;
+    OCL_CHECK(err, err = krnl_read.setArg(0, buffer));
+    OCL_CHECK(err, err = krnl_read.setArg(1, size));
+    OCL_CHECK(err, err = krnl_read.setArg(2, iter));
+
+    double latency = 0;
+    for (int run = 0; run < LATENCY_RUNS; run++) {
+        cl::Event event;
+        OCL_CHECK(err, err = q.enqueueTask(krnl_read, nullptr, &event));
+        OCL_CHECK(err, err = q.finish());
+        unsigned long queued = OCL_CHECK(err, event.getProfilingInfo<CL_PROFILING_COMMAND_QUEUED>(&err));
+        unsigned long end = OCL_CHECK(err, event.getProfilingInfo<CL_PROFILING_COMMAND_END>(&err));
+        double us = (end - queued) / 1000.0;
+        if (run == 0 || us < latency) latency = us;
+    }
+    return latency;
+}
 
-        if (gbpersec > read_max) {
-            read_max = gbpersec;
+// Prints one matrix of the NUMA sweep, the memory nodes in rows and the
+// thread nodes in columns, the node of the card marked with a *
+static void print_matrix(const std::string& title,
+                         const std::vector<int>& nodes,
+                         int device_node,
+                         const std::vector<std::vector<double> >& cells) {
+    printf("%-22s", title.c_str());
+    for (int node : nodes) {
+        printf(" %9s%-2d", "cpu ", node);
+    }
+    printf("\n");
+    for (size_t m = 0; m < nodes.size(); m++) {
+        printf("mem %-2d %-15s", nodes[m], nodes[m] == device_node ? "*" : "");
+        for (size_t c = 0; c < nodes.size(); c++) {
+            printf(" %11.2f", cells[m][c]);
         }
+        printf("\n");
+    }
+}
 
-        OCL_CHECK(err, err = krnl_write.setArg(0, *(buffer[1])));
-        OCL_CHECK(err, err = krnl_write.setArg(1, bufsize));
-        OCL_CHECK(err, err = krnl_write.setArg(2, iter));
+int main(int argc, char* argv[]) {
+    // Command Line Parser
+    sda::utils::CmdLineParser parser;
+    sda::utils::BandwidthBench bench("host_memory_bandwidth");
+
+    // Switches
+    //**************//"<Full Arg>",  "<Short Arg>", "<Description>", "<Default>"
+    parser.addSwitch("--xclbin_file", "-x", "input binary file string", "");
+    parser.addSwitch("--iter_cnt", "-l", "kernel iterations of every task", "1024");
+    parser.addSwitch("--numa", "-n", "NUMA nodes of the buffers and the submitting thread, e.g. 0,1 or all", "");
+    parser.addSwitch("--pages", "-pg", "pages of the NUMA buffers, 4k, 2m or 1g", "4k,2m");
+    bench.options().max_size = 256 * 1024 * 1024;
+    // At most 1 + 10 tasks of -l kernel iterations each per size
+    bench.options().reps = 3;
+    bench.options().max_reps = 10;
+    if (xcl::is_emulation()) {
+        bench.options().max_size = 8 * 1024;
+        bench.options().reps = 1;
+        bench.options().max_reps = 3;
+        bench.options().warmup = 0;
+    }
+    bench.addSwitches(parser);
+    parser.parse(argc, argv);
+    bench.parse(parser);
 
-        /* Execute Kernel */
-        auto write_start = std::chrono::high_resolution_clock::now();
-        q.enqueueTask(krnl_write);
-        q.finish();
-        auto write_end = std::chrono::high_resolution_clock::now();
-        duration = std::chrono::duration_cast<std::chrono::microseconds>(write_end - write_start).count();
-        msduration = duration / iter;
+    std::string binaryFile = parser.value("xclbin_file");
+    if (binaryFile.empty()) {
+        parser.printHelp();
+        return EXIT_FAILURE;
+    }
+
+    cl_int err;
+    cl::Context context;
+    cl::CommandQueue q;
+    cl::Kernel krnl, krnl_read, krnl_write;
+    int device_node = -1;
+
+    // The get_xil_devices will return vector of Xilinx Devices
+    auto devices = xcl::get_xil_devices();
+
+    auto fileBuf = xcl::read_binary_file(binaryFile);
+
+    cl::Program::Binaries bins{{fileBuf.data(), fileBuf.size()}};
+    bool valid_device = false;
+    for (unsigned int i = 0; i < devices.size(); i++) {
+        auto device = devices[i];
+        // Creating Context and Command Queue for selected Device
+        OCL_CHECK(err, context = cl::Context(device, nullptr, nullptr, nullptr, &err));
+        OCL_CHECK(err, q = cl::CommandQueue(context, device,
+                                            CL_QUEUE_PROFILING_ENABLE | CL_QUEUE_OUT_OF_ORDER_EXEC_MODE_ENABLE, &err));
 
-        /* Profiling information */
-        dsduration = msduration / ((double)1000000);
+        std::cout << "Trying to program device[" << i << "]: " << device.getInfo<CL_DEVICE_NAME>() << std::endl;
+        cl::Program program(context, {device}, bins, nullptr, &err);
+        if (err != CL_SUCCESS) {
+            std::cout << "Failed to program device[" << i << "] with xclbin file!\n";
+        } else {
+            std::cout << "Device[" << i << "]: program successful!\n";
+            OCL_CHECK(err, krnl = cl::Kernel(program, "bandwidth", &err));
+            OCL_CHECK(err, krnl_read = cl::Kernel(program, "read_bandwidth", &err));
+            OCL_CHECK(err, krnl_write = cl::Kernel(program, "write_bandwidth", &err));
+            bench.setInfo("device", device.getInfo<CL_DEVICE_NAME>());
+            device_node = xcl::numa_node(device);
+            valid_device = true;
+            break; // we break because we found a valid device
+        }
+    }
+    if (!valid_device) {
+        std::cout << "Failed to program any device found, exit!\n";
+        exit(EXIT_FAILURE);
+    }
 
-        bpersec = (dbytes / dsduration);
-        gbpersec = bpersec / ((double)1024 * 1024 * 1024);
+    bench.setInfo("xclbin", binaryFile);
 
-        std::cout << "Write Throughput = " << gbpersec << " (GB/sec) for buffer size " << size_str << "\n\n";
+    // Every task runs all the kernel iterations, and -r/-mr bound the number
+    // of tasks of a size
+    size_t iter = std::max(parser.value_to_int("iter_cnt"), 1);
+    if (xcl::is_emulation()) iter = 2;
 
-        if (gbpersec > write_max) {
-            write_max = gbpersec;
+    std::string numa = parser.value("numa");
+    if (numa.empty()) {
+        Best best;
+        if (!sweep(bench, context, q, krnl, krnl_read, krnl_write, iter, "host", "HOST[0]", nullptr, best)) {
+            return EXIT_FAILURE;
         }
 
-        delete (buffer[0]);
-        delete (buffer[1]);
+        std::cout << "Maximum bandwidth achieved :\n";
+        std::cout << "Concurrent Read and Write Throughput = " << best.read_write / 1024 << " (GB/sec) \n";
+        std::cout << "Read Throughput = " << best.read / 1024 << " (GB/sec) \n";
+        std::cout << "Write Throughput = " << best.write / 1024 << " (GB/sec) \n\n";
+    } else {
+        std::vector<int> nodes;
+        if (numa == "all") {
+            nodes = xcl::numa_nodes();
+        } else {
+            for (auto& node : split(numa)) {
+                nodes.push_back(stoi(node));
+            }
+        }
+        if (nodes.empty()) {
+            std::cout << "ERROR : no NUMA node found\n";
+            return EXIT_FAILURE;
+        }
+        std::cout << "Card on NUMA node " << device_node << std::endl;
+
+        // Every page size, memory node and thread node, with buffers of the
+        // largest size of the sweep, shared by all its sizes
+        uint64_t max_size = bench.sizes().back();
+        for (auto& page : split(parser.value("pages"))) {
+            xcl::BufferPool::PageSize page_size = xcl::BufferPool::PAGE_4K;
+            if (page == "2m") {
+                page_size = xcl::BufferPool::PAGE_2M;
+            } else if (page == "1g") {
+                page_size = xcl::BufferPool::PAGE_1G;
+            } else if (page != "4k") {
+                std::cout << "ERROR : unknown page size " << page << ", expected 4k, 2m or 1g\n";
+                return EXIT_FAILURE;
+            }
+
+            bool fallback = false;
+            size_t count = nodes.size();
+            std::vector<std::vector<double> > read_write(count, std::vector<double>(count));
+            std::vector<std::vector<double> > read(read_write), write(read_write), latency(read_write);
+            for (size_t m = 0; m < count; m++) {
+                xcl::BufferPool pool(page_size, nodes[m]);
+                void* host_ptr[2] = {pool.allocate(max_size), pool.allocate(max_size)};
+                for (size_t c = 0; c < count; c++) {
+                    if (!xcl::bind_thread_to_numa_node(nodes[c])) {
+                        std::cout << "WARNING: cannot bind the thread to NUMA node " << nodes[c] << std::endl;
+                    }
+                    std::string banks = "HOST[0] mem" + std::to_string(nodes[m]) + " cpu" + std::to_string(nodes[c]) +
+                                        " " + page;
+                    Best best;
+                    if (!sweep(bench, context, q, krnl, krnl_read, krnl_write, iter, "numa", banks, host_ptr, best)) {
+                        return EXIT_FAILURE;
+                    }
+                    read_write[m][c] = best.read_write / 1024;
+                    read[m][c] = best.read / 1024;
+                    write[m][c] = best.write / 1024;
+                    latency[m][c] = read_latency(context, q, krnl_read, host_ptr[0]);
+                }
+                fallback |= pool.hugePageFallback();
+            }
+            xcl::bind_thread_to_numa_node(-1);
+
+            printf("\nNUMA matrix, %s pages%s, * is the node of the card\n", page.c_str(),
+                   fallback ? " (fell back to 4k)" : "");
+            print_matrix("read_write GB/s", nodes, device_node, read_write);
+            print_matrix("read GB/s", nodes, device_node, read);
+            print_matrix("write GB/s", nodes, device_node, write);
+            print_matrix("4 KB read latency us", nodes, device_node, latency);
+        }
     }
 
-    std::cout << "Maximum bandwidth achieved :\n";
-    std::cout << "Concurrent Read and Write Throughput = " << concurrent_max << " (GB/sec) \n";
-    std::cout << "Read Throughput = " << read_max << " (GB/sec) \n";
-    std::cout << "Write Throughput = " << write_max << " (GB/sec) \n\n";
+    if (!bench.write() || !bench.check()) return EXIT_FAILURE;
     std::cout << "TEST PASSED\n";
     return EXIT_SUCCESS;
 }
@@ -0,0 +1,33 @@
+/**
+* Copyright (C) 2019-2021 Xilinx, Inc
+*
+* Licensed under the Apache License, Version 2.0 (the "License"). You may
+* not use this file except in compliance with the License. A copy of the
+* License is located at
+*
+*     http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+* WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the
+* License for the specific language governing permissions and limitations
+* under the License.
+*/
+
+extern "C" {
+void hello(char* buf) {
+    buf[0] = 'H';
+    buf[1] = 'e';
+    buf[2] = 'l';
+    buf[3] = 'l';
+    buf[4] = 'o';
+    buf[5] = ' ';
+    buf[6] = 'W';
+    buf[7] = 'o';
+    buf[8] = 'r';
+    buf[9] = 'l';
+    buf[10] = 'd';
+    buf[11] = '\n';
+    buf[12] = '\0';
+}
+}
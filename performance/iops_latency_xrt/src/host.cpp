@@ -0,0 +1,406 @@
+/**
+* Copyright (C) 2019-2021 Xilinx, Inc
+*
+* Licensed under the Apache License, Version 2.0 (the "License"). You may
+* not use this file except in compliance with the License. A copy of the
+* License is located at
+*
+*     http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+* WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the
+* License for the specific language governing permissions and limitations
+* under the License.
+*/
+#include "bench.h"
+#include "cmdlineparser.h"
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <iostream>
+#include <iomanip>
+#include <math.h>
+#include <sstream>
+#include <stdlib.h>
+#include <string.h>
+#include <thread>
+#include <vector>
+#include "xcl2.hpp"
+
+#include "experimental/xrt_device.h"
+#include "experimental/xrt_bo.h"
+#include "experimental/xrt_kernel.h"
+
+#define BUF_SIZE 20
+
+using Clock = std::chrono::high_resolution_clock;
+
+// A way of submitting commands: the CUs of a kernel, all started and
+// waited for with xrt::run::start() and xrt::run::wait()
+struct Path {
+    std::string name;
+    std::string kernel;
+    std::vector<xrt::kernel> cus;
+};
+
+// Results of one point of the sweep. The latencies of the commands are in
+// microseconds from their submission, to the return of xrt::run::start()
+// (start) and to the poll that found the command done (complete).
+struct Profile {
+    std::string path;
+    unsigned int cus;
+    unsigned int threads;
+    unsigned int depth;
+    double iops;
+    std::vector<double> start_us;
+    std::vector<double> complete_us;
+};
+
+static std::vector<unsigned int> split_uint(const std::string& list) {
+    std::vector<unsigned int> values;
+    std::stringstream stream(list);
+    std::string item;
+    while (std::getline(stream, item, ',')) {
+        if (item.empty() || item.find_first_not_of("0123456789") != std::string::npos) {
+            std::cout << "ERROR : invalid number \"" << item << "\" in the list " << list << std::endl;
+            exit(EXIT_FAILURE);
+        }
+        values.push_back(stoi(item));
+    }
+    return values;
+}
+
+static std::vector<std::string> split(const std::string& list) {
+    std::vector<std::string> items;
+    std::stringstream stream(list);
+    std::string item;
+    while (std::getline(stream, item, ',')) {
+        items.push_back(item);
+    }
+    return items;
+}
+
+// Opens every CU of a kernel, kernel_1 to kernel_N, or the kernel itself
+// when its CUs are not named that way
+static std::vector<xrt::kernel> open_cus(xrt::device& device, xrt::uuid& uuid, const std::string& kernel) {
+    std::vector<xrt::kernel> cus;
+    for (unsigned int i = 1;; i++) {
+        std::string name = kernel + ":{" + kernel + "_" + std::to_string(i) + "}";
+        try {
+            cus.push_back(xrt::kernel(device, uuid.get(), name));
+        } catch (const std::exception&) {
+            break;
+        }
+    }
+    if (cus.empty()) cus.push_back(xrt::kernel(device, uuid.get(), kernel));
+    return cus;
+}
+
+// Value below which a fraction p of the sorted samples are
+static double percentile(const std::vector<double>& sorted, double p) {
+    if (sorted.empty()) return 0;
+    size_t index = (size_t)ceil(p * sorted.size());
+    return sorted[std::max(index, (size_t)1) - 1];
+}
+
+// A run is done once its command left the new, queued, submitted and
+// running states, whether it completed or failed
+static bool finished(ert_cmd_state state) {
+    return state != ERT_CMD_STATE_NEW && state != ERT_CMD_STATE_QUEUED && state != ERT_CMD_STATE_SUBMITTED &&
+           state != ERT_CMD_STATE_RUNNING;
+}
+
+static std::string state_name(ert_cmd_state state) {
+    switch (state) {
+        case ERT_CMD_STATE_ERROR:
+            return "error";
+        case ERT_CMD_STATE_ABORT:
+            return "abort";
+        case ERT_CMD_STATE_TIMEOUT:
+            return "timeout";
+        default:
+            return std::to_string((int)state);
+    }
+}
+
+// Submits commands on its runs, keeping all of them in flight, until it
+// completed num_cmds of them, and appends the latency of each command. The
+// runs are polled rather than waited for in turn, so a command that
+// completes on one CU is reaped and started again at once instead of
+// waiting behind an older command of a slower CU. Once a command fails, no
+// command is started anymore, the ones in flight are reaped and false is
+// returned.
+static bool submit(std::vector<xrt::run>& runs,
+                   unsigned int num_cmds,
+                   std::vector<double>& start_us,
+                   std::vector<double>& complete_us) {
+    std::vector<Clock::time_point> submitted(runs.size());
+    std::vector<bool> in_flight(runs.size(), false);
+    unsigned int issued = 0, completed = 0;
+    bool failed = false;
+    auto issue = [&](size_t i) {
+        submitted[i] = Clock::now();
+        runs[i].start();
+        start_us.push_back(std::chrono::duration<double, std::micro>(Clock::now() - submitted[i]).count());
+        in_flight[i] = true;
+        issued++;
+    };
+
+    for (size_t i = 0; i < runs.size() && issued < num_cmds; i++) {
+        issue(i);
+    }
+
+    while (completed < issued) {
+        bool reaped = false;
+        for (size_t i = 0; i < runs.size(); i++) {
+            if (!in_flight[i]) continue;
+            auto state = runs[i].state();
+            if (!finished(state)) continue;
+            in_flight[i] = false;
+            reaped = true;
+            completed++;
+            if (state != ERT_CMD_STATE_COMPLETED) {
+                std::cout << "ERROR : command ended in state " << state_name(state) << std::endl;
+                failed = true;
+                continue;
+            }
+            // Returns at once, the command is done
+            runs[i].wait();
+            complete_us.push_back(std::chrono::duration<double, std::micro>(Clock::now() - submitted[i]).count());
+
+            if (!failed && issued < num_cmds) issue(i);
+        }
+        if (!reaped) std::this_thread::yield();
+    }
+    return !failed;
+}
+
+// Runs num_cmds commands per repetition on the first num_cus CUs of a path,
+// from threads threads keeping depth commands each in flight. Each thread
+// has its own runs, spread round robin over the CUs.
+static bool profile(sda::utils::BandwidthBench& bench,
+                    xrt::device& device,
+                    Path& path,
+                    unsigned int num_cus,
+                    unsigned int threads,
+                    unsigned int depth,
+                    unsigned int num_cmds,
+                    Profile& result) {
+    std::vector<std::vector<xrt::run> > runs(threads);
+    std::vector<xrt::bo> bos;
+    for (unsigned int t = 0; t < threads; t++) {
+        for (unsigned int i = 0; i < depth; i++) {
+            auto& cu = path.cus[(t * depth + i) % num_cus];
+            auto run = xrt::run(cu);
+            auto bo = xrt::bo(device, BUF_SIZE, cu.group_id(0));
+            run.set_arg(0, bo);
+            runs[t].push_back(std::move(run));
+            bos.push_back(std::move(bo));
+        }
+    }
+
+    // The warm-up repetitions are left out of the latencies
+    std::vector<std::vector<double> > start_us(threads), complete_us(threads);
+    unsigned int repetition = 0;
+    unsigned int cmds_per_thread = std::max(num_cmds / threads, 1u);
+    std::string config = "t" + std::to_string(threads) + "_qd" + std::to_string(depth);
+    // Set by a failed command, after which the repetitions left do nothing
+    bool failed = false;
+    auto& iops = bench.run({path.name, "start", config, num_cus, num_cmds, (double)cmds_per_thread * threads}, [&] {
+        if (failed) return;
+        bool warmup = repetition++ < bench.options().warmup;
+        std::vector<std::vector<double> > start_rep(threads), complete_rep(threads);
+        std::vector<char> ok(threads);
+        std::vector<std::thread> workers;
+        for (unsigned int t = 1; t < threads; t++) {
+            workers.push_back(std::thread(
+                [&, t] { ok[t] = submit(runs[t], cmds_per_thread, start_rep[t], complete_rep[t]); }));
+        }
+        ok[0] = submit(runs[0], cmds_per_thread, start_rep[0], complete_rep[0]);
+        for (auto& worker : workers) {
+            worker.join();
+        }
+        failed = std::find(ok.begin(), ok.end(), 0) != ok.end();
+        if (warmup || failed) return;
+        for (unsigned int t = 0; t < threads; t++) {
+            start_us[t].insert(start_us[t].end(), start_rep[t].begin(), start_rep[t].end());
+            complete_us[t].insert(complete_us[t].end(), complete_rep[t].begin(), complete_rep[t].end());
+        }
+    });
+    if (failed) {
+        std::cout << "ERROR : " << path.name << " failed with " << num_cus << " CUs, " << threads << " threads, depth "
+                  << depth << std::endl;
+        return false;
+    }
+
+    result = {path.name, num_cus, threads, depth, iops.median, {}, {}};
+    for (unsigned int t = 0; t < threads; t++) {
+        result.start_us.insert(result.start_us.end(), start_us[t].begin(), start_us[t].end());
+        result.complete_us.insert(result.complete_us.end(), complete_us[t].begin(), complete_us[t].end());
+    }
+    std::sort(result.start_us.begin(), result.start_us.end());
+    std::sort(result.complete_us.begin(), result.complete_us.end());
+
+    // Every run wrote the string of the kernel to its buffer
+    for (auto& bo : bos) {
+        char buf[BUF_SIZE];
+        bo.sync(XCL_BO_SYNC_BO_FROM_DEVICE);
+        bo.read(buf);
+        if (strcmp(buf, "Hello World\n") != 0) {
+            std::cout << "ERROR : " << path.name << " command did not write Hello World" << std::endl;
+            return false;
+        }
+    }
+    return true;
+}
+
+// Sweeps the CU counts, thread counts and queue depths on every path
+static bool sweep(sda::utils::BandwidthBench& bench,
+                  xrt::device& device,
+                  std::vector<Path>& paths,
+                  const std::vector<unsigned int>& cu_counts,
+                  const std::vector<unsigned int>& thread_counts,
+                  const std::vector<unsigned int>& depths,
+                  unsigned int num_cmds,
+                  std::vector<Profile>& profiles) {
+    for (auto& path : paths) {
+        std::cout << "Path " << path.name << ": kernel " << path.kernel << ", " << path.cus.size() << " CUs"
+                  << std::endl;
+        for (auto num_cus : cu_counts) {
+            if (num_cus > path.cus.size()) continue;
+            for (auto threads : thread_counts) {
+                for (auto depth : depths) {
+                    Profile result;
+                    if (!profile(bench, device, path, num_cus, threads, depth, num_cmds, result)) return false;
+                    profiles.push_back(result);
+                }
+            }
+        }
+    }
+    return true;
+}
+
+static void print_profiles(const std::vector<Profile>& profiles) {
+    printf("\nCommand latency (us from submission)\n");
+    printf("%-13s %4s %7s %5s %10s %9s %9s %9s %9s %9s %9s\n", "path", "cus", "threads", "depth", "iops",
+           "start p50", "p99", "done p50", "p99", "p99.9", "max");
+    for (auto& p : profiles) {
+        printf("%-13s %4u %7u %5u %10.0f %9.1f %9.1f %9.1f %9.1f %9.1f %9.1f\n", p.path.c_str(), p.cus, p.threads,
+               p.depth, p.iops, percentile(p.start_us, 0.5), percentile(p.start_us, 0.99),
+               percentile(p.complete_us, 0.5), percentile(p.complete_us, 0.99), percentile(p.complete_us, 0.999),
+               percentile(p.complete_us, 1));
+    }
+}
+
+static bool write_profiles(const std::vector<Profile>& profiles, const std::string& filename) {
+    std::ofstream file(filename);
+    if (!file) {
+        std::cout << "ERROR : cannot write " << filename << std::endl;
+        return false;
+    }
+    file << "path,cus,threads,depth,iops,start_p50_us,start_p99_us,complete_p50_us,complete_p99_us,"
+         << "complete_p999_us,complete_max_us\n";
+    for (auto& p : profiles) {
+        file << p.path << "," << p.cus << "," << p.threads << "," << p.depth << "," << p.iops << ","
+             << percentile(p.start_us, 0.5) << "," << percentile(p.start_us, 0.99) << ","
+             << percentile(p.complete_us, 0.5) << "," << percentile(p.complete_us, 0.99) << ","
+             << percentile(p.complete_us, 0.999) << "," << percentile(p.complete_us, 1) << "\n";
+    }
+    std::cout << "Latencies written to " << filename << std::endl;
+    return true;
+}
+
+int main(int argc, char* argv[]) {
+    // Command Line Parser
+    sda::utils::CmdLineParser parser;
+    sda::utils::BandwidthBench bench("iops_latency_xrt");
+    bench.setUnit("ops/s", 1);
+    bench.options().reps = 5;
+    bench.options().max_reps = 20;
+    std::string num_cmds = "10000";
+    if (xcl::is_emulation()) {
+        bench.options().reps = 1;
+        bench.options().max_reps = 3;
+        bench.options().warmup = 0;
+        num_cmds = "20";
+    }
+
+    // Switches
+    //**************//"<Full Arg>",  "<Short Arg>", "<Description>", "<Default>"
+    parser.addSwitch("--xclbin_file", "-x", "input binary file string", "");
+    parser.addSwitch("--fa_xclbin_file", "-f", "xclbin of iops_fast_adapter_xrt, for the fast adapter path", "");
+    parser.addSwitch("--device_id", "-d", "device index", "0");
+    parser.addSwitch("--paths", "-pa", "submission paths, plain, chain and fast_adapter",
+                     "plain,chain,fast_adapter");
+    parser.addSwitch("--cu_counts", "-c", "CUs used by the commands", "1,4");
+    parser.addSwitch("--threads", "-th", "submitting threads", "1,2,4");
+    parser.addSwitch("--depths", "-q", "commands in flight per thread", "1,4,16,64");
+    parser.addSwitch("--commands", "-n", "commands per repetition", num_cmds);
+    parser.addSwitch("--latency_csv", "-lc", "CSV file of the latencies", "");
+    bench.addSwitches(parser);
+    parser.parse(argc, argv);
+    bench.parse(parser);
+
+    // Read settings
+    std::string binaryFile = parser.value("xclbin_file");
+    std::string faBinaryFile = parser.value("fa_xclbin_file");
+    int device_index = stoi(parser.value("device_id"));
+    std::vector<std::string> path_names = split(parser.value("paths"));
+    std::vector<unsigned int> cu_counts = split_uint(parser.value("cu_counts"));
+    std::vector<unsigned int> thread_counts = split_uint(parser.value("threads"));
+    std::vector<unsigned int> depths = split_uint(parser.value("depths"));
+    unsigned int commands = stoi(parser.value("commands"));
+    std::string latency_csv = parser.value("latency_csv");
+
+    if (argc < 3) {
+        parser.printHelp();
+        return EXIT_FAILURE;
+    }
+
+    auto selected = [&](const std::string& name) {
+        return std::find(path_names.begin(), path_names.end(), name) != path_names.end();
+    };
+
+    std::cout << "Open the device" << device_index << std::endl;
+    auto device = xrt::device(device_index);
+    bench.setInfo("device", device.get_info<xrt::info::device::name>());
+    bench.setInfo("xclbin", binaryFile);
+
+    std::vector<Profile> profiles;
+    {
+        std::cout << "Load the xclbin " << binaryFile << std::endl;
+        auto uuid = device.load_xclbin(binaryFile);
+        std::vector<Path> paths;
+        if (selected("plain")) paths.push_back({"plain", "hello", open_cus(device, uuid, "hello")});
+        if (selected("chain")) paths.push_back({"chain", "hello_chain", open_cus(device, uuid, "hello_chain")});
+        if (!sweep(bench, device, paths, cu_counts, thread_counts, depths, commands, profiles)) {
+            std::cout << "TEST FAILED\n";
+            return EXIT_FAILURE;
+        }
+    }
+
+    // The fast adapter kernel is packaged by fa_pack in its own xclbin, loaded
+    // once the kernels of the first one are released
+    if (selected("fast_adapter")) {
+        if (faBinaryFile.empty()) {
+            std::cout << "No fast adapter xclbin given with -f, skipping the fast_adapter path" << std::endl;
+        } else {
+            std::cout << "Load the xclbin " << faBinaryFile << std::endl;
+            auto uuid = device.load_xclbin(faBinaryFile);
+            std::vector<Path> paths = {{"fast_adapter", "FA_hello", open_cus(device, uuid, "FA_hello")}};
+            if (!sweep(bench, device, paths, cu_counts, thread_counts, depths, commands, profiles)) {
+                std::cout << "TEST FAILED\n";
+                return EXIT_FAILURE;
+            }
+        }
+    }
+
+    print_profiles(profiles);
+    if ((!latency_csv.empty() && !write_profiles(profiles, latency_csv)) || !bench.write() || !bench.check()) {
+        std::cout << "TEST FAILED\n";
+        return EXIT_FAILURE;
+    }
+    std::cout << "TEST PASSED\n";
+    return 0;
+}
@@ -50,6 +50,8 @@
 *
 *********************************************************************************************/
 
+#include "bench.h"
+#include "cmdlineparser.h"
 #include "xcl2.hpp"
 #include <stdint.h>
 #include <stdio.h>
@@ -62,12 +64,37 @@
 #endif
 
 int main(int argc, char** argv) {
-    if (argc != 2) {
-        std::cout << "Usage: " << argv[0] << " <XCLBIN File>" << std::endl;
-        return EXIT_FAILURE;
+    // Command Line Parser
+    sda::utils::CmdLineParser parser;
+    sda::utils::BandwidthBench bench("kernel_global_bandwidth");
+
+    size_t globalbuffersize = 1024 * 1024 * 256; /* 256 MB */
+
+    /* Reducing the data size for emulation mode */
+    char* xcl_mode = getenv("XCL_EMULATION_MODE");
+    if (xcl_mode != nullptr) {
+        globalbuffersize = 1024 * 1024; /* 1MB */
+        bench.options().reps = 1;
+        bench.options().max_reps = 3;
+        bench.options().warmup = 0;
     }
 
-    std::string binaryFile = argv[1];
+    // Switches
+    //**************//"<Full Arg>",  "<Short Arg>", "<Description>", "<Default>"
+    parser.addSwitch("--xclbin_file", "-x", "input binary file string", "");
+    bench.options().min_size = globalbuffersize;
+    bench.options().max_size = globalbuffersize;
+    bench.addSwitches(parser);
+    parser.parse(argc, argv);
+    bench.parse(parser);
+
+    std::string binaryFile = parser.value("xclbin_file");
+    if (binaryFile.empty()) {
+        parser.printHelp();
+        return EXIT_FAILURE;
+    }
+    /* Buffers are allocated for the largest transfer of the sweep */
+    globalbuffersize = bench.options().max_size;
 
     cl_int err;
     cl::CommandQueue q;
@@ -92,6 +119,7 @@ int main(int argc, char** argv) {
         } else {
             std::cout << "Device[" << i << "]: program successful!\n";
             OCL_CHECK(err, krnl_global_bandwidth = cl::Kernel(program, "bandwidth", &err));
+            bench.setInfo("device", device.getInfo<CL_DEVICE_NAME>());
             valid_device = true;
             break; // we break because we found a valid device
         }
@@ -101,14 +129,6 @@ int main(int argc, char** argv) {
         exit(EXIT_FAILURE);
     }
 
-    size_t globalbuffersize = 1024 * 1024 * 256; /* 256 MB */
-
-    /* Reducing the data size for emulation mode */
-    char* xcl_mode = getenv("XCL_EMULATION_MODE");
-    if (xcl_mode != nullptr) {
-        globalbuffersize = 1024 * 1024; /* 1MB */
-    }
-
     /* Input buffer */
     unsigned char* input_host = ((unsigned char*)malloc(globalbuffersize));
     if (input_host == nullptr) {
@@ -159,7 +179,6 @@ int main(int argc, char** argv) {
     /* Set the kernel arguments */
     int arg_index = 0;
     int buffer_index = 0;
-    cl_ulong num_blocks = globalbuffersize / 64;
 
     OCL_CHECK(err, err = krnl_global_bandwidth.setArg(arg_index++, *(buffer[buffer_index++])));
     OCL_CHECK(err, err = krnl_global_bandwidth.setArg(arg_index++, *(buffer[buffer_index++])));
@@ -169,14 +188,7 @@ int main(int argc, char** argv) {
     OCL_CHECK(err, err = krnl_global_bandwidth.setArg(arg_index++, *(buffer[buffer_index++])));
     OCL_CHECK(err, err = krnl_global_bandwidth.setArg(arg_index++, *(buffer[buffer_index++])));
 #endif
-    OCL_CHECK(err, err = krnl_global_bandwidth.setArg(arg_index++, num_blocks));
-
-    double dbytes = globalbuffersize;
-    double dmbytes = dbytes / (((double)1024) * ((double)1024));
-    printf(
-        "Starting kernel to read/write %.0lf MB bytes from/to global "
-        "memory... \n",
-        dmbytes);
+    int num_blocks_index = arg_index;
 
     /* Write input buffer */
     /* Map input buffer for PCIe write */
@@ -210,15 +222,25 @@ int main(int argc, char** argv) {
     OCL_CHECK(err, err = q.finish());
 #endif
 
-    unsigned long start, end, nsduration;
-    cl::Event event;
-
-    /* Execute Kernel */
-    OCL_CHECK(err, err = q.enqueueTask(krnl_global_bandwidth, nullptr, &event));
-    OCL_CHECK(err, err = event.wait());
-    end = OCL_CHECK(err, event.getProfilingInfo<CL_PROFILING_COMMAND_END>(&err));
-    start = OCL_CHECK(err, event.getProfilingInfo<CL_PROFILING_COMMAND_START>(&err));
-    nsduration = end - start;
+    std::string banks = "DDR[0:" + std::to_string(ddr_banks - 1) + "]";
+    size_t copied = 0;
+    for (uint64_t size : bench.sizes()) {
+        cl_ulong num_blocks = size / 64;
+        copied = num_blocks * 64;
+        OCL_CHECK(err, err = krnl_global_bandwidth.setArg(num_blocks_index, num_blocks));
+        printf("Starting kernel to read/write %.0lf MB bytes from/to global memory... \n",
+               size / ((double)1024 * 1024));
+
+        /* Execute Kernel, timed from the profiling info of its events */
+        bench.runTimed({"ddr", "read_write", banks, 1, size, (double)size * num_buffers}, [&] {
+            cl::Event event;
+            OCL_CHECK(err, err = q.enqueueTask(krnl_global_bandwidth, nullptr, &event));
+            OCL_CHECK(err, err = event.wait());
+            unsigned long end = OCL_CHECK(err, event.getProfilingInfo<CL_PROFILING_COMMAND_END>(&err));
+            unsigned long start = OCL_CHECK(err, event.getProfilingInfo<CL_PROFILING_COMMAND_START>(&err));
+            return (end - start) / ((double)1000000000);
+        });
+    }
 
     /* Copy results back from OpenCL buffer */
     unsigned char* map_output_buffer0;
@@ -226,10 +248,8 @@ int main(int argc, char** argv) {
                                                                            globalbuffersize, nullptr, nullptr, &err));
     OCL_CHECK(err, err = q.finish());
 
-    std::cout << "Kernel Duration..." << nsduration << " ns" << std::endl;
-
-    /* Check the results of output0 */
-    for (size_t i = 0; i < globalbuffersize; i++) {
+    /* Check the results of output0, copied by the last kernel run */
+    for (size_t i = 0; i < copied; i++) {
         if (map_output_buffer0[i] != input_host[i]) {
             printf("ERROR : kernel failed to copy entry %zu input %i output %i\n", i, input_host[i],
                    map_output_buffer0[i]);
@@ -243,7 +263,7 @@ int main(int argc, char** argv) {
     OCL_CHECK(err, err = q.finish());
 
     /* Check the results of output1 */
-    for (size_t i = 0; i < globalbuffersize; i++) {
+    for (size_t i = 0; i < copied; i++) {
         if (map_output_buffer1[i] != input_host[i]) {
             printf("ERROR : kernel failed to copy entry %zu input %i output %i\n", i, input_host[i],
                    map_output_buffer1[i]);
@@ -259,7 +279,7 @@ int main(int argc, char** argv) {
     OCL_CHECK(err, err = q.finish());
 
     /* Check the results of output1 */
-    for (size_t i = 0; i < globalbuffersize; i++) {
+    for (size_t i = 0; i < copied; i++) {
         if (map_output_buffer1[i] != input_host[i]) {
             printf("ERROR : kernel failed to copy entry %zu input %i output %i\n", i, input_host[i],
                    map_output_buffer1[i]);
@@ -277,16 +297,9 @@ int main(int argc, char** argv) {
     delete (buffer[1]);
 #endif
 
-    /* Profiling information */
-    double dnsduration = ((double)nsduration);
-    double dsduration = dnsduration / ((double)1000000000);
-
-    double bpersec = (dbytes / dsduration);
-    double gbpersec = bpersec / ((double)1024 * 1024 * 1024) * num_buffers;
-
-    printf("Kernel completed read/write %.0lf MB bytes from/to global memory.\n", dmbytes);
-    printf("Execution time = %f (sec) \n", dsduration);
-    printf("Concurrent Read and Write Throughput = %f (GB/sec) \n", gbpersec);
+    /* Highest median throughput of the sweep */
+    printf("Concurrent Read and Write Throughput = %f (GB/sec) \n", bench.best("ddr", "read_write") / 1024);
+    if (!bench.write() || !bench.check()) return EXIT_FAILURE;
 
     printf("TEST PASSED\n");
     return EXIT_SUCCESS;
@@ -0,0 +1,8 @@
+# Rows and columns of the stencils, odd, e.g. make run KSIZE=5
+KSIZE := 7
+# Pixels per clock of the kernels, the widths must be multiples of it
+PPC := 8
+
+VPP_FLAGS += -DSTENCIL_SIZE=$(KSIZE) -DSTENCIL_PPC=$(PPC)
+
+CXXFLAGS += -DSTENCIL_SIZE=$(KSIZE) -DSTENCIL_PPC=$(PPC)
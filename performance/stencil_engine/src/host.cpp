@@ -0,0 +1,278 @@
+/**
+* Copyright (C) 2019-2021 Xilinx, Inc
+*
+* Licensed under the Apache License, Version 2.0 (the "License"). You may
+* not use this file except in compliance with the License. A copy of the
+* License is located at
+*
+*     http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+* WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the
+* License for the specific language governing permissions and limitations
+* under the License.
+*/
+
+/*******************************************************************************
+
+Description:
+
+    2D and separable stencils on the templated stencil engine, for 16:9
+    images of 8-bit pixels and each border mode. The throughput, in
+    MPixels/s, is compared with the vectorized multi-threaded CPU twin of
+    the kernels, which also checks their output. Without an xclbin, only
+    the CPU twin runs.
+
+*******************************************************************************/
+#include "bench.h"
+#include "cmdlineparser.h"
+#include "stencil.h"
+#include "stencil_cpu.h"
+#include "xcl2.hpp"
+#include <algorithm>
+#include <iostream>
+#include <sstream>
+#include <thread>
+#include <vector>
+
+typedef std::vector<unsigned char, aligned_allocator<unsigned char> > image_t;
+typedef std::vector<signed char, aligned_allocator<signed char> > coeff_t;
+
+// A stencil of the kernels, with its coefficients and normalization
+struct Stencil {
+    std::string name;
+    bool separable;
+    coeff_t coeff;
+    float factor;
+    short bias;
+    cl::Kernel krnl;
+};
+
+static const char* border_names[] = {"zero", "clamp", "mirror"};
+
+// Splits a comma separated list
+static std::vector<std::string> split(const std::string& list) {
+    std::vector<std::string> items;
+    std::stringstream stream(list);
+    std::string item;
+    while (getline(stream, item, ',')) {
+        items.push_back(item);
+    }
+    return items;
+}
+
+// Random coefficients in [-8, 8], normalized so that the output stays
+// around the bias
+static Stencil make_stencil(const std::string& name) {
+    Stencil s;
+    s.name = name;
+    s.separable = (name == "separable");
+    s.coeff.resize(s.separable ? 2 * STENCIL_SIZE : STENCIL_SIZE * STENCIL_SIZE);
+    int total = 0, column = 0, row = 0;
+    for (size_t t = 0; t < s.coeff.size(); t++) {
+        s.coeff[t] = rand() % 17 - 8;
+        total += abs(s.coeff[t]);
+        if (t < STENCIL_SIZE)
+            column += abs(s.coeff[t]);
+        else
+            row += abs(s.coeff[t]);
+    }
+    int norm = s.separable ? column * row : total;
+    s.factor = 1.0f / std::max(norm / 4, 1);
+    s.bias = 128;
+    return s;
+}
+
+static void run_cpu(const Stencil& s, const image_t& src, image_t& dst, int width, int height, int border,
+                    unsigned int threads) {
+    if (s.separable) {
+        stencil_cpu_separable(src.data(), dst.data(), s.coeff.data(), STENCIL_SIZE, STENCIL_SIZE, s.factor, s.bias,
+                              width, height, border, threads);
+    } else {
+        stencil_cpu_2d(src.data(), dst.data(), s.coeff.data(), STENCIL_SIZE, STENCIL_SIZE, s.factor, s.bias, width,
+                       height, border, threads);
+    }
+}
+
+int main(int argc, char** argv) {
+    // Command Line Parser
+    sda::utils::CmdLineParser parser;
+    sda::utils::BandwidthBench bench("stencil_engine");
+    bench.setUnit("MPixels/s", 1000.0 * 1000);
+    bench.options().min_size = 480;
+    bench.options().max_size = 3840;
+    bench.options().reps = 3;
+    bench.options().max_reps = 10;
+    if (xcl::is_emulation()) {
+        bench.options().min_size = 64;
+        bench.options().max_size = 128;
+        bench.options().reps = 1;
+        bench.options().max_reps = 3;
+        bench.options().warmup = 0;
+    }
+
+    // Switches
+    //**************//"<Full Arg>",  "<Short Arg>", "<Description>", "<Default>"
+    parser.addSwitch("--xclbin_file", "-x", "input binary file string, none to run the CPU twin only", "");
+    parser.addSwitch("--stencils", "-s", "stencils: 2d, separable", "2d,separable");
+    parser.addSwitch("--borders", "-bm", "border modes: zero, clamp, mirror", "zero,clamp,mirror");
+    parser.addSwitch("--threads", "-th", "threads of the CPU twin (0 = all cores)", "0");
+    bench.addSwitches(parser);
+    parser.parse(argc, argv);
+    bench.parse(parser);
+
+    // Read settings
+    std::string binaryFile = parser.value("xclbin_file");
+    unsigned int threads = std::max(parser.value_to_int("threads"), 0);
+    if (threads == 0) threads = std::max(std::thread::hardware_concurrency(), 1u);
+    bool run_fpga = !binaryFile.empty();
+
+    std::vector<Stencil> stencils;
+    for (auto& name : split(parser.value("stencils"))) {
+        if (name != "2d" && name != "separable") {
+            std::cout << "ERROR : unknown stencil " << name << ", use 2d or separable" << std::endl;
+            return EXIT_FAILURE;
+        }
+        stencils.push_back(make_stencil(name));
+    }
+    std::vector<int> borders;
+    for (auto& name : split(parser.value("borders"))) {
+        int border = std::find(border_names, border_names + 3, name) - border_names;
+        if (border == 3) {
+            std::cout << "ERROR : unknown border mode " << name << ", use zero, clamp or mirror" << std::endl;
+            return EXIT_FAILURE;
+        }
+        borders.push_back(border);
+    }
+
+    cl_int err;
+    cl::CommandQueue q;
+    cl::Context context;
+
+    // OPENCL HOST CODE AREA START
+    if (run_fpga) {
+        auto devices = xcl::get_xil_devices();
+
+        // read_binary_file() is a utility API which will load the binaryFile
+        // and will return the pointer to file buffer.
+        auto fileBuf = xcl::read_binary_file(binaryFile);
+        cl::Program::Binaries bins{{fileBuf.data(), fileBuf.size()}};
+        bool valid_device = false;
+        for (unsigned int i = 0; i < devices.size(); i++) {
+            auto device = devices[i];
+            // Creating Context and Command Queue for selected Device
+            OCL_CHECK(err, context = cl::Context(device, nullptr, nullptr, nullptr, &err));
+            OCL_CHECK(err, q = cl::CommandQueue(context, device, CL_QUEUE_PROFILING_ENABLE, &err));
+
+            std::cout << "Trying to program device[" << i << "]: " << device.getInfo<CL_DEVICE_NAME>() << std::endl;
+            cl::Program program(context, {device}, bins, nullptr, &err);
+            if (err != CL_SUCCESS) {
+                std::cout << "Failed to program device[" << i << "] with xclbin file!\n";
+            } else {
+                std::cout << "Device[" << i << "]: program successful!\n";
+                for (auto& s : stencils) {
+                    std::string krnl_name = "stencil_" + s.name;
+                    OCL_CHECK(err, s.krnl = cl::Kernel(program, krnl_name.c_str(), &err));
+                }
+                bench.setInfo("device", device.getInfo<CL_DEVICE_NAME>());
+                valid_device = true;
+                break; // we break because we found a valid device
+            }
+        }
+        if (!valid_device) {
+            std::cout << "Failed to program any device found, exit!\n";
+            exit(EXIT_FAILURE);
+        }
+        bench.setInfo("xclbin", binaryFile);
+    } else {
+        std::cout << "No xclbin given, running the CPU twin only" << std::endl;
+    }
+
+    bench.setInfo("stencil_size", std::to_string(STENCIL_SIZE));
+    std::cout << STENCIL_SIZE << " x " << STENCIL_SIZE << " stencils, " << STENCIL_PPC << " pixels per clock, "
+              << threads << " CPU threads" << std::endl;
+
+    bool match = true;
+    for (uint64_t size : bench.sizes()) {
+        // 16:9 images, as wide as the kernels take them
+        int width = (size + STENCIL_PPC - 1) / STENCIL_PPC * STENCIL_PPC;
+        int height = std::max(width * 9 / 16, STENCIL_SIZE);
+        // At least 2 words per row, for the line buffers of the engine
+        int min_width = std::max(STENCIL_SIZE, 2 * STENCIL_PPC);
+        if (width > STENCIL_MAX_WIDTH || width < min_width) {
+            std::cout << "Skipping width " << width << ", the kernels take " << min_width << " to "
+                      << STENCIL_MAX_WIDTH << " pixels" << std::endl;
+            continue;
+        }
+        size_t pixels = (size_t)width * height;
+
+        // Create the test data
+        image_t src(pixels), out(pixels), gold(pixels);
+        for (size_t i = 0; i < pixels; i++) src[i] = rand() % 256;
+
+        cl::Buffer buffer_src, buffer_out;
+        if (run_fpga) {
+            // Allocate Buffer in Global Memory
+            OCL_CHECK(err, buffer_src = cl::Buffer(context, CL_MEM_USE_HOST_PTR | CL_MEM_READ_ONLY, pixels, src.data(),
+                                                   &err));
+            OCL_CHECK(err, buffer_out = cl::Buffer(context, CL_MEM_USE_HOST_PTR | CL_MEM_WRITE_ONLY, pixels,
+                                                   out.data(), &err));
+
+            // Copy input data to device global memory
+            OCL_CHECK(err, err = q.enqueueMigrateMemObjects({buffer_src}, 0 /* 0 means from host*/));
+            OCL_CHECK(err, err = q.finish());
+        }
+
+        for (auto& s : stencils) {
+            cl::Buffer buffer_coeff;
+            if (run_fpga) {
+                OCL_CHECK(err, buffer_coeff = cl::Buffer(context, CL_MEM_USE_HOST_PTR | CL_MEM_READ_ONLY,
+                                                         s.coeff.size(), s.coeff.data(), &err));
+                OCL_CHECK(err, err = s.krnl.setArg(0, buffer_src));
+                OCL_CHECK(err, err = s.krnl.setArg(1, buffer_out));
+                OCL_CHECK(err, err = s.krnl.setArg(2, buffer_coeff));
+                OCL_CHECK(err, err = s.krnl.setArg(3, s.factor));
+                OCL_CHECK(err, err = s.krnl.setArg(4, s.bias));
+                OCL_CHECK(err, err = s.krnl.setArg(5, width));
+                OCL_CHECK(err, err = s.krnl.setArg(6, height));
+                OCL_CHECK(err, err = q.enqueueMigrateMemObjects({buffer_coeff}, 0 /* 0 means from host*/));
+            }
+
+            for (int border : borders) {
+                std::string mode = border_names[border];
+                bench.run({"cpu", s.name, mode, threads, (uint64_t)width, (double)pixels},
+                          [&] { run_cpu(s, src, gold, width, height, border, threads); });
+                if (!run_fpga) continue;
+
+                OCL_CHECK(err, err = s.krnl.setArg(7, border));
+                bench.run({"fpga", s.name, mode, 1, (uint64_t)width, (double)pixels}, [&] {
+                    OCL_CHECK(err, err = q.enqueueTask(s.krnl));
+                    OCL_CHECK(err, err = q.finish());
+                });
+
+                // Copy Result from Device Global Memory to Host Local Memory
+                OCL_CHECK(err, err = q.enqueueMigrateMemObjects({buffer_out}, CL_MIGRATE_MEM_OBJECT_HOST));
+                OCL_CHECK(err, err = q.finish());
+
+                for (size_t i = 0; i < pixels && match; i++) {
+                    if (out[i] != gold[i]) {
+                        std::cout << "Error: Result mismatch" << std::endl;
+                        std::cout << s.name << " " << mode << " x = " << i % width << " y = " << i / width
+                                  << " CPU result = " << (int)gold[i] << " Device result = " << (int)out[i]
+                                  << std::endl;
+                        match = false;
+                    }
+                }
+                if (!match) break;
+            }
+            if (!match) break;
+        }
+        if (!match) break;
+    }
+    // OPENCL HOST CODE AREA END
+
+    if (!bench.write() || !bench.check()) match = false;
+    std::cout << "TEST " << (match ? "PASSED" : "FAILED") << std::endl;
+    return (match ? EXIT_SUCCESS : EXIT_FAILURE);
+}
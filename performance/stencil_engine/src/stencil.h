@@ -0,0 +1,49 @@
+/**
+* Copyright (C) 2019-2021 Xilinx, Inc
+*
+* Licensed under the Apache License, Version 2.0 (the "License"). You may
+* not use this file except in compliance with the License. A copy of the
+* License is located at
+*
+*     http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+* WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the
+* License for the specific language governing permissions and limitations
+* under the License.
+*/
+#ifndef STENCIL_H
+#define STENCIL_H
+
+// Settings shared by the kernels, the CPU implementation and the host
+
+// Rows and columns of the stencils, set by config.mk
+#ifndef STENCIL_SIZE
+#define STENCIL_SIZE 7
+#endif
+
+// Pixels per clock of the kernels, set by config.mk
+#ifndef STENCIL_PPC
+#define STENCIL_PPC 8
+#endif
+
+// Widest image of the kernels, the size of their line buffers
+#define STENCIL_MAX_WIDTH 3840
+
+// How the pixels out of the image are made up
+enum { BORDER_ZERO = 0, BORDER_CLAMP = 1, BORDER_MIRROR = 2 };
+
+// Row or column of the image that stands for the row or column i, which
+// may be out of [0, size). The pixels out of the image are zeros for
+// BORDER_ZERO, the ones of the edge for BORDER_CLAMP, and the ones across
+// the edge, without repeating it, for BORDER_MIRROR: -1 is 1, size is
+// size - 2. The image must be larger than the stencil.
+inline int border_index(int i, int size, int border) {
+    if (i >= 0 && i < size) return i;
+    if (border == BORDER_CLAMP) return i < 0 ? 0 : size - 1;
+    if (border == BORDER_MIRROR) return i < 0 ? -i : 2 * size - 2 - i;
+    return i;
+}
+
+#endif
@@ -0,0 +1,42 @@
+/**
+* Copyright (C) 2019-2021 Xilinx, Inc
+*
+* Licensed under the Apache License, Version 2.0 (the "License"). You may
+* not use this file except in compliance with the License. A copy of the
+* License is located at
+*
+*     http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+* WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the
+* License for the specific language governing permissions and limitations
+* under the License.
+*/
+
+// Stencil of STENCIL_SIZE x STENCIL_SIZE coefficients, row by row, on
+// STENCIL_PPC pixels per clock.
+// See stencil_engine.h for the arguments.
+
+#include "stencil_engine.h"
+
+typedef ap_uint<8 * STENCIL_PPC> stencil_word_t;
+
+extern "C" {
+void stencil_2d(const stencil_word_t* in, // Read-Only Image
+                stencil_word_t* out,      // Output Image
+                const signed char* coeff, // Read-Only Coefficients
+                float factor,             // Scale of the sums
+                short bias,               // Offset of the output pixels
+                int width,                // Multiple of STENCIL_PPC
+                int height,
+                int border                // BORDER_ZERO, BORDER_CLAMP or BORDER_MIRROR
+                ) {
+#pragma HLS INTERFACE m_axi port = in offset = slave bundle = gmem0 max_read_burst_length = 64
+#pragma HLS INTERFACE m_axi port = out offset = slave bundle = gmem1 max_write_burst_length = 64
+#pragma HLS INTERFACE m_axi port = coeff offset = slave bundle = gmem0
+
+    stencil_engine<Stencil2D<STENCIL_SIZE, STENCIL_SIZE>, STENCIL_PPC, STENCIL_MAX_WIDTH>(in, out, coeff, factor, bias,
+                                                                                         width, height, border);
+}
+}
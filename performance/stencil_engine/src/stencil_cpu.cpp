@@ -0,0 +1,187 @@
+/**
+* Copyright (C) 2019-2021 Xilinx, Inc
+*
+* Licensed under the Apache License, Version 2.0 (the "License"). You may
+* not use this file except in compliance with the License. A copy of the
+* License is located at
+*
+*     http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+* WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the
+* License for the specific language governing permissions and limitations
+* under the License.
+*/
+
+#include "stencil_cpu.h"
+#include "stencil.h"
+
+#include <algorithm>
+#include <string.h>
+#include <thread>
+#include <vector>
+
+// Copies the rows [first, last) of the image, which may be out of it, with
+// kh / 2 more pixels on each side as the border makes them up. The stencil
+// loops then read whole rows without a border to check.
+static void pad_rows(const unsigned char* src,
+                     int width,
+                     int height,
+                     int kh,
+                     int border,
+                     int first,
+                     int last,
+                     std::vector<unsigned char>& padded) {
+    int r = kh / 2;
+    int stride = width + kh - 1;
+    padded.assign((size_t)(last - first) * stride, 0);
+    for (int y = first; y < last; y++) {
+        int ys = border_index(y, height, border);
+        if (ys < 0 || ys >= height) continue;
+        const unsigned char* row = src + (size_t)ys * width;
+        unsigned char* dst = padded.data() + (size_t)(y - first) * stride + r;
+        memcpy(dst, row, width);
+        for (int x = -r; x < 0; x++) {
+            int xs = border_index(x, width, border);
+            if (xs >= 0) dst[x] = row[xs];
+        }
+        for (int x = width; x < width + r; x++) {
+            int xs = border_index(x, width, border);
+            if (xs < width) dst[x] = row[xs];
+        }
+    }
+}
+
+// Normalizes and saturates a row of sums as the kernels do
+static void store_row(const int* sum, unsigned char* dst, int width, float factor, short bias) {
+    for (int x = 0; x < width; x++) {
+        int value = int(factor * sum[x]) + bias;
+        dst[x] = (value < 0) ? 0 : (value > 255) ? 255 : value;
+    }
+}
+
+// Runs the stencil on one band of rows per thread
+template <typename F>
+static void run_bands(const F& band,
+                      const unsigned char* src,
+                      unsigned char* dst,
+                      const signed char* coeff,
+                      int kv,
+                      int kh,
+                      float factor,
+                      short bias,
+                      int width,
+                      int height,
+                      int border,
+                      unsigned int threads) {
+    int rows = (height + threads - 1) / threads;
+    std::vector<std::thread> workers;
+    for (int first = rows; first < height; first += rows) {
+        workers.push_back(std::thread(band, src, dst, coeff, kv, kh, factor, bias, width, height, border, first,
+                                      std::min(first + rows, height)));
+    }
+    band(src, dst, coeff, kv, kh, factor, bias, width, height, border, 0, std::min(rows, height));
+    for (auto& worker : workers) {
+        worker.join();
+    }
+}
+
+// Adds one coefficient times a row at a time, so that the inner loop runs
+// over consecutive pixels
+static void band_2d(const unsigned char* src,
+                    unsigned char* dst,
+                    const signed char* coeff,
+                    int kv,
+                    int kh,
+                    float factor,
+                    short bias,
+                    int width,
+                    int height,
+                    int border,
+                    int first,
+                    int last) {
+    int stride = width + kh - 1;
+    std::vector<unsigned char> padded;
+    pad_rows(src, width, height, kh, border, first - kv / 2, last + kv / 2, padded);
+    std::vector<int> sum(width);
+    const unsigned char* rows = padded.data();
+    int* s = sum.data();
+    for (int y = first; y < last; y++) {
+        for (int x = 0; x < width; x++) s[x] = 0;
+        for (int i = 0; i < kv; i++) {
+            const unsigned char* row = rows + (size_t)(y - first + i) * stride;
+            for (int j = 0; j < kh; j++) {
+                int c = coeff[i * kh + j];
+                if (c == 0) continue;
+                const unsigned char* pixels = row + j;
+                for (int x = 0; x < width; x++) s[x] += c * pixels[x];
+            }
+        }
+        store_row(s, dst + (size_t)y * width, width, factor, bias);
+    }
+}
+
+// Sums the columns of the padded rows first, then the rows of these sums
+static void band_separable(const unsigned char* src,
+                           unsigned char* dst,
+                           const signed char* coeff,
+                           int kv,
+                           int kh,
+                           float factor,
+                           short bias,
+                           int width,
+                           int height,
+                           int border,
+                           int first,
+                           int last) {
+    int stride = width + kh - 1;
+    std::vector<unsigned char> padded;
+    pad_rows(src, width, height, kh, border, first - kv / 2, last + kv / 2, padded);
+    std::vector<int> column(stride), sum(width);
+    const unsigned char* rows = padded.data();
+    int* v = column.data();
+    int* s = sum.data();
+    for (int y = first; y < last; y++) {
+        for (int x = 0; x < stride; x++) v[x] = 0;
+        for (int i = 0; i < kv; i++) {
+            int c = coeff[i];
+            const unsigned char* row = rows + (size_t)(y - first + i) * stride;
+            for (int x = 0; x < stride; x++) v[x] += c * row[x];
+        }
+        for (int x = 0; x < width; x++) s[x] = 0;
+        for (int j = 0; j < kh; j++) {
+            int c = coeff[kv + j];
+            for (int x = 0; x < width; x++) s[x] += c * v[x + j];
+        }
+        store_row(s, dst + (size_t)y * width, width, factor, bias);
+    }
+}
+
+void stencil_cpu_2d(const unsigned char* src,
+                    unsigned char* dst,
+                    const signed char* coeff,
+                    int kv,
+                    int kh,
+                    float factor,
+                    short bias,
+                    int width,
+                    int height,
+                    int border,
+                    unsigned int threads) {
+    run_bands(band_2d, src, dst, coeff, kv, kh, factor, bias, width, height, border, threads);
+}
+
+void stencil_cpu_separable(const unsigned char* src,
+                           unsigned char* dst,
+                           const signed char* coeff,
+                           int kv,
+                           int kh,
+                           float factor,
+                           short bias,
+                           int width,
+                           int height,
+                           int border,
+                           unsigned int threads) {
+    run_bands(band_separable, src, dst, coeff, kv, kh, factor, bias, width, height, border, threads);
+}
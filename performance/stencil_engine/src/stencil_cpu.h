@@ -0,0 +1,47 @@
+/**
+* Copyright (C) 2019-2021 Xilinx, Inc
+*
+* Licensed under the Apache License, Version 2.0 (the "License"). You may
+* not use this file except in compliance with the License. A copy of the
+* License is located at
+*
+*     http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+* WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the
+* License for the specific language governing permissions and limitations
+* under the License.
+*/
+#ifndef STENCIL_CPU_H
+#define STENCIL_CPU_H
+
+// Vectorized multi-threaded twins of the stencil kernels, with the same
+// coefficients, output and borders (see stencil_engine.h): kv x kh
+// coefficients row by row for stencil_cpu_2d, kv then kh coefficients for
+// stencil_cpu_separable. Any width works, the sizes must be odd.
+void stencil_cpu_2d(const unsigned char* src,
+                    unsigned char* dst,
+                    const signed char* coeff,
+                    int kv,
+                    int kh,
+                    float factor,
+                    short bias,
+                    int width,
+                    int height,
+                    int border,
+                    unsigned int threads);
+
+void stencil_cpu_separable(const unsigned char* src,
+                           unsigned char* dst,
+                           const signed char* coeff,
+                           int kv,
+                           int kh,
+                           float factor,
+                           short bias,
+                           int width,
+                           int height,
+                           int border,
+                           unsigned int threads);
+
+#endif
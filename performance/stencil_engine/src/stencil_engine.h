@@ -0,0 +1,311 @@
+/**
+* Copyright (C) 2019-2021 Xilinx, Inc
+*
+* Licensed under the Apache License, Version 2.0 (the "License"). You may
+* not use this file except in compliance with the License. A copy of the
+* License is located at
+*
+*     http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+* WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the
+* License for the specific language governing permissions and limitations
+* under the License.
+*/
+
+/*
+
+  Templated Stencil Engine
+
+  The line buffer of vconv (cpp_kernels/dependence_inter) and the sliding
+  window of the Window2D/Filter2D pair of system_compilation/quick_start_sc,
+  redone as one engine for centered stencils of any size on 8-bit images.
+  Those examples keep their own code: vconv filters 32-bit samples with
+  the taps above the last row read and no clamping, which the engine does
+  not do. The engine is
+
+      stencil_engine<S, PPC, MAX_WIDTH>(in, out, coeff, factor, bias, width, height, border)
+
+  S is the stencil, Stencil2D<KV, KH> for any KV x KH coefficients, or
+  StencilSeparable<KV, KH> for a column of KV coefficients followed by a row
+  of KH ones. PPC pixels move per clock, packed in words of 8 x PPC bits, so
+  the width must be a multiple of PPC, at least 2 x PPC and at most
+  MAX_WIDTH. With a single word per row the line buffers would be read on
+  the cycle after the write of the same word, which the DEPENDENCE pragma
+  of linebuf rules out.
+
+  The output pixel is
+
+      min(max(int(factor * sum) + bias, 0), 255)
+
+  where sum is the products of the coefficients with the pixels around it,
+  from KV / 2 rows above to KV / 2 rows below, and from KH / 2 columns to
+  the left to KH / 2 columns to the right. The sizes are odd, so that the
+  mirror of a row or column out of the image is as far from the edge on the
+  other side. The pixels out of the image are set by border, see
+  border_index().
+
+  The image streams through a single loop, one word per cycle:
+
+      line buffers : the last KV - 1 rows, which give KV pixels of a column
+                     with the word that comes in. The rows out of the image
+                     are replaced here, by rows the line buffers hold.
+      window       : the last columns, enough for the PPC outputs of a word
+                     and KH - 1 neighbours, as S stores them. The columns out
+                     of the image are replaced here, by columns of the window.
+
+  The output is KV / 2 rows and a few words behind the input. The loop does
+  not stop at the end of a row, so a new row starts on the next cycle, and
+  only the rows below the last one and the words after the last one are
+  extra cycles.
+*/
+
+#ifndef STENCIL_ENGINE_H
+#define STENCIL_ENGINE_H
+
+#include "stencil.h"
+#include <ap_int.h>
+#include <hls_stream.h>
+
+typedef unsigned char pixel_t;
+
+// TRIPCOUNT identifiers
+const unsigned int c_words = 1920 * 1080 / STENCIL_PPC;
+const unsigned int c_taps = STENCIL_SIZE * STENCIL_SIZE;
+
+// The pixels of a column of the stencil
+template <int KV>
+struct Pixels {
+    pixel_t p[KV];
+};
+
+// KV x KH coefficients, row by row. The window holds the columns of pixels.
+template <int KV, int KH>
+struct Stencil2D {
+    static_assert(KV % 2 == 1 && KH % 2 == 1, "the stencil sizes must be odd");
+    static const int kv = KV;
+    static const int kh = KH;
+    static const int taps = KV * KH;
+    typedef Pixels<KV> value_t;
+
+    static value_t zero() {
+        value_t v;
+        for (int i = 0; i < KV; i++) v.p[i] = 0;
+        return v;
+    }
+
+    static value_t column(const Pixels<KV>& pixels, const signed char coeff[taps]) { return pixels; }
+
+    static int apply(const value_t columns[KH], const signed char coeff[taps]) {
+        int sum = 0;
+        for (int i = 0; i < KV; i++) {
+            for (int j = 0; j < KH; j++) {
+                sum += coeff[i * KH + j] * columns[j].p[i];
+            }
+        }
+        return sum;
+    }
+};
+
+// A column of KV coefficients, then a row of KH coefficients. The window
+// holds the sums of the columns, so a pixel costs KV + KH products.
+template <int KV, int KH>
+struct StencilSeparable {
+    static_assert(KV % 2 == 1 && KH % 2 == 1, "the stencil sizes must be odd");
+    static const int kv = KV;
+    static const int kh = KH;
+    static const int taps = KV + KH;
+    typedef int value_t;
+
+    static value_t zero() { return 0; }
+
+    static value_t column(const Pixels<KV>& pixels, const signed char coeff[taps]) {
+        int sum = 0;
+        for (int i = 0; i < KV; i++) {
+            sum += coeff[i] * pixels.p[i];
+        }
+        return sum;
+    }
+
+    static int apply(const value_t columns[KH], const signed char coeff[taps]) {
+        int sum = 0;
+        for (int j = 0; j < KH; j++) {
+            sum += coeff[KV + j] * columns[j];
+        }
+        return sum;
+    }
+};
+
+template <int PPC>
+static void stencil_read(const ap_uint<8 * PPC>* in,
+                         hls::stream<ap_uint<8 * PPC> >& inStream,
+                         int width,
+                         int height) {
+    int words = width / PPC * height;
+mem_rd:
+    for (int i = 0; i < words; i++) {
+#pragma HLS LOOP_TRIPCOUNT min = c_words max = c_words
+#pragma HLS PIPELINE II = 1
+        inStream << in[i];
+    }
+}
+
+template <int PPC>
+static void stencil_write(ap_uint<8 * PPC>* out,
+                          hls::stream<ap_uint<8 * PPC> >& outStream,
+                          int width,
+                          int height) {
+    int words = width / PPC * height;
+mem_wr:
+    for (int i = 0; i < words; i++) {
+#pragma HLS LOOP_TRIPCOUNT min = c_words max = c_words
+#pragma HLS PIPELINE II = 1
+        out[i] = outStream.read();
+    }
+}
+
+template <typename S, int PPC, int MAX_WIDTH>
+static void stencil_compute(hls::stream<ap_uint<8 * PPC> >& inStream,
+                            hls::stream<ap_uint<8 * PPC> >& outStream,
+                            const signed char* coeff,
+                            float factor,
+                            short bias,
+                            int width,
+                            int height,
+                            int border) {
+    typedef ap_uint<8 * PPC> word_t;
+    typedef typename S::value_t value_t;
+    const int KV = S::kv;
+    const int KH = S::kh;
+    const int top = KV / 2;
+    const int bottom = KV / 2;
+    const int left = KH / 2;
+    const int right = KH / 2;
+    // Words read ahead of the output word, for its right neighbours
+    const int ahead = (right + PPC - 1) / PPC;
+    // Columns of the window, from the left neighbours of the output word to
+    // the last column read
+    const int WL = (ahead + 1) * PPC + left;
+
+    signed char coeff_reg[S::taps];
+#pragma HLS ARRAY_PARTITION variable = coeff_reg complete dim = 0
+
+load_coeff:
+    for (int t = 0; t < S::taps; t++) {
+#pragma HLS LOOP_TRIPCOUNT min = c_taps max = c_taps
+#pragma HLS PIPELINE II = 1
+        coeff_reg[t] = coeff[t];
+    }
+
+    word_t linebuf[KV > 1 ? KV - 1 : 1][MAX_WIDTH / PPC];
+#pragma HLS ARRAY_PARTITION variable = linebuf dim = 1 complete
+    // A word of the line buffers is written again one row later, at least
+    // 2 cycles after it is read, as a row has at least 2 words
+#pragma HLS DEPENDENCE variable = linebuf inter false
+
+    value_t window[WL];
+#pragma HLS ARRAY_PARTITION variable = window complete dim = 0
+
+    int words = width / PPC;
+    int iterations = (height + bottom) * words + ahead;
+
+    // Word read, and output word, as a row of the input and a word of it.
+    // The column of the word read is centered on the row row - bottom.
+    int row = 0, col = 0;
+    int out_row = 0, out_col = 0;
+
+stencil:
+    for (int n = 0; n < iterations; n++) {
+#pragma HLS LOOP_TRIPCOUNT min = c_words max = c_words
+#pragma HLS PIPELINE II = 1
+        word_t rows[KV];
+#pragma HLS ARRAY_PARTITION variable = rows complete dim = 0
+        for (int i = 0; i < KV - 1; i++) {
+            rows[i] = linebuf[i][col];
+        }
+        rows[KV - 1] = (row < height) ? inStream.read() : word_t(0);
+
+        // The line buffers keep the last KV - 1 rows
+        for (int i = 0; i < KV - 2; i++) {
+            linebuf[i][col] = rows[i + 1];
+        }
+        if (KV > 1) linebuf[KV - 2][col] = rows[KV - 1];
+
+        // The column of each pixel of the word, with the rows out of the
+        // image replaced by the ones border_index() gives
+        int y = row - bottom;
+        bool y_valid = (y >= 0 && y < height);
+        value_t columns[PPC];
+        for (int p = 0; p < PPC; p++) {
+            Pixels<KV> pixels;
+            for (int i = 0; i < KV; i++) {
+                int yi = y - top + i;
+                int source = y_valid ? i + border_index(yi, height, border) - yi : i;
+                bool zero = (border == BORDER_ZERO) && (yi < 0 || yi >= height);
+                pixels.p[i] = zero ? pixel_t(0) : pixel_t(rows[source].range(8 * p + 7, 8 * p));
+            }
+            columns[p] = S::column(pixels, coeff_reg);
+        }
+
+        // Slide the window by a word
+        for (int s = 0; s < WL - PPC; s++) {
+            window[s] = window[s + PPC];
+        }
+        for (int p = 0; p < PPC; p++) {
+            window[WL - PPC + p] = columns[p];
+        }
+
+        // The output word, once its right neighbours are in the window,
+        // with the columns out of the image replaced
+        if (n >= ahead && out_row >= bottom) {
+            word_t pixels_out;
+            for (int p = 0; p < PPC; p++) {
+                value_t taps[KH];
+                for (int j = 0; j < KH; j++) {
+                    int x = out_col * PPC + p + j - left;
+                    int source = p + j + border_index(x, width, border) - x;
+                    bool zero = (border == BORDER_ZERO) && (x < 0 || x >= width);
+                    taps[j] = zero ? S::zero() : window[source];
+                }
+                int sum = S::apply(taps, coeff_reg);
+                int value = int(factor * sum) + bias;
+                pixels_out.range(8 * p + 7, 8 * p) = (value < 0) ? 0 : (value > 255) ? 255 : value;
+            }
+            outStream << pixels_out;
+        }
+
+        if (n >= ahead) {
+            if (++out_col == words) {
+                out_col = 0;
+                out_row++;
+            }
+        }
+        if (++col == words) {
+            col = 0;
+            row++;
+        }
+    }
+}
+
+template <typename S, int PPC, int MAX_WIDTH>
+void stencil_engine(const ap_uint<8 * PPC>* in,
+                    ap_uint<8 * PPC>* out,
+                    const signed char* coeff,
+                    float factor,
+                    short bias,
+                    int width,
+                    int height,
+                    int border) {
+    hls::stream<ap_uint<8 * PPC> > inStream("in_stream");
+    hls::stream<ap_uint<8 * PPC> > outStream("out_stream");
+#pragma HLS STREAM variable = inStream depth = 32
+#pragma HLS STREAM variable = outStream depth = 32
+
+#pragma HLS dataflow
+    stencil_read<PPC>(in, inStream, width, height);
+    stencil_compute<S, PPC, MAX_WIDTH>(inStream, outStream, coeff, factor, bias, width, height, border);
+    stencil_write<PPC>(out, outStream, width, height);
+}
+
+#endif
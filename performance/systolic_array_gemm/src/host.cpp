@@ -0,0 +1,351 @@
+/**
+* Copyright (C) 2019-2021 Xilinx, Inc
+*
+* Licensed under the Apache License, Version 2.0 (the "License"). You may
+* not use this file except in compliance with the License. A copy of the
+* License is located at
+*
+*     http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+* WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the
+* License for the specific language governing permissions and limitations
+* under the License.
+*/
+
+/*******************************************************************************
+
+Description:
+
+    Large matrix multiplication on the tiled systolic array kernel. The host
+    packs the matrices in 16 x 16 tiles, splits C in blocks of tiles and
+    spreads the blocks over the CUs, then compares the throughput, in GOP/s
+    (one multiply and one add per term), with a blocked multi-threaded CPU
+    implementation.
+
+*******************************************************************************/
+#include "bench.h"
+#include "cmdlineparser.h"
+#include "xcl2.hpp"
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+#include <thread>
+#include <vector>
+
+// Tile size of the kernel, one 512-bit word per tile row
+#define TILE 16
+
+// Number of CUs in the xclbin, see mmult.cfg
+#define NUM_CU 4
+
+// Block size of the CPU implementation
+#define CPU_BLOCK 64
+
+typedef std::vector<int, aligned_allocator<int> > matrix_t;
+
+// A call of a CU: the block of C tiles [ti_begin, ti_end) x [tj_begin, tj_end)
+struct Job {
+    int ti_begin;
+    int ti_end;
+    int tj_begin;
+    int tj_end;
+};
+
+static int tile_count(int size) {
+    return (size + TILE - 1) / TILE;
+}
+
+// Copies a rows x cols row major matrix into TILE x TILE tiles, zero padded.
+// The tiles of a row of tiles come first, or the ones of a column of tiles
+// with by_columns, as the kernel reads B.
+static void pack(const int* src, int rows, int cols, bool by_columns, int* dst) {
+    int rt_count = tile_count(rows);
+    int ct_count = tile_count(cols);
+    for (int rt = 0; rt < rt_count; rt++) {
+        for (int ct = 0; ct < ct_count; ct++) {
+            size_t tile = by_columns ? (size_t)ct * rt_count + rt : (size_t)rt * ct_count + ct;
+            int* t = dst + tile * TILE * TILE;
+            for (int r = 0; r < TILE; r++) {
+                int row = rt * TILE + r;
+                for (int c = 0; c < TILE; c++) {
+                    int col = ct * TILE + c;
+                    t[r * TILE + c] = (row < rows && col < cols) ? src[(size_t)row * cols + col] : 0;
+                }
+            }
+        }
+    }
+}
+
+// Copies the tiles of C, a row of tiles first, back to a row major matrix
+static void unpack(const int* src, int rows, int cols, int* dst) {
+    int ct_count = tile_count(cols);
+    for (int row = 0; row < rows; row++) {
+        for (int col = 0; col < cols; col++) {
+            size_t tile = (size_t)(row / TILE) * ct_count + col / TILE;
+            dst[(size_t)row * cols + col] = src[(tile * TILE + row % TILE) * TILE + col % TILE];
+        }
+    }
+}
+
+// Splits C in blocks of up to block x block tiles, halving the blocks until
+// every CU has at least 4 of them so that the CUs finish together
+static std::vector<Job> schedule(int ti_count, int tj_count, int block, unsigned int num_cus) {
+    std::vector<Job> jobs;
+    for (block = std::max(block, 1);; block /= 2) {
+        jobs.clear();
+        for (int ti = 0; ti < ti_count; ti += block) {
+            for (int tj = 0; tj < tj_count; tj += block) {
+                jobs.push_back({ti, std::min(ti + block, ti_count), tj, std::min(tj + block, tj_count)});
+            }
+        }
+        if (block == 1 || jobs.size() >= 4 * num_cus) return jobs;
+    }
+}
+
+// Runs the jobs round robin on the CUs and waits for all of them. Job i runs
+// on CU i % krnls.size(), which writes it to the C buffer of its bank.
+static void run_jobs(cl::CommandQueue& q, std::vector<cl::Kernel>& krnls, const std::vector<Job>& jobs) {
+    cl_int err;
+    for (size_t i = 0; i < jobs.size(); i++) {
+        cl::Kernel& krnl = krnls[i % krnls.size()];
+        OCL_CHECK(err, err = krnl.setArg(5, jobs[i].ti_begin));
+        OCL_CHECK(err, err = krnl.setArg(6, jobs[i].ti_end));
+        OCL_CHECK(err, err = krnl.setArg(7, jobs[i].tj_begin));
+        OCL_CHECK(err, err = krnl.setArg(8, jobs[i].tj_end));
+        OCL_CHECK(err, err = q.enqueueTask(krnl));
+    }
+    OCL_CHECK(err, err = q.finish());
+}
+
+// Blocked multi-threaded reference C = A x B of n x n matrices. Each thread
+// computes a band of rows of C, CPU_BLOCK x CPU_BLOCK at a time so that the
+// blocks of A, B and C stay in the cache.
+static void cpu_gemm(const matrix_t& a, const matrix_t& b, matrix_t& c, int n, unsigned int threads) {
+    std::fill(c.begin(), c.end(), 0);
+    auto band = [&](int row_begin, int row_end) {
+        for (int i0 = row_begin; i0 < row_end; i0 += CPU_BLOCK) {
+            for (int k0 = 0; k0 < n; k0 += CPU_BLOCK) {
+                for (int j0 = 0; j0 < n; j0 += CPU_BLOCK) {
+                    for (int i = i0; i < std::min(i0 + CPU_BLOCK, row_end); i++) {
+                        for (int k = k0; k < std::min(k0 + CPU_BLOCK, n); k++) {
+                            int a_ik = a[(size_t)i * n + k];
+                            for (int j = j0; j < std::min(j0 + CPU_BLOCK, n); j++) {
+                                c[(size_t)i * n + j] += a_ik * b[(size_t)k * n + j];
+                            }
+                        }
+                    }
+                }
+            }
+        }
+    };
+
+    int rows = (n + threads - 1) / threads;
+    std::vector<std::thread> workers;
+    for (int row = 0; row < n; row += rows) {
+        workers.push_back(std::thread(band, row, std::min(row + rows, n)));
+    }
+    for (auto& worker : workers) {
+        worker.join();
+    }
+}
+
+// Compares the device result with the CPU one, or with a sample of dot
+// products computed here when the CPU implementation did not run
+static bool verify(const matrix_t& a, const matrix_t& b, const matrix_t& c, const matrix_t* gold, int n) {
+    size_t samples = gold ? (size_t)n * n : std::min((size_t)n * n, (size_t)1024);
+    for (size_t s = 0; s < samples; s++) {
+        size_t index = gold ? s : (size_t)rand() % ((size_t)n * n);
+        int expected = 0;
+        if (gold) {
+            expected = (*gold)[index];
+        } else {
+            size_t i = index / n, j = index % n;
+            for (int k = 0; k < n; k++) expected += a[i * n + k] * b[(size_t)k * n + j];
+        }
+        if (c[index] != expected) {
+            std::cout << "Error: Result mismatch" << std::endl;
+            std::cout << "i = " << index / n << " j = " << index % n << " CPU result = " << expected
+                      << " Device result = " << c[index] << std::endl;
+            return false;
+        }
+    }
+    return true;
+}
+
+static double elapsed_ms(std::chrono::high_resolution_clock::time_point start) {
+    return std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+}
+
+int main(int argc, char** argv) {
+    // Command Line Parser
+    sda::utils::CmdLineParser parser;
+    sda::utils::BandwidthBench bench("systolic_array_gemm");
+    bench.setUnit("GOP/s", 1000.0 * 1000 * 1000);
+    bench.options().min_size = 256;
+    bench.options().max_size = 8192;
+    bench.options().reps = 3;
+    bench.options().max_reps = 10;
+    if (xcl::is_emulation()) {
+        bench.options().min_size = 32;
+        bench.options().max_size = 64;
+        bench.options().reps = 1;
+        bench.options().max_reps = 3;
+        bench.options().warmup = 0;
+    }
+
+    // Switches
+    //**************//"<Full Arg>",  "<Short Arg>", "<Description>", "<Default>"
+    parser.addSwitch("--xclbin_file", "-x", "input binary file string", "");
+    parser.addSwitch("--block", "-bl", "largest block of C computed by one CU call, in elements", "512");
+    parser.addSwitch("--threads", "-th", "threads of the CPU implementation (0 = all cores)", "0");
+    parser.addSwitch("--no_cpu", "-nc", "skip the CPU implementation, check a sample of C instead", "", true);
+    bench.addSwitches(parser);
+    parser.parse(argc, argv);
+    bench.parse(parser);
+
+    // Read settings
+    std::string binaryFile = parser.value("xclbin_file");
+    int block = std::max(parser.value_to_int("block"), TILE) / TILE;
+    unsigned int threads = std::max(parser.value_to_int("threads"), 0);
+    if (threads == 0) threads = std::max(std::thread::hardware_concurrency(), 1u);
+    bool run_cpu = !parser.value_to_bool("no_cpu");
+
+    if (argc < 3) {
+        parser.printHelp();
+        return EXIT_FAILURE;
+    }
+
+    cl_int err;
+    cl::CommandQueue q;
+    cl::Context context;
+    std::vector<cl::Kernel> krnls(NUM_CU);
+
+    // OPENCL HOST CODE AREA START
+    auto devices = xcl::get_xil_devices();
+
+    // read_binary_file() is a utility API which will load the binaryFile
+    // and will return the pointer to file buffer.
+    auto fileBuf = xcl::read_binary_file(binaryFile);
+    cl::Program::Binaries bins{{fileBuf.data(), fileBuf.size()}};
+    bool valid_device = false;
+    for (unsigned int i = 0; i < devices.size(); i++) {
+        auto device = devices[i];
+        // Creating Context and Command Queue for selected Device
+        OCL_CHECK(err, context = cl::Context(device, nullptr, nullptr, nullptr, &err));
+        OCL_CHECK(err, q = cl::CommandQueue(context, device,
+                                            CL_QUEUE_OUT_OF_ORDER_EXEC_MODE_ENABLE | CL_QUEUE_PROFILING_ENABLE, &err));
+
+        std::cout << "Trying to program device[" << i << "]: " << device.getInfo<CL_DEVICE_NAME>() << std::endl;
+        cl::Program program(context, {device}, bins, nullptr, &err);
+        if (err != CL_SUCCESS) {
+            std::cout << "Failed to program device[" << i << "] with xclbin file!\n";
+        } else {
+            std::cout << "Device[" << i << "]: program successful!\n";
+            // One kernel object per CU, so that the jobs can be spread over them
+            for (int cu = 0; cu < NUM_CU; cu++) {
+                std::string krnl_name_full = "mmult_tiled:{mmult_tiled_" + std::to_string(cu + 1) + "}";
+                OCL_CHECK(err, krnls[cu] = cl::Kernel(program, krnl_name_full.c_str(), &err));
+            }
+            bench.setInfo("device", device.getInfo<CL_DEVICE_NAME>());
+            valid_device = true;
+            break; // we break because we found a valid device
+        }
+    }
+    if (!valid_device) {
+        std::cout << "Failed to program any device found, exit!\n";
+        exit(EXIT_FAILURE);
+    }
+
+    bench.setInfo("xclbin", binaryFile);
+    unsigned int num_cus = bench.cus(NUM_CU);
+    krnls.resize(num_cus);
+    std::string cus = "CU[0:" + std::to_string(num_cus - 1) + "]";
+
+    bool match = true;
+    for (uint64_t size : bench.sizes()) {
+        int n = size;
+        int t = tile_count(n);
+        size_t matrix_size = (size_t)n * n;
+        size_t tiled_size = (size_t)t * t * TILE * TILE;
+        double ops = 2.0 * n * n * n;
+
+        // Create the test data
+        matrix_t a(matrix_size), b(matrix_size), c(matrix_size);
+        for (size_t i = 0; i < matrix_size; i++) {
+            a[i] = rand() % 16 - 8;
+            b[i] = rand() % 16 - 8;
+        }
+
+        auto start = std::chrono::high_resolution_clock::now();
+        matrix_t a_tiles(tiled_size), b_tiles(tiled_size), c_tiles(tiled_size);
+        pack(a.data(), n, n, false, a_tiles.data());
+        pack(b.data(), n, n, true, b_tiles.data());
+        double pack_ms = elapsed_ms(start);
+
+        // Allocate Buffer in Global Memory. mmult.cfg and the conn_*.cfg
+        // files put each CU on its own banks, so every CU gets its own copy
+        // of A and B and its own C, placed in its banks by setArg before the
+        // first transfer.
+        size_t tiled_size_bytes = sizeof(int) * tiled_size;
+        std::vector<cl::Buffer> buffer_a(num_cus), buffer_b(num_cus), buffer_c(num_cus);
+        for (unsigned int cu = 0; cu < num_cus; cu++) {
+            OCL_CHECK(err, buffer_a[cu] = cl::Buffer(context, CL_MEM_READ_ONLY, tiled_size_bytes, nullptr, &err));
+            OCL_CHECK(err, buffer_b[cu] = cl::Buffer(context, CL_MEM_READ_ONLY, tiled_size_bytes, nullptr, &err));
+            OCL_CHECK(err, buffer_c[cu] = cl::Buffer(context, CL_MEM_WRITE_ONLY, tiled_size_bytes, nullptr, &err));
+            OCL_CHECK(err, err = krnls[cu].setArg(0, buffer_a[cu]));
+            OCL_CHECK(err, err = krnls[cu].setArg(1, buffer_b[cu]));
+            OCL_CHECK(err, err = krnls[cu].setArg(2, buffer_c[cu]));
+            OCL_CHECK(err, err = krnls[cu].setArg(3, t));
+            OCL_CHECK(err, err = krnls[cu].setArg(4, t));
+        }
+
+        // Copy input data to device global memory
+        start = std::chrono::high_resolution_clock::now();
+        for (unsigned int cu = 0; cu < num_cus; cu++) {
+            OCL_CHECK(err, err = q.enqueueWriteBuffer(buffer_a[cu], CL_FALSE, 0, tiled_size_bytes, a_tiles.data()));
+            OCL_CHECK(err, err = q.enqueueWriteBuffer(buffer_b[cu], CL_FALSE, 0, tiled_size_bytes, b_tiles.data()));
+        }
+        OCL_CHECK(err, err = q.finish());
+        double h2d_ms = elapsed_ms(start);
+
+        std::vector<Job> jobs = schedule(t, t, block, num_cus);
+        bench.run({"fpga", "gemm", cus, num_cus, size, ops}, [&] { run_jobs(q, krnls, jobs); });
+
+        // Copy Result from Device Global Memory to Host Local Memory, the
+        // rows of tiles of each job from the C of the CU that ran it
+        start = std::chrono::high_resolution_clock::now();
+        size_t tile_bytes = sizeof(int) * TILE * TILE;
+        for (size_t i = 0; i < jobs.size(); i++) {
+            const Job& job = jobs[i];
+            for (int ti = job.ti_begin; ti < job.ti_end; ti++) {
+                size_t first = (size_t)ti * t + job.tj_begin;
+                OCL_CHECK(err, err = q.enqueueReadBuffer(buffer_c[i % num_cus], CL_FALSE, first * tile_bytes,
+                                                         (job.tj_end - job.tj_begin) * tile_bytes,
+                                                         c_tiles.data() + first * TILE * TILE));
+            }
+        }
+        OCL_CHECK(err, err = q.finish());
+        unpack(c_tiles.data(), n, n, c.data());
+        double d2h_ms = elapsed_ms(start);
+        std::cout << "Size " << n << ": " << jobs.size() << " jobs, tiling " << pack_ms << " ms, to device " << h2d_ms
+                  << " ms, back and untiling " << d2h_ms << " ms" << std::endl;
+
+        matrix_t gold;
+        if (run_cpu) {
+            gold.resize(matrix_size);
+            std::string cores = "threads_" + std::to_string(threads);
+            bench.run({"cpu", "gemm", cores, threads, size, ops}, [&] { cpu_gemm(a, b, gold, n, threads); });
+        }
+        if (!verify(a, b, c, run_cpu ? &gold : nullptr, n)) {
+            match = false;
+            break;
+        }
+    }
+    // OPENCL HOST CODE AREA END
+
+    if (!bench.write() || !bench.check()) match = false;
+    std::cout << "TEST " << (match ? "PASSED" : "FAILED") << std::endl;
+    return (match ? EXIT_SUCCESS : EXIT_FAILURE);
+}
@@ -0,0 +1,234 @@
+/**
+* Copyright (C) 2019-2021 Xilinx, Inc
+*
+* Licensed under the Apache License, Version 2.0 (the "License"). You may
+* not use this file except in compliance with the License. A copy of the
+* License is located at
+*
+*     http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+* WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the
+* License for the specific language governing permissions and limitations
+* under the License.
+*/
+
+/*
+
+Kernel Description :
+
+    Tiled version of the systolic array matrix multiplication of
+    cpp_kernels/systolic_array. The host packs the matrices in tiles of
+    TILE x TILE integers, so that one row of a tile is one 512-bit word and
+    every tile is contiguous in global memory:
+
+        A : tiles of a row of tiles first, A(ti, kt) at (ti * kt_count + kt)
+        B : tiles of a column of tiles first, B(kt, tj) at (tj * kt_count + kt)
+        C : tiles of a row of tiles first, C(ti, tj) at (ti * tj_count + tj)
+
+    Each call computes the block of C tiles [ti_begin, ti_end) x
+    [tj_begin, tj_end). For every C tile, the TILE x TILE systolic array
+    accumulates the products of the kt_count A and B tiles along K.
+
+    Arguments :
+
+        tile_row_t *a        (input )  --> Tiles of Matrix A
+        tile_row_t *b        (input )  --> Tiles of Matrix B
+        tile_row_t *c        (output)  --> Tiles of Output Matrix
+        int  kt_count        (input )  --> Number of tiles along K
+        int  tj_count        (input )  --> Number of tile columns of C
+        int  ti_begin/ti_end (input )  --> Tile rows of C to compute
+        int  tj_begin/tj_end (input )  --> Tile columns of C to compute
+
+    Kernel Configuration :
+
+        Tile Size   --> 16 (one 512-bit word per tile row)
+*/
+
+#include <ap_int.h>
+#include <hls_stream.h>
+
+#define TILE 16
+#define DATAWIDTH 512
+#define DATATYPE_SIZE 32
+
+// One row of a tile
+typedef ap_uint<DATAWIDTH> tile_row_t;
+
+// TRIPCOUNT identifiers
+const unsigned int c_tiles = 64;
+const unsigned int c_k = 64 * TILE;
+
+// Streams the rows of the A tiles in the order the systolic array uses them.
+// The row of tiles of A is read again for every tile of C.
+static void read_a(const tile_row_t* a,
+                   hls::stream<tile_row_t>& aStream,
+                   int kt_count,
+                   int ti_begin,
+                   int ti_end,
+                   int tj_begin,
+                   int tj_end) {
+read_a_rows:
+    for (int ti = ti_begin; ti < ti_end; ti++) {
+#pragma HLS LOOP_TRIPCOUNT min = c_tiles max = c_tiles
+    read_a_tiles:
+        for (int tj = tj_begin; tj < tj_end; tj++) {
+#pragma HLS LOOP_TRIPCOUNT min = c_tiles max = c_tiles
+        read_a_words:
+            for (int w = 0; w < kt_count * TILE; w++) {
+#pragma HLS LOOP_TRIPCOUNT min = c_k max = c_k
+#pragma HLS PIPELINE II = 1
+                aStream << a[ti * kt_count * TILE + w];
+            }
+        }
+    }
+}
+
+// Streams the rows of the B tiles, a column of tiles for every tile of C
+static void read_b(const tile_row_t* b,
+                   hls::stream<tile_row_t>& bStream,
+                   int kt_count,
+                   int ti_begin,
+                   int ti_end,
+                   int tj_begin,
+                   int tj_end) {
+read_b_rows:
+    for (int ti = ti_begin; ti < ti_end; ti++) {
+#pragma HLS LOOP_TRIPCOUNT min = c_tiles max = c_tiles
+    read_b_tiles:
+        for (int tj = tj_begin; tj < tj_end; tj++) {
+#pragma HLS LOOP_TRIPCOUNT min = c_tiles max = c_tiles
+        read_b_words:
+            for (int w = 0; w < kt_count * TILE; w++) {
+#pragma HLS LOOP_TRIPCOUNT min = c_k max = c_k
+#pragma HLS PIPELINE II = 1
+                bStream << b[tj * kt_count * TILE + w];
+            }
+        }
+    }
+}
+
+// Multiplies the tiles of A and B of every C tile on the systolic array
+//
+// Step k of a tile needs column k of the A tile and row k of the B tile. Row
+// k of the B tile is the k-th word of its stream, used as it arrives. The A
+// tile is needed whole, so localA holds two of them: the rows of the next A
+// tile are loaded, one per step, while the current one is multiplied.
+static void systolic(hls::stream<tile_row_t>& aStream,
+                     hls::stream<tile_row_t>& bStream,
+                     hls::stream<tile_row_t>& cStream,
+                     int kt_count,
+                     int ti_begin,
+                     int ti_end,
+                     int tj_begin,
+                     int tj_end) {
+    int tiles = (ti_end - ti_begin) * (tj_end - tj_begin);
+
+    tile_row_t localA[2][TILE];
+#pragma HLS ARRAY_PARTITION variable = localA dim = 0 complete
+
+    int localC[TILE][TILE];
+#pragma HLS ARRAY_PARTITION variable = localC dim = 0 complete
+
+systolic_tiles:
+    for (int t = 0; t < tiles; t++) {
+#pragma HLS LOOP_TRIPCOUNT min = c_tiles * c_tiles max = c_tiles * c_tiles
+    load_first_a:
+        for (int r = 0; r < TILE; r++) {
+#pragma HLS PIPELINE II = 1
+            localA[0][r] = aStream.read();
+        }
+
+    systolic1:
+        for (int step = 0; step < kt_count * TILE; step++) {
+#pragma HLS LOOP_TRIPCOUNT min = c_k max = c_k
+#pragma HLS PIPELINE II = 1
+            int cur = (step / TILE) % 2;
+            int k = step % TILE;
+            if (step + TILE < kt_count * TILE) localA[1 - cur][k] = aStream.read();
+            tile_row_t b_row = bStream.read();
+
+        systolic2:
+            for (int i = 0; i < TILE; i++) {
+#pragma HLS UNROLL
+            systolic3:
+                for (int j = 0; j < TILE; j++) {
+#pragma HLS UNROLL
+                    // Get previous sum
+                    int last = (step == 0) ? 0 : localC[i][j];
+
+                    // Update current sum
+                    int a_val = localA[cur][i].range(DATATYPE_SIZE * (k + 1) - 1, DATATYPE_SIZE * k);
+                    int b_val = b_row.range(DATATYPE_SIZE * (j + 1) - 1, DATATYPE_SIZE * j);
+                    localC[i][j] = last + a_val * b_val;
+                }
+            }
+        }
+
+    writeC:
+        for (int i = 0; i < TILE; i++) {
+#pragma HLS PIPELINE II = 1
+            tile_row_t c_row;
+            for (int j = 0; j < TILE; j++) {
+#pragma HLS UNROLL
+                c_row.range(DATATYPE_SIZE * (j + 1) - 1, DATATYPE_SIZE * j) = localC[i][j];
+            }
+            cStream << c_row;
+        }
+    }
+}
+
+// Writes the C tiles back, each one contiguous
+static void write_c(tile_row_t* c,
+                    hls::stream<tile_row_t>& cStream,
+                    int tj_count,
+                    int ti_begin,
+                    int ti_end,
+                    int tj_begin,
+                    int tj_end) {
+write_c_rows:
+    for (int ti = ti_begin; ti < ti_end; ti++) {
+#pragma HLS LOOP_TRIPCOUNT min = c_tiles max = c_tiles
+    write_c_tiles:
+        for (int tj = tj_begin; tj < tj_end; tj++) {
+#pragma HLS LOOP_TRIPCOUNT min = c_tiles max = c_tiles
+        write_c_words:
+            for (int r = 0; r < TILE; r++) {
+#pragma HLS PIPELINE II = 1
+                c[(ti * tj_count + tj) * TILE + r] = cStream.read();
+            }
+        }
+    }
+}
+
+extern "C" {
+void mmult_tiled(const tile_row_t* a, // Read-Only Tiles of Matrix A
+                 const tile_row_t* b, // Read-Only Tiles of Matrix B
+                 tile_row_t* c,       // Output Tiles
+                 int kt_count,        // Tiles along K
+                 int tj_count,        // Tile columns of C
+                 int ti_begin,        // First tile row of the block
+                 int ti_end,          // Last tile row of the block, excluded
+                 int tj_begin,        // First tile column of the block
+                 int tj_end           // Last tile column of the block, excluded
+                 ) {
+#pragma HLS INTERFACE m_axi port = a offset = slave bundle = gmem0 max_read_burst_length = 64
+#pragma HLS INTERFACE m_axi port = b offset = slave bundle = gmem1 max_read_burst_length = 64
+#pragma HLS INTERFACE m_axi port = c offset = slave bundle = gmem2 max_write_burst_length = 16
+
+    // Two tiles deep, so that the readers run one tile ahead of the array
+    static hls::stream<tile_row_t> aStream("a_stream");
+    static hls::stream<tile_row_t> bStream("b_stream");
+    static hls::stream<tile_row_t> cStream("c_stream");
+#pragma HLS STREAM variable = aStream depth = 32
+#pragma HLS STREAM variable = bStream depth = 32
+#pragma HLS STREAM variable = cStream depth = 32
+
+#pragma HLS dataflow
+    read_a(a, aStream, kt_count, ti_begin, ti_end, tj_begin, tj_end);
+    read_b(b, bStream, kt_count, ti_begin, ti_end, tj_begin, tj_end);
+    systolic(aStream, bStream, cStream, kt_count, ti_begin, ti_end, tj_begin, tj_end);
+    write_c(c, cStream, tj_count, ti_begin, ti_end, tj_begin, tj_end);
+}
+}
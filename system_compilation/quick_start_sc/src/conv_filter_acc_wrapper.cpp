@@ -15,7 +15,11 @@
 */
 
 #include "conv_filter_acc_wrapper.hpp"
+#include <chrono>
+#include <condition_variable>
 #include <cstring>
+#include <mutex>
+#include <vector>
 
 int conv_filter_execute_fpga(const char coeffs[FILTER_V_SIZE][FILTER_H_SIZE],
                              float factor,
@@ -43,7 +47,7 @@ int conv_filter_execute_fpga(const char coeffs[FILTER_V_SIZE][FILTER_H_SIZE],
         for (int ch = 0; ch < 3; ch++) {
             std::memcpy(srcBuf + ch * dataSizePerChannel, srcChannel[ch], dataSizePerChannel);
         }
-        std::memcpy(coeffsBuf, coeffs, 256);
+        std::memcpy(coeffsBuf, coeffs, FILTER_V_SIZE * FILTER_H_SIZE);
         // execute conv_acc<NCU> parallel computes
         for (int ch = 0; ch < 3; ch++) {
             conv_acc::compute(coeffsBuf, factor, bias, width, height, srcBuf + ch * dataSizePerChannel,
@@ -66,3 +70,70 @@ int conv_filter_execute_fpga(const char coeffs[FILTER_V_SIZE][FILTER_H_SIZE],
 
     return 0;
 }
+
+int conv_filter_stream_fpga(const char coeffs[FILTER_V_SIZE][FILTER_H_SIZE],
+                            float factor,
+                            short bias,
+                            unsigned short width,
+                            unsigned short height,
+                            unsigned int numFrames,
+                            unsigned int maxInFlight,
+                            const unsigned char* srcFrames,
+                            unsigned char* dstFrames,
+                            double* latency) {
+    auto srcBufPool = conv_acc::create_bufpool(vpp::input);
+    auto dstBufPool = conv_acc::create_bufpool(vpp::output);
+    auto coeffsBufPool = conv_acc::create_bufpool(vpp::input);
+
+    int dataSizePerChannel = width * height;
+    size_t frameSize = 3 * (size_t)dataSizePerChannel;
+    std::vector<std::chrono::high_resolution_clock::time_point> sent(numFrames);
+
+    // frames sent and not received yet
+    std::mutex inFlightMutex;
+    std::condition_variable inFlightDone;
+    unsigned int inFlight = 0;
+
+    unsigned int frame = 0;
+    // sending input, as long as less than maxInFlight frames are in the pool
+    conv_acc::send_while([&]() -> bool {
+        {
+            std::unique_lock<std::mutex> lock(inFlightMutex);
+            inFlightDone.wait(lock, [&] { return inFlight < maxInFlight; });
+            inFlight++;
+        }
+        sent[frame] = std::chrono::high_resolution_clock::now();
+        conv_acc::set_handle(frame);
+        unsigned char* srcBuf = (unsigned char*)conv_acc::alloc_buf(srcBufPool, frameSize);
+        unsigned char* dstBuf = (unsigned char*)conv_acc::alloc_buf(dstBufPool, frameSize);
+        char* coeffsBuf = (char*)conv_acc::alloc_buf(coeffsBufPool, FILTER_V_SIZE * FILTER_H_SIZE);
+
+        std::memcpy(srcBuf, srcFrames + frame * frameSize, frameSize);
+        std::memcpy(coeffsBuf, coeffs, FILTER_V_SIZE * FILTER_H_SIZE);
+        // execute conv_acc<NCU> parallel computes
+        for (int ch = 0; ch < 3; ch++) {
+            conv_acc::compute(coeffsBuf, factor, bias, width, height, srcBuf + ch * dataSizePerChannel,
+                              dstBuf + ch * dataSizePerChannel);
+        }
+        return (++frame < numFrames);
+    });
+
+    // receive lambda function for receive thread, called for each frame as
+    // soon as its three computes are done, whatever frames were sent before
+    conv_acc::receive_all_out_of_order([&]() {
+        unsigned int frame = conv_acc::get_handle();
+        unsigned char* dstBuf = (unsigned char*)conv_acc::get_buf(dstBufPool);
+        std::memcpy(dstFrames + frame * frameSize, dstBuf, frameSize);
+        std::chrono::duration<double> duration = std::chrono::high_resolution_clock::now() - sent[frame];
+        latency[frame] = duration.count();
+        {
+            std::lock_guard<std::mutex> lock(inFlightMutex);
+            inFlight--;
+        }
+        inFlightDone.notify_one();
+    });
+    // wait for both loops to finish
+    conv_acc::join();
+
+    return 0;
+}
@@ -25,3 +25,19 @@ int conv_filter_execute_fpga(const char coeffs[FILTER_V_SIZE][FILTER_H_SIZE],
                              unsigned int numImages,
                              YUVImage srcImage,
                              YUVImage dstImage);
+
+// Streams numFrames frames, each the Y, U and V channels of width x height
+// pixels one after the other, from srcFrames to dstFrames. Up to maxInFlight
+// frames are sent ahead of the ones received, which are received as the
+// compute units complete them, in any order. latency[i] gets the seconds
+// from sending frame i to receiving it.
+int conv_filter_stream_fpga(const char coeffs[FILTER_V_SIZE][FILTER_H_SIZE],
+                            float factor,
+                            short bias,
+                            unsigned short width,
+                            unsigned short height,
+                            unsigned int numFrames,
+                            unsigned int maxInFlight,
+                            const unsigned char* srcFrames,
+                            unsigned char* dstFrames,
+                            double* latency);
@@ -14,7 +14,172 @@
 * under the License.
 */
 
-#include "common.h"
+#include "conv_filter_cpu.hpp"
+#include <algorithm>
+#include <thread>
+#include <vector>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define FILTER2D_X86
+#endif
+
+// Rows above and below, and columns to the left and right, of the pixel
+static const int V_HALF = FILTER_V_SIZE / 2;
+static const int H_HALF = FILTER_H_SIZE / 2;
+
+static bool has_avx2() {
+#ifdef FILTER2D_X86
+    static const bool avx2 = __builtin_cpu_supports("avx2");
+    return avx2;
+#else
+    return false;
+#endif
+}
+
+// Normalize and saturate a sum
+static inline unsigned char normalize(int sum, float factor, short bias) {
+    return MIN(MAX((int(factor * sum) + bias), 0), 255);
+}
+
+// One pixel, with the pixels out of the image as zeros
+static unsigned char filter_pixel(const char coeffs[FILTER_V_SIZE][FILTER_H_SIZE],
+                                  float factor,
+                                  short bias,
+                                  int width,
+                                  int height,
+                                  const unsigned char* src,
+                                  int x,
+                                  int y) {
+    int sum = 0;
+    for (int row = 0; row < FILTER_V_SIZE; row++) {
+        int yoffset = y + row - V_HALF;
+        if (yoffset < 0 || yoffset >= height) continue;
+        for (int col = 0; col < FILTER_H_SIZE; col++) {
+            int xoffset = x + col - H_HALF;
+            if (xoffset < 0 || xoffset >= width) continue;
+            sum += src[yoffset * width + xoffset] * coeffs[row][col];
+        }
+    }
+    return normalize(sum, factor, bias);
+}
+
+// The pixels [first, width - H_HALF) of a row at least V_HALF rows from the
+// top and bottom, one coefficient times a row at a time so that the compiler
+// vectorizes the inner loop
+static void interior_row(const char coeffs[FILTER_V_SIZE][FILTER_H_SIZE],
+                         float factor,
+                         short bias,
+                         int width,
+                         const unsigned char* src,
+                         unsigned char* dst,
+                         int y,
+                         int first,
+                         int* sum) {
+    int last = width - H_HALF;
+    for (int x = first; x < last; x++) sum[x] = 0;
+    for (int row = 0; row < FILTER_V_SIZE; row++) {
+        const unsigned char* line = src + (y + row - V_HALF) * width;
+        for (int col = 0; col < FILTER_H_SIZE; col++) {
+            int c = coeffs[row][col];
+            if (c == 0) continue;
+            const unsigned char* pixels = line + col;
+            for (int x = first; x < last; x++) sum[x] += c * pixels[x - H_HALF];
+        }
+    }
+    unsigned char* out = dst + y * width;
+    for (int x = first; x < last; x++) out[x] = normalize(sum[x], factor, bias);
+}
+
+#ifdef FILTER2D_X86
+// The pixels of a row at least V_HALF rows from the top and bottom, 16 at a
+// time from H_HALF on. The pixels next to each other are widened to 16 bits
+// and interleaved, so that madd multiplies them by a pair of coefficients
+// and adds the two products in 32 bits. Returns the first pixel left.
+__attribute__((target("avx2"))) static int interior_row_avx2(const char coeffs[FILTER_V_SIZE][FILTER_H_SIZE],
+                                                             float factor,
+                                                             short bias,
+                                                             int width,
+                                                             const unsigned char* src,
+                                                             unsigned char* dst,
+                                                             int y) {
+    const int PAIRS = (FILTER_H_SIZE + 1) / 2;
+    __m256i pairs[FILTER_V_SIZE][PAIRS];
+    bool used[FILTER_V_SIZE][PAIRS];
+    for (int row = 0; row < FILTER_V_SIZE; row++) {
+        for (int p = 0; p < PAIRS; p++) {
+            int c0 = coeffs[row][2 * p];
+            int c1 = (2 * p + 1 < FILTER_H_SIZE) ? coeffs[row][2 * p + 1] : 0;
+            pairs[row][p] = _mm256_set1_epi32((unsigned short)c0 | ((unsigned int)(unsigned short)c1 << 16));
+            used[row][p] = (c0 != 0 || c1 != 0);
+        }
+    }
+    const __m256 vfactor = _mm256_set1_ps(factor);
+    const __m256i vbias = _mm256_set1_epi32(bias);
+
+    int x = H_HALF;
+    for (; x + 16 <= width - H_HALF; x += 16) {
+        // Pixels 0-3 and 8-11 in lo, 4-7 and 12-15 in hi, as unpack works
+        // on each 128-bit half
+        __m256i lo = _mm256_setzero_si256();
+        __m256i hi = _mm256_setzero_si256();
+        for (int row = 0; row < FILTER_V_SIZE; row++) {
+            const unsigned char* line = src + (y + row - V_HALF) * width + x - H_HALF;
+            for (int p = 0; p < PAIRS; p++) {
+                if (!used[row][p]) continue;
+                int col = 2 * p;
+                __m256i a = _mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i*)(line + col)));
+                __m256i b = (col + 1 < FILTER_H_SIZE)
+                                ? _mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i*)(line + col + 1)))
+                                : _mm256_setzero_si256();
+                lo = _mm256_add_epi32(lo, _mm256_madd_epi16(_mm256_unpacklo_epi16(a, b), pairs[row][p]));
+                hi = _mm256_add_epi32(hi, _mm256_madd_epi16(_mm256_unpackhi_epi16(a, b), pairs[row][p]));
+            }
+        }
+        // int(factor * sum) + bias, then saturated to 16 and 8 bits, which
+        // also puts the pixels back in order in each half
+        lo = _mm256_add_epi32(_mm256_cvttps_epi32(_mm256_mul_ps(_mm256_cvtepi32_ps(lo), vfactor)), vbias);
+        hi = _mm256_add_epi32(_mm256_cvttps_epi32(_mm256_mul_ps(_mm256_cvtepi32_ps(hi), vfactor)), vbias);
+        __m256i words = _mm256_packs_epi32(lo, hi);
+        __m256i bytes = _mm256_permute4x64_epi64(_mm256_packus_epi16(words, words), 0x08);
+        _mm_storeu_si128((__m128i*)(dst + y * width + x), _mm256_castsi256_si128(bytes));
+    }
+    return x;
+}
+#endif
+
+// The rows [first, last) of a plane
+static void filter_rows(const char coeffs[FILTER_V_SIZE][FILTER_H_SIZE],
+                        float factor,
+                        short bias,
+                        int width,
+                        int height,
+                        const unsigned char* src,
+                        unsigned char* dst,
+                        int first,
+                        int last) {
+    std::vector<int> sum(width);
+    bool avx2 = has_avx2();
+    for (int y = first; y < last; y++) {
+        if (y < V_HALF || y >= height - V_HALF || width <= 2 * H_HALF) {
+            for (int x = 0; x < width; x++) {
+                dst[y * width + x] = filter_pixel(coeffs, factor, bias, width, height, src, x, y);
+            }
+            continue;
+        }
+        for (int x = 0; x < H_HALF; x++) {
+            dst[y * width + x] = filter_pixel(coeffs, factor, bias, width, height, src, x, y);
+        }
+        int x = H_HALF;
+#ifdef FILTER2D_X86
+        if (avx2) x = interior_row_avx2(coeffs, factor, bias, width, src, dst, y);
+#endif
+        interior_row(coeffs, factor, bias, width, src, dst, y, x, sum.data());
+        for (x = width - H_HALF; x < width; x++) {
+            dst[y * width + x] = filter_pixel(coeffs, factor, bias, width, height, src, x, y);
+        }
+    }
+}
 
 void Filter2D(const char coeffs[FILTER_V_SIZE][FILTER_H_SIZE],
               float factor,
@@ -23,30 +188,43 @@ void Filter2D(const char coeffs[FILTER_V_SIZE][FILTER_H_SIZE],
               unsigned short height,
               unsigned char* src,
               unsigned char* dst) {
-    for (int y = 0; y < height; ++y) {
-        for (int x = 0; x < width; ++x) {
-            // Apply 2D filter to the pixel window
-            int sum = 0;
-            for (int row = 0; row < FILTER_V_SIZE; row++) {
-                for (int col = 0; col < FILTER_H_SIZE; col++) {
-                    unsigned char pixel;
-                    int xoffset = (x + col - (FILTER_H_SIZE / 2));
-                    int yoffset = (y + row - (FILTER_V_SIZE / 2));
-                    // Deal with boundary conditions : clamp pixels to 0 when outside of image
-                    if ((xoffset < 0) || (xoffset >= width) || (yoffset < 0) || (yoffset >= height)) {
-                        pixel = 0;
-                    } else {
-                        pixel = src[yoffset * width + xoffset];
-                    }
-                    sum += pixel * coeffs[row][col];
-                }
-            }
+    filter_rows(coeffs, factor, bias, width, height, src, dst, 0, height);
+}
 
-            // Normalize and saturate result
-            unsigned char outpix = MIN(MAX((int(factor * sum) + bias), 0), 255);
+void Filter2DYUV(const char coeffs[FILTER_V_SIZE][FILTER_H_SIZE],
+                 float factor,
+                 short bias,
+                 unsigned short width,
+                 unsigned short height,
+                 YUVImage src,
+                 YUVImage dst,
+                 unsigned int threads) {
+    if (threads == 0) threads = std::max(std::thread::hardware_concurrency(), 1u);
+    unsigned char* srcPlanes[3] = {src.yChannel, src.uChannel, src.vChannel};
+    unsigned char* dstPlanes[3] = {dst.yChannel, dst.uChannel, dst.vChannel};
 
-            // Write output
-            dst[y * width + x] = outpix;
+    // The planes one after the other, as 3 x height rows split evenly, so
+    // that a band ending in a plane goes on in the next one
+    int total = 3 * height;
+    if (total == 0) return;
+    int rows = (total + threads - 1) / threads;
+    auto band = [&](int first, int last) {
+        for (int plane = first / height; plane < 3 && plane * height < last; plane++) {
+            int begin = std::max(first - plane * height, 0);
+            int end = std::min(last - plane * height, (int)height);
+            filter_rows(coeffs, factor, bias, width, height, srcPlanes[plane], dstPlanes[plane], begin, end);
         }
+    };
+    std::vector<std::thread> workers;
+    for (int first = rows; first < total; first += rows) {
+        workers.push_back(std::thread(band, first, std::min(first + rows, total)));
+    }
+    band(0, std::min(rows, total));
+    for (auto& worker : workers) {
+        worker.join();
     }
 }
+
+const char* Filter2DInstructionSet() {
+    return has_avx2() ? "AVX2" : "scalar";
+}
@@ -15,6 +15,11 @@
 */
 
 #pragma once
+#include "common.h"
+
+// Filters a plane of the image, with the pixels out of it as zeros: a
+// checked loop for the border of FILTER_V_SIZE / 2 rows and FILTER_H_SIZE / 2
+// columns, and 16 pixels at a time with AVX2 inside it when the CPU has it.
 void Filter2D(const char coeffs[FILTER_V_SIZE][FILTER_H_SIZE],
               float factor,
               short bias,
@@ -22,3 +27,17 @@ void Filter2D(const char coeffs[FILTER_V_SIZE][FILTER_H_SIZE],
               unsigned short height,
               unsigned char* src,
               unsigned char* dst);
+
+// Filters the Y, U and V planes of the image, split in bands of rows over
+// threads (0 = all cores)
+void Filter2DYUV(const char coeffs[FILTER_V_SIZE][FILTER_H_SIZE],
+                 float factor,
+                 short bias,
+                 unsigned short width,
+                 unsigned short height,
+                 YUVImage src,
+                 YUVImage dst,
+                 unsigned int threads);
+
+// Instruction set of the filter loop on this CPU, "AVX2" or "scalar"
+const char* Filter2DInstructionSet();
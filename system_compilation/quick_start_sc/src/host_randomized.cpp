@@ -18,10 +18,18 @@
 #include <malloc.h>
 #include <stdlib.h>
 #include <string.h>
+#include <errno.h>
 #include <math.h>
 #include <iostream>
 #include <vector>
+#include <algorithm>
+#include <string>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
 #include <chrono>
+#include <thread>
 #include "conv_filter_acc_wrapper.hpp"
 #include "cmdlineparser.h"
 #include "conv_filter_cpu.hpp"
@@ -33,6 +41,160 @@
 #define RED "\033[31m"
 #define GREEN "\033[32m"
 
+// Latency under which p percent of the frames are, of the sorted latencies
+static double percentile(const std::vector<double>& sorted, double p) {
+    size_t rank = (size_t)ceil(p / 100 * sorted.size());
+    return sorted[rank > 0 ? rank - 1 : 0];
+}
+
+// Streams the frames of a raw YUV 4:4:4 planar file (yuv444p), memory-mapped,
+// through the compute units, then checks them against the CPU version
+static int run_stream(const std::string& inputFile,
+                      const std::string& outputFile,
+                      unsigned int filterType,
+                      unsigned int width,
+                      unsigned int height,
+                      unsigned int maxInFlight,
+                      unsigned int numThreads,
+                      bool comparePerf) {
+    size_t nbytes = width * height;
+    size_t frameSize = 3 * nbytes;
+
+    int inFd = open(inputFile.c_str(), O_RDONLY);
+    struct stat inStat;
+    if (inFd < 0 || fstat(inFd, &inStat) != 0) {
+        printf("ERROR: Cannot open %s: %s\n", inputFile.c_str(), strerror(errno));
+        if (inFd >= 0) close(inFd);
+        return -1;
+    }
+    unsigned int numFrames = inStat.st_size / frameSize;
+    if (numFrames == 0) {
+        printf("ERROR: %s is smaller than a %dx%d YUV frame\n", inputFile.c_str(), width, height);
+        close(inFd);
+        return -1;
+    }
+    if (inStat.st_size % frameSize) {
+        printf("WARNING: Ignoring the last %zu bytes of %s, less than a frame\n", (size_t)(inStat.st_size % frameSize),
+               inputFile.c_str());
+    }
+    size_t length = numFrames * frameSize;
+    unsigned char* srcFrames = (unsigned char*)mmap(nullptr, length, PROT_READ, MAP_SHARED, inFd, 0);
+    if (srcFrames == MAP_FAILED) {
+        printf("ERROR: Cannot map %s\n", inputFile.c_str());
+        close(inFd);
+        return -1;
+    }
+    madvise(srcFrames, length, MADV_SEQUENTIAL);
+
+    // The filtered frames go to the output file if any, else to anonymous
+    // memory
+    int outFd = -1;
+    unsigned char* dstFrames;
+    if (!outputFile.empty()) {
+        outFd = open(outputFile.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+        if (outFd < 0 || ftruncate(outFd, length) != 0) {
+            printf("ERROR: Cannot create %s: %s\n", outputFile.c_str(), strerror(errno));
+            if (outFd >= 0) close(outFd);
+            munmap(srcFrames, length);
+            close(inFd);
+            return -1;
+        }
+        dstFrames = (unsigned char*)mmap(nullptr, length, PROT_READ | PROT_WRITE, MAP_SHARED, outFd, 0);
+    } else {
+        dstFrames = (unsigned char*)mmap(nullptr, length, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    }
+    if (dstFrames == MAP_FAILED) {
+        printf("ERROR: Cannot map %zu bytes for the output frames: %s\n", length, strerror(errno));
+        if (outFd >= 0) close(outFd);
+        munmap(srcFrames, length);
+        close(inFd);
+        return -1;
+    }
+
+    printf("Input file        : %s\n", inputFile.c_str());
+    printf("Output file       : %s\n", outputFile.empty() ? "none" : outputFile.c_str());
+    printf("Number of frames  : %d\n", numFrames);
+    printf("Frames in flight  : %d\n", maxInFlight);
+    printf("Image width       : %d\n", width);
+    printf("Image height      : %d\n", height);
+    printf("Filter type       : %d\n", filterType);
+    printf("Compare perf.     : %d\n", comparePerf);
+    printf("CPU threads       : %d\n", numThreads);
+    printf("CPU instructions  : %s\n", Filter2DInstructionSet());
+    printf("\n");
+
+    float factor = filterFactors[filterType];
+    short bias = filterBiases[filterType];
+
+    printf("Streaming %d frames through the FPGA accelerator\n", numFrames);
+    std::vector<double> latency(numFrames);
+    auto fpga_begin = std::chrono::high_resolution_clock::now();
+
+    conv_filter_stream_fpga(filterCoeffs[filterType], factor, bias, width, height, numFrames, maxInFlight, srcFrames,
+                            dstFrames, latency.data());
+
+    auto fpga_end = std::chrono::high_resolution_clock::now();
+
+    // Compute reference results frame by frame and compare, timing the CPU
+    // version alone
+    printf("Comparing results\n");
+    std::vector<unsigned char> ref(frameSize);
+    YUVImage refImage = {ref.data(), ref.data() + nbytes, ref.data() + 2 * nbytes};
+    std::chrono::duration<double> cpu_duration(0);
+    bool diff = false;
+    for (unsigned int f = 0; f < numFrames && !diff; f++) {
+        unsigned char* src = srcFrames + f * frameSize;
+        unsigned char* dst = dstFrames + f * frameSize;
+        YUVImage srcImage = {src, src + nbytes, src + 2 * nbytes};
+        auto cpu_begin = std::chrono::high_resolution_clock::now();
+        Filter2DYUV(filterCoeffs[filterType], factor, bias, width, height, srcImage, refImage, numThreads);
+        cpu_duration += std::chrono::high_resolution_clock::now() - cpu_begin;
+        for (size_t i = 0; i < frameSize; i++) {
+            if (dst[i] != ref[i]) {
+                printf("first diff in frame %d on pixel (%zu,%zu) of channel %c\n", f, i % nbytes % width,
+                       i % nbytes / width, "YUV"[i / nbytes]);
+                printf("expected: %3d\n", ref[i]);
+                printf("got:      %3d\n", dst[i]);
+                diff = true;
+                break;
+            }
+        }
+    }
+
+    if (diff) {
+        printf("\n%sTest FAILED: Output has mismatches with reference%s\n", RED, RESET);
+    } else {
+        printf("\n%sTest PASSED: Output matches reference%s\n", GREEN, RESET);
+    }
+
+    // Report performance (if not running in emulation mode)
+    if (getenv("XCL_EMULATION_MODE") == NULL) {
+        std::chrono::duration<double> fpga_duration = fpga_end - fpga_begin;
+        std::sort(latency.begin(), latency.end());
+        printf("\n");
+        printf("FPGA Time         : %10.4f s\n", fpga_duration.count());
+        printf("FPGA Frames/s     : %10.4f\n", numFrames / fpga_duration.count());
+        printf("FPGA Throughput   : %10.4f MB/s\n", length / fpga_duration.count() / (1024.0 * 1024.0));
+        printf("Latency p50       : %10.4f ms\n", 1000 * percentile(latency, 50));
+        printf("Latency p90       : %10.4f ms\n", 1000 * percentile(latency, 90));
+        printf("Latency p99       : %10.4f ms\n", 1000 * percentile(latency, 99));
+        printf("Latency max       : %10.4f ms\n", 1000 * latency.back());
+        if (comparePerf) {
+            printf("CPU  Time         : %10.4f s\n", cpu_duration.count());
+            printf("CPU  Frames/s     : %10.4f\n", numFrames / cpu_duration.count());
+            printf("FPGA Speedup      : %10.4f x\n", cpu_duration.count() / fpga_duration.count());
+        }
+    }
+
+    printf("----------------------------------------------------------------------------\n");
+
+    munmap(dstFrames, length);
+    munmap(srcFrames, length);
+    if (outFd >= 0) close(outFd);
+    close(inFd);
+    return (diff ? 1 : 0);
+}
+
 int main(int argc, char** argv) {
     printf("----------------------------------------------------------------------------\n");
     printf("\n");
@@ -49,6 +211,11 @@ int main(int argc, char** argv) {
     parser.addSwitch("--height", "-h", "Image height", "1080");
     parser.addSwitch("--filter", "-f", "Filter type (0-6)", "0");
     parser.addSwitch("--compare", "-c", "Compare FPGA and SW performance", "false", true);
+    parser.addSwitch("--threads", "-t", "Number of CPU threads for the SW version (0 = all cores)", "0");
+    parser.addSwitch("--input", "-i", "Raw YUV 4:4:4 planar file to stream frame by frame, instead of a random image",
+                     "");
+    parser.addSwitch("--output", "-o", "Raw YUV file for the filtered frames of the input file", "");
+    parser.addSwitch("--depth", "-d", "Number of frames in flight when streaming the input file", "6");
 
     // parse all command line options
     parser.parse(argc, argv);
@@ -57,6 +224,11 @@ int main(int argc, char** argv) {
     unsigned int numRuns = parser.value_to_int("nruns");
     unsigned int filterType = parser.value_to_int("filter");
     bool comparePerf = parser.value_to_bool("compare");
+    unsigned int numThreads = parser.value_to_int("threads");
+    if (numThreads == 0) numThreads = std::max(std::thread::hardware_concurrency(), 1u);
+    std::string inputFile = parser.value("input");
+    std::string outputFile = parser.value("output");
+    unsigned int maxInFlight = std::max(parser.value_to_int("depth"), 1);
 
     if ((width > MAX_IMAGE_WIDTH) || (height > MAX_IMAGE_HEIGHT)) {
         printf("ERROR: Maximum image size is %dx%d\n", MAX_IMAGE_WIDTH, MAX_IMAGE_HEIGHT);
@@ -67,11 +239,17 @@ int main(int argc, char** argv) {
         return -1;
     }
 
+    if (!inputFile.empty()) {
+        return run_stream(inputFile, outputFile, filterType, width, height, maxInFlight, numThreads, comparePerf);
+    }
+
     printf("Number of runs    : %d\n", numRuns);
     printf("Image width       : %d\n", width);
     printf("Image height      : %d\n", height);
     printf("Filter type       : %d\n", filterType);
     printf("Compare perf.     : %d\n", comparePerf);
+    printf("CPU threads       : %d\n", numThreads);
+    printf("CPU instructions  : %s\n", Filter2DInstructionSet());
     printf("\n");
 
     // ---------------------------------------------------------------------------------
@@ -128,17 +306,15 @@ int main(int argc, char** argv) {
     unsigned char* y_ref = (unsigned char*)malloc(nbytes);
     unsigned char* u_ref = (unsigned char*)malloc(nbytes);
     unsigned char* v_ref = (unsigned char*)malloc(nbytes);
+    YUVImage refImage = {y_ref, u_ref, v_ref};
 
     unsigned numRunsSW = comparePerf ? numRuns : 1;
 
     auto cpu_begin = std::chrono::high_resolution_clock::now();
 
-#pragma omp parallel for num_threads(3)
+    // Compute reference results, the three channels split over the CPU threads
     for (unsigned int n = 0; n < numRunsSW; n++) {
-        // Compute reference results
-        Filter2D(filterCoeffs[filterType], factor, bias, width, height, srcImage.yChannel, y_ref);
-        Filter2D(filterCoeffs[filterType], factor, bias, width, height, srcImage.uChannel, u_ref);
-        Filter2D(filterCoeffs[filterType], factor, bias, width, height, srcImage.vChannel, v_ref);
+        Filter2DYUV(filterCoeffs[filterType], factor, bias, width, height, srcImage, refImage, numThreads);
     }
 
     auto cpu_end = std::chrono::high_resolution_clock::now();
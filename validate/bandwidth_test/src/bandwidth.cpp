@@ -14,19 +14,82 @@
 * under the License.
 */
 #include <ap_int.h>
+#include <hls_stream.h>
 
 auto constexpr DATAWIDTH = 512;
 using TYPE = ap_uint<DATAWIDTH>;
 
+// Reads read_blocks blocks reps times. Each pass XORs its blocks and its
+// index, and the sum of the passes is sent, so that every pass of the reads
+// counts and none can be optimized away.
+static void read_blocks(TYPE* input, unsigned int read_blocks, unsigned int reps, hls::stream<TYPE>& sum_stream) {
+    TYPE sum = 0;
+read_outer:
+    for (int repindex = 0; repindex < reps; repindex++) {
+        TYPE pass = repindex;
+    read:
+        for (int blockindex = 0; blockindex < read_blocks; blockindex++) {
+            pass ^= input[blockindex];
+        }
+        sum += pass;
+    }
+    sum_stream << sum;
+}
+
+// Writes the index of each block to the write_blocks first blocks reps times,
+// then the sum of the reads to the block after the buffer
+static void write_blocks(TYPE* output,
+                         unsigned int write_blocks,
+                         unsigned int num_blocks,
+                         unsigned int reps,
+                         hls::stream<TYPE>& sum_stream) {
+write_outer:
+    for (int repindex = 0; repindex < reps; repindex++) {
+    write:
+        for (int blockindex = 0; blockindex < write_blocks; blockindex++) {
+            output[blockindex] = blockindex;
+        }
+    }
+    output[num_blocks] = sum_stream.read();
+}
+
+// Runs the reads and the writes concurrently
+static void read_write_mixed(TYPE* input,
+                             TYPE* output,
+                             unsigned int num_reads,
+                             unsigned int num_writes,
+                             unsigned int num_blocks,
+                             unsigned int reps) {
+#pragma HLS DATAFLOW
+    hls::stream<TYPE> sum_stream("sum_stream");
+    read_blocks(input, num_reads, reps, sum_stream);
+    write_blocks(output, num_writes, num_blocks, reps, sum_stream);
+}
+
 extern "C" {
-void bandwidth(TYPE* input, TYPE* output, unsigned int buf_size, unsigned int reps) {
+// Copies the input buffer to the output buffer reps times when reads and
+// writes are equal. Otherwise reads and writes run concurrently in the ratio
+// reads:writes, the larger of the two covering the whole buffer, e.g. 1:0
+// only reads, 0:1 only writes and 2:1 writes half of the blocks it reads.
+// The output buffer then needs one more block, for the sum of the reads.
+void bandwidth(TYPE* input,
+               TYPE* output,
+               unsigned int buf_size,
+               unsigned int reps,
+               unsigned int reads,
+               unsigned int writes) {
     unsigned int num_blocks = (buf_size - 1) / 64 + 1;
-read_write:
-    for (int repindex = 0; repindex < reps; repindex++) {
-        for (int blockindex = 0; blockindex < num_blocks; blockindex++) {
-            TYPE temp = input[blockindex];
-            output[blockindex] = temp;
+    if (reads == writes) {
+    read_write:
+        for (int repindex = 0; repindex < reps; repindex++) {
+            for (int blockindex = 0; blockindex < num_blocks; blockindex++) {
+                TYPE temp = input[blockindex];
+                output[blockindex] = temp;
+            }
         }
+    } else {
+        unsigned int most = reads > writes ? reads : writes;
+        read_write_mixed(input, output, num_blocks * reads / most, num_blocks * writes / most, num_blocks, reps);
     }
 }
 }
@@ -19,37 +19,87 @@
 #include <math.h>
 #include <sys/time.h>
 #include <xcl2.hpp>
+#include "bandwidth_cus.h"
+#include "bench.h"
+#include "cmdlineparser.h"
+
+// Sweeps the transfer sizes on the bandwidth CUs, each CU reading its own
+// input buffer and writing its output buffer reps times per task
+static bool sweep(sda::utils::BandwidthBench& bench,
+                  cl::Context& context,
+                  cl::CommandQueue& q,
+                  std::vector<Cu>& cus,
+                  const std::string& test,
+                  const std::string& banks,
+                  unsigned int reps,
+                  const Mix& mix) {
+    unsigned int num_cus = cus.size();
+    for (uint64_t size : bench.sizes()) {
+        unsigned int data_size = size;
+        std::vector<unsigned char, aligned_allocator<unsigned char> > input_host(data_size);
+
+        // Filling up memory with an incremental byte pattern
+        for (uint32_t j = 0; j < data_size; j++) {
+            input_host[j] = j % 256;
+        }
+
+        std::vector<cl::Buffer> input_buffer, output_buffer;
+        setup_cus(context, q, cus, input_buffer, output_buffer, input_host, reps, mix);
+
+        // Every task reads and writes its blocks reps times on each CU
+        unsigned int num_reads, num_writes;
+        mix_blocks(mix, data_size, num_reads, num_writes);
+        double bytes = (double)(num_reads + num_writes) * BLOCK_SIZE * reps * num_cus;
+        bench.run({test, mix.name, banks, num_cus, size, bytes}, [&] {
+            cl_int err;
+            for (unsigned int i = 0; i < num_cus; i++) {
+                OCL_CHECK(err, err = q.enqueueTask(cus[i].krnl));
+            }
+            q.finish();
+        });
 
-static void printHelp() {
-    std::cout << "usage: %s <options>\n";
-    std::cout << "  -p <path>\n";
-    std::cout << "  -d <device> \n";
-    std::cout << "  -l <loop_iter_cnt> \n";
-    std::cout << "  -s <supported>\n";
-    std::cout << "  -h <help>\n";
+        if (!check_cus(q, cus, output_buffer, input_host, reps, mix)) return false;
+    }
+    return true;
 }
 
 int main(int argc, char** argv) {
-    std::string dev_id = "0";
-    std::string test_path;
-    std::string iter_cnt = "10000";
     std::string b_file = "/bandwidth.xclbin";
-    bool flag_s = false;
 
-    for (int i = 1; i < argc; i++) {
-        if ((strcmp(argv[i], "-p") == 0) || (strcmp(argv[i], "--path") == 0)) {
-            test_path = argv[i + 1];
-        } else if ((strcmp(argv[i], "-d") == 0) || (strcmp(argv[i], "--device") == 0)) {
-            dev_id = argv[i + 1];
-        } else if ((strcmp(argv[i], "-l") == 0) || (strcmp(argv[i], "--loop_iter_cnt") == 0)) {
-            iter_cnt = argv[i + 1];
-        } else if ((strcmp(argv[i], "-s") == 0) || (strcmp(argv[i], "--supported") == 0)) {
-            flag_s = true;
-        } else if ((strcmp(argv[i], "-h") == 0) || (strcmp(argv[i], "--help") == 0)) {
-            printHelp();
-            return 1;
-        }
+    // Command Line Parser
+    sda::utils::CmdLineParser parser;
+    sda::utils::BandwidthBench bench("bandwidth_test");
+
+    // Switches
+    //**************//"<Full Arg>",  "<Short Arg>", "<Description>", "<Default>"
+    parser.addSwitch("--path", "-p", "platform test path", "");
+    parser.addSwitch("--device", "-d", "device id or bdf", "0");
+    parser.addSwitch("--loop_iter_cnt", "-l", "kernel iterations of every task", "10000");
+    parser.addSwitch("--supported", "-s", "only check if the test is supported", "", true);
+    parser.addSwitch("--mix", "-m", "kernel accesses, read_write, read, write or reads:writes such as 2:1",
+                     "read_write");
+    parser.addSwitch("--saturate", "-a", "also load every bank at once and report the saturation", "", true);
+    // At most 1 + 10 tasks of -l kernel iterations each per size
+    bench.options().reps = 3;
+    bench.options().max_reps = 10;
+    if (xcl::is_emulation()) {
+        // Running only upto 8K with at most 3 repetitions for emulation flow
+        bench.options().max_size = 8 * 1024;
+        bench.options().reps = 1;
+        bench.options().max_reps = 3;
+        bench.options().warmup = 0;
     }
+    bench.addSwitches(parser);
+    parser.parse(argc, argv);
+    bench.parse(parser);
+
+    std::string test_path = parser.value("path");
+    std::string dev_id = parser.value("device");
+    std::string iter_cnt = parser.value("loop_iter_cnt");
+    bool flag_s = parser.value_to_bool("supported");
+    bool flag_a = parser.value_to_bool("saturate");
+    std::vector<Mix> mixes;
+    if (!parse_mixes(parser.value("mix"), mixes)) return EXIT_FAILURE;
 
     if (test_path.empty()) {
         std::cout << "ERROR : please provide the platform test path to -p option\n";
@@ -160,179 +210,45 @@ int main(int argc, char** argv) {
         }
     }
 
-    double max_throughput = 0;
-    int reps = stoi(iter_cnt);
-    if (num_kernel_ddr) {
-        // Starting at 4K and going up to 16M with increments of power of 2
-        for (uint32_t i = 4 * 1024; i <= 16 * 1024 * 1024; i *= 2) {
-            unsigned int data_size = i;
-
-            if (xcl::is_emulation()) {
-                reps = 2; // reducing the repeat count to 2 for emulation flow
-                // Running only upto 8K for emulation flow
-                if (data_size > 8 * 1024) {
-                    break;
-                }
-            }
-
-            unsigned int vector_size_bytes = data_size;
-            std::vector<unsigned char, aligned_allocator<unsigned char> > input_host(data_size);
-            std::vector<unsigned char, aligned_allocator<unsigned char> > output_host[num_kernel_ddr];
-
-            for (int i = 0; i < num_kernel_ddr; i++) {
-                output_host[i].resize(data_size);
-            }
-            // Filling up memory with an incremental byte pattern
-            for (uint32_t j = 0; j < data_size; j++) {
-                input_host[j] = j % 256;
-            }
-
-            // Initializing output vectors to zero
-            for (int i = 0; i < num_kernel_ddr; i++) {
-                std::fill(output_host[i].begin(), output_host[i].end(), 0);
-            }
-
-            std::vector<cl::Buffer> input_buffer(num_kernel_ddr);
-            std::vector<cl::Buffer> output_buffer(num_kernel_ddr);
-
-            // These commands will allocate memory on the FPGA. The cl::Buffer objects
-            // can
-            // be used to reference the memory locations on the device.
-            // Creating Buffers
-            for (int i = 0; i < num_kernel_ddr; i++) {
-                OCL_CHECK(err,
-                          input_buffer[i] = cl::Buffer(context, CL_MEM_READ_WRITE, vector_size_bytes, nullptr, &err));
-                OCL_CHECK(err,
-                          output_buffer[i] = cl::Buffer(context, CL_MEM_READ_WRITE, vector_size_bytes, nullptr, &err));
-            }
+    bench.setInfo("device", device.getInfo<CL_DEVICE_NAME>());
+    bench.setInfo("xclbin", binaryFile.string());
 
-            for (int i = 0; i < num_kernel_ddr; i++) {
-                OCL_CHECK(err, err = krnls[i].setArg(0, input_buffer[i]));  // setting input data buffer
-                OCL_CHECK(err, err = krnls[i].setArg(1, output_buffer[i])); // setting output data buffer
-                OCL_CHECK(err, err = krnls[i].setArg(2, data_size));        // size of the data
-                OCL_CHECK(err, err = krnls[i].setArg(3, reps));             // repeat counter
-            }
-
-            for (int i = 0; i < num_kernel_ddr; i++) {
-                OCL_CHECK(err, err = q.enqueueWriteBuffer(input_buffer[i], CL_TRUE, 0, vector_size_bytes,
-                                                          input_host.data(), nullptr, nullptr));
-                OCL_CHECK(err, err = q.finish());
-            }
-
-            auto time_start = std::chrono::high_resolution_clock::now();
-
-            for (int i = 0; i < num_kernel_ddr; i++) {
-                OCL_CHECK(err, err = q.enqueueTask(krnls[i]));
-            }
-            q.finish();
-            auto time_end = std::chrono::high_resolution_clock::now();
-
-            for (int i = 0; i < num_kernel_ddr; i++) {
-                OCL_CHECK(err, err = q.enqueueReadBuffer(output_buffer[i], CL_TRUE, 0, vector_size_bytes,
-                                                         output_host[i].data(), nullptr, nullptr));
-                OCL_CHECK(err, err = q.finish());
-            }
+    // Every task runs all the kernel iterations, as one launch of the
+    // baseline did, and -r/-mr bound the number of tasks of a size
+    unsigned int reps = std::max(stoi(iter_cnt), 1);
+    if (xcl::is_emulation()) reps = 2; // reducing the repeat count to 2 for emulation flow
 
-            // check
-            for (int i = 0; i < num_kernel_ddr; i++) {
-                for (uint32_t j = 0; j < data_size; j++) {
-                    if (output_host[i][j] != input_host[j]) {
-                        std::cout << "ERROR : kernel failed to copy entry " << j << " input " << input_host[j]
-                                  << " output " << output_host[i][j] << std::endl;
-                        return EXIT_FAILURE;
-                    }
-                }
-            }
-
-            double usduration =
-                (double)(std::chrono::duration_cast<std::chrono::nanoseconds>(time_end - time_start).count() / reps);
-
-            double dnsduration = (double)usduration;
-            double dsduration = dnsduration / ((double)1000000000); // Convert the duration from nanoseconds to seconds
-            double bpersec = (data_size * num_kernel_ddr) / dsduration;
-            double mbpersec = (2 * bpersec) / ((double)1024 * 1024); // Convert b/sec to mb/sec
-
-            if (mbpersec > max_throughput) max_throughput = mbpersec;
-        }
-
-        std::cout << "Throughput (Type: DDR) (Bank count: " << num_kernel_ddr << ") : " << max_throughput << "MB/s\n";
+    std::vector<Cu> cus_ddr, cus_hbm;
+    for (unsigned int i = 0; i < bench.cus(num_kernel_ddr); i++) {
+        cus_ddr.push_back({krnls[i], "DDR[" + std::to_string(i) + "]", false});
     }
-    if (chk_hbm_mem) {
-        max_throughput = 0;
-        // Starting at 4K and going up to 16M with increments of power of 2
-        for (uint32_t i = 4 * 1024; i <= 16 * 1024 * 1024; i *= 2) {
-            unsigned int data_size = i;
-
-            if (xcl::is_emulation()) {
-                reps = 2; // reducing the repeat count to 2 for emulation flow
-                // Running only upto 8K for emulation flow
-                if (data_size > 8 * 1024) {
-                    break;
-                }
-            }
-
-            unsigned int vector_size_bytes = data_size;
-            std::vector<unsigned char, aligned_allocator<unsigned char> > input_host(data_size);
-            std::vector<unsigned char, aligned_allocator<unsigned char> > output_host(data_size);
-
-            for (uint32_t j = 0; j < data_size; j++) {
-                input_host[j] = j % 256;
-            }
-
-            // Initializing output vectors to zero
-            std::fill(output_host.begin(), output_host.end(), 0);
-
-            cl::Buffer input_buffer, output_buffer;
+    if (chk_hbm_mem) cus_hbm.push_back({krnls[num_kernel - 1], "HBM", false});
 
-            // These commands will allocate memory on the FPGA. The cl::Buffer objects
-            // can
-            // be used to reference the memory locations on the device.
-            // Creating Buffers
-            OCL_CHECK(err, input_buffer = cl::Buffer(context, CL_MEM_READ_WRITE, vector_size_bytes, nullptr, &err));
-            OCL_CHECK(err, output_buffer = cl::Buffer(context, CL_MEM_READ_WRITE, vector_size_bytes, nullptr, &err));
+    for (auto& mix : mixes) {
+        // The throughput of the default copy keeps its original summary line
+        std::string type = mix.name == "read_write" ? "" : " (Mix: " + mix.name + ")";
+        if (!cus_ddr.empty()) {
+            std::string banks = "DDR[0:" + std::to_string(cus_ddr.size() - 1) + "]";
+            if (!sweep(bench, context, q, cus_ddr, "ddr", banks, reps, mix)) return EXIT_FAILURE;
 
-            OCL_CHECK(err, err = krnls[num_kernel - 1].setArg(0, input_buffer));  // setting input data buffer
-            OCL_CHECK(err, err = krnls[num_kernel - 1].setArg(1, output_buffer)); // setting output data buffer
-            OCL_CHECK(err, err = krnls[num_kernel - 1].setArg(2, data_size));     // size of the data
-            OCL_CHECK(err, err = krnls[num_kernel - 1].setArg(3, reps));          // repeat counter
-
-            OCL_CHECK(err, err = q.enqueueWriteBuffer(input_buffer, CL_TRUE, 0, vector_size_bytes, input_host.data(),
-                                                      nullptr, nullptr));
-            OCL_CHECK(err, err = q.finish());
-
-            auto time_start = std::chrono::high_resolution_clock::now();
-
-            OCL_CHECK(err, err = q.enqueueTask(krnls[num_kernel - 1]));
-            q.finish();
-            auto time_end = std::chrono::high_resolution_clock::now();
-
-            OCL_CHECK(err, err = q.enqueueReadBuffer(output_buffer, CL_TRUE, 0, vector_size_bytes, output_host.data(),
-                                                     nullptr, nullptr));
-            OCL_CHECK(err, err = q.finish());
-
-            // check
-            for (uint32_t j = 0; j < data_size; j++) {
-                if (output_host[j] != input_host[j]) {
-                    std::cout << "ERROR : kernel failed to copy entry " << j << " input " << input_host[j] << " output "
-                              << output_host[j] << std::endl;
-                    return EXIT_FAILURE;
-                }
-            }
-
-            double usduration =
-                (double)(std::chrono::duration_cast<std::chrono::nanoseconds>(time_end - time_start).count() / reps);
-
-            double dnsduration = (double)usduration;
-            double dsduration = dnsduration / ((double)1000000000); // Convert duration from nanoseconds to seconds
-            double bpersec = data_size / dsduration;
-            double mbpersec = (2 * bpersec) / ((double)1024 * 1024); // Convert b/sec to mb/sec
-
-            if (mbpersec > max_throughput) max_throughput = mbpersec;
+            std::cout << "Throughput (Type: DDR) (Bank count: " << cus_ddr.size() << ")" << type << " : "
+                      << bench.best("ddr", mix.name) << "MB/s\n";
         }
+        if (!cus_hbm.empty()) {
+            if (!sweep(bench, context, q, cus_hbm, "hbm", "HBM", reps, mix)) return EXIT_FAILURE;
 
-        std::cout << "Throughput (Type: HBM) (Bank count: 1) : " << max_throughput << "MB/s\n";
+            std::cout << "Throughput (Type: HBM) (Bank count: 1)" << type << " : " << bench.best("hbm", mix.name)
+                      << "MB/s\n";
+        }
+        if (flag_a) {
+            // Every DDR bank and the HBM at once
+            std::vector<Cu> cus_all(cus_ddr);
+            cus_all.insert(cus_all.end(), cus_hbm.begin(), cus_hbm.end());
+            if (!saturate(bench, context, q, cus_all, reps, mix)) return EXIT_FAILURE;
+        }
     }
 
+    if (!bench.write() || !bench.check()) return EXIT_FAILURE;
     std::cout << "TEST PASSED\n";
 
     return EXIT_SUCCESS;
@@ -13,6 +13,8 @@
 * License for the specific language governing permissions and limitations
 * under the License.
 */
+#include "bandwidth_cus.h"
+#include "bench.h"
 #include "cmdlineparser.h"
 #include "xcl2.hpp"
 #include <algorithm>
@@ -33,16 +35,34 @@ int main(int argc, char** argv) {
 
     // Command Line Parser
     sda::utils::CmdLineParser parser;
+    sda::utils::BandwidthBench bench("combine_bw_hm");
 
     // Switches
     //**************//"<Full Arg>",  "<Short Arg>", "<Description>", "<Default>"
     parser.addSwitch("--device", "-d", "device id", "0");
-    parser.addSwitch("--iter_cnt", "-l", "loop iteration count", "10000");
+    parser.addSwitch("--iter_cnt", "-l", "kernel iterations of every task", "10000");
+    parser.addSwitch("--mix", "-m", "kernel accesses of the saturation test, read_write, read, write or reads:writes",
+                     "read_write");
+    parser.addSwitch("--saturate", "-a", "also load every DDR bank and the host memory at once", "", true);
+    // At most 1 + 10 tasks of -l kernel iterations each per size
+    bench.options().reps = 3;
+    bench.options().max_reps = 10;
+    if (xcl::is_emulation()) {
+        bench.options().max_size = 8 * 1024;
+        bench.options().reps = 1;
+        bench.options().max_reps = 3;
+        bench.options().warmup = 0;
+    }
+    bench.addSwitches(parser);
     parser.parse(argc, argv);
+    bench.parse(parser);
 
     // Read settings
     std::string dev_id = parser.value("device");
     std::string iter_cnt = parser.value("iter_cnt");
+    bool flag_a = parser.value_to_bool("saturate");
+    std::vector<Mix> mixes;
+    if (!parse_mixes(parser.value("mix"), mixes)) return EXIT_FAILURE;
 
     std::string test_path = argv[1];
 
@@ -166,16 +186,18 @@ int main(int argc, char** argv) {
         OCL_CHECK(err, krnls[i] = cl::Kernel(program, krnl_name_full.c_str(), &err));
     }
 
-    double max_throughput = 0;
-    int reps = stoi(iter_cnt);
+    bench.setInfo("device", device.getInfo<CL_DEVICE_NAME>());
+    bench.setInfo("xclbin", binaryFile);
 
-    for (uint32_t i = 4 * 1024; i <= 16 * 1024 * 1024; i *= 2) {
-        unsigned int DATA_SIZE = i;
+    // Every task runs all the kernel iterations, as one launch of the
+    // baseline did, and -r/-mr bound the number of tasks of a size
+    unsigned int reps = std::max(stoi(iter_cnt), 1);
+    if (xcl::is_emulation()) reps = 2;
 
-        if (xcl::is_emulation()) {
-            reps = 2;
-            if (DATA_SIZE > 8 * 1024) break;
-        }
+    NUM_KERNEL = bench.cus(NUM_KERNEL);
+    std::string banks = "DDR[0:" + std::to_string(NUM_KERNEL - 1) + "]";
+    for (uint64_t size : bench.sizes()) {
+        unsigned int DATA_SIZE = size;
 
         unsigned int vector_size_bytes = DATA_SIZE;
         std::vector<unsigned char, aligned_allocator<unsigned char> > input_host(DATA_SIZE);
@@ -210,6 +232,8 @@ int main(int argc, char** argv) {
             OCL_CHECK(err, err = krnls[i].setArg(1, output_buffer[i]));
             OCL_CHECK(err, err = krnls[i].setArg(2, DATA_SIZE));
             OCL_CHECK(err, err = krnls[i].setArg(3, reps));
+            OCL_CHECK(err, err = krnls[i].setArg(4, 1u)); // copy, as many reads as writes
+            OCL_CHECK(err, err = krnls[i].setArg(5, 1u));
         }
 
         for (int i = 0; i < NUM_KERNEL; i++) {
@@ -218,16 +242,14 @@ int main(int argc, char** argv) {
             OCL_CHECK(err, err = q.finish());
         }
 
-        std::chrono::high_resolution_clock::time_point timeStart;
-        std::chrono::high_resolution_clock::time_point timeEnd;
-
-        timeStart = std::chrono::high_resolution_clock::now();
-
-        for (int i = 0; i < NUM_KERNEL; i++) {
-            OCL_CHECK(err, err = q.enqueueTask(krnls[i]));
-        }
-        q.finish();
-        timeEnd = std::chrono::high_resolution_clock::now();
+        // For concurrent Read/Write
+        bench.run({"ddr", "read_write", banks, (unsigned int)NUM_KERNEL, size, 2.0 * DATA_SIZE * reps * NUM_KERNEL},
+                  [&] {
+                      for (int i = 0; i < NUM_KERNEL; i++) {
+                          OCL_CHECK(err, err = q.enqueueTask(krnls[i]));
+                      }
+                      q.finish();
+                  });
 
         for (int i = 0; i < NUM_KERNEL; i++) {
             OCL_CHECK(err, err = q.enqueueReadBuffer(output_buffer[i], CL_TRUE, 0, vector_size_bytes,
@@ -245,24 +267,9 @@ int main(int argc, char** argv) {
                 }
             }
         }
-
-        double usduration;
-        double dnsduration;
-        double dsduration;
-        double bpersec;
-        double mbpersec;
-
-        usduration = (double)(std::chrono::duration_cast<std::chrono::nanoseconds>(timeEnd - timeStart).count() / reps);
-
-        dnsduration = (double)usduration;
-        dsduration = dnsduration / ((double)1000000000);
-        bpersec = (DATA_SIZE * NUM_KERNEL) / dsduration;
-        mbpersec = (2 * bpersec) / ((double)1024 * 1024); // For concurrent Read/Write
-
-        if (mbpersec > max_throughput) max_throughput = mbpersec;
     }
 
-    std::cout << "Concurrent read and write throughput: " << max_throughput << "MB/s\n";
+    std::cout << "Concurrent read and write throughput: " << bench.best("ddr", "read_write") << "MB/s\n";
 
     std::cout << "\nStarting the host memory test....\n";
     int NUM_KERNEL_HOST;
@@ -293,16 +300,10 @@ int main(int argc, char** argv) {
         OCL_CHECK(err, krnls_host[i] = cl::Kernel(program, krnl_name_full.c_str(), &err));
     }
 
-    max_throughput = 0;
-    reps = stoi(iter_cnt);
-
-    for (uint32_t i = 4 * 1024; i <= 16 * 1024 * 1024; i *= 2) {
-        unsigned int DATA_SIZE = i;
-
-        if (xcl::is_emulation()) {
-            reps = 2;
-            if (DATA_SIZE > 8 * 1024) break;
-        }
+    NUM_KERNEL_HOST = bench.cus(NUM_KERNEL_HOST);
+    banks = "HOST[0]";
+    for (uint64_t size : bench.sizes()) {
+        unsigned int DATA_SIZE = size;
 
         unsigned int vector_size_bytes = DATA_SIZE;
         std::vector<unsigned char, aligned_allocator<unsigned char> > input_host(DATA_SIZE);
@@ -341,6 +342,8 @@ int main(int argc, char** argv) {
             OCL_CHECK(err, err = krnls_host[i].setArg(1, out_buffer[i]));
             OCL_CHECK(err, err = krnls_host[i].setArg(2, DATA_SIZE));
             OCL_CHECK(err, err = krnls_host[i].setArg(3, reps));
+            OCL_CHECK(err, err = krnls_host[i].setArg(4, 1u));
+            OCL_CHECK(err, err = krnls_host[i].setArg(5, 1u));
         }
 
         for (int i = 0; i < NUM_KERNEL_HOST; i++) {
@@ -355,15 +358,16 @@ int main(int argc, char** argv) {
                 map_input_buffer[i][j] = input_host[j];
             }
         }
-        std::chrono::high_resolution_clock::time_point timeStart;
-        std::chrono::high_resolution_clock::time_point timeEnd;
 
-        timeStart = std::chrono::high_resolution_clock::now();
-        for (int i = 0; i < NUM_KERNEL_HOST; i++) {
-            OCL_CHECK(err, err = q.enqueueTask(krnls_host[i]));
-        }
-        q.finish();
-        timeEnd = std::chrono::high_resolution_clock::now();
+        // For concurrent Read/Write
+        bench.run(
+            {"host", "read_write", banks, (unsigned int)NUM_KERNEL_HOST, size, 2.0 * DATA_SIZE * reps * NUM_KERNEL_HOST},
+            [&] {
+                for (int i = 0; i < NUM_KERNEL_HOST; i++) {
+                    OCL_CHECK(err, err = q.enqueueTask(krnls_host[i]));
+                }
+                q.finish();
+            });
 
         for (int i = 0; i < NUM_KERNEL_HOST; i++) {
             OCL_CHECK(err, map_output_buffer[i] = (unsigned char*)q.enqueueMapBuffer(
@@ -381,23 +385,24 @@ int main(int argc, char** argv) {
                 }
             }
         }
+    }
+    std::cout << "Concurrent read and write throughput: " << bench.best("host", "read_write") << "MB/s\n";
 
-        double usduration;
-        double dnsduration;
-        double dsduration;
-        double bpersec;
-        double mbpersec;
-
-        usduration = (double)(std::chrono::duration_cast<std::chrono::nanoseconds>(timeEnd - timeStart).count() / reps);
-
-        dnsduration = (double)usduration;
-        dsduration = dnsduration / ((double)1000000000);
-        bpersec = (DATA_SIZE * NUM_KERNEL_HOST) / dsduration;
-        mbpersec = (2 * bpersec) / ((double)1024 * 1024); // For concurrent Read/Write
-
-        if (mbpersec > max_throughput) max_throughput = mbpersec;
+    if (flag_a) {
+        std::cout << "\nStarting the saturation test....\n";
+        std::vector<Cu> cus_all;
+        for (int i = 0; i < NUM_KERNEL; i++) {
+            cus_all.push_back({krnls[i], "DDR[" + std::to_string(i) + "]", false});
+        }
+        for (int i = 0; i < NUM_KERNEL_HOST; i++) {
+            std::string bank = i ? "HOST[0]_" + std::to_string(i + 1) : "HOST[0]";
+            cus_all.push_back({krnls_host[i], bank, true});
+        }
+        for (auto& mix : mixes) {
+            if (!saturate(bench, context, q, cus_all, reps, mix)) return EXIT_FAILURE;
+        }
     }
-    std::cout << "Concurrent read and write throughput: " << max_throughput << "MB/s\n";
+    if (!bench.write() || !bench.check()) return EXIT_FAILURE;
 
     std::cout << "TEST PASSED\n";
     return 0;